@@ -27,9 +27,12 @@ o.print \
 o.printbytes \
 o.route \
 o.schedule \
+o.schedule~ \
 o.select \
 o.slip.decode \
 o.slip.encode \
+o.snapshot~ \
+o.stats \
 o.table \
 o.timetag \
 o.union \
@@ -14,34 +14,137 @@ extern "C" {
 #include "m_pd.h"
 #include "string.h"
 
+#include "omax_util.h"
+#include "odot_stats.h"
+
+/*
+  Pd atoms are floats, so a packet can't travel as FullPacket <len> <ptr>
+  the way it does in Max.  The sender pushes the length and pointer onto
+  a stack shared by every odot external in the process and sends
+  FullPacket <slot> <serial>, two small integers that are exact as
+  floats, and the receiver looks them up.  A packet is only good for the
+  duration of the outlet call, as before, so the stack unwinds as outlet
+  calls return, and the serial number catches a FullPacket message that
+  has been stored and played back after its packet is gone.
+
+  The old format, three floats holding the bits of the length and of the
+  two halves of the pointer, is still accepted from externals built
+  before this.
+*/
+#define ODOT_PD_PACKETS_SYMBOL "#odot.pd.packets"
+#define ODOT_PD_PACKETS_VERSION 1
+#define ODOT_PD_PACKETS_MAX 1024
+#define ODOT_PD_PACKETS_MAXSERIAL 0xffffff
+
+typedef struct _odot_pd_packet{
+	long len;
+	char *ptr;
+	long serial;
+} t_odot_pd_packet;
+
+typedef struct _odot_pd_packets{
+	long version;
+	long depth;
+	long serial;
+	t_odot_pd_packet stack[ODOT_PD_PACKETS_MAX];
+} t_odot_pd_packets;
+
+static t_odot_pd_packets *odot_pd_packets_get(void)
+{
+	static t_odot_pd_packets *packets;
+	static int failed;
+	if(!packets && !failed){
+		t_symbol *s = gensym(ODOT_PD_PACKETS_SYMBOL);
+		t_odot_pd_packets *p = (t_odot_pd_packets *)s->s_thing;
+		if(!p){
+			p = (t_odot_pd_packets *)getbytes(sizeof(t_odot_pd_packets));
+			if(p){
+				p->version = ODOT_PD_PACKETS_VERSION;
+				s->s_thing = (void *)p;
+			}
+		}
+		if(p && p->version == ODOT_PD_PACKETS_VERSION){
+			packets = p;
+		}else{
+			failed = 1;
+		}
+	}
+	return packets;
+}
+
+static void odot_pd_outletOSC(void *outlet, long len, char *ptr)
+{
+	static t_symbol *ps_FullPacket;
+	odot_stats_outlet(len);
+	t_odot_pd_packets *p = odot_pd_packets_get();
+	if(!p || p->depth >= ODOT_PD_PACKETS_MAX){
+		omax_util_outletOSC(outlet, len, ptr);
+		return;
+	}
+	if(!ps_FullPacket){
+		ps_FullPacket = gensym("FullPacket");
+	}
+	long slot = p->depth++;
+	p->serial = (p->serial % ODOT_PD_PACKETS_MAXSERIAL) + 1;
+	t_odot_pd_packet *pk = p->stack + slot;
+	pk->len = len;
+	pk->ptr = ptr;
+	pk->serial = p->serial;
+	t_atom out[2];
+	SETFLOAT(out, (t_float)slot);
+	SETFLOAT(out + 1, (t_float)pk->serial);
+	outlet_anything((t_outlet *)outlet, ps_FullPacket, 2, out);
+	pk->serial = 0;
+	p->depth = slot;
+}
+
+#define omax_util_outletOSC odot_pd_outletOSC
+
+static int odot_pd_getLenAndPtr(const char *func, int argc, t_atom *argv, long *len, char **ptr)
+{
+	int i;
+	for(i = 0; i < argc; i++){
+		if(argv[i].a_type != A_FLOAT){
+			error("%s: argument %d should be a float", func, i + 1);
+			return 1;
+		}
+	}
+	if(argc == 2){
+		t_odot_pd_packets *p = odot_pd_packets_get();
+		long slot = (long)atom_getfloat(argv);
+		long serial = (long)atom_getfloat(argv + 1);
+		if(!p || slot < 0 || slot >= p->depth || p->stack[slot].serial != serial){
+			error("%s: FullPacket refers to a packet that no longer exists", func);
+			return 1;
+		}
+		*len = p->stack[slot].len;
+		*ptr = p->stack[slot].ptr;
+	}else if(argc == 3){
+		float ff = atom_getfloat(&argv[0]);
+		*len = (long)*((uint32_t *)&ff);
+		ff = atom_getfloat(&argv[1]);
+		uint64_t l1 = (uint64_t)(*((uint32_t *)&ff));
+		ff = atom_getfloat(&argv[2]);
+		uint64_t l2 = (uint64_t)(*((uint32_t *)&ff));
+		*ptr = (char *)((l1 << 32) | l2);
+	}else{
+		error("%s: expected 2 arguments but got %d", func, argc);
+		return 1;
+	}
+	if(OSC_MEM_VALIDATE(*ptr)){
+		error("received something that is neither an OSC bundle nor a message");
+		return 1;
+	}
+	return 0;
+}
+
 #define OMAX_UTIL_GET_LEN_AND_PTR					\
-	if(argc != 3){							\
-		error("%s: expected 2 arguments but got %d", __func__, argc); \
-		return;							\
-	}								\
-	if(argv->a_type != A_FLOAT){					\
-		error("%s: argument 1 should be a float", __func__);	\
-		return;							\
-	}								\
-	if(argv[1].a_type != A_FLOAT){					\
-		error("%s: argument 2 should be a symbol", __func__);	\
-		return;							\
-	}								\
-	if(argv[2].a_type != A_FLOAT){					\
-		error("%s: argument 2 should be a symbol", __func__);	\
+	long len = 0;							\
+	char *ptr = NULL;						\
+	if(odot_pd_getLenAndPtr(__func__, argc, argv, &len, &ptr)){	\
 		return;							\
 	}								\
-	float ff = atom_getfloat(&argv[0]);				\
-	long len = (long)*((uint32_t *)&ff);				\
-    ff = atom_getfloat(&argv[1]);\
-    uint64_t l1 = (uint64_t)(*((uint32_t *)&ff));\
-    ff = atom_getfloat(&argv[2]);\
-    uint64_t l2 = (uint64_t)(*((uint32_t *)&ff));\
-    char *ptr = (char *)((l1<<32) | l2);\
-	if(OSC_MEM_VALIDATE(ptr)){\
-		error("received something that is neither an OSC bundle nor a message");\
-		return;\
-	}
+	ODOT_STATS_ENTER(x, len)
 
 
 #define sysmem_freeptr free
@@ -138,6 +241,19 @@ void printargs(int argc, t_atom *argv)
     
 #else
 //MAX VERSION
+#include "ext.h"
+#include "ext_obex.h"
+#include "omax_util.h"
+#include "odot_stats.h"
+
+static void odot_max_outletOSC(void *outlet, long len, char *ptr)
+{
+	odot_stats_outlet(len);
+	omax_util_outletOSC(outlet, len, ptr);
+}
+
+#define omax_util_outletOSC odot_max_outletOSC
+
 #define OMAX_UTIL_GET_LEN_AND_PTR					\
 	if(argc != 2){							\
 		object_error((t_object *)x, "expected 2 arguments but got %d", argc); \
@@ -156,9 +272,15 @@ void printargs(int argc, t_atom *argv)
 	if(OSC_MEM_VALIDATE(ptr)){\
 		object_error((t_object *)x, "received something that is neither an OSC bundle nor a message");\
 		return;\
-	}
+	}\
+	ODOT_STATS_ENTER(x, len)
 
 #endif
+
+// charge allocations made by the objects themselves to the instance being run
+#define osc_mem_alloc(size) odot_stats_alloc(size)
+#define osc_mem_resize(ptr, size) odot_stats_resize((ptr), (size))
+
 #ifdef __cplusplus 
 }
 #endif
@@ -1,10 +1,20 @@
 
 
 
+#if defined(ODOT_MARCH_DISPATCH) && !defined(ODOT_MARCH_VARIANT) && defined(__x86_64__) && defined(__GNUC__)
+#define ODOT_LOAD_VARIANT
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stdio.h>
+#include <string.h>
+#endif
+
 #include "m_pd.h"
 
 static t_class *odot_class;
 
+void odot_setup(void);
+
 static void *odot_new(void)
 {
   t_object *x = (t_object *)pd_new(odot_class);
@@ -14,12 +24,16 @@ static void *odot_new(void)
 
 int setup_o0x2eappend(void);
 int setup_o0x2eatomize(void);
+int setup_o0x2ebundle(void);
 int setup_o0x2echange(void);
+void setup_o0x2ecompose(void);
 int setup_o0x2ecollect(void);
 int setup_o0x2econd(void);
 int setup_o0x2econtext(void);
 int setup_o0x2edifference(void);
+void setup_o0x2edisplay(void);
 int setup_o0x2edowncast(void);
+int setup_o0x2eedge0x7e(void);
 int setup_o0x2eexplode(void);
 int setup_o0x2eexpr(void);
 int setup_o0x2eexpr0x2ecodebox(void);
@@ -40,31 +54,94 @@ int setup_o0x2eschedule(void);
 int setup_o0x2eselect(void);
 //int setup_o0x2eslip.decode(void);
 //int setup_o0x2eslip.encode(void);
+int setup_o0x2eshm0x2ereceive(void);
+int setup_o0x2eshm0x2esend(void);
 int setup_o0x2eslip0x2edecode(void);
 int setup_o0x2eslip0x2eencode(void);
+int setup_o0x2eslip0x2ereceive(void);
+int setup_o0x2estats(void);
+int setup_o0x2etcp0x2ereceive(void);
+int setup_o0x2etcp0x2esend(void);
 int setup_o0x2etable(void);
 int setup_o0x2etimetag(void);
+int setup_o0x2eudp0x2ereceive(void);
+int setup_o0x2eudp0x2esend(void);
 int setup_o0x2eunion(void);
 int setup_o0x2eunless(void);
 int setup_o0x2evalidate(void);
 int setup_o0x2evar(void);
 int setup_o0x2ewhen(void);
 
+#ifdef ODOT_LOAD_VARIANT
+/*
+  the Makefile can build copies of the library for newer CPUs next to
+  this one (odot.x86-64-v3.so etc.).  if there's one the CPU we're
+  running on can run, load it and let it register the objects instead.
+*/
+static int odot_loadVariant(void)
+{
+  // newest first
+  const char *variants[] = {"x86-64-v4", "x86-64-v3", "x86-64-v2"};
+  int supported[3];
+  __builtin_cpu_init();
+  supported[0] = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+    && __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl");
+  supported[1] = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2")
+    && __builtin_cpu_supports("fma");
+  supported[2] = __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt");
+  Dl_info info;
+  if(!dladdr((void *)odot_loadVariant, &info) || !info.dli_fname){
+    return 0;
+  }
+  const char *slash = strrchr(info.dli_fname, '/');
+  int dirlen = slash ? (int)(slash - info.dli_fname) + 1 : 0;
+  char path[4096];
+  int i;
+  for(i = 0; i < 3; i++){
+    if(!supported[i]){
+      continue;
+    }
+    snprintf(path, sizeof(path), "%.*sodot.%s.so", dirlen, info.dli_fname, variants[i]);
+    void *h = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if(!h){
+      continue;
+    }
+    void (*setup)(void) = (void (*)(void))dlsym(h, "odot_setup");
+    if(setup && setup != odot_setup){
+      post("odot: using %s", path);
+      setup();
+      return 1;
+    }
+    dlclose(h);
+  }
+  return 0;
+}
+#endif
+
 /* ------------------------ setup routine ------------------------- */
 
 void odot_setup(void)
 {
+#ifdef ODOT_LOAD_VARIANT
+  if(odot_loadVariant()){
+    return;
+  }
+#endif
   odot_class = class_new(gensym("odot"), odot_new, 0,
     sizeof(t_object), CLASS_NOINLET, 0);
 
  setup_o0x2eappend();
  setup_o0x2eatomize();
+ setup_o0x2ebundle();
  setup_o0x2echange();
+ setup_o0x2ecompose();
  setup_o0x2ecollect();
  setup_o0x2econd();
  setup_o0x2econtext();
  setup_o0x2edifference();
+ setup_o0x2edisplay();
  setup_o0x2edowncast();
+ setup_o0x2eedge0x7e();
  setup_o0x2eexplode();
  setup_o0x2eexpr();
  setup_o0x2eexpr0x2ecodebox();
@@ -81,12 +158,20 @@ void odot_setup(void)
  setup_o0x2eprint();
  setup_o0x2eprintbytes();
  setup_o0x2eroute();
- //setup_o0x2eschedule();
+ setup_o0x2eschedule();
  setup_o0x2eselect();
+ setup_o0x2eshm0x2ereceive();
+ setup_o0x2eshm0x2esend();
  setup_o0x2eslip0x2edecode();
  setup_o0x2eslip0x2eencode();
+ setup_o0x2eslip0x2ereceive();
+ setup_o0x2estats();
+ setup_o0x2etcp0x2ereceive();
+ setup_o0x2etcp0x2esend();
  setup_o0x2etable();
  setup_o0x2etimetag();
+ setup_o0x2eudp0x2ereceive();
+ setup_o0x2eudp0x2esend();
  setup_o0x2eunion();
  setup_o0x2eunless();
  setup_o0x2evalidate();
@@ -0,0 +1,74 @@
+#ifndef __ODOT_ARGSIZE_H__
+#define __ODOT_ARGSIZE_H__
+
+/*
+  For objects that walk serialized messages a typetag at a time, rather
+  than deserializing them.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include "osc.h"
+#include "osc_byteorder.h"
+
+// the number of bytes of data an atom with typetag tt takes up at p, or -1
+// if the typetag is unknown or the data runs past e
+static long odot_argSize(char tt, char *p, char *e)
+{
+	long n = -1;
+	switch(tt){
+	case 'c':
+	case 'C':
+	case 'u':
+	case 'U':
+	case 'i':
+	case 'I':
+	case 'f':
+		n = 4;
+		break;
+	case 'h':
+	case 'H':
+	case 'd':
+	case OSC_TIMETAG_TYPETAG:
+		n = 8;
+		break;
+	case 'T':
+	case 'F':
+	case 'N':
+		n = 0;
+		break;
+	case 's':
+	case 'S':
+		{
+			char *z = memchr(p, '\0', e - p);
+			if(z){
+				n = ((z - p) / 4 + 1) * 4;
+			}
+		}
+		break;
+	case 'b':
+		if(e - p >= 4){
+			n = 4 + ((ntoh32(*((uint32_t *)p)) + 3) & ~3);
+		}
+		break;
+	case OSC_BUNDLE_TYPETAG:
+		if(e - p >= 4){
+			n = 4 + ntoh32(*((uint32_t *)p));
+		}
+		break;
+	}
+	if(n < 0 || n > e - p){
+		return -1;
+	}
+	return n;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ODOT_ARGSIZE_H__
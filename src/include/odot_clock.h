@@ -0,0 +1,104 @@
+#ifndef __ODOT_CLOCK_H__
+#define __ODOT_CLOCK_H__
+
+/*
+  The time according to the audio clock, for objects whose timestamps
+  should agree with each other rather than with whenever the thread they
+  run on happened to get to them.
+
+  In Max this is omax_realtime_clock_now(), the clock o.edge~ and the
+  other signal objects tick from their perform routines.  In Pd it's the
+  scheduler's logical time, which moves a DSP block at a time, anchored
+  to the system clock the first time anyone asks.  The anchor is shared
+  by every external in the process through the s_thing of a symbol, so
+  all odot objects read the same clock.
+
+  odot_clock_tick() identifies the scheduler tick we're in, so that an
+  object can read the clock once per tick and give everything it sees
+  during that tick the same time.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "osc.h"
+#include "osc_mem.h"
+#include "osc_timetag.h"
+
+#ifdef OMAX_PD_VERSION
+
+#define ODOT_CLOCK_VERSION 1
+#define ODOT_CLOCK_SYMBOL "#odot.clock"
+
+typedef struct _odot_clock{
+	long version;
+	double logicaltime; // Pd's logical time when the anchor was taken
+	t_osc_timetag time; // and the system time then
+} t_odot_clock;
+
+static t_odot_clock *odot_clock_get(void)
+{
+	static t_odot_clock *clock;
+	static int failed;
+	if(clock || failed){
+		return clock;
+	}
+	t_symbol *sym = gensym(ODOT_CLOCK_SYMBOL);
+	t_odot_clock *c = (t_odot_clock *)sym->s_thing;
+	if(!c){
+		c = (t_odot_clock *)osc_mem_alloc(sizeof(t_odot_clock));
+		if(!c){
+			failed = 1;
+			return NULL;
+		}
+		c->version = ODOT_CLOCK_VERSION;
+		c->logicaltime = clock_getlogicaltime();
+		c->time = osc_timetag_now();
+		sym->s_thing = (void *)c;
+	}
+	if(c->version != ODOT_CLOCK_VERSION){
+		failed = 1;
+		return NULL;
+	}
+	clock = c;
+	return clock;
+}
+
+static t_osc_timetag odot_clock_now(void)
+{
+	t_odot_clock *c = odot_clock_get();
+	if(!c){
+		return osc_timetag_now();
+	}
+	return osc_timetag_add(c->time, osc_timetag_floatToTimetag(clock_gettimesince(c->logicaltime) / 1000.));
+}
+
+static double odot_clock_tick(void)
+{
+	return clock_getlogicaltime();
+}
+
+#else
+
+#include "omax_realtime.h"
+
+static t_osc_timetag odot_clock_now(void)
+{
+	t_osc_timetag t;
+	omax_realtime_clock_now(&t);
+	return t;
+}
+
+static double odot_clock_tick(void)
+{
+	return (double)gettime();
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ODOT_CLOCK_H__
@@ -0,0 +1,322 @@
+#ifndef __ODOT_DOWNCAST_H__
+#define __ODOT_DOWNCAST_H__
+
+/*
+  Downcast a serialized bundle to the types of OSC 1.0, for o.downcast.
+
+  Downcasting only ever rewrites atoms in place, so it is done in a
+  single walk over the serialized bundle, straight into the output
+  buffer.  The walk is done twice: once with out set to NULL to measure
+  the result, and once to write it.
+
+  Nested bundles are removed from the messages they are in and appended
+  to the bundle as OSC 1.0 bundle elements, after being downcast
+  themselves.
+
+  Timetags become two ints, the fraction and then the seconds, each in
+  the host's byte order.  That's odd, but it's what o.downcast has
+  always output, and patches depend on it.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include "osc.h"
+#include "osc_byteorder.h"
+#include "osc_timetag.h"
+#include "odot_argsize.h"
+
+typedef struct _odot_downcast{
+	long doubles, ints, bundles, timetags;	// which types to downcast
+	const char *timetag_address;		// the message whose timetag becomes the bundle's, or NULL
+	int nonntp;				// set if a timetag was left alone because timetags aren't NTP
+} t_odot_downcast;
+
+// the typetags tt becomes once downcast; the empty string for atoms that are removed
+static const char *odot_downcast_newTypetags(t_odot_downcast *d, char tt)
+{
+	switch(tt){
+	case 'c':
+	case 'C':
+	case 'I':
+	case 'h':
+	case 'H':
+	case 'u':
+	case 'U':
+	case 'N':
+	case 'T':
+	case 'F':
+		return d->ints ? "i" : NULL;
+	case 'd':
+		return d->doubles ? "f" : NULL;
+	case OSC_BUNDLE_TYPETAG:
+		return d->bundles ? "" : NULL;
+#if OSC_TIMETAG_FORMAT == OSC_TIMETAG_NTP
+	case OSC_TIMETAG_TYPETAG:
+		return d->timetags ? "ii" : NULL;
+#endif
+	}
+	return NULL;
+}
+
+// write the downcast value of the atom with typetag tt and data p into out.
+// ints and doubles are the only types whose bytes change
+static void odot_downcast_writeArg(char tt, char *p, long argsize, const char *newtt, char *out)
+{
+	int32_t i = 0;
+	switch(*newtt){
+	case 'i':
+		switch(tt){
+		case 'c':
+			i = (int8_t)ntoh32(*((uint32_t *)p));
+			break;
+		case 'C':
+			i = (uint8_t)ntoh32(*((uint32_t *)p));
+			break;
+		case 'u':
+			i = (int16_t)ntoh32(*((uint32_t *)p));
+			break;
+		case 'U':
+			i = (uint16_t)ntoh32(*((uint32_t *)p));
+			break;
+		case 'I':
+			i = (int32_t)ntoh32(*((uint32_t *)p));
+			break;
+		case 'h':
+		case 'H':
+			i = (int32_t)ntoh64(*((uint64_t *)p));
+			break;
+		case 'T':
+			i = 1;
+			break;
+		case OSC_TIMETAG_TYPETAG:
+			{
+				// fraction first, then seconds, each as the host stores it,
+				// which is what o.downcast has always output
+				uint32_t sec = ntoh32(*((uint32_t *)p));
+				uint32_t frac = ntoh32(*((uint32_t *)(p + 4)));
+				memcpy(out, &frac, 4);
+				memcpy(out + 4, &sec, 4);
+			}
+			return;
+		}
+		*((uint32_t *)out) = hton32((uint32_t)i);
+		break;
+	case 'f':
+		{
+			uint64_t l = ntoh64(*((uint64_t *)p));
+			double d;
+			memcpy(&d, &l, sizeof(double));
+			float f = (float)d;
+			uint32_t u;
+			memcpy(&u, &f, sizeof(float));
+			*((uint32_t *)out) = hton32(u);
+		}
+		break;
+	default:
+		memcpy(out, p, argsize);
+	}
+}
+
+/*
+Downcast the message m, which is n bytes long not counting its size, into
+out, or just measure it if out is NULL.  Returns the length of the result,
+not counting its size, or -1 if the message is malformed.  If the message
+is the one named by @headertimetag, *timetag is pointed at its timetag,
+and if it contains bundles that need to be moved out, *hasbundles is set.
+*/
+static long odot_downcast_message(t_odot_downcast *d, char *m, long n, char *out, char **timetag, int *hasbundles)
+{
+	char *e = m + n;
+	char *z = memchr(m, '\0', n);
+	if(!z){
+		return -1;
+	}
+	long addresslen = ((z - m) / 4 + 1) * 4;
+	if(addresslen >= n || m[addresslen] != ','){
+		// no typetags, so nothing to do
+		if(addresslen > n){
+			return -1;
+		}
+		if(out){
+			memcpy(out, m, n);
+		}
+		return n;
+	}
+	char *tt = m + addresslen;
+	z = memchr(tt, '\0', e - tt);
+	if(!z){
+		return -1;
+	}
+	long ntt = z - tt - 1;
+	long ttlen = ((z - tt) / 4 + 1) * 4;
+	char *data = tt + ttlen;
+	if(data > e){
+		return -1;
+	}
+
+	// measure
+	long newntt = 0, datalen = 0;
+	char *p = data;
+	long i;
+	for(i = 1; i <= ntt; i++){
+		long argsize = odot_argSize(tt[i], p, e);
+		if(argsize < 0){
+			return -1;
+		}
+		const char *newtt = odot_downcast_newTypetags(d, tt[i]);
+		if(newtt){
+			newntt += strlen(newtt);
+			datalen += strlen(newtt) * 4;
+			if(tt[i] == OSC_BUNDLE_TYPETAG){
+				*hasbundles = 1;
+			}
+		}else{
+			newntt++;
+			datalen += argsize;
+		}
+		p += argsize;
+	}
+	long newttlen = ((newntt + 1) / 4 + 1) * 4;
+	if(!out){
+		return addresslen + newttlen + datalen;
+	}
+
+	// write
+	memcpy(out, m, addresslen);
+	char *ttout = out + addresslen;
+	memset(ttout, '\0', newttlen);
+	*ttout++ = ',';
+	char *dataout = out + addresslen + newttlen;
+	int istimetagmsg = d->timetags && d->timetag_address && !strcmp(m, d->timetag_address);
+	p = data;
+	for(i = 1; i <= ntt; i++){
+		long argsize = odot_argSize(tt[i], p, e);
+		const char *newtt = odot_downcast_newTypetags(d, tt[i]);
+		if(newtt){
+			if(*newtt){
+				odot_downcast_writeArg(tt[i], p, argsize, newtt, dataout);
+				long l = strlen(newtt);
+				memcpy(ttout, newtt, l);
+				ttout += l;
+				dataout += l * 4;
+			}
+			if(tt[i] == OSC_TIMETAG_TYPETAG && istimetagmsg){
+				*timetag = p;
+			}
+		}else{
+#if OSC_TIMETAG_FORMAT != OSC_TIMETAG_NTP
+			if(tt[i] == OSC_TIMETAG_TYPETAG && d->timetags){
+				d->nonntp = 1;
+			}
+#endif
+			*ttout++ = tt[i];
+			memcpy(dataout, p, argsize);
+			dataout += argsize;
+		}
+		p += argsize;
+	}
+	return addresslen + newttlen + datalen;
+}
+
+static long odot_downcast_bundle(t_odot_downcast *d, long len, char *ptr, char *out);
+
+// the bundles in message m, downcast and framed as bundle elements
+static long odot_downcast_nestedBundles(t_odot_downcast *d, char *m, long n, char *out)
+{
+	char *e = m + n;
+	char *z = memchr(m, '\0', n);
+	long addresslen = ((z - m) / 4 + 1) * 4;
+	if(addresslen >= n || m[addresslen] != ','){
+		return 0;
+	}
+	char *tt = m + addresslen;
+	z = memchr(tt, '\0', e - tt);
+	char *p = tt + ((z - tt) / 4 + 1) * 4;
+	long pos = 0;
+	long i;
+	for(i = 1; tt[i]; i++){
+		long argsize = odot_argSize(tt[i], p, e);
+		if(tt[i] == OSC_BUNDLE_TYPETAG){
+			long l = odot_downcast_bundle(d, argsize - 4, p + 4, out ? out + pos + 4 : NULL);
+			if(l < 0){
+				return -1;
+			}
+			if(out){
+				*((uint32_t *)(out + pos)) = hton32((uint32_t)l);
+			}
+			pos += 4 + l;
+		}
+		p += argsize;
+	}
+	return pos;
+}
+
+// downcast the bundle into out, or just measure it if out is NULL.
+// returns the length of the result, or -1 if the bundle is malformed
+static long odot_downcast_bundle(t_odot_downcast *d, long len, char *ptr, char *out)
+{
+	if(len < OSC_HEADER_SIZE || strncmp(ptr, "#bundle", OSC_ID_SIZE)){
+		return -1;
+	}
+	char *timetag = NULL;
+	if(out){
+		t_osc_timetag tt = OSC_TIMETAG_NULL;
+		memcpy(out, ptr, OSC_ID_SIZE);
+		memcpy(out + OSC_ID_SIZE, &tt, sizeof(t_osc_timetag));
+	}
+	long pos = OSC_HEADER_SIZE;
+	int hasbundles = 0;
+	char *p = ptr + OSC_HEADER_SIZE;
+	char *e = ptr + len;
+	while(p < e){
+		if(e - p < 4){
+			return -1;
+		}
+		long n = ntoh32(*((uint32_t *)p));
+		if(n < 0 || n > e - p - 4){
+			return -1;
+		}
+		long l;
+		if(n >= OSC_ID_SIZE && !strncmp(p + 4, "#bundle", OSC_ID_SIZE)){
+			l = odot_downcast_bundle(d, n, p + 4, out ? out + pos + 4 : NULL);
+		}else{
+			l = odot_downcast_message(d, p + 4, n, out ? out + pos + 4 : NULL, &timetag, &hasbundles);
+		}
+		if(l < 0){
+			return -1;
+		}
+		if(out){
+			*((uint32_t *)(out + pos)) = hton32((uint32_t)l);
+		}
+		pos += 4 + l;
+		p += 4 + n;
+	}
+	if(hasbundles){
+		p = ptr + OSC_HEADER_SIZE;
+		while(p < e){
+			long n = ntoh32(*((uint32_t *)p));
+			if(strncmp(p + 4, "#bundle", OSC_ID_SIZE)){
+				long l = odot_downcast_nestedBundles(d, p + 4, n, out ? out + pos : NULL);
+				if(l < 0){
+					return -1;
+				}
+				pos += l;
+			}
+			p += 4 + n;
+		}
+	}
+	if(out && timetag){
+		memcpy(out + OSC_ID_SIZE, timetag, sizeof(t_osc_timetag));
+	}
+	return pos;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ODOT_DOWNCAST_H__
@@ -0,0 +1,183 @@
+#ifndef __ODOT_ENCODE_H__
+#define __ODOT_ENCODE_H__
+
+/*
+  Serialize Max/Pd atoms straight into an OSC message, without building a
+  t_osc_msg_u first.  The message is written the way it appears inside a
+  bundle, i.e. preceded by its 32-bit size.
+
+  Atoms map to OSC types as follows:
+	Max A_LONG	'i' (or 'h' if it doesn't fit in 32 bits)
+	Max A_FLOAT	'd'
+	Pd A_FLOAT	'f'
+	A_SYM		's'
+  anything else is skipped.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include "osc.h"
+
+#define ODOT_ENCODE_PADDED(n) ((((n) / 4) + 1) * 4) // string of length n + at least one NULL
+
+// buffers are plain chars and offsets are only 4-byte multiples from
+// wherever the caller's buffer starts, so never store through a cast
+static void odot_encode_put32(char *p, uint32_t u)
+{
+	u = hton32(u);
+	memcpy(p, &u, 4);
+}
+
+static void odot_encode_put64(char *p, uint64_t u)
+{
+	u = hton64(u);
+	memcpy(p, &u, 8);
+}
+
+static char odot_encode_typetag(t_atom *a)
+{
+	switch(atom_gettype(a)){
+#ifdef OMAX_PD_VERSION
+	case A_FLOAT:
+		return 'f';
+#else
+	case A_LONG:
+		{
+			long l = atom_getlong(a);
+			return l == (int32_t)l ? 'i' : 'h';
+		}
+	case A_FLOAT:
+		return 'd';
+#endif
+	case A_SYM:
+		return 's';
+	default:
+		return 0;
+	}
+}
+
+static long odot_encode_string(char *buf, long n, long pos, const char *s)
+{
+	long len = strlen(s);
+	long padded = ODOT_ENCODE_PADDED(len);
+	if(pos + padded <= n){
+		memcpy(buf + pos, s, len);
+		memset(buf + pos + len, '\0', padded - len);
+	}
+	return padded;
+}
+
+/*
+  Write a message with the given address and arguments into buf, which
+  has room for n bytes.  If sel is non-NULL, it is encoded as a string
+  before the arguments (an "anything" message).  Typetags and data are
+  written in one pass over the atoms.
+
+  Returns the number of bytes the message needs, including its size.  If
+  that's more than n, the contents of buf are undefined and the caller
+  should try again with a buffer that big; the message that's written
+  then may be a little shorter, if atoms were skipped, so the caller
+  should use the length the second call returns.  The address must
+  start with a '/'.  If nskipped is non-NULL, it is
+  set to the number of atoms that had no OSC equivalent.
+*/
+static long odot_encode_message(char *buf, long n, const char *address, t_symbol *sel, long argc, t_atom *argv, int *nskipped)
+{
+	long addresslen = ODOT_ENCODE_PADDED(strlen(address));
+	long ntags = argc + (sel ? 1 : 0);
+	long typetagslen = ODOT_ENCODE_PADDED(ntags + 1);
+	long pos = 4 + addresslen + typetagslen;
+	char *typetags = buf + 4 + addresslen;
+	int tt = 0, skipped = 0;
+	if(pos <= n){
+		odot_encode_string(buf, n, 4, address);
+		memset(typetags, '\0', typetagslen);
+		typetags[tt++] = ',';
+	}
+	if(sel){
+		if(pos <= n){
+			typetags[tt] = 's';
+		}
+		tt++;
+		pos += odot_encode_string(buf, n, pos, sel->s_name);
+	}
+	long i;
+	for(i = 0; i < argc; i++){
+		char t = odot_encode_typetag(argv + i);
+		long size = 0;
+		switch(t){
+		case 'i':
+			size = 4;
+			if(pos + size <= n){
+				odot_encode_put32(buf + pos, (uint32_t)((int32_t)atom_getlong(argv + i)));
+			}
+			break;
+		case 'h':
+			size = 8;
+			if(pos + size <= n){
+				odot_encode_put64(buf + pos, (uint64_t)((int64_t)atom_getlong(argv + i)));
+			}
+			break;
+		case 'f':
+			size = 4;
+			if(pos + size <= n){
+				float f = atom_getfloat(argv + i);
+				uint32_t u;
+				memcpy(&u, &f, 4);
+				odot_encode_put32(buf + pos, u);
+			}
+			break;
+		case 'd':
+			size = 8;
+			if(pos + size <= n){
+				double d = atom_getfloat(argv + i);
+				uint64_t u;
+				memcpy(&u, &d, 8);
+				odot_encode_put64(buf + pos, u);
+			}
+			break;
+		case 's':
+			size = odot_encode_string(buf, n, pos, atom_getsym(argv + i)->s_name);
+			break;
+		default:
+			skipped++;
+			continue;
+		}
+		if(pos + size <= n){
+			typetags[tt] = t;
+		}
+		tt++;
+		pos += size;
+	}
+	if(pos > n){
+		// writing it takes room for the typetags we reserved, even if
+		// some of them go unused
+		if(nskipped){
+			*nskipped = skipped;
+		}
+		return pos;
+	}
+	if(skipped){
+		// we reserved room for typetags we didn't write--close the gap
+		long shrink = typetagslen - ODOT_ENCODE_PADDED(tt);
+		if(shrink){
+			memmove(typetags + typetagslen - shrink, typetags + typetagslen, pos - (typetags + typetagslen - buf));
+		}
+		pos -= shrink;
+	}
+	odot_encode_put32(buf, (uint32_t)(pos - 4));
+	if(nskipped){
+		*nskipped = skipped;
+	}
+	return pos;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ODOT_ENCODE_H__
@@ -0,0 +1,506 @@
+#ifndef __ODOT_MAPEXPR_H__
+#define __ODOT_MAPEXPR_H__
+
+/*
+  Map an expression over the messages of a serialized bundle, for
+  o.mappatch's expression mode.
+
+  Each message is turned into a little bundle of its own,
+
+	/address : "/foo", /value : [the arguments of /foo]
+
+  the expression is evaluated on that, and whatever /value holds
+  afterwards goes into the output under whatever /address holds.
+
+  The messages of a large bundle are split between the calling thread
+  and a pool of worker threads.  Work is handed out in chunks of
+  consecutive messages from a shared counter, and each message has its
+  own result slot, so the output comes out in the original order no
+  matter which thread evaluated what.  Nothing promises that evaluating
+  an expression leaves its tree alone, so every thread evaluates its own
+  copy of the expression, parsed from the same text.
+
+  None of this is safe to call from more than one thread at a time; the
+  pool is only started on the first bundle big enough to need it, and
+  is stopped whenever the expression or the number of threads changes.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "osc.h"
+#include "osc_mem.h"
+#include "osc_byteorder.h"
+#include "osc_expr.h"
+#include "osc_expr_parser.h"
+#include "osc_atom_u.h"
+
+#define ODOT_MAPEXPR_MAX_THREADS 64
+#define ODOT_MAPEXPR_PARALLEL_MIN 32 // don't wake the workers for bundles with fewer messages than this
+#define ODOT_MAPEXPR_CHUNKS_PER_THREAD 4
+
+typedef struct _odot_mapexpr_result{
+	char *bndl; // the little /address, /value bundle the expression is evaluated on
+	long bndlsize;
+	char *msg; // the resulting message, preceded by its size.  msglen is 0 if it was dropped
+	long msglen;
+	long msgsize;
+} t_odot_mapexpr_result;
+
+struct _odot_mapexpr;
+
+typedef struct _odot_mapexpr_worker{
+	pthread_t thread;
+	struct _odot_mapexpr *m;
+	t_osc_expr *expr; // this worker's own copy of the expression
+} t_odot_mapexpr_worker;
+
+typedef struct _odot_mapexpr{
+	t_osc_expr *expr; // the calling thread's copy
+	char *text; // what the workers' copies are parsed from
+	// the pool
+	t_odot_mapexpr_worker *workers;
+	long nworkers;
+	pthread_mutex_t mutex;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	long generation;
+	long active;
+	int quit;
+	// the bundle being mapped
+	char **msgs;
+	t_odot_mapexpr_result *results;
+	long max;
+	long n;
+	long chunk;
+	volatile long next;
+	char *outbuf;
+	long outbufsize;
+} t_odot_mapexpr;
+
+#define ODOT_MAPEXPR_PADDED(n) ((((n) / 4) + 1) * 4) // string of length n + at least one NULL
+
+// make sure a buffer allocated with osc_mem_alloc has room for n bytes
+static int odot_mapexpr_reserve(char **buf, long *size, long n)
+{
+	if(n > *size){
+		char *tmp = (char *)osc_mem_resize(*buf, n);
+		if(!tmp){
+			return 1;
+		}
+		*buf = tmp;
+		*size = n;
+	}
+	return 0;
+}
+
+// evaluate expr on one message and leave the result in r.  this is called
+// from the worker threads, so it mustn't touch anything but r and expr,
+// which belongs to the thread calling it
+static void odot_mapexpr_evalMessage(t_osc_expr *expr, char *m, t_odot_mapexpr_result *r)
+{
+	long msglen = ntoh32(*((uint32_t *)m));
+	char *address = m + 4;
+	r->msglen = 0;
+	if(*address != '/'){
+		// a nested bundle or something we don't understand--pass it through
+		if(!odot_mapexpr_reserve(&(r->msg), &(r->msgsize), msglen + 4)){
+			memcpy(r->msg, m, msglen + 4);
+			r->msglen = msglen + 4;
+		}
+		return;
+	}
+	long addresslen = strlen(address);
+	long paddedaddresslen = ODOT_MAPEXPR_PADDED(addresslen);
+	long argslen = msglen - paddedaddresslen; // typetags and data
+
+	// /address : "/foo", /value : [args]
+	long addressmsglen = 12 + 4 + paddedaddresslen;
+	long valuemsglen = 8 + argslen;
+	long len = OSC_HEADER_SIZE + 4 + addressmsglen + 4 + valuemsglen;
+	if(odot_mapexpr_reserve(&(r->bndl), &(r->bndlsize), len)){
+		return;
+	}
+	char *p = r->bndl;
+	memcpy(p, OSC_EMPTY_HEADER, OSC_HEADER_SIZE);
+	p += OSC_HEADER_SIZE;
+	*((uint32_t *)p) = hton32((uint32_t)addressmsglen);
+	p += 4;
+	memcpy(p, "/address\0\0\0\0,s\0\0", 16);
+	p += 16;
+	memcpy(p, address, addresslen);
+	memset(p + addresslen, '\0', paddedaddresslen - addresslen);
+	p += paddedaddresslen;
+	*((uint32_t *)p) = hton32((uint32_t)valuemsglen);
+	p += 4;
+	memcpy(p, "/value\0\0", 8);
+	p += 8;
+	memcpy(p, address + paddedaddresslen, argslen);
+
+	int ret = 0;
+	t_osc_expr *f = expr;
+	while(f){
+		t_osc_atom_ar_u *av = NULL;
+		ret = osc_expr_eval(f, &len, &(r->bndl), &av);
+		if(av){
+			osc_atom_array_u_free(av);
+		}
+		if(ret){
+			break;
+		}
+		f = osc_expr_next(f);
+	}
+	// the evaluator resizes the bundle to fit what it leaves in it, which
+	// may be smaller than what we had, so len is all we know is there
+	r->bndlsize = len;
+	if(ret){
+		// same as o.expr: if the expression fails, the message goes through untouched
+		if(!odot_mapexpr_reserve(&(r->msg), &(r->msgsize), msglen + 4)){
+			memcpy(r->msg, m, msglen + 4);
+			r->msglen = msglen + 4;
+		}
+		return;
+	}
+
+	// pick /address and /value out of the result
+	char *newaddress = NULL, *value = NULL;
+	long valuelen = 0;
+	long pos = OSC_HEADER_SIZE;
+	while(pos + 4 <= len){
+		long l = ntoh32(*((uint32_t *)(r->bndl + pos)));
+		char *a = r->bndl + pos + 4;
+		if(!strcmp(a, "/value")){
+			value = a + 8;
+			valuelen = l - 8;
+		}else if(!strcmp(a, "/address")){
+			char *tt = a + 12;
+			if(tt[0] == ',' && tt[1] == 's'){
+				newaddress = tt + 4;
+			}
+		}
+		pos += l + 4;
+	}
+	if(!value){
+		return;
+	}
+	if(newaddress){
+		address = newaddress;
+		addresslen = strlen(address);
+		paddedaddresslen = ODOT_MAPEXPR_PADDED(addresslen);
+	}
+	msglen = paddedaddresslen + valuelen;
+	if(odot_mapexpr_reserve(&(r->msg), &(r->msgsize), msglen + 4)){
+		return;
+	}
+	p = r->msg;
+	*((uint32_t *)p) = hton32((uint32_t)msglen);
+	p += 4;
+	memcpy(p, address, addresslen);
+	memset(p + addresslen, '\0', paddedaddresslen - addresslen);
+	p += paddedaddresslen;
+	memcpy(p, value, valuelen);
+	r->msglen = msglen + 4;
+}
+
+// take chunks of messages until there are none left
+static void odot_mapexpr_work(t_odot_mapexpr *m, t_osc_expr *expr)
+{
+	long n = m->n;
+	long chunk = m->chunk;
+	long i;
+	while((i = __sync_fetch_and_add(&(m->next), chunk)) < n){
+		long end = i + chunk < n ? i + chunk : n;
+		for(; i < end; i++){
+			odot_mapexpr_evalMessage(expr, m->msgs[i], m->results + i);
+		}
+	}
+}
+
+static void *odot_mapexpr_worker(void *arg)
+{
+	t_odot_mapexpr_worker *w = (t_odot_mapexpr_worker *)arg;
+	t_odot_mapexpr *m = w->m;
+	long generation = 0;
+	pthread_mutex_lock(&(m->mutex));
+	while(1){
+		while(!m->quit && m->generation == generation){
+			pthread_cond_wait(&(m->start), &(m->mutex));
+		}
+		if(m->quit){
+			break;
+		}
+		generation = m->generation;
+		pthread_mutex_unlock(&(m->mutex));
+		odot_mapexpr_work(m, w->expr);
+		pthread_mutex_lock(&(m->mutex));
+		if(--(m->active) == 0){
+			pthread_cond_signal(&(m->done));
+		}
+	}
+	pthread_mutex_unlock(&(m->mutex));
+	return NULL;
+}
+
+static void odot_mapexpr_freeWorkers(t_odot_mapexpr_worker *workers, long n)
+{
+	long i;
+	for(i = 0; i < n; i++){
+		if(workers[i].expr){
+			osc_expr_free(workers[i].expr);
+		}
+	}
+	osc_mem_free(workers);
+}
+
+// stop the workers, if they're running.  they're started again the next
+// time they're needed
+static void odot_mapexpr_stop(t_odot_mapexpr *m)
+{
+	if(!m->workers){
+		return;
+	}
+	pthread_mutex_lock(&(m->mutex));
+	m->quit = 1;
+	pthread_cond_broadcast(&(m->start));
+	pthread_mutex_unlock(&(m->mutex));
+	long i;
+	for(i = 0; i < m->nworkers; i++){
+		pthread_join(m->workers[i].thread, NULL);
+	}
+	odot_mapexpr_freeWorkers(m->workers, m->nworkers);
+	m->workers = NULL;
+	m->nworkers = 0;
+	pthread_cond_destroy(&(m->start));
+	pthread_cond_destroy(&(m->done));
+	pthread_mutex_destroy(&(m->mutex));
+}
+
+// start n workers, each with its own copy of the expression.  returns 1
+// if none could be started
+static int odot_mapexpr_start(t_odot_mapexpr *m, long n)
+{
+	t_odot_mapexpr_worker *workers = (t_odot_mapexpr_worker *)osc_mem_alloc(n * sizeof(t_odot_mapexpr_worker));
+	if(!workers){
+		return 1;
+	}
+	memset(workers, '\0', n * sizeof(t_odot_mapexpr_worker));
+	long i;
+	for(i = 0; i < n; i++){
+		workers[i].m = m;
+		if(osc_expr_parser_parseExpr(m->text, &(workers[i].expr)) || !workers[i].expr){
+			odot_mapexpr_freeWorkers(workers, n);
+			return 1;
+		}
+	}
+	pthread_mutex_init(&(m->mutex), NULL);
+	pthread_cond_init(&(m->start), NULL);
+	pthread_cond_init(&(m->done), NULL);
+	m->generation = 0;
+	m->active = 0;
+	m->quit = 0;
+	m->workers = workers;
+	m->nworkers = 0;
+	for(i = 0; i < n; i++){
+		if(pthread_create(&(workers[i].thread), NULL, odot_mapexpr_worker, workers + i)){
+			break;
+		}
+		m->nworkers++;
+	}
+	for(i = m->nworkers; i < n; i++){
+		osc_expr_free(workers[i].expr);
+		workers[i].expr = NULL;
+	}
+	if(!m->nworkers){
+		odot_mapexpr_freeWorkers(workers, n);
+		m->workers = NULL;
+		pthread_cond_destroy(&(m->start));
+		pthread_cond_destroy(&(m->done));
+		pthread_mutex_destroy(&(m->mutex));
+		return 1;
+	}
+	return 0;
+}
+
+// set the expression, or clear it if text is NULL.  returns 1 if text
+// doesn't parse, and leaves the old expression alone
+static int odot_mapexpr_setExpr(t_odot_mapexpr *m, char *text)
+{
+	t_osc_expr *f = NULL;
+	char *t = NULL;
+	if(text){
+		if(osc_expr_parser_parseExpr(text, &f) || !f){
+			return 1;
+		}
+		t = (char *)osc_mem_alloc(strlen(text) + 1);
+		if(!t){
+			osc_expr_free(f);
+			return 1;
+		}
+		strcpy(t, text);
+	}
+	odot_mapexpr_stop(m);
+	if(m->expr){
+		osc_expr_free(m->expr);
+	}
+	if(m->text){
+		osc_mem_free(m->text);
+	}
+	m->expr = f;
+	m->text = t;
+	return 0;
+}
+
+static int odot_mapexpr_grow(t_odot_mapexpr *m, long n)
+{
+	if(n <= m->max){
+		return 0;
+	}
+	char **msgs = (char **)osc_mem_resize(m->msgs, n * sizeof(char *));
+	if(!msgs){
+		return 1;
+	}
+	m->msgs = msgs;
+	t_odot_mapexpr_result *results = (t_odot_mapexpr_result *)osc_mem_resize(m->results, n * sizeof(t_odot_mapexpr_result));
+	if(!results){
+		return 1;
+	}
+	memset(results + m->max, '\0', (n - m->max) * sizeof(t_odot_mapexpr_result));
+	m->results = results;
+	m->max = n;
+	return 0;
+}
+
+// map the expression over the bundle at ptr, with up to nthreads workers.
+// the result is left in m->outbuf, and its length in *outlen.  returns 1
+// if we ran out of memory.  if the workers couldn't be started, the
+// bundle is mapped on the calling thread, and *nothreads is set
+static int odot_mapexpr_map(t_odot_mapexpr *m, long nthreads, long len, char *ptr, long *outlen, int *nothreads)
+{
+	long n = 0;
+	long pos = OSC_HEADER_SIZE;
+	while(pos + 4 <= len){
+		if(n == m->max && odot_mapexpr_grow(m, m->max ? m->max * 2 : 64)){
+			return 1;
+		}
+		m->msgs[n++] = ptr + pos;
+		pos += ntoh32(*((uint32_t *)(ptr + pos))) + 4;
+	}
+
+	m->n = n;
+	m->next = 0;
+	if(n >= ODOT_MAPEXPR_PARALLEL_MIN && nthreads > 0 && !m->workers){
+		if(odot_mapexpr_start(m, nthreads)){
+			*nothreads = 1;
+		}
+	}
+	if(n >= ODOT_MAPEXPR_PARALLEL_MIN && m->workers){
+		m->chunk = n / ((m->nworkers + 1) * ODOT_MAPEXPR_CHUNKS_PER_THREAD);
+		if(m->chunk < 1){
+			m->chunk = 1;
+		}
+		pthread_mutex_lock(&(m->mutex));
+		m->active = m->nworkers;
+		m->generation++;
+		pthread_cond_broadcast(&(m->start));
+		pthread_mutex_unlock(&(m->mutex));
+
+		odot_mapexpr_work(m, m->expr);
+
+		pthread_mutex_lock(&(m->mutex));
+		while(m->active){
+			pthread_cond_wait(&(m->done), &(m->mutex));
+		}
+		pthread_mutex_unlock(&(m->mutex));
+	}else{
+		m->chunk = n ? n : 1;
+		odot_mapexpr_work(m, m->expr);
+	}
+
+	long l = OSC_HEADER_SIZE;
+	long i;
+	for(i = 0; i < n; i++){
+		l += m->results[i].msglen;
+	}
+	if(odot_mapexpr_reserve(&(m->outbuf), &(m->outbufsize), l)){
+		return 1;
+	}
+	// keep the timetag of the bundle that came in
+	memcpy(m->outbuf, ptr, OSC_HEADER_SIZE);
+	char *p = m->outbuf + OSC_HEADER_SIZE;
+	for(i = 0; i < n; i++){
+		t_odot_mapexpr_result *r = m->results + i;
+		if(r->msglen){
+			memcpy(p, r->msg, r->msglen);
+			p += r->msglen;
+		}
+	}
+	*outlen = l;
+	return 0;
+}
+
+static void odot_mapexpr_init(t_odot_mapexpr *m)
+{
+	memset(m, '\0', sizeof(t_odot_mapexpr));
+	m->chunk = 1;
+}
+
+static void odot_mapexpr_free(t_odot_mapexpr *m)
+{
+	odot_mapexpr_stop(m);
+	odot_mapexpr_setExpr(m, NULL);
+	long i;
+	for(i = 0; i < m->max; i++){
+		if(m->results[i].bndl){
+			osc_mem_free(m->results[i].bndl);
+		}
+		if(m->results[i].msg){
+			osc_mem_free(m->results[i].msg);
+		}
+	}
+	if(m->results){
+		osc_mem_free(m->results);
+	}
+	if(m->msgs){
+		osc_mem_free(m->msgs);
+	}
+	if(m->outbuf){
+		osc_mem_free(m->outbuf);
+	}
+	odot_mapexpr_init(m);
+}
+
+// one worker for each core other than the one we're running on
+static long odot_mapexpr_defaultThreads(void)
+{
+	long n = 1;
+#ifdef _WIN32
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	n = si.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	n--;
+	if(n < 0){
+		n = 0;
+	}
+	if(n > ODOT_MAPEXPR_MAX_THREADS){
+		n = ODOT_MAPEXPR_MAX_THREADS;
+	}
+	return n;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ODOT_MAPEXPR_H__
@@ -0,0 +1,292 @@
+#ifndef __ODOT_PACKET_H__
+#define __ODOT_PACKET_H__
+
+/*
+  Reference counted, immutable OSC packets.
+
+  Packets still travel as FullPacket <len> <ptr>, so objects that know
+  nothing about handles keep working, but the data of a packet made here
+  is registered, and an object that wants to keep a packet it has been
+  sent can look the pointer up and retain it instead of copying it:
+
+	t_odot_packet *p = odot_packet_retainOrCopy(len, ptr);
+	...
+	odot_packet_outlet(x->outlet, p);
+	...
+	odot_packet_release(p);
+
+  The data of a packet must never be changed once it has been sent or
+  retained; an object that wants to change one calls
+  odot_packet_writable(), which hands back a private copy if anyone else
+  holds a reference.
+
+  Every external gets its own copy of these functions, so the registry
+  they share hangs off the s_thing of a symbol, and is created by
+  odot_packet_init(), which every object that uses this file calls from
+  its class setup function.  If it can't be created, or was created by a
+  build with a different layout, packets are simply never found, and
+  everybody copies as before.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include "osc.h"
+#include "osc_mem.h"
+#include "omax_util.h"
+#include "odot_pool.h"
+
+#define ODOT_PACKET_MAGIC 0x6f706b74
+#define ODOT_PACKET_REGISTRY_VERSION 1
+#define ODOT_PACKET_REGISTRY_SYMBOL "#odot.packet.registry"
+
+typedef struct _odot_packet{
+	uint32_t magic;
+	long refcount;
+	long len;
+	char data[];
+} t_odot_packet;
+
+typedef struct _odot_packet_registry{
+	long version;
+	t_critical lock;
+	// open addressing hash table of live packets, keyed on their data
+	t_odot_packet **tab;
+	long size, n, ntombs;
+} t_odot_packet_registry;
+
+#define ODOT_PACKET_TOMBSTONE ((t_odot_packet *)1)
+
+static t_odot_packet_registry *odot_packet_registry;
+
+static void odot_packet_init(void)
+{
+	if(odot_packet_registry){
+		return;
+	}
+	t_symbol *s = gensym(ODOT_PACKET_REGISTRY_SYMBOL);
+	t_odot_packet_registry *r = (t_odot_packet_registry *)s->s_thing;
+	if(!r){
+		r = (t_odot_packet_registry *)osc_mem_alloc(sizeof(t_odot_packet_registry));
+		if(!r){
+			return;
+		}
+		memset(r, '\0', sizeof(t_odot_packet_registry));
+		r->version = ODOT_PACKET_REGISTRY_VERSION;
+		critical_new(&(r->lock));
+		s->s_thing = (void *)r;
+	}
+	if(r->version == ODOT_PACKET_REGISTRY_VERSION){
+		odot_packet_registry = r;
+	}
+}
+
+static unsigned long odot_packet_hash(const char *ptr, long size)
+{
+	uintptr_t h = (uintptr_t)ptr;
+	h ^= h >> 17;
+	h *= 0x9e3779b1UL;
+	return (unsigned long)(h ^ (h >> 15)) & (size - 1);
+}
+
+// call with the registry locked
+static long odot_packet_find(t_odot_packet_registry *r, const char *ptr)
+{
+	if(!r->size){
+		return -1;
+	}
+	unsigned long i = odot_packet_hash(ptr, r->size);
+	while(r->tab[i]){
+		if(r->tab[i] != ODOT_PACKET_TOMBSTONE && r->tab[i]->data == ptr){
+			return i;
+		}
+		i = (i + 1) & (r->size - 1);
+	}
+	return -1;
+}
+
+// call with the registry locked
+static int odot_packet_register(t_odot_packet_registry *r, t_odot_packet *p)
+{
+	if((r->n + r->ntombs + 1) * 2 > r->size){
+		long size = r->size;
+		if((r->n + 1) * 4 > size){
+			size = size ? size * 2 : 256;
+		}
+		t_odot_packet **tab = (t_odot_packet **)osc_mem_alloc(size * sizeof(t_odot_packet *));
+		if(!tab){
+			return 1;
+		}
+		memset(tab, '\0', size * sizeof(t_odot_packet *));
+		long i;
+		for(i = 0; i < r->size; i++){
+			t_odot_packet *q = r->tab[i];
+			if(q && q != ODOT_PACKET_TOMBSTONE){
+				unsigned long j = odot_packet_hash(q->data, size);
+				while(tab[j]){
+					j = (j + 1) & (size - 1);
+				}
+				tab[j] = q;
+			}
+		}
+		if(r->tab){
+			osc_mem_free(r->tab);
+		}
+		r->tab = tab;
+		r->size = size;
+		r->ntombs = 0;
+	}
+	unsigned long i = odot_packet_hash(p->data, r->size);
+	while(r->tab[i] && r->tab[i] != ODOT_PACKET_TOMBSTONE){
+		i = (i + 1) & (r->size - 1);
+	}
+	if(r->tab[i] == ODOT_PACKET_TOMBSTONE){
+		r->ntombs--;
+	}
+	r->tab[i] = p;
+	r->n++;
+	return 0;
+}
+
+// a new packet of len bytes with a reference count of 1.  fill it in
+// with odot_packet_getPtr() before anyone else sees it
+static t_odot_packet *odot_packet_alloc(long len)
+{
+	t_odot_packet *p = (t_odot_packet *)odot_pool_alloc(sizeof(t_odot_packet) + len);
+	if(!p){
+		return NULL;
+	}
+	p->magic = ODOT_PACKET_MAGIC;
+	p->refcount = 1;
+	p->len = len;
+	t_odot_packet_registry *r = odot_packet_registry;
+	if(r){
+		critical_enter(r->lock);
+		odot_packet_register(r, p);
+		critical_exit(r->lock);
+	}
+	return p;
+}
+
+static t_odot_packet *odot_packet_copy(long len, char *ptr)
+{
+	t_odot_packet *p = odot_packet_alloc(len);
+	if(p){
+		memcpy(p->data, ptr, len);
+	}
+	return p;
+}
+
+static long odot_packet_getLen(t_odot_packet *p)
+{
+	return p->len;
+}
+
+static char *odot_packet_getPtr(t_odot_packet *p)
+{
+	return p->data;
+}
+
+static t_odot_packet *odot_packet_retain(t_odot_packet *p)
+{
+	__atomic_add_fetch(&(p->refcount), 1, __ATOMIC_RELAXED);
+	return p;
+}
+
+static void odot_packet_release(t_odot_packet *p)
+{
+	if(!p){
+		return;
+	}
+	long c = __atomic_load_n(&(p->refcount), __ATOMIC_ACQUIRE);
+	while(c > 1){
+		if(__atomic_compare_exchange_n(&(p->refcount), &c, c - 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+			return;
+		}
+	}
+	// last reference.  the count has to go to 0 with the registry
+	// locked, so that odot_packet_retainPtr() can't find it on the way
+	t_odot_packet_registry *r = odot_packet_registry;
+	if(r){
+		critical_enter(r->lock);
+	}
+	if(__atomic_sub_fetch(&(p->refcount), 1, __ATOMIC_ACQ_REL) > 0){
+		if(r){
+			critical_exit(r->lock);
+		}
+		return;
+	}
+	if(r){
+		long i = odot_packet_find(r, p->data);
+		if(i >= 0){
+			r->tab[i] = ODOT_PACKET_TOMBSTONE;
+			r->n--;
+			r->ntombs++;
+		}
+		critical_exit(r->lock);
+	}
+	p->magic = 0;
+	odot_pool_free(p);
+}
+
+// if ptr is the data of a live packet, retain and return it, otherwise return NULL
+static t_odot_packet *odot_packet_retainPtr(long len, char *ptr)
+{
+	t_odot_packet_registry *r = odot_packet_registry;
+	if(!r){
+		return NULL;
+	}
+	t_odot_packet *p = NULL;
+	critical_enter(r->lock);
+	long i = odot_packet_find(r, ptr);
+	if(i >= 0 && r->tab[i]->len == len){
+		p = odot_packet_retain(r->tab[i]);
+	}
+	critical_exit(r->lock);
+	return p;
+}
+
+// retain the packet ptr belongs to, or make a new one from it if it doesn't belong to one
+static t_odot_packet *odot_packet_retainOrCopy(long len, char *ptr)
+{
+	t_odot_packet *p = odot_packet_retainPtr(len, ptr);
+	if(p){
+		return p;
+	}
+	return odot_packet_copy(len, ptr);
+}
+
+// copy on write: returns p if we hold the only reference to it, otherwise
+// releases p and returns a copy of it that nobody else has seen.  returns
+// NULL, and leaves p alone, if there's no memory for the copy
+static t_odot_packet *odot_packet_writable(t_odot_packet *p)
+{
+	if(__atomic_load_n(&(p->refcount), __ATOMIC_ACQUIRE) == 1){
+		return p;
+	}
+	t_odot_packet *c = odot_packet_copy(p->len, p->data);
+	if(c){
+		odot_packet_release(p);
+	}
+	return c;
+}
+
+// whether a packet has the same bytes as len, ptr
+static int odot_packet_equals(t_odot_packet *p, long len, char *ptr)
+{
+	return p->len == len && (p->data == ptr || !memcmp(p->data, ptr, len));
+}
+
+static void odot_packet_outlet(void *outlet, t_odot_packet *p)
+{
+	omax_util_outletOSC(outlet, p->len, p->data);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ODOT_PACKET_H__
@@ -0,0 +1,395 @@
+#ifndef __ODOT_POOL_H__
+#define __ODOT_POOL_H__
+
+/*
+  A size-class pool for memory that odot objects allocate and free per
+  packet, with counters of live bytes, peak bytes and allocations for
+  every object (source file) that uses it.
+
+	char *p = (char *)odot_pool_alloc(len);
+	...
+	odot_pool_free(p);
+
+  Blocks come in power-of-two sizes from ODOT_POOL_MINSIZE up to
+  ODOT_POOL_MAXSIZE; anything bigger goes straight to osc_mem_alloc.
+  Each thread keeps a short free list per size, so the Max main and
+  scheduler threads don't contend, and trades blocks in batches with a
+  depot shared by every external in the process (through the s_thing of
+  a symbol), so a block can be freed by a different object, thread or
+  external than the one that allocated it.  When a thread exits, its
+  free lists go back to the depot, the same way odot_scratch.h frees a
+  thread's blocks.
+
+  Only memory that never changes hands with libo may come from here:
+  libo frees and resizes with osc_mem_free and osc_mem_resize, which
+  know nothing about the pool.  Conversely, odot_pool_free() must only
+  be given blocks that came from odot_pool_alloc().
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include "osc_mem.h"
+#include "odot_stats.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#if defined(_MSC_VER)
+#define ODOT_POOL_THREAD_LOCAL __declspec(thread)
+#else
+#define ODOT_POOL_THREAD_LOCAL __thread
+#endif
+
+#define ODOT_POOL_VERSION 1
+#define ODOT_POOL_SYMBOL "#odot.pool"
+#define ODOT_POOL_MINSHIFT 5 // 32 bytes
+#define ODOT_POOL_NCLASSES 12 // up to 64k
+#define ODOT_POOL_MINSIZE (1 << ODOT_POOL_MINSHIFT)
+#define ODOT_POOL_MAXSIZE (1 << (ODOT_POOL_MINSHIFT + ODOT_POOL_NCLASSES - 1))
+#define ODOT_POOL_CACHE 32 // blocks per size kept by each thread
+#define ODOT_POOL_BATCH 16 // blocks moved to or from the depot at once
+#define ODOT_POOL_BIG -1
+
+// counters for everything allocated by one object
+typedef struct _odot_pool_counters{
+	struct _odot_pool_counters *next;
+	const char *file;
+	uint64_t allocs, frees;
+	int64_t live, peak; // bytes
+	uint64_t lastallocs, lasttime; // where the last rate was measured from
+} t_odot_pool_counters;
+
+typedef struct _odot_pool_header{
+	t_odot_pool_counters *counters;
+	size_t size; // the size of the block, not what was asked for
+	int sizeclass;
+	struct _odot_pool_header *next; // while it's on a free list
+} t_odot_pool_header;
+
+#define ODOT_POOL_HEADER_SIZE ((sizeof(t_odot_pool_header) + 15) & ~(size_t)15)
+
+typedef struct _odot_pool_depot{
+	long version;
+	volatile long lock;
+	t_odot_pool_header *free[ODOT_POOL_NCLASSES];
+	long nfree[ODOT_POOL_NCLASSES];
+	t_odot_pool_counters *counters;
+} t_odot_pool_depot;
+
+// a thread's free lists
+typedef struct _odot_pool_cache{
+	t_odot_pool_header *free[ODOT_POOL_NCLASSES];
+	long nfree[ODOT_POOL_NCLASSES];
+} t_odot_pool_cache;
+
+static ODOT_POOL_THREAD_LOCAL t_odot_pool_cache odot_pool_cache;
+static ODOT_POOL_THREAD_LOCAL int odot_pool_cachekeyset;
+static t_odot_pool_counters *odot_pool_thisfile;
+
+// the key that empties a thread's free lists when it exits: 0 until it's made,
+// 1 while it's being made, 2 once it's made, and 3 if it couldn't be
+static volatile long odot_pool_keystate;
+#ifdef _WIN32
+static DWORD odot_pool_key;
+#else
+static pthread_key_t odot_pool_key;
+#endif
+
+static t_odot_pool_depot *odot_pool_getDepot(void)
+{
+	static t_odot_pool_depot *depot;
+	static int failed;
+	if(depot || failed){
+		return depot;
+	}
+	t_symbol *sym = gensym(ODOT_POOL_SYMBOL);
+	t_odot_pool_depot *d = (t_odot_pool_depot *)sym->s_thing;
+	if(!d){
+		d = (t_odot_pool_depot *)osc_mem_alloc(sizeof(t_odot_pool_depot));
+		if(!d){
+			failed = 1;
+			return NULL;
+		}
+		memset(d, '\0', sizeof(t_odot_pool_depot));
+		d->version = ODOT_POOL_VERSION;
+		sym->s_thing = (void *)d;
+	}
+	if(d->version != ODOT_POOL_VERSION){
+		failed = 1;
+		return NULL;
+	}
+	depot = d;
+	return depot;
+}
+
+static void odot_pool_lock(t_odot_pool_depot *d)
+{
+	while(__atomic_exchange_n(&(d->lock), 1, __ATOMIC_ACQUIRE)){
+		;
+	}
+}
+
+static void odot_pool_unlock(t_odot_pool_depot *d)
+{
+	__atomic_store_n(&(d->lock), 0, __ATOMIC_RELEASE);
+}
+
+// hand everything on an exiting thread's free lists back to the depot
+#ifdef _WIN32
+static void WINAPI odot_pool_threadExit(void *cache)
+#else
+static void odot_pool_threadExit(void *cache)
+#endif
+{
+	t_odot_pool_cache *c = (t_odot_pool_cache *)cache;
+	t_odot_pool_depot *d = odot_pool_getDepot();
+	int i;
+	for(i = 0; i < ODOT_POOL_NCLASSES; i++){
+		t_odot_pool_header *first = c->free[i], *last = first;
+		if(!first){
+			continue;
+		}
+		while(last->next){
+			last = last->next;
+		}
+		if(d){
+			odot_pool_lock(d);
+			last->next = d->free[i];
+			d->free[i] = first;
+			d->nfree[i] += c->nfree[i];
+			odot_pool_unlock(d);
+		}else{
+			while(first){
+				t_odot_pool_header *next = first->next;
+				osc_mem_free(first);
+				first = next;
+			}
+		}
+		c->free[i] = NULL;
+		c->nfree[i] = 0;
+	}
+}
+
+// point the key at this thread's free lists, making it first if need be
+static void odot_pool_setKey(void)
+{
+	long state = __atomic_load_n(&odot_pool_keystate, __ATOMIC_ACQUIRE);
+	if(state == 0 && __atomic_compare_exchange_n(&odot_pool_keystate, &state, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+#ifdef _WIN32
+		odot_pool_key = FlsAlloc(odot_pool_threadExit);
+		state = odot_pool_key == FLS_OUT_OF_INDEXES ? 3 : 2;
+#else
+		state = pthread_key_create(&odot_pool_key, odot_pool_threadExit) ? 3 : 2;
+#endif
+		__atomic_store_n(&odot_pool_keystate, state, __ATOMIC_RELEASE);
+	}
+	while(state < 2){
+		state = __atomic_load_n(&odot_pool_keystate, __ATOMIC_ACQUIRE);
+	}
+	if(state == 2){
+#ifdef _WIN32
+		FlsSetValue(odot_pool_key, &odot_pool_cache);
+#else
+		pthread_setspecific(odot_pool_key, &odot_pool_cache);
+#endif
+	}
+	odot_pool_cachekeyset = 1;
+}
+
+// the counters for file, made if there aren't any yet
+static t_odot_pool_counters *odot_pool_getCounters(const char *file)
+{
+	if(odot_pool_thisfile){
+		return odot_pool_thisfile;
+	}
+	t_odot_pool_depot *d = odot_pool_getDepot();
+	if(!d){
+		return NULL;
+	}
+	odot_pool_lock(d);
+	t_odot_pool_counters *c = d->counters;
+	while(c && strcmp(c->file, file)){
+		c = c->next;
+	}
+	if(!c){
+		c = (t_odot_pool_counters *)osc_mem_alloc(sizeof(t_odot_pool_counters));
+		if(c){
+			memset(c, '\0', sizeof(t_odot_pool_counters));
+			c->file = file;
+			c->next = d->counters;
+			d->counters = c;
+		}
+	}
+	odot_pool_unlock(d);
+	odot_pool_thisfile = c;
+	return c;
+}
+
+static int odot_pool_sizeclass(size_t size)
+{
+	if(size > ODOT_POOL_MAXSIZE){
+		return ODOT_POOL_BIG;
+	}
+	int c = 0;
+	size_t s = ODOT_POOL_MINSIZE;
+	while(s < size){
+		s <<= 1;
+		c++;
+	}
+	return c;
+}
+
+static t_odot_pool_header *odot_pool_getBlock(int sizeclass)
+{
+	t_odot_pool_cache *c = &odot_pool_cache;
+	t_odot_pool_header *h = c->free[sizeclass];
+	if(h){
+		c->free[sizeclass] = h->next;
+		c->nfree[sizeclass]--;
+		return h;
+	}
+	// refill from the depot
+	t_odot_pool_depot *d = odot_pool_getDepot();
+	if(d && d->nfree[sizeclass]){
+		if(!odot_pool_cachekeyset){
+			odot_pool_setKey();
+		}
+		odot_pool_lock(d);
+		long n = 0;
+		while(d->free[sizeclass] && n < ODOT_POOL_BATCH){
+			t_odot_pool_header *b = d->free[sizeclass];
+			d->free[sizeclass] = b->next;
+			b->next = c->free[sizeclass];
+			c->free[sizeclass] = b;
+			n++;
+		}
+		d->nfree[sizeclass] -= n;
+		odot_pool_unlock(d);
+		h = c->free[sizeclass];
+		if(h){
+			c->free[sizeclass] = h->next;
+			c->nfree[sizeclass] += n - 1;
+			return h;
+		}
+	}
+	size_t size = (size_t)ODOT_POOL_MINSIZE << sizeclass;
+	h = (t_odot_pool_header *)osc_mem_alloc(ODOT_POOL_HEADER_SIZE + size);
+	if(h){
+		h->sizeclass = sizeclass;
+		h->size = size;
+	}
+	return h;
+}
+
+static void odot_pool_putBlock(t_odot_pool_header *h)
+{
+	int sizeclass = h->sizeclass;
+	t_odot_pool_depot *d = odot_pool_getDepot();
+	if(!d){
+		osc_mem_free(h);
+		return;
+	}
+	if(!odot_pool_cachekeyset){
+		odot_pool_setKey();
+	}
+	t_odot_pool_cache *c = &odot_pool_cache;
+	h->next = c->free[sizeclass];
+	c->free[sizeclass] = h;
+	if(++(c->nfree[sizeclass]) > ODOT_POOL_CACHE){
+		// hand a batch back to the depot
+		t_odot_pool_header *first = c->free[sizeclass], *last = first;
+		long n = 1;
+		while(n < ODOT_POOL_BATCH){
+			last = last->next;
+			n++;
+		}
+		c->free[sizeclass] = last->next;
+		c->nfree[sizeclass] -= n;
+		odot_pool_lock(d);
+		last->next = d->free[sizeclass];
+		d->free[sizeclass] = first;
+		d->nfree[sizeclass] += n;
+		odot_pool_unlock(d);
+	}
+}
+
+static void *odot_pool_allocFrom(size_t size, const char *file)
+{
+	int sizeclass = odot_pool_sizeclass(size);
+	t_odot_pool_header *h;
+	if(sizeclass == ODOT_POOL_BIG){
+		h = (t_odot_pool_header *)osc_mem_alloc(ODOT_POOL_HEADER_SIZE + size);
+		if(h){
+			h->sizeclass = ODOT_POOL_BIG;
+			h->size = size;
+		}
+	}else{
+		h = odot_pool_getBlock(sizeclass);
+	}
+	if(!h){
+		return NULL;
+	}
+	t_odot_pool_counters *c = h->counters = odot_pool_getCounters(file);
+	if(c){
+		__atomic_add_fetch(&(c->allocs), 1, __ATOMIC_RELAXED);
+		int64_t live = __atomic_add_fetch(&(c->live), (int64_t)h->size, __ATOMIC_RELAXED);
+		int64_t peak = __atomic_load_n(&(c->peak), __ATOMIC_RELAXED);
+		while(live > peak && !__atomic_compare_exchange_n(&(c->peak), &peak, live, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+			;
+		}
+	}
+	return (char *)h + ODOT_POOL_HEADER_SIZE;
+}
+
+static void odot_pool_free(void *ptr)
+{
+	if(!ptr){
+		return;
+	}
+	t_odot_pool_header *h = (t_odot_pool_header *)((char *)ptr - ODOT_POOL_HEADER_SIZE);
+	t_odot_pool_counters *c = h->counters;
+	if(c){
+		__atomic_add_fetch(&(c->frees), 1, __ATOMIC_RELAXED);
+		__atomic_sub_fetch(&(c->live), (int64_t)h->size, __ATOMIC_RELAXED);
+	}
+	if(h->sizeclass == ODOT_POOL_BIG){
+		osc_mem_free(h);
+	}else{
+		odot_pool_putBlock(h);
+	}
+}
+
+static void *odot_pool_resizeFrom(void *ptr, size_t size, const char *file)
+{
+	if(!ptr){
+		return odot_pool_allocFrom(size, file);
+	}
+	t_odot_pool_header *h = (t_odot_pool_header *)((char *)ptr - ODOT_POOL_HEADER_SIZE);
+	if(h->sizeclass != ODOT_POOL_BIG && size <= h->size){
+		return ptr;
+	}
+	void *p = odot_pool_allocFrom(size, file);
+	if(!p){
+		return NULL;
+	}
+	memcpy(p, ptr, h->size < size ? h->size : size);
+	odot_pool_free(ptr);
+	return p;
+}
+
+// counters are kept per object, under the same name odot_stats.h gives it
+#define odot_pool_alloc(size) odot_pool_allocFrom((size), ODOT_STATS_FILE)
+#define odot_pool_resize(ptr, size) odot_pool_resizeFrom((ptr), (size), ODOT_STATS_FILE)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ODOT_POOL_H__
@@ -0,0 +1,111 @@
+#ifndef __ODOT_REDRAW_H__
+#define __ODOT_REDRAW_H__
+
+/*
+  Limit how often a box that shows the packets it's sent redraws, to
+  once every interval ms, however fast the packets come.
+
+	if(odot_redraw_request(&(x->redraw))){
+		qelem_set(x->qelem);
+	}
+
+  and in the function the clock was made with:
+
+	odot_redraw_fired(&(x->redraw));
+	qelem_set(x->qelem);
+
+  A request that comes too soon after the last redraw sets the clock to
+  go off when the interval is up, rather than being dropped, so the last
+  packet of a burst is always the one that's shown.  Boxes make their
+  text when they're drawn, so this also limits how often packets are
+  formatted.  An interval of 0 redraws on every request.
+
+  In Max, requests come from whatever thread the packet arrived on, and
+  the clock fires on the scheduler, so the state is kept under a lock.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ODOT_REDRAW_INTERVAL 33. // ms, about the frame rate of the display
+
+typedef struct _odot_redraw{
+	void *clock;
+	t_critical lock;
+	double interval; // ms
+	double last; // when the box was last redrawn
+	int pending; // the clock is set
+} t_odot_redraw;
+
+#ifdef OMAX_PD_VERSION
+#define odot_redraw_now() clock_getlogicaltime()
+#define odot_redraw_since(t) clock_gettimesince(t)
+#define odot_redraw_delay(c, ms) clock_delay((c), (ms))
+#else
+#define odot_redraw_now() ((double)gettime())
+#define odot_redraw_since(t) ((double)gettime() - (t))
+#define odot_redraw_delay(c, ms) clock_fdelay((c), (ms))
+#endif
+
+static void odot_redraw_init(t_odot_redraw *r, void *clock, double interval)
+{
+	r->clock = clock;
+	critical_new(&(r->lock));
+	r->interval = interval;
+	r->last = odot_redraw_now() - interval;
+	r->pending = 0;
+}
+
+static void odot_redraw_free(t_odot_redraw *r)
+{
+	clock_unset(r->clock);
+#ifdef OMAX_PD_VERSION
+	clock_free(r->clock);
+#else
+	object_free(r->clock);
+#endif
+	critical_free(r->lock);
+}
+
+static void odot_redraw_setInterval(t_odot_redraw *r, double interval)
+{
+	critical_enter(r->lock);
+	r->interval = interval < 0 ? 0 : interval;
+	critical_exit(r->lock);
+}
+
+// 1 if the box should be redrawn now, 0 if the clock will say when
+static int odot_redraw_request(t_odot_redraw *r)
+{
+	critical_enter(r->lock);
+	if(r->pending){
+		critical_exit(r->lock);
+		return 0;
+	}
+	double elapsed = odot_redraw_since(r->last);
+	if(r->interval <= 0 || elapsed >= r->interval){
+		r->last = odot_redraw_now();
+		critical_exit(r->lock);
+		return 1;
+	}
+	r->pending = 1;
+	double delay = r->interval - elapsed;
+	critical_exit(r->lock);
+	odot_redraw_delay(r->clock, delay);
+	return 0;
+}
+
+static void odot_redraw_fired(t_odot_redraw *r)
+{
+	critical_enter(r->lock);
+	r->pending = 0;
+	r->last = odot_redraw_now();
+	critical_exit(r->lock);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ODOT_REDRAW_H__
@@ -0,0 +1,208 @@
+#ifndef __ODOT_SCRATCH_H__
+#define __ODOT_SCRATCH_H__
+
+/*
+  A per-thread scratch arena for packet-sized temporaries.
+
+  Objects used to copy bundles into variable length arrays on the stack
+  before sending them out, which is cheap but blows the Max and Pd thread
+  stacks once bundles get big.  The arena is a bump allocator instead:
+
+	t_odot_scratch_mark mark = odot_scratch_mark();
+	char *buf = (char *)odot_scratch_alloc(len);
+	if(!buf){
+		odot_scratch_release(mark);
+		...out of memory...
+	}
+	memcpy(buf, ptr, len);
+	omax_util_outletOSC(x->outlet, len, buf);
+	odot_scratch_release(mark);
+
+  Marks are released in the reverse of the order they were taken, just
+  like stack frames, so an object further down the chain that takes its
+  own mark while we're sending it a packet is done with it by the time
+  the outlet call returns, and when the outermost FullPacket dispatch
+  releases its mark the arena is empty again.  Blocks are kept around
+  once they've been allocated, so in the steady state allocating is a
+  pointer increment.  They're freed when their thread exits, and objects
+  call odot_scratch_trim() from their free method so that the main
+  thread's blocks don't outlive the objects that used them.
+
+  Anything allocated here is only good until the mark it was allocated
+  under is released; an object that wants to keep a packet it has been
+  sent has to copy it, exactly as it did when the packet was on the
+  stack.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "osc_mem.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#if defined(_MSC_VER)
+#define ODOT_SCRATCH_THREAD_LOCAL __declspec(thread)
+#else
+#define ODOT_SCRATCH_THREAD_LOCAL __thread
+#endif
+
+#define ODOT_SCRATCH_ALIGN 16
+#define ODOT_SCRATCH_MIN_BLOCK_SIZE 65536
+
+typedef struct _odot_scratch_block{
+	struct _odot_scratch_block *next;
+	size_t size;
+	char *data;
+} t_odot_scratch_block;
+
+typedef struct _odot_scratch_mark{
+	t_odot_scratch_block *block;
+	size_t used;
+} t_odot_scratch_mark;
+
+// the block we're allocating from, and how much of it is in use
+static ODOT_SCRATCH_THREAD_LOCAL t_odot_scratch_block *odot_scratch_head;
+static ODOT_SCRATCH_THREAD_LOCAL t_odot_scratch_block *odot_scratch_cur;
+static ODOT_SCRATCH_THREAD_LOCAL size_t odot_scratch_used;
+
+// the key that frees a thread's blocks when it exits: 0 until it's made, 1 while
+// it's being made, 2 once it's made, and 3 if it couldn't be
+static volatile long odot_scratch_keystate;
+#ifdef _WIN32
+static DWORD odot_scratch_key;
+#else
+static pthread_key_t odot_scratch_key;
+#endif
+
+static void odot_scratch_freeBlocks(t_odot_scratch_block *b)
+{
+	while(b){
+		t_odot_scratch_block *next = b->next;
+		osc_mem_free(b);
+		b = next;
+	}
+}
+
+#ifdef _WIN32
+static void WINAPI odot_scratch_threadExit(void *head)
+#else
+static void odot_scratch_threadExit(void *head)
+#endif
+{
+	odot_scratch_freeBlocks((t_odot_scratch_block *)head);
+}
+
+// point the key at this thread's blocks, making it first if need be
+static void odot_scratch_setKey(void)
+{
+	long state = __atomic_load_n(&odot_scratch_keystate, __ATOMIC_ACQUIRE);
+	if(state == 0 && __atomic_compare_exchange_n(&odot_scratch_keystate, &state, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+#ifdef _WIN32
+		odot_scratch_key = FlsAlloc(odot_scratch_threadExit);
+		state = odot_scratch_key == FLS_OUT_OF_INDEXES ? 3 : 2;
+#else
+		state = pthread_key_create(&odot_scratch_key, odot_scratch_threadExit) ? 3 : 2;
+#endif
+		__atomic_store_n(&odot_scratch_keystate, state, __ATOMIC_RELEASE);
+	}
+	while(state < 2){
+		state = __atomic_load_n(&odot_scratch_keystate, __ATOMIC_ACQUIRE);
+	}
+	if(state == 2){
+#ifdef _WIN32
+		FlsSetValue(odot_scratch_key, odot_scratch_head);
+#else
+		pthread_setspecific(odot_scratch_key, odot_scratch_head);
+#endif
+	}
+}
+
+static t_odot_scratch_mark odot_scratch_mark(void)
+{
+	t_odot_scratch_mark m = {odot_scratch_cur, odot_scratch_used};
+	return m;
+}
+
+static void odot_scratch_release(t_odot_scratch_mark m)
+{
+	odot_scratch_cur = m.block;
+	odot_scratch_used = m.used;
+}
+
+static t_odot_scratch_block *odot_scratch_newBlock(size_t n)
+{
+	size_t size = ODOT_SCRATCH_MIN_BLOCK_SIZE;
+	while(size < n){
+		size *= 2;
+	}
+	t_odot_scratch_block *b = (t_odot_scratch_block *)osc_mem_alloc(sizeof(t_odot_scratch_block) + size + ODOT_SCRATCH_ALIGN);
+	if(!b){
+		return NULL;
+	}
+	b->next = NULL;
+	b->size = size;
+	b->data = (char *)(((uintptr_t)(b + 1) + (ODOT_SCRATCH_ALIGN - 1)) & ~((uintptr_t)ODOT_SCRATCH_ALIGN - 1));
+	return b;
+}
+
+// n bytes aligned to ODOT_SCRATCH_ALIGN, or NULL if we're out of memory
+static void *odot_scratch_alloc(size_t n)
+{
+	n = (n + (ODOT_SCRATCH_ALIGN - 1)) & ~((size_t)ODOT_SCRATCH_ALIGN - 1);
+	if(!n){
+		n = ODOT_SCRATCH_ALIGN;
+	}
+	t_odot_scratch_block *b = odot_scratch_cur;
+	if(b && b->size - odot_scratch_used >= n){
+		void *p = b->data + odot_scratch_used;
+		odot_scratch_used += n;
+		return p;
+	}
+	// move on to the next block, replacing it (and everything after
+	// it, which can't be in use) if it's too small
+	t_odot_scratch_block **next = b ? &(b->next) : &odot_scratch_head;
+	if(*next && (*next)->size < n){
+		odot_scratch_freeBlocks(*next);
+		*next = NULL;
+	}
+	if(!*next){
+		*next = odot_scratch_newBlock(n);
+		odot_scratch_setKey();
+		if(!*next){
+			return NULL;
+		}
+	}
+	odot_scratch_cur = *next;
+	odot_scratch_used = n;
+	return odot_scratch_cur->data;
+}
+
+// free this thread's blocks, unless something is still allocated from them
+static void odot_scratch_trim(void)
+{
+	if(odot_scratch_cur){
+		return;
+	}
+	odot_scratch_freeBlocks(odot_scratch_head);
+	odot_scratch_head = NULL;
+	if(__atomic_load_n(&odot_scratch_keystate, __ATOMIC_ACQUIRE) == 2){
+#ifdef _WIN32
+		FlsSetValue(odot_scratch_key, NULL);
+#else
+		pthread_setspecific(odot_scratch_key, NULL);
+#endif
+	}
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ODOT_SCRATCH_H__
@@ -0,0 +1,404 @@
+#ifndef __ODOT_SHM_H__
+#define __ODOT_SHM_H__
+
+/*
+  A ring of serialized OSC packets in POSIX shared memory, written by one
+  process and read by up to ODOT_SHM_MAXREADERS others on the same host.
+
+  The segment starts with a header, followed by a table of reader slots
+  and then the data.  head is the total number of bytes the writer has
+  ever written; each reader slot has its own tail, the number of bytes
+  that reader is done with.  Positions in the data are head and tail
+  modulo the capacity, which is a power of 2.
+
+  Each record is an 8-byte header (the packet's length and some flags)
+  followed by the packet, padded to a multiple of 8 bytes.  Records
+  never wrap around the end of the data: if a record doesn't fit, the
+  writer fills the rest with a padding record and starts over at 0.  So
+  every packet is contiguous in the mapping and can be copied out with
+  one memcpy.  Readers should copy a packet out before checking or
+  outputting it, since any process that can open the segment can write
+  to it.
+
+  The writer never writes past the slowest reader's tail, and a reader
+  only moves its tail once it is done with a packet, so nothing a reader
+  is looking at gets overwritten.  The segment is created with mode 0600,
+  so only processes running as the same user can open it.  If there's no room, the writer drops
+  the packet.  Slots whose process has gone away are reclaimed when the
+  ring is full.
+
+  After each record, the writer bumps a sequence number.  Only the
+  writer ever changes it.  On Linux, readers can sleep on it with a
+  futex (odot_shm_wait()), each with its slot's bit in the futex bitset,
+  so a reader that's closing can wake its own thread with
+  odot_shm_interrupt() without waking anyone else's; elsewhere,
+  odot_shm_wait() just sleeps for a moment.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#define ODOT_SHM_MAGIC 0x6f64736d // 'odsm'
+#define ODOT_SHM_VERSION 1
+#define ODOT_SHM_MAXREADERS 16
+#define ODOT_SHM_DEFAULT_SIZE (1 << 20)
+#define ODOT_SHM_RECORD_HEADER 8
+#define ODOT_SHM_PADDED(n) (((n) + 7) & ~7)
+#define ODOT_SHM_NAMELEN 256
+
+enum{
+	ODOT_SHM_RECORD_PACKET = 0,
+	ODOT_SHM_RECORD_PADDING = 1
+};
+
+// slots and the header each get a cache line of their own, so readers moving
+// their tails don't keep stealing the line the writer's head lives on
+typedef struct _odot_shm_reader{
+	uint32_t pid;
+	uint32_t active;
+	uint64_t tail;
+	char pad[48];
+} t_odot_shm_reader;
+
+typedef struct _odot_shm_header{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t capacity;
+	uint32_t writer;	// pid of the process that's writing, or 0
+	uint32_t seq;		// bumped after every record; readers wait on this
+	uint64_t head;
+	uint32_t waiters;
+	char pad[28];
+	t_odot_shm_reader readers[ODOT_SHM_MAXREADERS];
+} t_odot_shm_header;
+
+typedef struct _odot_shm{
+	t_odot_shm_header *header;
+	unsigned char *data;
+	uint64_t mask;
+	size_t maplen;
+	int slot;	// reader slot, or -1
+	int writer;
+	char name[ODOT_SHM_NAMELEN];
+} t_odot_shm;
+
+static int odot_shm_alive(uint32_t pid)
+{
+	return pid == (uint32_t)getpid() || kill((pid_t)pid, 0) == 0 || errno != ESRCH;
+}
+
+/*
+  Map the ring called name, creating it with room for at least size bytes
+  of data if it doesn't exist.  If it does, size is ignored.  Returns 0
+  on success, or an errno value.
+*/
+static int odot_shm_open(t_odot_shm *s, const char *name, long size)
+{
+	memset(s, '\0', sizeof(t_odot_shm));
+	s->slot = -1;
+	snprintf(s->name, ODOT_SHM_NAMELEN, "/odot.%s", name);
+	uint64_t capacity = 4096;
+	while(capacity < (uint64_t)size){
+		capacity <<= 1;
+	}
+	int created = 1;
+	int fd = shm_open(s->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if(fd < 0 && errno == EEXIST){
+		created = 0;
+		fd = shm_open(s->name, O_RDWR, 0600);
+	}
+	if(fd < 0){
+		return errno;
+	}
+	if(created){
+		if(ftruncate(fd, sizeof(t_odot_shm_header) + capacity) < 0){
+			int err = errno;
+			close(fd);
+			shm_unlink(s->name);
+			return err;
+		}
+	}else{
+		// whoever created it may not have sized it yet
+		struct stat st;
+		int tries = 0;
+		while(fstat(fd, &st) == 0 && st.st_size <= (off_t)sizeof(t_odot_shm_header) && tries++ < 100){
+			usleep(1000);
+		}
+		if(st.st_size <= (off_t)sizeof(t_odot_shm_header)){
+			close(fd);
+			return EINVAL;
+		}
+		capacity = st.st_size - sizeof(t_odot_shm_header);
+	}
+	s->maplen = sizeof(t_odot_shm_header) + capacity;
+	void *p = mmap(NULL, s->maplen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(p == MAP_FAILED){
+		return errno;
+	}
+	s->header = (t_odot_shm_header *)p;
+	s->data = (unsigned char *)p + sizeof(t_odot_shm_header);
+	if(created){
+		s->header->version = ODOT_SHM_VERSION;
+		s->header->capacity = capacity;
+		__atomic_store_n(&(s->header->magic), ODOT_SHM_MAGIC, __ATOMIC_RELEASE);
+	}else{
+		int tries = 0;
+		while(__atomic_load_n(&(s->header->magic), __ATOMIC_ACQUIRE) != ODOT_SHM_MAGIC && tries++ < 100){
+			usleep(1000);
+		}
+		if(s->header->magic != ODOT_SHM_MAGIC || s->header->version != ODOT_SHM_VERSION || s->header->capacity != capacity || (capacity & (capacity - 1))){
+			munmap(p, s->maplen);
+			s->header = NULL;
+			return EINVAL;
+		}
+	}
+	s->mask = capacity - 1;
+	return 0;
+}
+
+// give up the reader slot or the writer role, and unmap.  the segment itself stays
+static void odot_shm_close(t_odot_shm *s)
+{
+	if(!s->header){
+		return;
+	}
+	if(s->slot >= 0){
+		__atomic_store_n(&(s->header->readers[s->slot].active), 0, __ATOMIC_RELEASE);
+		s->slot = -1;
+	}
+	if(s->writer){
+		__atomic_store_n(&(s->header->writer), 0, __ATOMIC_RELEASE);
+		s->writer = 0;
+	}
+	munmap(s->header, s->maplen);
+	s->header = NULL;
+}
+
+// become the ring's writer.  fails with EBUSY if another live process is writing
+static int odot_shm_claimWriter(t_odot_shm *s)
+{
+	uint32_t pid = (uint32_t)getpid();
+	uint32_t cur = __atomic_load_n(&(s->header->writer), __ATOMIC_ACQUIRE);
+	while(1){
+		if(cur && odot_shm_alive(cur) && cur != pid){
+			return EBUSY;
+		}
+		if(cur == pid){
+			// another object in this process; only one writer per ring
+			return EBUSY;
+		}
+		if(__atomic_compare_exchange_n(&(s->header->writer), &cur, pid, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+			break;
+		}
+	}
+	s->writer = 1;
+	return 0;
+}
+
+// take a reader slot.  the reader starts with whatever is written from now on
+static int odot_shm_claimReader(t_odot_shm *s)
+{
+	uint32_t pid = (uint32_t)getpid();
+	int i;
+	for(i = 0; i < ODOT_SHM_MAXREADERS; i++){
+		t_odot_shm_reader *r = s->header->readers + i;
+		uint32_t active = __atomic_load_n(&(r->active), __ATOMIC_ACQUIRE);
+		if(active && odot_shm_alive(__atomic_load_n(&(r->pid), __ATOMIC_RELAXED))){
+			continue;
+		}
+		if(!__atomic_compare_exchange_n(&(r->active), &active, 2, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+			continue;
+		}
+		r->pid = pid;
+		__atomic_store_n(&(r->tail), __atomic_load_n(&(s->header->head), __ATOMIC_ACQUIRE), __ATOMIC_SEQ_CST);
+		__atomic_store_n(&(r->active), 1, __ATOMIC_SEQ_CST);
+		// the writer may have gone ahead without seeing us; catch up with it
+		__atomic_store_n(&(r->tail), __atomic_load_n(&(s->header->head), __ATOMIC_SEQ_CST), __ATOMIC_RELEASE);
+		s->slot = i;
+		return 0;
+	}
+	return EBUSY;
+}
+
+static uint64_t odot_shm_minTail(t_odot_shm *s, uint64_t head, int reap)
+{
+	uint64_t min = head;
+	int i;
+	for(i = 0; i < ODOT_SHM_MAXREADERS; i++){
+		t_odot_shm_reader *r = s->header->readers + i;
+		if(__atomic_load_n(&(r->active), __ATOMIC_ACQUIRE) != 1){
+			continue;
+		}
+		if(reap && !odot_shm_alive(r->pid)){
+			uint32_t one = 1;
+			__atomic_compare_exchange_n(&(r->active), &one, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+			continue;
+		}
+		uint64_t t = __atomic_load_n(&(r->tail), __ATOMIC_ACQUIRE);
+		if(head - t > head - min){
+			min = t;
+		}
+	}
+	return min;
+}
+
+static void odot_shm_wake(t_odot_shm *s)
+{
+	__atomic_add_fetch(&(s->header->seq), 1, __ATOMIC_RELEASE);
+#ifdef __linux__
+	if(__atomic_load_n(&(s->header->waiters), __ATOMIC_SEQ_CST)){
+		syscall(SYS_futex, &(s->header->seq), FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+	}
+#endif
+}
+
+/*
+  Append a packet.  Returns 0 on success, ENOSPC if the slowest reader is
+  too far behind for it to fit, or EMSGSIZE if it could never fit.
+*/
+static int odot_shm_write(t_odot_shm *s, const char *packet, long n)
+{
+	t_odot_shm_header *h = s->header;
+	uint64_t capacity = s->mask + 1;
+	uint64_t need = ODOT_SHM_RECORD_HEADER + ODOT_SHM_PADDED(n);
+	if(need > capacity / 2){
+		return EMSGSIZE;
+	}
+	uint64_t head = __atomic_load_n(&(h->head), __ATOMIC_RELAXED);
+	uint64_t contiguous = capacity - (head & s->mask);
+	uint64_t total = contiguous < need ? contiguous + need : need;
+	if(head + total - odot_shm_minTail(s, head, 0) > capacity){
+		if(head + total - odot_shm_minTail(s, head, 1) > capacity){
+			return ENOSPC;
+		}
+	}
+	if(contiguous < need){
+		uint32_t *pad = (uint32_t *)(s->data + (head & s->mask));
+		pad[0] = (uint32_t)(contiguous - ODOT_SHM_RECORD_HEADER);
+		pad[1] = ODOT_SHM_RECORD_PADDING;
+		head += contiguous;
+	}
+	uint32_t *rec = (uint32_t *)(s->data + (head & s->mask));
+	rec[0] = (uint32_t)n;
+	rec[1] = ODOT_SHM_RECORD_PACKET;
+	memcpy(rec + 2, packet, n);
+	__atomic_store_n(&(h->head), head + need, __ATOMIC_RELEASE);
+	odot_shm_wake(s);
+	return 0;
+}
+
+// is there anything for this reader?
+static int odot_shm_pending(t_odot_shm *s)
+{
+	return __atomic_load_n(&(s->header->head), __ATOMIC_ACQUIRE) != __atomic_load_n(&(s->header->readers[s->slot].tail), __ATOMIC_RELAXED);
+}
+
+/*
+  Find the next packet for this reader, without moving its tail.  Returns
+  1 and sets *packet and *n if there is one; the packet points into the
+  mapping and stays put until odot_shm_release() is called.  Returns 0 if
+  the reader is caught up, and -1 if the ring is corrupt, in which case
+  the reader has been moved up to the writer's head.
+*/
+static int odot_shm_peek(t_odot_shm *s, char **packet, long *n)
+{
+	t_odot_shm_reader *r = s->header->readers + s->slot;
+	uint64_t head = __atomic_load_n(&(s->header->head), __ATOMIC_ACQUIRE);
+	uint64_t tail = __atomic_load_n(&(r->tail), __ATOMIC_RELAXED);
+	uint64_t capacity = s->mask + 1;
+	while(tail != head){
+		if(head - tail > capacity){
+			__atomic_store_n(&(r->tail), head, __ATOMIC_RELEASE);
+			return -1;
+		}
+		uint32_t *rec = (uint32_t *)(s->data + (tail & s->mask));
+		uint64_t len = rec[0];
+		uint64_t reclen = ODOT_SHM_RECORD_HEADER + ODOT_SHM_PADDED(len);
+		if(reclen > head - tail || reclen > capacity - (tail & s->mask)){
+			__atomic_store_n(&(r->tail), head, __ATOMIC_RELEASE);
+			return -1;
+		}
+		if(rec[1] == ODOT_SHM_RECORD_PADDING){
+			tail += reclen;
+			__atomic_store_n(&(r->tail), tail, __ATOMIC_RELEASE);
+			continue;
+		}
+		*packet = (char *)(rec + 2);
+		*n = (long)len;
+		return 1;
+	}
+	return 0;
+}
+
+// done with the packet returned by odot_shm_peek(); the writer may reuse its space
+static void odot_shm_release(t_odot_shm *s, long n)
+{
+	t_odot_shm_reader *r = s->header->readers + s->slot;
+	uint64_t tail = __atomic_load_n(&(r->tail), __ATOMIC_RELAXED);
+	__atomic_store_n(&(r->tail), tail + ODOT_SHM_RECORD_HEADER + ODOT_SHM_PADDED(n), __ATOMIC_RELEASE);
+}
+
+// sleep until the writer has written something since seq was read, or for at most ms milliseconds
+static void odot_shm_wait(t_odot_shm *s, uint32_t seq, long ms)
+{
+#ifdef __linux__
+	// FUTEX_WAIT_BITSET takes an absolute time on the monotonic clock
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (ms % 1000) * 1000000;
+	if(ts.tv_nsec >= 1000000000){
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	__atomic_add_fetch(&(s->header->waiters), 1, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&(s->header->seq), __ATOMIC_SEQ_CST) == seq){
+		syscall(SYS_futex, &(s->header->seq), FUTEX_WAIT_BITSET, seq, &ts, NULL, 1u << s->slot);
+	}
+	__atomic_sub_fetch(&(s->header->waiters), 1, __ATOMIC_SEQ_CST);
+#else
+	if(__atomic_load_n(&(s->header->seq), __ATOMIC_ACQUIRE) == seq){
+		usleep(1000);
+	}
+#endif
+}
+
+// wake this reader's thread out of odot_shm_wait(), leaving the other readers and seq alone
+static void odot_shm_interrupt(t_odot_shm *s)
+{
+#ifdef __linux__
+	if(s->slot >= 0){
+		syscall(SYS_futex, &(s->header->seq), FUTEX_WAKE_BITSET, INT32_MAX, NULL, NULL, 1u << s->slot);
+	}
+#else
+	// odot_shm_wait() only sleeps for a millisecond, so there's nothing to do
+#endif
+}
+
+static uint32_t odot_shm_seq(t_odot_shm *s)
+{
+	return __atomic_load_n(&(s->header->seq), __ATOMIC_ACQUIRE);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ODOT_SHM_H__
@@ -0,0 +1,254 @@
+#ifndef __ODOT_SLIP_H__
+#define __ODOT_SLIP_H__
+
+/*
+  Block-oriented SLIP (RFC 1055) codec.
+
+  Both directions work on runs of bytes rather than one byte at a time:
+  the input is scanned for the next END or ESC, and everything up to it
+  is copied in one go.  The decoder keeps its state between calls, so a
+  packet can be split across any number of blocks, and its buffer grows
+  as needed up to maxsize.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include "osc_mem.h"
+
+// SLIP codes
+#define ODOT_SLIP_END		0300	// indicates end of packet
+#define ODOT_SLIP_ESC		0333	// indicates byte stuffing
+#define ODOT_SLIP_ESC_END	0334	// ESC ESC_END means END data byte
+#define ODOT_SLIP_ESC_ESC	0335	// ESC ESC_ESC means ESC data byte
+
+#define ODOT_SLIP_DEFAULT_MAXSIZE (1 << 20)
+#define ODOT_SLIP_INITIAL_SIZE 2048
+
+enum{
+	ODOT_SLIP_STATE_IDLE = 0,	// waiting for packet to start
+	ODOT_SLIP_STATE_PACKET,		// packet has started
+	ODOT_SLIP_STATE_ESCAPE,		// previous byte was ESC
+	ODOT_SLIP_STATE_ERROR		// hunting for the next END
+};
+
+typedef struct _odot_slip_decoder{
+	unsigned char *buf;
+	long len;
+	long size;
+	long maxsize;
+	int state;
+	long errors;	// packets thrown away because of bad escapes, bad lengths, or no memory
+	long dropped;	// bytes thrown away while hunting for an END
+} t_odot_slip_decoder;
+
+// the first END or ESC in [p, e), or e.  eight bytes are checked at a
+// time: a byte of v ^ k is zero where v has the byte k
+#define ODOT_SLIP_ONES 0x0101010101010101ULL
+#define ODOT_SLIP_HIGHS 0x8080808080808080ULL
+#define ODOT_SLIP_HASZERO(v) (((v) - ODOT_SLIP_ONES) & ~(v) & ODOT_SLIP_HIGHS)
+
+static const unsigned char *odot_slip_scan(const unsigned char *p, const unsigned char *e)
+{
+	while(e - p >= 8){
+		uint64_t v;
+		memcpy(&v, p, 8);
+		if(ODOT_SLIP_HASZERO(v ^ (ODOT_SLIP_ONES * ODOT_SLIP_END)) | ODOT_SLIP_HASZERO(v ^ (ODOT_SLIP_ONES * ODOT_SLIP_ESC))){
+			break;
+		}
+		p += 8;
+	}
+	while(p < e && *p != ODOT_SLIP_END && *p != ODOT_SLIP_ESC){
+		p++;
+	}
+	return p;
+}
+
+static void odot_slip_decoder_init(t_odot_slip_decoder *d, long maxsize)
+{
+	memset(d, '\0', sizeof(t_odot_slip_decoder));
+	d->maxsize = maxsize > 0 ? maxsize : ODOT_SLIP_DEFAULT_MAXSIZE;
+}
+
+static void odot_slip_decoder_free(t_odot_slip_decoder *d)
+{
+	if(d->buf){
+		osc_mem_free(d->buf);
+		d->buf = NULL;
+	}
+	d->len = d->size = 0;
+	d->state = ODOT_SLIP_STATE_IDLE;
+}
+
+static int odot_slip_decoder_reserve(t_odot_slip_decoder *d, long n)
+{
+	if(n <= d->size){
+		return 0;
+	}
+	if(n > d->maxsize){
+		return 1;
+	}
+	long size = d->size ? d->size : ODOT_SLIP_INITIAL_SIZE;
+	while(size < n){
+		size *= 2;
+	}
+	if(size > d->maxsize){
+		size = d->maxsize;
+	}
+	unsigned char *tmp = (unsigned char *)osc_mem_resize(d->buf, size);
+	if(!tmp){
+		return 1;
+	}
+	d->buf = tmp;
+	d->size = size;
+	return 0;
+}
+
+static void odot_slip_decoder_fail(t_odot_slip_decoder *d)
+{
+	d->errors++;
+	d->len = 0;
+	d->state = ODOT_SLIP_STATE_ERROR;
+}
+
+/*
+  Consume bytes from in until either a packet is complete or the input
+  runs out, and return the number of bytes consumed.  If a packet was
+  completed, *packetlen is set to its length and the packet is in d->buf
+  until the next call; otherwise *packetlen is 0.  Call this in a loop
+  until all n bytes have been consumed.  Packets whose length isn't a
+  multiple of 4 can't be OSC, and are counted as errors.
+*/
+static long odot_slip_decode(t_odot_slip_decoder *d, const unsigned char *in, long n, long *packetlen)
+{
+	const unsigned char *p = in, *e = in + n;
+	*packetlen = 0;
+	while(p < e){
+		switch(d->state){
+		case ODOT_SLIP_STATE_IDLE:
+			d->len = 0;
+			d->state = ODOT_SLIP_STATE_PACKET;
+			if(*p == ODOT_SLIP_END){
+				p++;
+			}
+			break;
+		case ODOT_SLIP_STATE_PACKET:
+			{
+				// copy everything up to the next special byte in one go
+				const unsigned char *run = p;
+				p = odot_slip_scan(p, e);
+				if(p > run){
+					if(odot_slip_decoder_reserve(d, d->len + (p - run))){
+						odot_slip_decoder_fail(d);
+						break;
+					}
+					memcpy(d->buf + d->len, run, p - run);
+					d->len += p - run;
+				}
+				if(p == e){
+					break;
+				}
+				if(*p++ == ODOT_SLIP_ESC){
+					d->state = ODOT_SLIP_STATE_ESCAPE;
+					break;
+				}
+				d->state = ODOT_SLIP_STATE_IDLE;
+				if(d->len == 0){
+					break;
+				}
+				if(d->len % 4){
+					d->errors++;
+					d->len = 0;
+					break;
+				}
+				*packetlen = d->len;
+				return p - in;
+			}
+		case ODOT_SLIP_STATE_ESCAPE:
+			{
+				unsigned char c;
+				switch(*p){
+				case ODOT_SLIP_ESC_END:
+					c = ODOT_SLIP_END;
+					break;
+				case ODOT_SLIP_ESC_ESC:
+					c = ODOT_SLIP_ESC;
+					break;
+				default:
+					odot_slip_decoder_fail(d);
+					continue; // the byte after the ESC could be the END we're looking for
+				}
+				p++;
+				if(odot_slip_decoder_reserve(d, d->len + 1)){
+					odot_slip_decoder_fail(d);
+					break;
+				}
+				d->buf[d->len++] = c;
+				d->state = ODOT_SLIP_STATE_PACKET;
+			}
+			break;
+		case ODOT_SLIP_STATE_ERROR:
+			{
+				const unsigned char *end = (const unsigned char *)memchr(p, ODOT_SLIP_END, e - p);
+				if(!end){
+					d->dropped += e - p;
+					p = e;
+					break;
+				}
+				d->dropped += end - p;
+				p = end + 1;
+				d->len = 0;
+				d->state = ODOT_SLIP_STATE_IDLE;
+			}
+			break;
+		}
+	}
+	return p - in;
+}
+
+// the exact number of bytes src will take up once encoded, including both ENDs
+static long odot_slip_encodedLen(const unsigned char *src, long n)
+{
+	long len = n + 2;
+	const unsigned char *e = src + n;
+	while(src < e){
+		if(*src == ODOT_SLIP_END || *src == ODOT_SLIP_ESC){
+			len++;
+		}
+		src++;
+	}
+	return len;
+}
+
+// encode n bytes of src into dst, which must have room for odot_slip_encodedLen(src, n) bytes.
+// returns the number of bytes written
+static long odot_slip_encode(unsigned char *dst, const unsigned char *src, long n)
+{
+	unsigned char *d = dst;
+	const unsigned char *e = src + n;
+	*d++ = ODOT_SLIP_END;
+	while(src < e){
+		const unsigned char *run = src;
+		src = odot_slip_scan(src, e);
+		if(src > run){
+			memcpy(d, run, src - run);
+			d += src - run;
+		}
+		if(src == e){
+			break;
+		}
+		*d++ = ODOT_SLIP_ESC;
+		*d++ = *src++ == ODOT_SLIP_END ? ODOT_SLIP_ESC_END : ODOT_SLIP_ESC_ESC;
+	}
+	*d++ = ODOT_SLIP_END;
+	return d - dst;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ODOT_SLIP_H__
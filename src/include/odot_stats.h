@@ -0,0 +1,480 @@
+#ifndef __ODOT_STATS_H__
+#define __ODOT_STATS_H__
+
+/*
+  Opt-in instrumentation of the FullPacket hot path.
+
+  OMAX_UTIL_GET_LEN_AND_PTR opens a frame for the instance it's called
+  in, which is closed automatically when the method returns, and
+  omax_util_outletOSC, osc_mem_alloc and osc_mem_resize charge the
+  innermost open frame.  For every instance that has been sent a packet
+  we count calls, bytes in, packets and bytes out and allocations, and
+  keep the inclusive time and the exclusive time (less the time spent in
+  odot objects further down the chain) as totals and as histograms with
+  power-of-two buckets.  Allocations libo makes on our behalf aren't
+  seen.
+
+  Nothing is recorded until an o.stats object turns it on, and while
+  it's off opening a frame costs a load and a branch.  The table is
+  shared by every external in the process through the s_thing of a
+  symbol, and the chain of open frames is kept per thread, so time spent
+  in a downstream object is taken out of its caller's exclusive time
+  even when they live in different externals.
+
+  Entries are keyed on the instance and its source file.  Looking one up
+  doesn't lock, so opening a frame on the audio thread never waits on
+  another thread; the lock is only taken to add an instance the first
+  time it's seen, and to remove one.  Objects call odot_stats_forget()
+  from their free method, so that a new object at the same address
+  starts from zero.  Removed entries are kept on a free list rather than
+  freed, and tables that have been outgrown are kept too, since another
+  thread may still be looking at them.  Instance pointers are only ever
+  used as keys.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "osc_mem.h"
+
+#if defined(__APPLE__)
+#include <mach/mach_time.h>
+#include <pthread.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#include <pthread.h>
+#endif
+
+#define ODOT_STATS_VERSION 2
+
+// an object's source file, even in code from a header it includes, so
+// that odot_pool.h's counters and ours call it the same thing
+#ifdef __BASE_FILE__
+#define ODOT_STATS_FILE __BASE_FILE__
+#else
+#define ODOT_STATS_FILE __FILE__
+#endif
+#define ODOT_STATS_SYMBOL "#odot.stats"
+// bucket i counts times of at least 2^i and less than 2^(i+1) ns
+#define ODOT_STATS_NBUCKETS 32
+
+typedef struct _odot_stats_entry{
+	void *x;
+	const char *file; // the object's source file, which gives us its name
+	long id;
+	struct _odot_stats_entry *next; // on the free list
+	uint64_t calls, bytes_in, packets_out, bytes_out, allocs;
+	uint64_t inclusive, exclusive; // ns
+	uint64_t inclusive_hist[ODOT_STATS_NBUCKETS];
+	uint64_t exclusive_hist[ODOT_STATS_NBUCKETS];
+} t_odot_stats_entry;
+
+typedef struct _odot_stats_frame{
+	t_odot_stats_entry *entry; // NULL if stats were off when the frame was opened
+	struct _odot_stats_frame *parent;
+	uint64_t start, children;
+} t_odot_stats_frame;
+
+// open addressing hash table of entries, keyed on the instance
+typedef struct _odot_stats_table{
+	long size;
+	struct _odot_stats_table *prev; // outgrown, but maybe still being read
+	t_odot_stats_entry *slots[1];
+} t_odot_stats_table;
+
+// a slot whose entry has been removed
+#define ODOT_STATS_TOMBSTONE ((t_odot_stats_entry *)1)
+
+typedef struct _odot_stats{
+	long version;
+	volatile long enabled;
+	volatile long lock;
+	long nextid;
+	t_odot_stats_table *tab;
+	long n;		// slots in use, including removed ones
+	long live;	// entries in the table
+	t_odot_stats_entry *free;
+#ifdef _WIN32
+	DWORD key;
+#else
+	pthread_key_t key;
+#endif
+} t_odot_stats;
+
+static t_odot_stats *odot_stats_get(void)
+{
+	static t_odot_stats *stats;
+	static int failed;
+	if(stats || failed){
+		return stats;
+	}
+	t_symbol *sym = gensym(ODOT_STATS_SYMBOL);
+	t_odot_stats *s = (t_odot_stats *)sym->s_thing;
+	if(!s){
+		s = (t_odot_stats *)osc_mem_alloc(sizeof(t_odot_stats));
+		if(!s){
+			failed = 1;
+			return NULL;
+		}
+		memset(s, '\0', sizeof(t_odot_stats));
+		s->version = ODOT_STATS_VERSION;
+#ifdef _WIN32
+		s->key = TlsAlloc();
+		if(s->key == TLS_OUT_OF_INDEXES){
+			osc_mem_free(s);
+			failed = 1;
+			return NULL;
+		}
+#else
+		if(pthread_key_create(&(s->key), NULL)){
+			osc_mem_free(s);
+			failed = 1;
+			return NULL;
+		}
+#endif
+		sym->s_thing = (void *)s;
+	}
+	if(s->version != ODOT_STATS_VERSION){
+		failed = 1;
+		return NULL;
+	}
+	stats = s;
+	return stats;
+}
+
+static uint64_t odot_stats_now(void)
+{
+#if defined(__APPLE__)
+	static mach_timebase_info_data_t tb;
+	if(!tb.denom){
+		mach_timebase_info(&tb);
+	}
+	return mach_absolute_time() * tb.numer / tb.denom;
+#elif defined(_WIN32)
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER c;
+	if(!freq.QuadPart){
+		QueryPerformanceFrequency(&freq);
+	}
+	QueryPerformanceCounter(&c);
+	return (uint64_t)(c.QuadPart / freq.QuadPart) * 1000000000ULL + (uint64_t)(c.QuadPart % freq.QuadPart) * 1000000000ULL / freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static void odot_stats_lock(t_odot_stats *s)
+{
+	while(__atomic_exchange_n(&(s->lock), 1, __ATOMIC_ACQUIRE)){
+		;
+	}
+}
+
+static void odot_stats_unlock(t_odot_stats *s)
+{
+	__atomic_store_n(&(s->lock), 0, __ATOMIC_RELEASE);
+}
+
+static t_odot_stats_frame *odot_stats_getTop(t_odot_stats *s)
+{
+#ifdef _WIN32
+	return (t_odot_stats_frame *)TlsGetValue(s->key);
+#else
+	return (t_odot_stats_frame *)pthread_getspecific(s->key);
+#endif
+}
+
+static void odot_stats_setTop(t_odot_stats *s, t_odot_stats_frame *f)
+{
+#ifdef _WIN32
+	TlsSetValue(s->key, (LPVOID)f);
+#else
+	pthread_setspecific(s->key, (void *)f);
+#endif
+}
+
+static unsigned long odot_stats_hash(void *x, long size)
+{
+	uintptr_t h = (uintptr_t)x;
+	h ^= h >> 17;
+	h *= 0x9e3779b1UL;
+	return (unsigned long)(h ^ (h >> 15)) & (size - 1);
+}
+
+static t_odot_stats_entry *odot_stats_find(t_odot_stats_table *t, void *x, const char *file)
+{
+	if(!t){
+		return NULL;
+	}
+	unsigned long i = odot_stats_hash(x, t->size);
+	t_odot_stats_entry *e;
+	while((e = __atomic_load_n(t->slots + i, __ATOMIC_ACQUIRE))){
+		if(e != ODOT_STATS_TOMBSTONE && e->x == x && e->file == file){
+			return e;
+		}
+		i = (i + 1) & (t->size - 1);
+	}
+	return NULL;
+}
+
+// make room for one more entry.  called with the lock held
+static int odot_stats_grow(t_odot_stats *s)
+{
+	t_odot_stats_table *old = s->tab;
+	if(old && (s->n + 1) * 2 <= old->size){
+		return 0;
+	}
+	long size = old ? old->size : 256;
+	while((s->live + 1) * 2 > size){
+		size *= 2;
+	}
+	t_odot_stats_table *t = (t_odot_stats_table *)osc_mem_alloc(sizeof(t_odot_stats_table) + (size - 1) * sizeof(t_odot_stats_entry *));
+	if(!t){
+		return 1;
+	}
+	memset(t, '\0', sizeof(t_odot_stats_table) + (size - 1) * sizeof(t_odot_stats_entry *));
+	t->size = size;
+	t->prev = old;
+	if(old){
+		long i;
+		for(i = 0; i < old->size; i++){
+			t_odot_stats_entry *e = old->slots[i];
+			if(e && e != ODOT_STATS_TOMBSTONE){
+				unsigned long j = odot_stats_hash(e->x, size);
+				while(t->slots[j]){
+					j = (j + 1) & (size - 1);
+				}
+				t->slots[j] = e;
+			}
+		}
+	}
+	s->n = s->live;
+	__atomic_store_n(&(s->tab), t, __ATOMIC_RELEASE);
+	return 0;
+}
+
+// the entry for x, made if there isn't one yet
+static t_odot_stats_entry *odot_stats_lookup(t_odot_stats *s, void *x, const char *file)
+{
+	t_odot_stats_entry *e = odot_stats_find(__atomic_load_n(&(s->tab), __ATOMIC_ACQUIRE), x, file);
+	if(e){
+		return e;
+	}
+	odot_stats_lock(s);
+	e = odot_stats_find(s->tab, x, file);
+	if(!e && !odot_stats_grow(s)){
+		e = s->free;
+		if(e){
+			s->free = e->next;
+		}else{
+			e = (t_odot_stats_entry *)osc_mem_alloc(sizeof(t_odot_stats_entry));
+		}
+		if(e){
+			memset(e, '\0', sizeof(t_odot_stats_entry));
+			e->x = x;
+			e->file = file;
+			e->id = s->nextid++;
+			unsigned long i = odot_stats_hash(x, s->tab->size);
+			while(s->tab->slots[i]){
+				i = (i + 1) & (s->tab->size - 1);
+			}
+			__atomic_store_n(s->tab->slots + i, e, __ATOMIC_RELEASE);
+			s->n++;
+			s->live++;
+		}
+	}
+	odot_stats_unlock(s);
+	return e;
+}
+
+// drop x's entries, so that an object made at the same address later starts
+// from zero.  called from each object's free method
+static void odot_stats_forget(void *x)
+{
+	t_odot_stats *s = odot_stats_get();
+	if(!s || !s->tab){
+		return;
+	}
+	odot_stats_lock(s);
+	t_odot_stats_table *t = s->tab;
+	unsigned long i = odot_stats_hash(x, t->size);
+	t_odot_stats_entry *e;
+	while((e = t->slots[i])){
+		if(e != ODOT_STATS_TOMBSTONE && e->x == x){
+			__atomic_store_n(t->slots + i, ODOT_STATS_TOMBSTONE, __ATOMIC_RELEASE);
+			e->next = s->free;
+			s->free = e;
+			s->live--;
+		}
+		i = (i + 1) & (t->size - 1);
+	}
+	odot_stats_unlock(s);
+}
+
+static t_odot_stats_frame odot_stats_enter(void *x, const char *file, long len)
+{
+	t_odot_stats_frame f = {NULL, NULL, 0, 0};
+	t_odot_stats *s = odot_stats_get();
+	if(!s || !s->enabled){
+		return f;
+	}
+	f.entry = odot_stats_lookup(s, x, file);
+	if(!f.entry){
+		return f;
+	}
+	__atomic_add_fetch(&(f.entry->calls), 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&(f.entry->bytes_in), len, __ATOMIC_RELAXED);
+	f.parent = odot_stats_getTop(s);
+	f.start = odot_stats_now();
+	return f;
+}
+
+// the frame has to be made the top one once it's in its final place on the stack
+static void odot_stats_push(t_odot_stats_frame *f)
+{
+	if(f->entry){
+		odot_stats_setTop(odot_stats_get(), f);
+	}
+}
+
+static int odot_stats_bucket(uint64_t t)
+{
+	int b = 0;
+	while(t > 1 && b < ODOT_STATS_NBUCKETS - 1){
+		t >>= 1;
+		b++;
+	}
+	return b;
+}
+
+static void odot_stats_exit(t_odot_stats_frame *f)
+{
+	if(!f->entry){
+		return;
+	}
+	uint64_t elapsed = odot_stats_now() - f->start;
+	uint64_t exclusive = elapsed > f->children ? elapsed - f->children : 0;
+	odot_stats_setTop(odot_stats_get(), f->parent);
+	if(f->parent){
+		f->parent->children += elapsed;
+	}
+	t_odot_stats_entry *e = f->entry;
+	__atomic_add_fetch(&(e->inclusive), elapsed, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&(e->exclusive), exclusive, __ATOMIC_RELAXED);
+	__atomic_add_fetch(e->inclusive_hist + odot_stats_bucket(elapsed), 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(e->exclusive_hist + odot_stats_bucket(exclusive), 1, __ATOMIC_RELAXED);
+}
+
+// the entry of the innermost open frame on this thread, if stats are on
+static t_odot_stats_entry *odot_stats_current(void)
+{
+	t_odot_stats *s = odot_stats_get();
+	if(!s || !s->enabled){
+		return NULL;
+	}
+	t_odot_stats_frame *f = odot_stats_getTop(s);
+	return f ? f->entry : NULL;
+}
+
+static void odot_stats_outlet(long len)
+{
+	t_odot_stats_entry *e = odot_stats_current();
+	if(e){
+		__atomic_add_fetch(&(e->packets_out), 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&(e->bytes_out), len, __ATOMIC_RELAXED);
+	}
+}
+
+static void odot_stats_countAlloc(void)
+{
+	t_odot_stats_entry *e = odot_stats_current();
+	if(e){
+		__atomic_add_fetch(&(e->allocs), 1, __ATOMIC_RELAXED);
+	}
+}
+
+static void *odot_stats_alloc(size_t size)
+{
+	odot_stats_countAlloc();
+	return osc_mem_alloc(size);
+}
+
+static void *odot_stats_resize(void *ptr, size_t size)
+{
+	odot_stats_countAlloc();
+	return osc_mem_resize(ptr, size);
+}
+
+static void odot_stats_enable(long onoff)
+{
+	t_odot_stats *s = odot_stats_get();
+	if(s){
+		s->enabled = onoff;
+	}
+}
+
+// zero the counters of every entry
+static void odot_stats_clear(void)
+{
+	t_odot_stats *s = odot_stats_get();
+	if(!s){
+		return;
+	}
+	odot_stats_lock(s);
+	long i;
+	for(i = 0; s->tab && i < s->tab->size; i++){
+		t_odot_stats_entry *e = s->tab->slots[i];
+		if(e && e != ODOT_STATS_TOMBSTONE){
+			memset(&(e->calls), '\0', sizeof(t_odot_stats_entry) - offsetof(t_odot_stats_entry, calls));
+		}
+	}
+	odot_stats_unlock(s);
+}
+
+// the name of an object from its source file
+static void odot_stats_nameFromFile(const char *file, char *buf, long n)
+{
+	const char *p = strrchr(file, '/');
+	const char *q = strrchr(file, '\\');
+	if(q > p){
+		p = q;
+	}
+	p = p ? p + 1 : file;
+	long len = strlen(p);
+	if(len > 2 && !strcmp(p + len - 2, ".c")){
+		len -= 2;
+	}
+	if(len > n - 1){
+		len = n - 1;
+	}
+	memcpy(buf, p, len);
+	buf[len] = '\0';
+}
+
+// the name of the object an entry belongs to
+static void odot_stats_getName(t_odot_stats_entry *e, char *buf, long n)
+{
+	odot_stats_nameFromFile(e->file, buf, n);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define ODOT_STATS_ENTER(x, len)					\
+	t_odot_stats_frame odot_stats_frame __attribute__((cleanup(odot_stats_exit), unused)) = odot_stats_enter((void *)(x), ODOT_STATS_FILE, (len)); \
+	odot_stats_push(&odot_stats_frame);
+#else
+#define ODOT_STATS_ENTER(x, len)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ODOT_STATS_H__
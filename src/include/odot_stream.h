@@ -0,0 +1,170 @@
+#ifndef __ODOT_STREAM_H__
+#define __ODOT_STREAM_H__
+
+/*
+  Packet framing for OSC over stream transports (TCP, Unix domain sockets).
+
+  OSC 1.0 streams prefix each packet with its size as a big-endian int32;
+  OSC 1.1 streams use SLIP.  The decoder keeps its state between calls,
+  so packets can be split across any number of reads, and more than one
+  packet can arrive in a single read.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include "osc.h"
+#include "osc_mem.h"
+#include "odot_slip.h"
+
+#define ODOT_STREAM_DEFAULT_MAXSIZE (1 << 24)
+
+enum{
+	ODOT_STREAM_FRAMING_SLIP = 0,	// OSC 1.1
+	ODOT_STREAM_FRAMING_LENGTH	// OSC 1.0
+};
+
+typedef struct _odot_stream_decoder{
+	int framing;
+	t_odot_slip_decoder slip;
+	unsigned char header[4];
+	long headerlen;
+	unsigned char *buf;
+	long len;	// bytes of the current packet read so far
+	long need;	// size of the current packet, once the header is complete
+	long size;
+	long maxsize;
+	long errors;
+} t_odot_stream_decoder;
+
+static void odot_stream_decoder_init(t_odot_stream_decoder *d, int framing, long maxsize)
+{
+	memset(d, '\0', sizeof(t_odot_stream_decoder));
+	d->framing = framing;
+	d->maxsize = maxsize > 0 ? maxsize : ODOT_STREAM_DEFAULT_MAXSIZE;
+	odot_slip_decoder_init(&(d->slip), d->maxsize);
+}
+
+static void odot_stream_decoder_free(t_odot_stream_decoder *d)
+{
+	odot_slip_decoder_free(&(d->slip));
+	if(d->buf){
+		osc_mem_free(d->buf);
+		d->buf = NULL;
+	}
+	d->size = d->len = d->need = d->headerlen = 0;
+}
+
+static long odot_stream_decoder_errors(t_odot_stream_decoder *d)
+{
+	return d->errors + d->slip.errors;
+}
+
+/*
+  Consume bytes from in until either a packet is complete or the input
+  runs out, and return the number of bytes consumed.  If a packet was
+  completed, *packetlen and *packet are set, and the packet stays valid
+  until the next call; otherwise *packetlen is 0.  Call this in a loop
+  until all n bytes have been consumed.
+
+  A length-prefixed stream has no way to resynchronize, so a bad size
+  puts the decoder into a state where it throws everything away.  The
+  caller should drop the connection when odot_stream_decoder_broken()
+  returns true.
+*/
+static long odot_stream_decode(t_odot_stream_decoder *d, const unsigned char *in, long n, long *packetlen, char **packet)
+{
+	*packetlen = 0;
+	if(d->framing == ODOT_STREAM_FRAMING_SLIP){
+		long c = odot_slip_decode(&(d->slip), in, n, packetlen);
+		*packet = (char *)d->slip.buf;
+		return c;
+	}
+	const unsigned char *p = in, *e = in + n;
+	while(p < e){
+		if(d->need < 0){
+			// broken
+			return n;
+		}
+		if(d->headerlen < 4){
+			long c = 4 - d->headerlen;
+			if(c > e - p){
+				c = e - p;
+			}
+			memcpy(d->header + d->headerlen, p, c);
+			d->headerlen += c;
+			p += c;
+			if(d->headerlen < 4){
+				break;
+			}
+			uint32_t size = ((uint32_t)d->header[0] << 24) | ((uint32_t)d->header[1] << 16) | ((uint32_t)d->header[2] << 8) | (uint32_t)d->header[3];
+			if(size == 0 || size % 4 || size > (uint32_t)d->maxsize){
+				d->errors++;
+				d->need = -1;
+				return n;
+			}
+			d->need = size;
+			d->len = 0;
+			if(d->need > d->size){
+				unsigned char *tmp = (unsigned char *)osc_mem_resize(d->buf, d->need);
+				if(!tmp){
+					d->errors++;
+					d->need = -1;
+					return n;
+				}
+				d->buf = tmp;
+				d->size = d->need;
+			}
+		}
+		long c = d->need - d->len;
+		if(c > e - p){
+			c = e - p;
+		}
+		memcpy(d->buf + d->len, p, c);
+		d->len += c;
+		p += c;
+		if(d->len == d->need){
+			d->headerlen = 0;
+			*packetlen = d->len;
+			*packet = (char *)d->buf;
+			return p - in;
+		}
+	}
+	return p - in;
+}
+
+static int odot_stream_decoder_broken(t_odot_stream_decoder *d)
+{
+	return d->need < 0;
+}
+
+// the number of bytes a packet of n bytes takes up once framed
+static long odot_stream_encodedLen(int framing, const char *packet, long n)
+{
+	if(framing == ODOT_STREAM_FRAMING_SLIP){
+		return odot_slip_encodedLen((const unsigned char *)packet, n);
+	}
+	return n + 4;
+}
+
+// frame a packet into dst, which must have room for odot_stream_encodedLen() bytes.
+// returns the number of bytes written
+static long odot_stream_encode(int framing, char *dst, const char *packet, long n)
+{
+	if(framing == ODOT_STREAM_FRAMING_SLIP){
+		return odot_slip_encode((unsigned char *)dst, (const unsigned char *)packet, n);
+	}
+	uint32_t size = hton32((uint32_t)n);
+	memcpy(dst, &size, 4);
+	memcpy(dst + 4, packet, n);
+	return n + 4;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ODOT_STREAM_H__
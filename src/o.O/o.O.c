@@ -189,6 +189,7 @@ void oO_assist(t_oO *x, void *b, long io, long num, char *buf)
 
 void oO_free(t_oO *x)
 {
+	odot_stats_forget(x);
 	critical_free(x->lock);
 }
 
@@ -229,6 +229,7 @@ void obundle_assist(t_obundle *x, void *b, long io, long num, char *buf)
 
 void obundle_free(t_obundle *x)
 {
+	odot_stats_forget(x);
 }
 
 #ifdef OMAX_PD_VERSION
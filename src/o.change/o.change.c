@@ -56,13 +56,13 @@
 #include "omax_dict.h"
 
 #include "o.h"
+#include "odot_packet.h"
 
 typedef struct _ochange{
 	t_object ob;
 	void *outlet_different;
 	void *outlet_same;
-	int buflen, bufsize;
-	char *buf;
+	t_odot_packet *last;
 	t_critical lock;
 #ifdef OMAX_PD_VERSION
 	void **proxy;
@@ -85,64 +85,64 @@ int ochange_copybundle(t_ochange *x, long len, char *ptr);
 void ochange_fullPacket(t_ochange *x, t_symbol *msg, int argc, t_atom *argv)
 {
 	OMAX_UTIL_GET_LEN_AND_PTR
-	critical_enter(x->lock);
-	long buflen = x->buflen;
 	if(proxy_getinlet((t_object *)x) == 1){
-		critical_exit(x->lock);
 		ochange_copybundle(x, len, ptr);
 		return;
 	}
-	if(!x->buf || buflen == 0){
+	critical_enter(x->lock);
+	if(!x->last){
 		critical_exit(x->lock);
 		ochange_copybundle(x, len, ptr);
 		omax_util_outletOSC(x->outlet_different, len, ptr);
 		return;
 	}
-	char buf[buflen];
-	memcpy(buf, x->buf, x->buflen);
+	t_odot_packet *last = odot_packet_retain(x->last);
 	critical_exit(x->lock);
-	if(buflen == len && *buf == *ptr){
+	long buflen = odot_packet_getLen(last);
+	char *buf = odot_packet_getPtr(last);
+	int same = 0;
+	if(buf == ptr){
+		// the same packet again, e.g. from an o.message that was banged
+		same = 1;
+	}else if(buflen == len && *buf == *ptr){
 		if(*buf == '#' && *ptr == '#'){
-			if(!memcmp(buf + OSC_HEADER_SIZE, ptr + OSC_HEADER_SIZE, buflen - OSC_HEADER_SIZE)){
-				omax_util_outletOSC(x->outlet_same, len, ptr);
-				return;
-			}
+			same = !memcmp(buf + OSC_HEADER_SIZE, ptr + OSC_HEADER_SIZE, buflen - OSC_HEADER_SIZE);
 		}else{// if(*buf == '/' && *ptr == '/'){
-			if(!memcmp(buf, ptr, buflen)){
-				omax_util_outletOSC(x->outlet_same, len, ptr);
-				return;
-			}
+			same = !memcmp(buf, ptr, buflen);
 		}
 	}
+	odot_packet_release(last);
+	if(same){
+		omax_util_outletOSC(x->outlet_same, len, ptr);
+		return;
+	}
 	ochange_copybundle(x, len, ptr);
 	omax_util_outletOSC(x->outlet_different, len, ptr);
 }
 
+// keep the packet for the next comparison.  if it belongs to a packet
+// handle, that is retained rather than copied
 int ochange_copybundle(t_ochange *x, long len, char *ptr){
-	char *buf = (char *)osc_mem_alloc(len);
-	if(buf){
-		memcpy(buf, (char *)ptr, len);
-		critical_enter(x->lock);
-		char *oldbuf = x->buf;
-		x->buf = buf;
-		x->bufsize = len;
-		x->buflen = len;
-		critical_exit(x->lock);
-		if(oldbuf){
-			osc_mem_free(oldbuf);
-		}
-	}else{
+	t_odot_packet *p = odot_packet_retainOrCopy(len, ptr);
+	if(!p){
 		object_error((t_object *)x, "out of memory!");
 		return 1;
 	}
+	critical_enter(x->lock);
+	t_odot_packet *old = x->last;
+	x->last = p;
+	critical_exit(x->lock);
+	odot_packet_release(old);
 	return 0;
 }
 
 void ochange_clear(t_ochange *x)
 {
 	critical_enter(x->lock);
-	x->buflen = 0;
+	t_odot_packet *old = x->last;
+	x->last = NULL;
 	critical_exit(x->lock);
+	odot_packet_release(old);
 }
 
 void ochange_anything(t_ochange *x, t_symbol *msg, int argc, t_atom *argv)
@@ -170,10 +170,9 @@ void ochange_doc(t_ochange *x)
 
 void ochange_free(t_ochange *x)
 {
+	odot_stats_forget(x);
 	critical_free(x->lock);
-	if(x->buf){
-		osc_mem_free(x->buf);
-	}
+	odot_packet_release(x->last);
 #ifdef OMAX_PD_VERSION
     pd_free(x->proxy[0]);
     pd_free(x->proxy[1]);
@@ -199,8 +198,7 @@ void *ochange_new(t_symbol *msg, short argc, t_atom *argv)
 		x->outlet_same = outlet_new((t_object *)x, gensym("FullPacket"));
         
 		critical_new(&(x->lock));
-		x->buf = NULL;
-		x->bufsize = x->buflen = 0;
+		x->last = NULL;
 	}
     
 	return(x);
@@ -208,6 +206,7 @@ void *ochange_new(t_symbol *msg, short argc, t_atom *argv)
 
 int setup_o0x2echange(void)
 {
+    odot_packet_init();
     omax_pd_class_new(ochange_class, gensym("o.change"), (t_newmethod)ochange_new, (t_method)ochange_free, sizeof(t_ochange), CLASS_NOINLET, A_GIMME, 0);
     
     t_omax_pd_proxy_class *c = NULL;
@@ -235,8 +234,7 @@ void *ochange_new(t_symbol *msg, short argc, t_atom *argv)
 		x->outlet_different = outlet_new((t_object *)x, "FullPacket");
 		x->proxy = proxy_new((t_object *)x, 1, &(x->inlet));
 		critical_new(&(x->lock));
-		x->buf = NULL;
-		x->bufsize = x->buflen = 0;
+		x->last = NULL;
 	}
 		   	
 	return(x);
@@ -244,6 +242,7 @@ void *ochange_new(t_symbol *msg, short argc, t_atom *argv)
 
 int main(void)
 {
+	odot_packet_init();
 	t_class *c = class_new("o.change", (method)ochange_new, (method)ochange_free, sizeof(t_ochange), 0L, A_GIMME, 0);
 	//class_addmethod(c, (method)ochange_fullPacket, "FullPacket", A_LONG, A_LONG, 0);
 	class_addmethod(c, (method)ochange_fullPacket, "FullPacket", A_GIMME, 0);
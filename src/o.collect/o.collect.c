@@ -59,6 +59,7 @@ VERSION 0.0: First try
 #include "omax_doc.h"
 
 #include "o.h"
+#include "odot_scratch.h"
 
 typedef struct _ocoll{
 	t_object ob;
@@ -150,9 +151,16 @@ void ocoll_anything(t_ocoll *x, t_symbol *msg, int argc, t_atom *argv)
 }
 
 void ocoll_bang(t_ocoll *x){
+    t_odot_scratch_mark mark = odot_scratch_mark();
     critical_enter(x->lock);
     int len = x->buffer_pos;
-    char outbuf[len];
+    char *outbuf = (char *)odot_scratch_alloc(len);
+    if(!outbuf){
+        critical_exit(x->lock);
+        odot_scratch_release(mark);
+        object_error((t_object *)x, "out of memory");
+        return;
+    }
     memcpy(outbuf, x->buffer, len);
     memset(x->buffer + OSC_HEADER_SIZE, '\0', len - OSC_HEADER_SIZE);
     x->buffer_pos = OSC_HEADER_SIZE;
@@ -160,6 +168,7 @@ void ocoll_bang(t_ocoll *x){
     omax_util_outletOSC(x->outlet, len, outbuf);
     // invalidate outbuf:
     OSC_MEM_INVALIDATE(outbuf);
+    odot_scratch_release(mark);
 }
 
 
@@ -186,12 +195,14 @@ void ocoll_doc(t_ocoll *x)
 }
 
 void ocoll_free(t_ocoll *x){
+	odot_stats_forget(x);
 	if(x->buffer){
 		free(x->buffer);
 	}
 	critical_free(x->lock);
     
     //need to free proxy?
+	odot_scratch_trim();
 }
 
 
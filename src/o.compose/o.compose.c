@@ -86,6 +86,8 @@
 //#include <mach/mach_time.h>
 
 #include "o.h"
+#include "odot_packet.h"
+#include "odot_redraw.h"
 
 #ifdef OMAX_PD_VERSION
 #include "opd_textbox.h"
@@ -119,7 +121,7 @@ typedef struct _ocompose {
     //new version
     int newbndl;
     t_osc_bndl_u *bndl_u;
-    t_osc_bndl_s *bndl_s;
+    t_odot_packet *bndl_s;
     int bndl_has_subs;
     int bndl_has_been_checked_for_subs;
 
@@ -128,6 +130,7 @@ typedef struct _ocompose {
     int have_new_data;
     int draw_new_data_indicator;
     t_clock *new_data_indicator_clock;
+    t_odot_redraw redraw;
     
     //char* stored_bundle_data;
     //long stored_bundle_length;
@@ -149,7 +152,7 @@ typedef struct _ocompose{
     t_critical lock;
     int newbndl;
     t_osc_bndl_u *bndl_u;
-    t_osc_bndl_s *bndl_s;
+    t_odot_packet *bndl_s;
     int bndl_has_subs;
     int bndl_has_been_checked_for_subs;
     long textlen;
@@ -161,6 +164,7 @@ typedef struct _ocompose{
     int have_new_data;
     int draw_new_data_indicator;
     void *new_data_indicator_clock;
+    t_odot_redraw redraw;
     
 	//char* stored_bundle_data;
 	//char* stored_bundle_data;
@@ -186,8 +190,10 @@ void ocompose_enter(t_ocompose *x);
 void ocompose_gettext(t_ocompose *x);
 void ocompose_clear(t_ocompose *x);
 void ocompose_clearBundles(t_ocompose *x);
-void ocompose_newBundle(t_ocompose *x, t_osc_bndl_u *bu, t_osc_bndl_s *bs);
+void ocompose_newBundle(t_ocompose *x, t_osc_bndl_u *bu, t_odot_packet *bs);
 void ocompose_output_bundle(t_ocompose *x);
+void ocompose_scheduleRedraw(t_ocompose *x);
+void ocompose_redrawTick(t_ocompose *x);
 void ocompose_bang(t_ocompose *x);
 void ocompose_int(t_ocompose *x, long n);
 void ocompose_float(t_ocompose *x, double xx);
@@ -245,11 +251,43 @@ void ocompose_fullPacket2(t_ocompose *x, t_symbol *msg, int argc, t_atom *argv)
 void ocompose_doFullPacket(t_ocompose *x, long len, char *ptr)
 {
     osc_bundle_s_wrap_naked_message(len, ptr);
-    long copylen = len;
-    char *copyptr = osc_mem_alloc(len);
-    memcpy(copyptr, ptr, len);
-    t_osc_bndl_s *b = osc_bundle_s_alloc(copylen, copyptr);
-    ocompose_newBundle(x, NULL, b);
+    // if we've been sent the bundle we already have, keep our packet
+    // and its text
+    critical_enter(x->lock);
+    int same = x->bndl_s && odot_packet_equals(x->bndl_s, len, ptr);
+    critical_exit(x->lock);
+    if(same){
+        critical_enter(x->lock);
+        x->draw_new_data_indicator = 1;
+        x->have_new_data = 1;
+        critical_exit(x->lock);
+    }else{
+        // keep the sender's packet if it has one, rather than a copy
+        t_odot_packet *b = odot_packet_retainOrCopy(len, ptr);
+        if(!b){
+            object_error((t_object *)x, "out of memory");
+            return;
+        }
+        ocompose_newBundle(x, NULL, b);
+    }
+    ocompose_scheduleRedraw(x);
+}
+
+// redraw no more often than the display can show it
+void ocompose_scheduleRedraw(t_ocompose *x)
+{
+    if(odot_redraw_request(&(x->redraw))){
+#ifdef OMAX_PD_VERSION
+        jbox_redraw((t_jbox *)x);
+#else
+        qelem_set(x->qelem);
+#endif
+    }
+}
+
+void ocompose_redrawTick(t_ocompose *x)
+{
+    odot_redraw_fired(&(x->redraw));
 #ifdef OMAX_PD_VERSION
     jbox_redraw((t_jbox *)x);
 #else
@@ -257,7 +295,7 @@ void ocompose_doFullPacket(t_ocompose *x, long len, char *ptr)
 #endif
 }
 
-void ocompose_newBundle(t_ocompose *x, t_osc_bndl_u *bu, t_osc_bndl_s *bs)
+void ocompose_newBundle(t_ocompose *x, t_osc_bndl_u *bu, t_odot_packet *bs)
 {
     critical_enter(x->lock);
         ocompose_clearBundles(x);
@@ -293,7 +331,7 @@ void ocompose_clearBundles(t_ocompose *x)
         x->bndl_u = NULL;
     }
     if(x->bndl_s){
-        osc_bundle_s_deepFree(x->bndl_s);
+        odot_packet_release(x->bndl_s);
         x->bndl_s = NULL;
     }
     
@@ -312,14 +350,12 @@ void ocompose_output_bundle(t_ocompose *x)
 {
     critical_enter(x->lock);                                /// lock
     if(x->bndl_s){
-        t_osc_bndl_s *b = x->bndl_s;
-        long len = osc_bundle_s_getLen(b);
-        char *ptr = osc_bundle_s_getPtr(b);
-        char buf[len];
-        memcpy(buf, ptr, len);
+        // a reference, not a copy, keeps the packet alive while it's
+        // downstream even if a new one comes in
+        t_odot_packet *b = odot_packet_retain(x->bndl_s);
         critical_exit(x->lock);                             /// unlock
-        omax_util_outletOSC(x->outlet, len, buf);
-        //OSC_MEM_INVALIDATE(buf);
+        odot_packet_outlet(x->outlet, b);
+        odot_packet_release(b);
         return;                                             /// ( return )
     }
     critical_exit(x->lock);                                 /// unlock ( if the above code block is skipped )
@@ -331,39 +367,53 @@ void ocompose_output_bundle(t_ocompose *x)
     //OSC_MEM_INVALIDATE(buf);
 }
 
-void ocompose_bundle2text(t_ocompose *x)
+// the packet as text, if it's changed since the text was last made,
+// otherwise NULL
+static char *ocompose_formatBundle(t_ocompose *x, long *textlen)
 {
-    if(x->newbndl && x->bndl_s){
-        critical_enter(x->lock);                            /// 1st lock in the if block
-        long len = osc_bundle_s_getLen(x->bndl_s);
-        char ptr[len];
-        memcpy(ptr, osc_bundle_s_getPtr(x->bndl_s), len);
-        critical_exit(x->lock);                             /// unlock in the if block
-        
-        long bufpos = osc_bundle_s_nformat(NULL, 0, len, (char *)ptr, 0);
-        char *buf = osc_mem_alloc(bufpos + 1);
+    critical_enter(x->lock);
+    if(!x->newbndl || !x->bndl_s){
+        critical_exit(x->lock);
+        return NULL;
+    }
+    t_odot_packet *b = odot_packet_retain(x->bndl_s);
+    x->newbndl = 0;
+    critical_exit(x->lock);
+    long len = odot_packet_getLen(b);
+    char *ptr = odot_packet_getPtr(b);
+    long bufpos = osc_bundle_s_nformat(NULL, 0, len, (char *)ptr, 0);
+    char *buf = osc_mem_alloc(bufpos + 1);
+    if(buf){
         osc_bundle_s_nformat(buf, bufpos + 1, len, (char *)ptr, 0);
         if (bufpos == 0) {
             *buf = '\0';
         }
-        
+    }
+    odot_packet_release(b);
+    *textlen = bufpos;
+    return buf;
+}
+
+void ocompose_bundle2text(t_ocompose *x)
+{
+    long bufpos = 0;
+    char *buf = ocompose_formatBundle(x, &bufpos);
+    if(!buf){
+        return;
+    }
 #ifndef OMAX_PD_VERSION
-        critical_enter(x->lock);                            /// 2nd lock ( after unlock ) in the max version
-        
-        if(x->text){
-            osc_mem_free(x->text);
-        }
-        
-        x->textlen = bufpos;
-        x->text = buf;
-        critical_exit(x->lock);                             /// 2nd unlock in the max version
-        object_method(jbox_get_textfield((t_object *)x), gensym("settext"), buf);
+    critical_enter(x->lock);
+    if(x->text){
+        osc_mem_free(x->text);
+    }
+    x->textlen = bufpos;
+    x->text = buf;
+    critical_exit(x->lock);
+    object_method(jbox_get_textfield((t_object *)x), gensym("settext"), buf);
 #else
-        opd_textbox_resetText(x->textbox, buf);
+    opd_textbox_resetText(x->textbox, buf);
+    osc_mem_free(buf);
 #endif
-        x->newbndl = 0;
-    }else{
-    }
 }
 
 #ifndef OMAX_PD_VERSION
@@ -511,9 +561,14 @@ void ocompose_mouseup(t_ocompose *x, t_object *patcherview, t_pt pt, long modifi
 void ocompose_jsave(t_ocompose *x, t_dictionary *d)
 {
     //post( "jsave ACTIVATE!!!" );
-    t_osc_bundle_s* bundle = x->bndl_s;
-    long len = osc_bundle_s_getLen(bundle);
-    char *ptr = osc_bundle_s_getPtr(bundle);
+    critical_enter(x->lock);
+    t_odot_packet *bundle = x->bndl_s ? odot_packet_retain(x->bndl_s) : NULL;
+    critical_exit(x->lock);
+    if(!bundle){
+        return;
+    }
+    long len = odot_packet_getLen(bundle);
+    char *ptr = odot_packet_getPtr(bundle);
     
     t_atom *av = (t_atom *)sysmem_newptr(len * sizeof( t_atom ) );
     dictionary_appendlong(d, gensym("saved_bundle_length"), len);
@@ -521,6 +576,7 @@ void ocompose_jsave(t_ocompose *x, t_dictionary *d)
         atom_setlong(av+i, ptr[i]);
     }
     dictionary_appendatoms(d, gensym("saved_bundle_data"), len, av);
+    odot_packet_release(bundle);
 }
 #endif
 
@@ -582,8 +638,8 @@ void ocompose_gettext(t_ocompose *x)
 #endif
     }
     t_osc_bndl_s *bs = osc_bundle_u_serialize(bndl_u);
-    t_osc_bndl_s *bndl_s = NULL;
-    osc_bundle_s_deepCopy(&bndl_s, bs);
+    t_odot_packet *bndl_s = odot_packet_copy(osc_bundle_s_getLen(bs), osc_bundle_s_getPtr(bs));
+    osc_bundle_s_deepFree(bs);
     ocompose_newBundle(x, bndl_u, bndl_s);
 #ifdef OMAX_PD_VERSION
     x->have_new_data = 1;
@@ -648,7 +704,8 @@ void ocompose_anything(t_ocompose *x, t_symbol *msg, short argc, t_atom *argv)
             t_osc_bndl_u *b = osc_bundle_u_alloc();
             osc_bundle_u_addMsg(b, m);
             t_osc_bndl_s *bs = osc_bundle_u_serialize(b);
-            ocompose_newBundle(x, b, bs);
+            ocompose_newBundle(x, b, odot_packet_copy(osc_bundle_s_getLen(bs), osc_bundle_s_getPtr(bs)));
+            osc_bundle_s_deepFree(bs);
         }
         break;
     }
@@ -656,11 +713,7 @@ void ocompose_anything(t_ocompose *x, t_symbol *msg, short argc, t_atom *argv)
     x->draw_new_data_indicator = 1;
     x->have_new_data = 1;
     critical_exit(x->lock);
-#ifdef OMAX_PD_VERSION
-    jbox_redraw((t_jbox *)x);
-#else
-    qelem_set(x->qelem);
-#endif
+    ocompose_scheduleRedraw(x);
 }
 
 void ocompose_set(t_ocompose *x, t_symbol *s, long ac, t_atom *av)
@@ -738,12 +791,12 @@ void ocompose_drawElements(t_object *ob, int firsttime)
     have_new_data = x->have_new_data;
     draw_new_data_indicator = x->draw_new_data_indicator;
     critical_exit(x->lock);
-    if(have_new_data){
+    // nobody can see the text of a box that isn't showing, so don't make
+    // it until it is.  ocompose_save() catches up if it has to
+    if(have_new_data && glist_isvisible(t->glist) && glist_getcanvas(t->glist)->gl_editor){
         ocompose_bundle2text(x);
     }
     
-   // ocompose_bundle2text(x);
-    
     int x1, y1, x2, y2;
     ocompose_getrect((t_gobj *)x, t->glist, &x1, &y1, &x2, &y2);
     int cx2 = x2 - t->margin_r;
@@ -940,6 +993,14 @@ static void ocompose_save(t_gobj *z, t_binbuf *b)
     t_opd_textbox *t = x->textbox;
     //post("%x %s", x, __func__);
     
+    // the text may not have been made yet if the box is hidden
+    long textlen = 0;
+    char *text = ocompose_formatBundle(x, &textlen);
+    if(text){
+        opd_textbox_setTextFromString(t, text);
+        osc_mem_free(text);
+    }
+    
     opd_textbox_setHexFromText(t, t->text);
     
     binbuf_addv(b, "ssiisiis", gensym("#X"),gensym("obj"),(t_int)x->ob.te_xpix, (t_int)x->ob.te_ypix, gensym("o.compose"), t->width, t->height, gensym("binhex"));
@@ -975,11 +1036,13 @@ static void ocompose_save(t_gobj *z, t_binbuf *b)
 
 void ocompose_free(t_ocompose *x)
 {
+    odot_stats_forget(x);
     free(x->border_tag);
     free(x->corner_tag);
     
     clock_free(x->m_clock);
     clock_free(x->new_data_indicator_clock);
+    odot_redraw_free(&(x->redraw));
     
     critical_free(x->lock);
     /*
@@ -1048,6 +1111,7 @@ void *ocompose_new(t_symbol *msg, short argc, t_atom *argv)
         x->m_clock = clock_new(x, (t_method)ocompose_tick);
         
         x->new_data_indicator_clock = clock_new(x, (t_method)ocompose_refresh);
+        odot_redraw_init(&(x->redraw), clock_new(x, (t_method)ocompose_redrawTick), ODOT_REDRAW_INTERVAL);
         x->have_new_data = 1;
         x->draw_new_data_indicator = 0;
         
@@ -1086,6 +1150,8 @@ void *ocompose_new(t_symbol *msg, short argc, t_atom *argv)
 
 void setup_o0x2ecompose(void) {
     
+    odot_packet_init();
+    
     t_class *c = class_new(gensym("o.compose"), (t_newmethod)ocompose_new, (t_method)ocompose_free, sizeof(t_ocompose),  0L, A_GIMME, 0);
 
     
@@ -1129,8 +1195,10 @@ void setup_o0x2ecompose(void) {
 
 void ocompose_free(t_ocompose *x)
 {
+    odot_stats_forget(x);
     qelem_free(x->qelem);
     object_free(x->new_data_indicator_clock);
+    odot_redraw_free(&(x->redraw));
     
     if(x->proxy){
         object_free(x->proxy);
@@ -1197,6 +1265,7 @@ void *ocompose_new(t_symbol *msg, short argc, t_atom *argv){
         critical_new(&(x->lock));
         x->qelem = qelem_new((t_object *)x, (method)ocompose_refresh);
         x->new_data_indicator_clock = clock_new((t_object *)x, (method)ocompose_refresh);
+        odot_redraw_init(&(x->redraw), clock_new((t_object *)x, (method)ocompose_redrawTick), ODOT_REDRAW_INTERVAL);
         x->mouse_down = 0;
         x->have_new_data = 1;
         x->draw_new_data_indicator = 0;
@@ -1219,12 +1288,14 @@ void *ocompose_new(t_symbol *msg, short argc, t_atom *argv){
         t_atom *av = NULL;
         dictionary_getatoms( d, gensym( "saved_bundle_data" ), &ac, &av );
         if ( ac != 0 ) {
-            char* saved_bundle = osc_mem_alloc( ac );
-            for ( long i = 0; i < ac; ++i ) {
-                saved_bundle[ i ] = (char *)atom_getlong( &av[ i ] );
+            x->bndl_s = odot_packet_alloc( ac );
+            if ( x->bndl_s ) {
+                char* saved_bundle = odot_packet_getPtr( x->bndl_s );
+                for ( long i = 0; i < ac; ++i ) {
+                    saved_bundle[ i ] = (char)atom_getlong( &av[ i ] );
+                }
+                //post( "bundle : %s", saved_bundle );
             }
-            //post( "bundle : %s", saved_bundle );
-            x->bndl_s = osc_bundle_s_alloc( ac, saved_bundle );
         } else {
             //post( "no dictionary data" );
             ocompose_gettext(x);
@@ -1249,6 +1320,7 @@ CLASS_ATTR_ATTR_PARSE(c,attrname,"category",USESYM(symbol),flags,parsestr)
 int main(void){
 	printf("%s: %d\n", __func__, __LINE__);
     common_symbols_init();
+    odot_packet_init();
     t_class *c = class_new("o.compose", (method)ocompose_new, (method)ocompose_free, sizeof(t_ocompose), 0L, A_GIMME, 0);
     alias("o.c");
     
@@ -338,6 +338,7 @@ void ocontext_doc(t_ocontext *x)
 
 void ocontext_free(t_ocontext *x)
 {
+	odot_stats_forget(x);
 }
 
 
@@ -86,6 +86,7 @@ void odict_assist(t_odict *x, void *b, long io, long num, char *buf)
 
 void odict_free(t_odict *x)
 {
+	odot_stats_forget(x);
 	object_free(x->dict);
 }
 
@@ -33,7 +33,7 @@
 
 #define OMAX_DOC_NAME "o.display"
 #define OMAX_DOC_SHORT_DESC "Display incoming OSC bundles"
-#define OMAX_DOC_LONG_DESC "o.display displays OSC in text form and passes them through to its outlet."
+#define OMAX_DOC_LONG_DESC "o.display displays OSC in text form and passes them through to its outlet.  The display is redrawn at most once every @interval milliseconds, showing the most recent bundle."
 #define OMAX_DOC_INLETS_DESC (char *[]){"An OSC packet is displayed and passed through"}
 #define OMAX_DOC_OUTLETS_DESC (char *[]){"OSC FullPacket"}
 #define OMAX_DOC_SEEALSO (char *[]){"o.compose"}
@@ -74,13 +74,36 @@
 #include "omax_doc.h"
 #include "omax_dict.h"
 
+#include "osc_byteorder.h"
+
 #include "o.h"
+#include "odot_packet.h"
+#include "odot_scratch.h"
+#include "odot_redraw.h"
 
 enum {
 	odisplay_U,
 	odisplay_S,
 };
 
+#define ODISPLAY_DEFAULT_INTERVAL 30.
+
+/*
+Every packet that comes in is copied into buf, which only ever grows, and
+passed straight through; redraws are rate limited to one every @interval
+milliseconds, so a fast stream only costs a copy per packet and gets
+displayed at the frame rate, always showing the latest bundle.
+
+Formatting keeps the serialized bytes and text of each top level message
+from the last frame, and only formats the messages whose bytes changed.
+*/
+typedef struct _odisplay_line{
+	char *mem;	// the message, with its size, followed by its text
+	long memsize;
+	long nbytes;
+	long textlen;
+} t_odisplay_line;
+
 #ifdef OMAX_PD_VERSION
 #include "opd_textbox.h"
 
@@ -99,8 +122,17 @@ typedef struct _odisplay {
     
     //new version
     int newbndl;
-	t_osc_bndl_u *bndl_u;
-	t_osc_bndl_s *bndl_s;
+	t_odot_packet *pkt;	// the current bundle, if it came with a handle
+	char *buf;	// otherwise a copy of it
+	long buflen, bufsize;
+	char *renderbuf;
+	long renderbufsize;
+	char *scratch;
+	long scratchsize;
+	t_odisplay_line *lines;
+	long nlines, linessize;
+	char *text;
+	long textsize;
 	int bndl_has_subs;
 	int bndl_has_been_checked_for_subs;
 
@@ -109,6 +141,8 @@ typedef struct _odisplay {
     int have_new_data;
 	int draw_new_data_indicator;
 	t_clock *new_data_indicator_clock;
+
+	t_odot_redraw redraw;
     
 } t_odisplay;
 
@@ -122,17 +156,26 @@ typedef struct _odisplay{
 	void *outlet;
 	t_critical lock;
 	int newbndl;
-	t_osc_bndl_u *bndl_u;
-	t_osc_bndl_s *bndl_s;
+	t_odot_packet *pkt;	// the current bundle, if it came with a handle
+	char *buf;	// otherwise a copy of it
+	long buflen, bufsize;
+	char *renderbuf;
+	long renderbufsize;
+	char *scratch;
+	long scratchsize;
+	t_odisplay_line *lines;
+	long nlines, linessize;
 //	int bndl_has_subs;
 //	int bndl_has_been_checked_for_subs;
 	long textlen;
 	char *text;
+	long textsize;
 	t_jrgba frame_color, background_color, text_color, flash_color;
 	void *qelem;
 	int have_new_data;
 	int draw_new_data_indicator;
 	void *new_data_indicator_clock;
+	t_odot_redraw redraw;
 } t_odisplay;
 
 static t_class *odisplay_class;
@@ -151,7 +194,8 @@ void odisplay_enter(t_odisplay *x);
 void odisplay_gettext(t_odisplay *x);
 void odisplay_clear(t_odisplay *x);
 void odisplay_clearBundles(t_odisplay *x);
-void odisplay_newBundle(t_odisplay *x, t_osc_bndl_u *bu, t_osc_bndl_s *bs);
+void odisplay_newBundle(t_odisplay *x, long len, char *ptr);
+void odisplay_scheduleRedraw(t_odisplay *x);
 void odisplay_output_bundle(t_odisplay *x);
 void odisplay_bang(t_odisplay *x);
 void odisplay_int(t_odisplay *x, long n);
@@ -190,65 +234,121 @@ void odisplay_fullPacket(t_odisplay *x, t_symbol *msg, int argc, t_atom *argv)
 void odisplay_doFullPacket(t_odisplay *x, long len, char *ptr)
 {
 	osc_bundle_s_wrap_naked_message(len, ptr);
-	long copylen = len;
-	char *copyptr = osc_mem_alloc(len);
-	memcpy(copyptr, ptr, len);
-	t_osc_bndl_s *b = osc_bundle_s_alloc(copylen, copyptr);
-	odisplay_newBundle(x, NULL, b);
-#ifdef OMAX_PD_VERSION
-    jbox_redraw((t_jbox *)x);
-#else
-	qelem_set(x->qelem);
-#endif
+	odisplay_newBundle(x, len, ptr);
+	odisplay_scheduleRedraw(x);
 }
 
-void odisplay_newBundle(t_odisplay *x, t_osc_bndl_u *bu, t_osc_bndl_s *bs)
+// grow *buf to at least n bytes. the contents are kept
+static int odisplay_reserve(char **buf, long *size, long n)
 {
+	if(n <= *size){
+		return 0;
+	}
+	long newsize = *size ? *size : 64;
+	while(newsize < n){
+		newsize *= 2;
+	}
+	char *tmp = (char *)osc_mem_resize(*buf, newsize);
+	if(!tmp){
+		return 1;
+	}
+	*buf = tmp;
+	*size = newsize;
+	return 0;
+}
+
+// the current bundle; call with the lock held
+#define odisplay_getBundlePtr(x) ((x)->pkt ? odot_packet_getPtr((x)->pkt) : (x)->buf)
+
+void odisplay_newBundle(t_odisplay *x, long len, char *ptr)
+{
+	// if the packet belongs to a handle, keep a reference to it instead of a copy
+	t_odot_packet *p = odot_packet_retainPtr(len, ptr);
 	critical_enter(x->lock);
-	odisplay_clearBundles(x);
-	x->bndl_u = bu;
-	x->bndl_s = bs;
+	t_odot_packet *old = x->pkt;
+	x->pkt = p;
+	if(!p){
+		if(odisplay_reserve(&(x->buf), &(x->bufsize), len)){
+			x->buflen = 0;
+			critical_exit(x->lock);
+			odot_packet_release(old);
+			object_error((t_object *)x, "out of memory");
+			return;
+		}
+		memcpy(x->buf, ptr, len);
+	}
+	x->buflen = len;
 	x->newbndl = 1;
 	//x->bndl_has_been_checked_for_subs = 0;
     x->draw_new_data_indicator = 1;
 	x->have_new_data = 1;
 	critical_exit(x->lock);
+	odot_packet_release(old);
 }
 
 void odisplay_clearBundles(t_odisplay *x)
 {
 	critical_enter(x->lock);
-	if(x->bndl_u){
-		osc_bundle_u_free(x->bndl_u);
-		x->bndl_u = NULL;
-	}
-	if(x->bndl_s){
-		osc_bundle_s_deepFree(x->bndl_s);
-		x->bndl_s = NULL;
-	}
-#ifndef OMAX_PD_VERSION
-	if(x->text){
-		x->textlen = 0;
-		osc_mem_free(x->text);
-		x->text = NULL;
-	}
-#endif
+	t_odot_packet *old = x->pkt;
+	x->pkt = NULL;
+	x->buflen = 0;
+	// so that the old text goes too, even if nothing replaces it
+	x->newbndl = 1;
 	critical_exit(x->lock);
+	odot_packet_release(old);
+}
+
+static void odisplay_redraw(t_odisplay *x)
+{
+#ifdef OMAX_PD_VERSION
+	jbox_redraw((t_jbox *)x);
+#else
+	qelem_set(x->qelem);
+#endif
+}
+
+void odisplay_redrawTick(t_odisplay *x)
+{
+	odot_redraw_fired(&(x->redraw));
+	odisplay_redraw(x);
+}
+
+// redraw now if the last redraw was at least @interval ms ago, otherwise
+// once the interval is up.  packets that arrive in between just replace
+// the bundle that will be drawn.
+void odisplay_scheduleRedraw(t_odisplay *x)
+{
+	if(odot_redraw_request(&(x->redraw))){
+		odisplay_redraw(x);
+	}
 }
 
 void odisplay_output_bundle(t_odisplay *x)
 {
 	// the use of critical sections is a little weird here, but correct.
 	critical_enter(x->lock);
-	if(x->bndl_s){
-		t_osc_bndl_s *b = x->bndl_s;
-		long len = osc_bundle_s_getLen(b);
-		char *ptr = osc_bundle_s_getPtr(b);
-		char buf[len];
-		memcpy(buf, ptr, len);
+	if(x->pkt){
+		t_odot_packet *p = odot_packet_retain(x->pkt);
+		critical_exit(x->lock);
+		odot_packet_outlet(x->outlet, p);
+		odot_packet_release(p);
+		return;
+	}
+	if(x->buflen){
+		long len = x->buflen;
+		t_odot_scratch_mark mark = odot_scratch_mark();
+		char *buf = (char *)odot_scratch_alloc(len);
+		if(!buf){
+			critical_exit(x->lock);
+			odot_scratch_release(mark);
+			object_error((t_object *)x, "out of memory");
+			return;
+		}
+		memcpy(buf, x->buf, len);
 		critical_exit(x->lock);
 		omax_util_outletOSC(x->outlet, len, buf);
         OSC_MEM_INVALIDATE(buf);
+		odot_scratch_release(mark);
 		return;
 	}
 	critical_exit(x->lock);
@@ -260,46 +360,134 @@ void odisplay_output_bundle(t_odisplay *x)
     OSC_MEM_INVALIDATE(buf);
 }
 
+// format the bundle in ptr into x->text, reusing the text of every top
+// level message whose bytes are the same as those of the message in the
+// same position last time.  returns the length of the text.
+static long odisplay_format(t_odisplay *x, long len, char *ptr)
+{
+	long nlines = 0;
+	long textlen = 0;
+	char *p = ptr + OSC_HEADER_SIZE;
+	char *e = ptr + len;
+	while(p + 4 <= e){
+		long n = ntoh32(*((uint32_t *)p)) + 4;
+		if(n < 4 || n > e - p){
+			break;
+		}
+		if(nlines == x->linessize){
+			long linessize = x->linessize ? x->linessize * 2 : 16;
+			t_odisplay_line *tmp = (t_odisplay_line *)osc_mem_resize(x->lines, linessize * sizeof(t_odisplay_line));
+			if(!tmp){
+				break;
+			}
+			memset(tmp + x->linessize, '\0', (linessize - x->linessize) * sizeof(t_odisplay_line));
+			x->lines = tmp;
+			x->linessize = linessize;
+		}
+		t_odisplay_line *l = x->lines + nlines;
+		if(l->nbytes != n || memcmp(l->mem, p, n)){
+			// format the message on its own, wrapped in this bundle's header
+			if(odisplay_reserve(&(x->scratch), &(x->scratchsize), OSC_HEADER_SIZE + n)){
+				break;
+			}
+			memcpy(x->scratch, ptr, OSC_HEADER_SIZE);
+			memcpy(x->scratch + OSC_HEADER_SIZE, p, n);
+			long tl = osc_bundle_s_nformat(NULL, 0, OSC_HEADER_SIZE + n, x->scratch, 0);
+			if(odisplay_reserve(&(l->mem), &(l->memsize), n + tl + 1)){
+				l->nbytes = 0;
+				break;
+			}
+			memcpy(l->mem, p, n);
+			osc_bundle_s_nformat(l->mem + n, tl + 1, OSC_HEADER_SIZE + n, x->scratch, 0);
+			l->nbytes = n;
+			l->textlen = tl;
+		}
+		textlen += l->textlen;
+		nlines++;
+		p += n;
+	}
+	// lines past nlines keep their memory and cached text for later frames
+	x->nlines = nlines;
+
+	if(odisplay_reserve(&(x->text), &(x->textsize), textlen + 1)){
+		return 0;
+	}
+	char *t = x->text;
+	long i;
+	for(i = 0; i < nlines; i++){
+		t_odisplay_line *l = x->lines + i;
+		memcpy(t, l->mem + l->nbytes, l->textlen);
+		t += l->textlen;
+	}
+	*t = '\0';
+	return textlen;
+}
+
+static void odisplay_freeText(t_odisplay *x)
+{
+	long i;
+	for(i = 0; i < x->linessize; i++){
+		if(x->lines[i].mem){
+			osc_mem_free(x->lines[i].mem);
+		}
+	}
+	if(x->lines){
+		osc_mem_free(x->lines);
+	}
+	if(x->text){
+		osc_mem_free(x->text);
+	}
+	if(x->scratch){
+		osc_mem_free(x->scratch);
+	}
+	if(x->renderbuf){
+		osc_mem_free(x->renderbuf);
+	}
+	if(x->buf){
+		osc_mem_free(x->buf);
+	}
+	odot_packet_release(x->pkt);
+	x->pkt = NULL;
+	x->lines = NULL;
+	x->nlines = x->linessize = 0;
+	x->text = x->scratch = x->renderbuf = x->buf = NULL;
+	x->textsize = x->scratchsize = x->renderbufsize = x->bufsize = x->buflen = 0;
+}
+
 void odisplay_bundle2text(t_odisplay *x)
 {
     critical_enter(x->lock);
-	if(x->newbndl && x->bndl_s){
-		long len = osc_bundle_s_getLen(x->bndl_s);
-		char ptr[len];
-		memcpy(ptr, osc_bundle_s_getPtr(x->bndl_s), len);
+	if(!x->newbndl){
 		critical_exit(x->lock);
-		long bufpos = osc_bundle_s_nformat(NULL, 0, len, (char *)ptr, 0);
-		char *buf = osc_mem_alloc(bufpos + 1);
-        osc_bundle_s_nformat(buf, bufpos + 1, len, (char *)ptr, 0);
-        if (bufpos != 0) {
-		/*
-            if(buf[bufpos - 2] == '\n'){
-                buf[bufpos - 2] = '\0';
-            }
-		*/
-        } else {
-            *buf = '\0';
-        }
-		
-#ifndef OMAX_PD_VERSION
-		critical_enter(x->lock);
-		if(x->text){
-			osc_mem_free(x->text);
-		}
-		x->textlen = bufpos;
-        x->text = buf;
+		return;
+	}
+	// take a copy so that new packets can keep coming in while we format
+	long len = x->buflen;
+	if(odisplay_reserve(&(x->renderbuf), &(x->renderbufsize), len)){
 		critical_exit(x->lock);
-        object_method(jbox_get_textfield((t_object *)x), gensym("settext"), buf);
-#else
-        opd_textbox_resetText(x->textbox, buf);
-
-#endif
-		if(buf){
-			//osc_mem_free(buf);
-		}
-		x->newbndl = 0;
+		return;
 	}
+	memcpy(x->renderbuf, odisplay_getBundlePtr(x), len);
+	x->newbndl = 0;
 	critical_exit(x->lock);
+
+	long textlen = 0;
+	if(len > OSC_HEADER_SIZE){
+		textlen = odisplay_format(x, len, x->renderbuf);
+	}
+	if(odisplay_reserve(&(x->text), &(x->textsize), 1)){
+		return;
+	}
+	if(textlen == 0){
+		*(x->text) = '\0';
+	}
+#ifndef OMAX_PD_VERSION
+	x->textlen = textlen;
+	object_method(jbox_get_textfield((t_object *)x), gensym("settext"), x->text);
+#else
+	x->textlen = textlen;
+	opd_textbox_resetText(x->textbox, x->text);
+#endif
 }
 
 #ifndef OMAX_PD_VERSION
@@ -408,8 +596,14 @@ void odisplay_gettext(t_odisplay *x)
 	}
 	char *buf = text;
 
+	t_odot_scratch_mark mark = odot_scratch_mark();
 	if(text[size - 1] != '\n'){
-		buf = alloca(size + 2);
+		buf = (char *)odot_scratch_alloc(size + 2);
+		if(!buf){
+			odot_scratch_release(mark);
+			object_error((t_object *)x, "out of memory");
+			return;
+		}
 		memcpy(buf, text, size);
 		buf[size] = '\n';
 		buf[size + 1] = '\0';
@@ -418,17 +612,20 @@ void odisplay_gettext(t_odisplay *x)
 
 	t_osc_bndl_u *bndl_u = NULL;
 	t_osc_err e = osc_parser_parseString(size, buf, &bndl_u);
+	odot_scratch_release(mark);
 	if(e){
 #ifdef OMAX_PD_VERSION
 //		x->parse_error = 1;
 #endif
 		object_error((t_object *)x, "error parsing bundle\n");
+		// show that the bundle is gone
+		odisplay_redraw(x);
 		return;
 	}
 	t_osc_bndl_s *bs = osc_bundle_u_serialize(bndl_u);
-	t_osc_bndl_s *bndl_s = NULL;
-	osc_bundle_s_deepCopy(&bndl_s, bs);
-	odisplay_newBundle(x, bndl_u, bndl_s);
+	odisplay_newBundle(x, osc_bundle_s_getLen(bs), osc_bundle_s_getPtr(bs));
+	osc_bundle_s_deepFree(bs);
+	osc_bundle_u_free(bndl_u);
 #ifdef OMAX_PD_VERSION
     x->have_new_data = 1;
 	jbox_redraw((t_jbox *)x);
@@ -498,17 +695,10 @@ void odisplay_anything(t_odisplay *x, t_symbol *msg, short argc, t_atom *argv)
     t_osc_bndl_u *b = osc_bundle_u_alloc();
     osc_bundle_u_addMsg(b, m);
     t_osc_bndl_s *bs = osc_bundle_u_serialize(b);
-    odisplay_newBundle(x, b, bs);
-
-#ifdef OMAX_PD_VERSION
-    x->draw_new_data_indicator = 1;
-    x->have_new_data = 1;
-    jbox_redraw((t_jbox *)x);
-#else
-    x->draw_new_data_indicator = 1;
-    x->have_new_data = 1;
-    qelem_set(x->qelem);
-#endif
+    odisplay_newBundle(x, osc_bundle_s_getLen(bs), osc_bundle_s_getPtr(bs));
+    osc_bundle_s_deepFree(bs);
+    osc_bundle_u_free(b);
+    odisplay_scheduleRedraw(x);
 }
 
 void odisplay_set(t_odisplay *x, t_symbol *s, long ac, t_atom *av)
@@ -529,6 +719,21 @@ void odisplay_doc(t_odisplay *x)
     omax_doc_outletDoc(x->outlet);
 }
 
+#ifdef OMAX_PD_VERSION
+void odisplay_interval(t_odisplay *x, double f)
+{
+	odot_redraw_setInterval(&(x->redraw), f);
+}
+#else
+t_max_err odisplay_setInterval(t_odisplay *x, void *attr, long ac, t_atom *av)
+{
+	if(ac && av){
+		odot_redraw_setInterval(&(x->redraw), atom_getfloat(av));
+	}
+	return MAX_ERR_NONE;
+}
+#endif
+
 /*
     ...........................................................................................
     ................................  PD VERSION  .............................................
@@ -808,6 +1013,7 @@ static void odisplay_save(t_gobj *z, t_binbuf *b)
 
 void odisplay_free(t_odisplay *x)
 {
+    odot_stats_forget(x);
     //post("%x %s", x, __func__);
     free(x->tk_tag);
     free(x->frame_color);
@@ -817,12 +1023,14 @@ void odisplay_free(t_odisplay *x)
     
     clock_free(x->m_clock);
     clock_free(x->new_data_indicator_clock);
+    odot_redraw_free(&(x->redraw));
     
     critical_free(x->lock);
     
-    odisplay_clearBundles(x);
+    odisplay_freeText(x);
     
     opd_textbox_free(x->textbox);
+    odot_scratch_trim();
 }
 
 
@@ -877,8 +1085,11 @@ void *odisplay_new(t_symbol *msg, short argc, t_atom *argv)
         
         x->outlet = outlet_new(&x->ob, NULL);
         
-        x->bndl_u = NULL;
-        x->bndl_s = NULL;
+        x->pkt = NULL;
+        x->buf = x->renderbuf = x->scratch = x->text = NULL;
+        x->buflen = x->bufsize = x->renderbufsize = x->scratchsize = x->textsize = 0;
+        x->lines = NULL;
+        x->nlines = x->linessize = 0;
         x->newbndl = 0;
         x->textlen = 0;
         
@@ -887,6 +1098,7 @@ void *odisplay_new(t_symbol *msg, short argc, t_atom *argv)
         x->m_clock = clock_new(x, (t_method)odisplay_tick);
         
         x->new_data_indicator_clock = clock_new(x, (t_method)odisplay_refresh);
+        odot_redraw_init(&(x->redraw), clock_new(x, (t_method)odisplay_redrawTick), ODISPLAY_DEFAULT_INTERVAL);
         x->have_new_data = 1;
         x->draw_new_data_indicator = 0;
         
@@ -914,6 +1126,7 @@ void *odisplay_new(t_symbol *msg, short argc, t_atom *argv)
 }
 
 void setup_o0x2edisplay(void) {
+    odot_packet_init();
     
     t_class *c = class_new(gensym("o.display"), (t_newmethod)odisplay_new, (t_method)odisplay_free, sizeof(t_odisplay),  0L, A_GIMME, 0);
 
@@ -926,6 +1139,7 @@ void setup_o0x2edisplay(void) {
     
 //	class_addmethod(c, (t_method)odisplay_set, gensym("set"),0);
     class_addmethod(c, (t_method)odisplay_doc, gensym("doc"),0);
+    class_addmethod(c, (t_method)odisplay_interval, gensym("interval"), A_FLOAT, 0);
 
     
     odisplay_widgetbehavior.w_getrectfn = odisplay_getrect;
@@ -956,10 +1170,13 @@ void setup_o0x2edisplay(void) {
 
 void odisplay_free(t_odisplay *x)
 {
+    odot_stats_forget(x);
     qelem_free(x->qelem);
     object_free(x->new_data_indicator_clock);
-    odisplay_clearBundles(x);
+    odot_redraw_free(&(x->redraw));
+    odisplay_freeText(x);
 	critical_free(x->lock);
+    odot_scratch_trim();
     jbox_free((t_jbox *)x);
 }
 
@@ -1008,16 +1225,19 @@ void *odisplay_new(t_symbol *msg, short argc, t_atom *argv){
  		x->ob.b_firstin = (void *)x;
 		x->outlet = outlet_new(x, NULL);
 		//x->proxy = proxy_new(x, 1, &(x->inlet));
-		x->bndl_u = NULL;
-		x->bndl_s = NULL;
+		x->pkt = NULL;
+		x->buf = x->renderbuf = x->scratch = x->text = NULL;
+		x->buflen = x->bufsize = x->renderbufsize = x->scratchsize = x->textsize = 0;
+		x->lines = NULL;
+		x->nlines = x->linessize = 0;
 		x->newbndl = 0;
 		x->textlen = 0;
-		x->text = NULL;
 		//x->bndl_has_been_checked_for_subs = 0;
 		//x->bndl_has_subs = 0;
 		critical_new(&(x->lock));
 		x->qelem = qelem_new((t_object *)x, (method)odisplay_refresh);
 		x->new_data_indicator_clock = clock_new((t_object *)x, (method)odisplay_refresh);
+		odot_redraw_init(&(x->redraw), clock_new((t_object *)x, (method)odisplay_redrawTick), ODISPLAY_DEFAULT_INTERVAL);
 		x->have_new_data = 1;
 		x->draw_new_data_indicator = 0;
 		attr_dictionary_process(x, d);
@@ -1051,6 +1271,7 @@ CLASS_ATTR_ATTR_PARSE(c,attrname,"category",USESYM(symbol),flags,parsestr)
 
 int main(void){
 	common_symbols_init();
+	odot_packet_init();
 	t_class *c = class_new("o.display", (method)odisplay_new, (method)odisplay_free, sizeof(t_odisplay), 0L, A_GIMME, 0);
 	alias("o.d");
     
@@ -1105,6 +1326,12 @@ int main(void){
 	
     
 	CLASS_ATTR_DEFAULT(c, "rect", 0, "0. 0. 150. 18.");
+
+	CLASS_ATTR_DOUBLE(c, "interval", 0, t_odisplay, redraw.interval);
+	CLASS_ATTR_ACCESSORS(c, "interval", NULL, odisplay_setInterval);
+	CLASS_ATTR_DEFAULT_SAVE(c, "interval", 0, "30.");
+	CLASS_ATTR_FILTER_MIN(c, "interval", 0.);
+	CLASS_ATTR_LABEL(c, "interval", 0, "Redraw Interval (ms)");
     
 	class_register(CLASS_BOX, c);
 	odisplay_class = c;
@@ -48,9 +48,12 @@
 #include "osc_bundle_s.h"
 #include "osc_message_s.h"
 #include "osc_bundle_iterator_s.h"
+#include "osc_byteorder.h"
 #include "omax_util.h"
 #include "omax_doc.h"
 #include "omax_dict.h"
+#include "odot_scratch.h"
+#include "odot_downcast.h"
 
 typedef struct _odowncast{
 	t_object ob;
@@ -68,119 +71,25 @@ void *odowncast_class;
 void odowncast_fullPacket(t_odowncast *x, t_symbol *msg, int argc, t_atom *argv)
 {
 	OMAX_UTIL_GET_LEN_AND_PTR;
-	t_osc_bndl_u *b = osc_bundle_s_deserialize(len, ptr);
-	if(!b){
+	t_odot_downcast d = {x->doubles, x->ints, x->bundles, x->timetags, x->timetag_address ? x->timetag_address->s_name : NULL, 0};
+	long outlen = odot_downcast_bundle(&d, len, ptr, NULL);
+	if(outlen < 0){
 		object_error((t_object *)x, "invalid OSC packet");
 		return;
 	}
-	/*
-	if(x->flatten_nested_bundles){
-		t_osc_bndl_u *bf = NULL;
-		e = osc_bundle_u_flatten(&bf, b
-	}
-	*/
-	t_osc_bndl_u **nestedbundles = NULL;
-	int nnestedbundles = 0, nestedbundles_buflen = 0;
-	t_osc_bndl_it_u *bit = osc_bndl_it_u_get(b);
-	t_osc_timetag timetag = OSC_TIMETAG_NULL;
-	while(osc_bndl_it_u_hasNext(bit)){
-		t_osc_msg_u *m = osc_bndl_it_u_next(bit);
-		t_osc_msg_it_u *mit = osc_msg_it_u_get(m);
-		while(osc_msg_it_u_hasNext(mit)){
-			t_osc_atom_u *a = osc_msg_it_u_next(mit);
-			int i = 0;
-			switch(osc_atom_u_getTypetag(a)){
-			case 'c':
-			case 'C':
-			case 'I':
-			case 'h':
-			case 'H':
-			case 'u':
-			case 'U':
-			case 'N':
-			case 'T':
-			case 'F':
-				if(x->ints){
-					osc_atom_u_setInt32(a, osc_atom_u_getInt32(a));
-				}
-				break;
-			case 'd':
-				if(x->doubles){
-					osc_atom_u_setFloat(a, osc_atom_u_getFloat(a));
-				}
-				break;
-			case OSC_BUNDLE_TYPETAG:
-				if(x->bundles){
-					if(!nestedbundles || nnestedbundles == nestedbundles_buflen){
-						nestedbundles = (t_osc_bndl_u **)osc_mem_resize(nestedbundles, (nestedbundles_buflen + 16) * sizeof(char *));
-					}
-					nestedbundles[nnestedbundles++] = osc_atom_u_getBndl(a);
-					osc_message_u_removeAtom(m, a);
-				}
-				break;
-			case OSC_TIMETAG_TYPETAG:
-#if OSC_TIMETAG_FORMAT == OSC_TIMETAG_NTP
-				if(x->timetags){
-					t_osc_timetag tt = osc_atom_u_getTimetag(a);
-					if(x->timetag_address){
-						char *address = osc_message_u_getAddress(m);
-						if(!strcmp(address, x->timetag_address->s_name)){
-							timetag = tt;
-						}
-					}
-					t_osc_atom_u *aa = osc_atom_u_alloc();
-					int32_t tt1, tt2;
-					//tt1 = (tt & 0xffffffff00000000) >> 32;
-					//tt2 = tt & 0xffffffff;
-					tt1 = osc_timetag_ntp_getSeconds(tt);
-					tt2 = osc_timetag_ntp_getFraction(tt);
-					osc_atom_u_setInt32(aa, ntoh32(tt1));
-					osc_atom_u_setInt32(a, ntoh32(tt2));
-					osc_message_u_insertAtom(m, aa, ++i);
-				}
-#else
-				object_error((t_object *)x, "o.downcast only supports NTP timetags");
-#endif
-				break;
-			}
-			i++;
-		}
-		osc_msg_it_u_destroy(mit);
+	t_odot_scratch_mark mark = odot_scratch_mark();
+	char *out = (char *)odot_scratch_alloc(outlen);
+	if(!out){
+		odot_scratch_release(mark);
+		object_error((t_object *)x, "out of memory!");
+		return;
 	}
-	osc_bndl_it_u_destroy(bit);
-	t_osc_bndl_s *bs1 = osc_bundle_u_serialize(b);
-	if(bs1){
-		long l = osc_bundle_s_getLen(bs1);
-		char *p = osc_bundle_s_getPtr(bs1);
-		memcpy(p + OSC_ID_SIZE, &timetag, sizeof(t_osc_timetag));
-		for(int i = 0; i < nnestedbundles; i++){
-			t_osc_bndl_s *bs2 = osc_bundle_u_serialize(nestedbundles[i]);
-			if(bs2){
-				long ll = osc_bundle_s_getLen(bs2);
-				char *pp = osc_bundle_s_getPtr(bs2);
-				p = osc_mem_resize(p, l + ll);
-				memcpy(p + l, pp, ll);
-				l += ll;
-				osc_bundle_s_deepFree(bs2);
-			}
-		}
-		//if(x->bundle){
-		omax_util_outletOSC(x->outlet, l, p);
-			/*
-		}else{
-			t_osc_bndl_it_s *bit = osc_bndl_it_s_get(l, p);
-			while(osc_bndl_it_s_hasNext(bit)){
-				t_osc_msg_s *m = osc_bndl_it_s_next(bit);
-				long ml = osc_message_s_getSize(m);
-				char *mp = osc_message_s_getAddress(m);
-				omax_util_outletOSC(x->outlet, ml, mp);
-			}
-			osc_bndl_it_s_destroy(bit);
-		}
-			*/
-		osc_bundle_s_deepFree(bs1);
+	odot_downcast_bundle(&d, len, ptr, out);
+	if(d.nonntp){
+		object_error((t_object *)x, "o.downcast only supports NTP timetags");
 	}
-	osc_bundle_u_free(b);
+	omax_util_outletOSC(x->outlet, outlen, out);
+	odot_scratch_release(mark);
 }
 
 
@@ -191,6 +100,8 @@ void odowncast_doc(t_odowncast *x)
 
 void odowncast_free(t_odowncast *x)
 {
+	odot_stats_forget(x);
+	odot_scratch_trim();
 }
 
 
@@ -29,12 +29,16 @@
 #define OMAX_DOC_SEEALSO (char *[]){"edge~"}
 
 #include "odot_version.h"
+#ifdef OMAX_PD_VERSION
+#include "m_pd.h"
+#else
 #include "ext.h"
 #include "ext_obex.h"
 #include "ext_critical.h"
 #include "ext_obex_util.h"
 #include "ext_sysmem.h"
 #include "z_dsp.h"
+#endif
 #include "osc.h"
 #include "osc_mem.h"
 #include "osc_bundle_iterator_s.h"
@@ -44,24 +48,82 @@
 #include "omax_util.h"
 #include "omax_doc.h"
 #include "omax_dict.h"
+#ifndef OMAX_PD_VERSION
 #include "omax_realtime.h"
+#endif
+#include "odot_clock.h"
+
+/*
+The perform routine does the edge detection itself: it scans the vector for
+the next sample whose zero-ness differs from the last one, and only when it
+finds one does it record an event (which edge, where in the block, the
+value, and the block's timetag) in a ring that's shared with the scheduler
+thread without a lock.  The perform routine only ever moves the tail and
+the callback only ever moves the head.  A callback is scheduled only for
+blocks that had edges, and only if one isn't already pending, so a signal
+with no edges costs little more than the scan.  If the ring fills up,
+events are dropped and counted.
+
+In Pd the perform routine runs on the same thread as the clocks, so the
+callback is a clock set to go off as soon as the DSP tick is done, and
+edges are stamped with the logical time of the block (see odot_clock.h).
+*/
+
+#define OEDGE_QUEUE_SIZE 4096
+
+enum{
+	OEDGE_ONSET,
+	OEDGE_ZERO
+};
+
+typedef struct _oedge_event{
+	int type;
+	long sample;	// within the block
+	long blocksize;
+	double blockcount;
+	double samplerate;
+	double value;
+	t_osc_timetag now;
+} t_oedge_event;
 
 typedef struct _oedge{
+#ifdef OMAX_PD_VERSION
+	t_object ob;
+	t_float f; // dummy for CLASS_MAINSIGNALIN
+	t_clock *clock;
+#else
 	t_pxobject ob;
+#endif
 	void *outlet;
 	t_critical lock;
-	int ac;
-	t_atom *av;
-	double lastx;
+	int lastnonzero;
 	int gettime;
 	t_osc_timetag dspstarttime;
 	double blockcount;
+	double samplerate;
+	t_oedge_event *queue;
+	long queue_head; // next event for the callback to output
+	long queue_tail; // next slot for the perform routine to fill
+	long dropped;
+	int scheduled;
 	t_osc_bndl_u *bundle;
 	t_osc_msg_u *time_onset, *block_sample_onset, *global_sample_onset, *value_onset;
 	t_osc_msg_u *time_zero, *block_sample_zero, *global_sample_zero;
 } t_oedge;
 
+#ifdef OMAX_PD_VERSION
+t_class *oedge_class;
+typedef t_sample t_oedge_sample;
+#define OEDGE_CLOCK_TICK(x)
+#define OEDGE_CLOCK_NOW(t) (*(t) = odot_clock_now())
+#define OEDGE_SCHEDULE(x) clock_delay((x)->clock, 0)
+#else
 void *oedge_class;
+typedef t_float t_oedge_sample;
+#define OEDGE_CLOCK_TICK(x) omax_realtime_clock_tick(x)
+#define OEDGE_CLOCK_NOW(t) omax_realtime_clock_now(t)
+#define OEDGE_SCHEDULE(x) schedule_delay((x), (method)oedge_callback, 0, NULL, 0, NULL)
+#endif
 
 t_osc_timetag oedge_computeTime(t_osc_timetag now, t_osc_timetag dspstarttime, double samplerate, double blocksize, double blockcount, double samplenum)
 {
@@ -75,43 +137,12 @@ t_osc_timetag oedge_computeTime(t_osc_timetag now, t_osc_timetag dspstarttime, d
 	return osc_timetag_add(dspstarttime, t);
 }
 
-void oedge_callback(t_oedge *x, t_symbol *msg, int argc, t_atom *argv)
+static void oedge_output(t_oedge *x)
 {
-	double lastx = x->lastx;
-	//t_osc_bndl_u *b = osc_bundle_u_alloc();
-	double sr = atom_getfloat(argv);
-	double blockcount = atom_getlong(argv + 1);
-	t_osc_timetag dspstarttime = x->dspstarttime;
-	t_osc_timetag now = (t_osc_timetag){atom_getlong(argv + 2), atom_getlong(argv + 3)};//(((uint64_t)atom_getlong(argv + 2)) << 32) | ((uint64_t)atom_getlong(argv + 3));
-	int shouldoutput = 0;
-
-	for(int i = 0; i < argc - 4; i++){
-		double xx = atom_getfloat(argv + i + 4);
-		if(lastx == 0 && xx != 0){
-			shouldoutput = 1;
-			t_osc_timetag t = oedge_computeTime(now, dspstarttime, sr, argc - 4, blockcount, i);
-			osc_message_u_appendTimetag(x->time_onset, t);
-			osc_message_u_appendUInt32(x->block_sample_onset, (i));
-			osc_message_u_appendDouble(x->global_sample_onset, ((argc - 4) * blockcount) + (i));
-			osc_message_u_appendDouble(x->value_onset, xx);
-			//oedge_addMessageToBundle(b, "/zerotononzero", i, blockcount, argc, t);
-		}else if(lastx != 0 && xx == 0){
-			shouldoutput = 1;
-			t_osc_timetag t = oedge_computeTime(now, dspstarttime, sr, argc - 4, blockcount, (i));
-			osc_message_u_appendTimetag(x->time_zero, t);
-			osc_message_u_appendUInt32(x->block_sample_zero, (i));
-			osc_message_u_appendDouble(x->global_sample_zero, ((argc - 4) * blockcount) + (i));
-			//oedge_addMessageToBundle(b, "/nonzerotozero", i, blockcount, argc, t);
-		}
-		lastx = xx;
-	}
-	x->lastx = lastx;
-	if(shouldoutput){
-		t_osc_bndl_s *bs = osc_bundle_u_serialize(x->bundle);
-		if(bs){
-			omax_util_outletOSC(x->outlet, osc_bundle_s_getLen(bs), osc_bundle_s_getPtr(bs));
-			osc_bundle_s_deepFree(bs);
-		}
+	t_osc_bndl_s *bs = osc_bundle_u_serialize(x->bundle);
+	if(bs){
+		omax_util_outletOSC(x->outlet, osc_bundle_s_getLen(bs), osc_bundle_s_getPtr(bs));
+		osc_bundle_s_deepFree(bs);
 	}
 	osc_message_u_clearArgs(x->time_onset);
 	osc_message_u_clearArgs(x->block_sample_onset);
@@ -123,52 +154,152 @@ void oedge_callback(t_oedge *x, t_symbol *msg, int argc, t_atom *argv)
 	osc_message_u_clearArgs(x->global_sample_zero);
 }
 
-void oedge_perform64(t_oedge *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vectorsize, long flags, void *userparam)
+// called on the scheduler thread.  events from the same block go out in one bundle
+void oedge_callback(t_oedge *x, t_symbol *msg, int argc, t_atom *argv)
 {
-	omax_realtime_clock_tick(x);
-	t_osc_timetag now;
-	omax_realtime_clock_now(&now);
+	__atomic_store_n(&(x->scheduled), 0, __ATOMIC_RELEASE);
+	t_osc_timetag dspstarttime = x->dspstarttime;
+	double blockcount = -1;
+	int pending = 0;
+	long head = x->queue_head;
+	while(head != __atomic_load_n(&(x->queue_tail), __ATOMIC_ACQUIRE)){
+		t_oedge_event *e = x->queue + head;
+		if(pending && e->blockcount != blockcount){
+			oedge_output(x);
+			pending = 0;
+		}
+		blockcount = e->blockcount;
+		t_osc_timetag t = oedge_computeTime(e->now, dspstarttime, e->samplerate, e->blocksize, e->blockcount, e->sample);
+		if(e->type == OEDGE_ONSET){
+			osc_message_u_appendTimetag(x->time_onset, t);
+			osc_message_u_appendUInt32(x->block_sample_onset, e->sample);
+			osc_message_u_appendDouble(x->global_sample_onset, (e->blocksize * e->blockcount) + e->sample);
+			osc_message_u_appendDouble(x->value_onset, e->value);
+		}else{
+			osc_message_u_appendTimetag(x->time_zero, t);
+			osc_message_u_appendUInt32(x->block_sample_zero, e->sample);
+			osc_message_u_appendDouble(x->global_sample_zero, (e->blocksize * e->blockcount) + e->sample);
+		}
+		pending = 1;
+		head = (head + 1) % OEDGE_QUEUE_SIZE;
+		__atomic_store_n(&(x->queue_head), head, __ATOMIC_RELEASE);
+	}
+	if(pending){
+		oedge_output(x);
+	}
+	long dropped = __atomic_exchange_n(&(x->dropped), 0, __ATOMIC_RELAXED);
+	if(dropped){
+		object_error((t_object *)x, "dropped %ld edges", dropped);
+	}
+}
 
-	atom_setlong(x->av + 1, x->blockcount++);
-	atom_setlong(x->av + 2, osc_timetag_ntp_getSeconds(now));//(((uint64_t)now) & 0xffffffff00000000) >> 32);
-	atom_setlong(x->av + 3, osc_timetag_ntp_getFraction(now));//(((uint64_t)now) & 0xffffffff));
-	atom_setdouble_array(x->ac, x->av + 4, vectorsize, ins[0]);
-	schedule_delay(x, (method)oedge_callback, 0, NULL, vectorsize + 4, x->av);
+// called on the audio thread
+static void oedge_push(t_oedge *x, int type, long sample, long blocksize, double value, t_osc_timetag now)
+{
+	long tail = x->queue_tail;
+	long next = (tail + 1) % OEDGE_QUEUE_SIZE;
+	if(next == __atomic_load_n(&(x->queue_head), __ATOMIC_ACQUIRE)){
+		__atomic_add_fetch(&(x->dropped), 1, __ATOMIC_RELAXED);
+		return;
+	}
+	t_oedge_event *e = x->queue + tail;
+	e->type = type;
+	e->sample = sample;
+	e->blocksize = blocksize;
+	e->blockcount = x->blockcount;
+	e->samplerate = x->samplerate;
+	e->value = value;
+	e->now = now;
+	__atomic_store_n(&(x->queue_tail), next, __ATOMIC_RELEASE);
 }
 
+// the index of the first sample at or after i that is zero if nonzero is set, or
+// non-zero if it isn't, or n if there isn't one.  samples are tested 8 at a time
+// without branching, so the compiler can vectorize the common case of no edge
+#define OEDGE_SCAN(name, type)							\
+	static long name(const type *in, long i, long n, int nonzero)		\
+	{									\
+		while(i + 8 <= n){						\
+			int diff = 0;						\
+			int j;							\
+			for(j = 0; j < 8; j++){					\
+				diff |= (in[i + j] != 0) != nonzero;		\
+			}							\
+			if(diff){						\
+				break;						\
+			}							\
+			i += 8;							\
+		}								\
+		while(i < n && (in[i] != 0) == nonzero){			\
+			i++;							\
+		}								\
+		return i;							\
+	}
+
+OEDGE_SCAN(oedge_scan64, double)
+OEDGE_SCAN(oedge_scan32, t_oedge_sample)
+
+#define OEDGE_PERFORM(x, in, n, scan)						\
+	{									\
+		OEDGE_CLOCK_TICK(x);						\
+		int nonzero = x->lastnonzero;					\
+		int gotnow = 0, pushed = 0;					\
+		t_osc_timetag now;						\
+		long i = 0;							\
+		while((i = scan(in, i, n, nonzero)) < n){			\
+			if(!gotnow){						\
+				OEDGE_CLOCK_NOW(&now);				\
+				gotnow = 1;					\
+			}							\
+			nonzero = !nonzero;					\
+			oedge_push(x, nonzero ? OEDGE_ONSET : OEDGE_ZERO, i, n, in[i], now); \
+			pushed = 1;						\
+			i++;							\
+		}								\
+		x->lastnonzero = nonzero;					\
+		if(pushed && !__atomic_exchange_n(&(x->scheduled), 1, __ATOMIC_ACQ_REL)){ \
+			OEDGE_SCHEDULE(x);					\
+		}								\
+		x->blockcount++;						\
+	}
+
+#ifndef OMAX_PD_VERSION
+void oedge_perform64(t_oedge *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vectorsize, long flags, void *userparam)
+{
+	double *in = ins[0];
+	OEDGE_PERFORM(x, in, vectorsize, oedge_scan64);
+}
+#endif
+
 t_int *oedge_perform(t_int *w) 
 {
 	t_oedge *x = (t_oedge *)(w[1]);
-	t_float *in = (t_float *)(w[2]);
-	t_int n = (t_float *)(w[3]);
-
-	omax_realtime_clock_tick(x);
-	t_osc_timetag now;
-	omax_realtime_clock_now(&now);
-
-	atom_setlong(x->av + 1, x->blockcount++);
-	atom_setlong(x->av + 2, osc_timetag_ntp_getSeconds(now));//(((uint64_t)now) & 0xffffffff00000000) >> 32);
-	atom_setlong(x->av + 3, osc_timetag_ntp_getFraction(now));//(((uint64_t)now) & 0xffffffff));
-	atom_setdouble_array(x->ac, x->av + 4, n, in);
-	schedule_delay(x, (method)oedge_callback, 0, NULL, n + 4, x->av);
+	t_oedge_sample *in = (t_oedge_sample *)(w[2]);
+	long n = (long)(w[3]);
+	OEDGE_PERFORM(x, in, n, oedge_scan32);
 	return w + 4;
 }
 
-void oedge_alloc_atom_array(t_oedge *x, int n)
+#ifdef OMAX_PD_VERSION
+void oedge_tick(t_oedge *x)
 {
-	if(n + 4 != x->ac){
-		x->ac = n + 4;
-		x->av = (t_atom *)sysmem_resizeptr(x->av, (n + 4) * sizeof(t_atom));
-	}
+	oedge_callback(x, NULL, 0, NULL);
 }
 
+void oedge_dsp(t_oedge *x, t_signal **sp)
+{
+	x->gettime = 1;
+	x->blockcount = 0;
+	x->samplerate = sp[0]->s_sr;
+	dsp_add(oedge_perform, 3, x, sp[0]->s_vec, sp[0]->s_n);
+}
+#else
 void oedge_dsp64(t_oedge *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags)
 {
 	x->gettime = 1;
 	omax_realtime_clock_register(x);
 	x->blockcount = 0;
-	oedge_alloc_atom_array(x, maxvectorsize);
-	atom_setlong(x->av, samplerate);
+	x->samplerate = samplerate;
 	object_method(dsp64, gensym("dsp_add64"), x, oedge_perform64, 0, NULL);
 }
 
@@ -177,10 +308,10 @@ void oedge_dsp(t_oedge *x, t_signal **sp, short *count)
 	x->gettime = 1;
 	omax_realtime_clock_register(x);
 	x->blockcount = 0;
-	oedge_alloc_atom_array(x, sp[0]->s_n);
-	atom_setlong(x->av, sp[0]->s_sr);
+	x->samplerate = sp[0]->s_sr;
 	dsp_add(oedge_perform, 3, x, sp[0]->s_vec, sp[0]->s_n);
 }
+#endif
 
 //OMAX_DICT_DICTIONARY(t_oedge, x, oedge_fullPacket);
 
@@ -189,19 +320,107 @@ void oedge_doc(t_oedge *x)
 	omax_doc_outletDoc(x->outlet);
 }
 
-void oedge_assist(t_oedge *x, void *b, long io, long num, char *buf)
-{
-	omax_doc_assist(io, num, buf);
-}
-
 void oedge_free(t_oedge *x)
 {
+#ifdef OMAX_PD_VERSION
+	clock_unset(x->clock);
+	clock_free(x->clock);
+#else
 	dsp_free((t_pxobject *)x);
+#endif
 	critical_free(x->lock);
-	if(x->av){
-		sysmem_freeptr(x->av);
+	if(x->queue){
+		osc_mem_free(x->queue);
+	}
+	if(x->bundle){
+		osc_bundle_u_free(x->bundle);
+	}
+}
+
+// everything but the outlet and the signal inlet, which are set up differently in Max and Pd.
+// returns non-zero if the queue couldn't be allocated, leaving x fit for oedge_free
+static int oedge_init(t_oedge *x)
+{
+	critical_new(&(x->lock));
+	x->lastnonzero = 0;
+	x->gettime = 0;
+	x->blockcount = 0;
+	x->samplerate = 0;
+	x->queue_head = 0;
+	x->queue_tail = 0;
+	x->dropped = 0;
+	x->scheduled = 0;
+	x->bundle = NULL;
+	x->queue = (t_oedge_event *)osc_mem_alloc(OEDGE_QUEUE_SIZE * sizeof(t_oedge_event));
+	if(!x->queue){
+		return 1;
+	}
+
+	x->time_onset = osc_message_u_alloc();
+	osc_message_u_setAddress(x->time_onset, "/zerotononzero/time");
+	x->block_sample_onset = osc_message_u_alloc();
+	osc_message_u_setAddress(x->block_sample_onset, "/zerotononzero/sample/withinblock");
+	x->global_sample_onset = osc_message_u_alloc();
+	osc_message_u_setAddress(x->global_sample_onset, "/zerotononzero/sample/sincedspstart");
+	x->value_onset = osc_message_u_alloc();
+	osc_message_u_setAddress(x->value_onset, "/zerotononzero/value");
+
+	x->time_zero = osc_message_u_alloc();
+	osc_message_u_setAddress(x->time_zero, "/nonzerotozero/time");
+	x->block_sample_zero = osc_message_u_alloc();
+	osc_message_u_setAddress(x->block_sample_zero, "/nonzerotozero/sample/withinblock");
+	x->global_sample_zero = osc_message_u_alloc();
+	osc_message_u_setAddress(x->global_sample_zero, "/nonzerotozero/sample/sincedspstart");
+
+	x->bundle = osc_bundle_u_alloc();
+
+	osc_bundle_u_addMsg(x->bundle, x->time_onset);
+	osc_bundle_u_addMsg(x->bundle, x->block_sample_onset);
+	osc_bundle_u_addMsg(x->bundle, x->global_sample_onset);
+	osc_bundle_u_addMsg(x->bundle, x->value_onset);
+	osc_bundle_u_addMsg(x->bundle, x->time_zero);
+	osc_bundle_u_addMsg(x->bundle, x->block_sample_zero);
+	osc_bundle_u_addMsg(x->bundle, x->global_sample_zero);
+	return 0;
+}
+
+#ifdef OMAX_PD_VERSION
+
+void *oedge_new(t_symbol *msg, int argc, t_atom *argv)
+{
+	t_oedge *x = NULL;
+	if((x = (t_oedge *)object_alloc(oedge_class))){
+		x->f = 0;
+		x->outlet = outlet_new(&x->ob, gensym("FullPacket"));
+		x->clock = clock_new(x, (t_method)oedge_tick);
+		if(oedge_init(x)){
+			object_error((t_object *)x, "out of memory!");
+			pd_free((t_pd *)x);
+			return NULL;
+		}
 	}
-	osc_bundle_u_free(x->bundle);
+	return x;
+}
+
+int setup_o0x2eedge0x7e(void)
+{
+	t_class *c = class_new(gensym("o.edge~"), (t_newmethod)oedge_new, (t_method)oedge_free, sizeof(t_oedge), 0L, A_GIMME, 0);
+	CLASS_MAINSIGNALIN(c, t_oedge, f);
+	class_addmethod(c, (t_method)oedge_doc, gensym("doc"), 0);
+	class_addmethod(c, (t_method)oedge_dsp, gensym("dsp"), A_CANT, 0);
+	class_addmethod(c, (t_method)odot_version, gensym("version"), 0);
+
+	oedge_class = c;
+
+	ODOT_PRINT_VERSION;
+	return 0;
+}
+
+#else
+
+void oedge_assist(t_oedge *x, void *b, long io, long num, char *buf)
+{
+	omax_doc_assist(io, num, buf);
 }
 
 void *oedge_new(t_symbol *msg, short argc, t_atom *argv)
@@ -210,37 +429,11 @@ void *oedge_new(t_symbol *msg, short argc, t_atom *argv)
 	if((x = (t_oedge *)object_alloc(oedge_class))){
   		dsp_setup((t_pxobject *)x, 1); 
 		x->outlet = outlet_new((t_object *)x, "FullPacket");
-		critical_new(&(x->lock));
-		x->ac = 0;
-		x->av = NULL;
-		x->lastx = 0;
-		x->gettime = 0;
-
-		x->time_onset = osc_message_u_alloc();
-		osc_message_u_setAddress(x->time_onset, "/zerotononzero/time");
-		x->block_sample_onset = osc_message_u_alloc();
-		osc_message_u_setAddress(x->block_sample_onset, "/zerotononzero/sample/withinblock");
-		x->global_sample_onset = osc_message_u_alloc();
-		osc_message_u_setAddress(x->global_sample_onset, "/zerotononzero/sample/sincedspstart");
-		x->value_onset = osc_message_u_alloc();
-		osc_message_u_setAddress(x->value_onset, "/zerotononzero/value");
-
-		x->time_zero = osc_message_u_alloc();
-		osc_message_u_setAddress(x->time_zero, "/nonzerotozero/time");
-		x->block_sample_zero = osc_message_u_alloc();
-		osc_message_u_setAddress(x->block_sample_zero, "/nonzerotozero/sample/withinblock");
-		x->global_sample_zero = osc_message_u_alloc();
-		osc_message_u_setAddress(x->global_sample_zero, "/nonzerotozero/sample/sincedspstart");
-
-		x->bundle = osc_bundle_u_alloc();
-
-		osc_bundle_u_addMsg(x->bundle, x->time_onset);
-		osc_bundle_u_addMsg(x->bundle, x->block_sample_onset);
-		osc_bundle_u_addMsg(x->bundle, x->global_sample_onset);
-		osc_bundle_u_addMsg(x->bundle, x->value_onset);
-		osc_bundle_u_addMsg(x->bundle, x->time_zero);
-		osc_bundle_u_addMsg(x->bundle, x->block_sample_zero);
-		osc_bundle_u_addMsg(x->bundle, x->global_sample_zero);
+		if(oedge_init(x)){
+			object_error((t_object *)x, "out of memory!");
+			object_free(x);
+			return NULL;
+		}
 	}
 	return x;
 }
@@ -274,6 +467,9 @@ int main(void)
 	omax_realtime_clock_init();
 	return 0;
 }
+
+#endif
+
 /*
 t_max_err oedge_notify(t_oedge *x, t_symbol *s, t_symbol *msg, void *sender, void *data){
 	t_symbol *attrname;
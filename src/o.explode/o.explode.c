@@ -49,33 +49,260 @@
 #endif
 #include "osc.h"
 #include "osc_mem.h"
+#include "osc_byteorder.h"
 #include "omax_util.h"
 #include "omax_doc.h"
 #include "omax_dict.h"
+#include "odot_scratch.h"
 
 #include "o.h"
 
+/*
+A packet is exploded by sorting its messages into a tree, one node per
+address segment, and then walking the tree twice: once to work out the
+size of each nested bundle, and once to write the packet.  The nodes point
+into the incoming packet rather than holding copies, and live in an array
+that is kept from one packet to the next, so nothing is allocated once
+the array is big enough.
+*/
+typedef struct _oexplode_node{
+	char *seg;	// the address segment, in the incoming packet
+	long seglen;	// -1 for an element that is passed through as it is
+	char *rest;	// for a leaf, the typetags and data of the message
+	long restlen;
+	long firstchild, lastchild, next;	// indexes of other nodes, or -1
+	long size;	// for a group, the size of the bundle of its children
+} t_oexplode_node;
+
 typedef struct _oexplode{
 	t_object ob;
 	void *outlet;
 	int level;
 	t_symbol *sep;
+	t_critical lock;
+	t_oexplode_node *nodes;
+	long nnodes, nodessize;
 } t_oexplode;
 
 void *oexplode_class;
 
+#define OEXPLODE_PADDED(n) (((n) / 4 + 1) * 4)
+
+// add a node under parent and return its index, or -1 if we're out of memory
+static long oexplode_addNode(t_oexplode *x, long parent, char *seg, long seglen, char *rest, long restlen)
+{
+	if(x->nnodes == x->nodessize){
+		long size = x->nodessize ? x->nodessize * 2 : 64;
+		t_oexplode_node *tmp = (t_oexplode_node *)osc_mem_resize(x->nodes, size * sizeof(t_oexplode_node));
+		if(!tmp){
+			return -1;
+		}
+		x->nodes = tmp;
+		x->nodessize = size;
+	}
+	long i = x->nnodes++;
+	t_oexplode_node *n = x->nodes + i;
+	n->seg = seg;
+	n->seglen = seglen;
+	n->rest = rest;
+	n->restlen = restlen;
+	n->firstchild = n->lastchild = n->next = -1;
+	n->size = 0;
+	if(parent >= 0){
+		t_oexplode_node *p = x->nodes + parent;
+		if(p->lastchild >= 0){
+			x->nodes[p->lastchild].next = i;
+		}else{
+			p->firstchild = i;
+		}
+		p->lastchild = i;
+	}
+	return i;
+}
+
+// where the address segment at seg ends: the first @sep followed by a slash after its first
+// character (o.flatten joins addresses with @sep), or NULL if it's the last segment
+static char *oexplode_findSep(char *seg, long seglen, const char *sep, long seplen)
+{
+	char c = seplen ? sep[0] : '/';
+	char *p = seg + 1;
+	char *e = seg + seglen;
+	// the separator and the slash after it have to fit before the end
+	while(p + seplen < e){
+		char *q = memchr(p, c, e - seplen - p);
+		if(!q){
+			return NULL;
+		}
+		if(!memcmp(q, sep, seplen) && q[seplen] == '/'){
+			return q;
+		}
+		p = q + 1;
+	}
+	return NULL;
+}
+
+// put the message m, which is n bytes long not counting its size, in the tree
+static int oexplode_insert(t_oexplode *x, char *m, long n)
+{
+	char *z = memchr(m, '\0', n);
+	if(!z){
+		return 1;
+	}
+	long addresslen = z - m;
+	long paddedaddresslen = OEXPLODE_PADDED(addresslen);
+	if(paddedaddresslen > n){
+		return 1;
+	}
+	const char *sep = x->sep->s_name;
+	long seplen = strlen(sep);
+	long parent = 0;
+	int level = 0;
+	char *seg = m;
+	long seglen = addresslen;
+	while(x->level < 0 || level < x->level){
+		if(seglen < 2 || *seg != '/'){
+			break;
+		}
+		char *end = oexplode_findSep(seg, seglen, sep, seplen);
+		if(!end){
+			break;
+		}
+		long l = end - seg;
+		long c;
+		for(c = x->nodes[parent].firstchild; c >= 0; c = x->nodes[c].next){
+			t_oexplode_node *cn = x->nodes + c;
+			if(!cn->rest && cn->seglen == l && !memcmp(cn->seg, seg, l)){
+				break;
+			}
+		}
+		if(c < 0){
+			c = oexplode_addNode(x, parent, seg, l, NULL, 0);
+			if(c < 0){
+				return 1;
+			}
+		}
+		parent = c;
+		seg += l + seplen;
+		seglen -= l + seplen;
+		level++;
+	}
+	return oexplode_addNode(x, parent, seg, seglen, m + paddedaddresslen, n - paddedaddresslen) < 0;
+}
+
+// the size of the bundle of node i's children, which is also worked out for every group below it
+static long oexplode_measure(t_oexplode *x, long i)
+{
+	long size = OSC_HEADER_SIZE;
+	long c;
+	for(c = x->nodes[i].firstchild; c >= 0; c = x->nodes[c].next){
+		t_oexplode_node *n = x->nodes + c;
+		if(n->seglen < 0){
+			size += 4 + n->restlen;
+		}else if(n->rest){
+			size += 4 + OEXPLODE_PADDED(n->seglen) + n->restlen;
+		}else{
+			size += 4 + OEXPLODE_PADDED(n->seglen) + 4 + 4 + oexplode_measure(x, c);
+		}
+	}
+	x->nodes[i].size = size;
+	return size;
+}
+
+// write the bundle of node i's children into out, using the sizes from oexplode_measure()
+static void oexplode_write(t_oexplode *x, long i, char *out)
+{
+	memcpy(out, OSC_EMPTY_HEADER, OSC_HEADER_SIZE);
+	char *o = out + OSC_HEADER_SIZE;
+	long c;
+	for(c = x->nodes[i].firstchild; c >= 0; c = x->nodes[c].next){
+		t_oexplode_node *n = x->nodes + c;
+		if(n->seglen < 0){
+			*((uint32_t *)o) = hton32((uint32_t)n->restlen);
+			memcpy(o + 4, n->rest, n->restlen);
+			o += 4 + n->restlen;
+			continue;
+		}
+		long paddedseglen = OEXPLODE_PADDED(n->seglen);
+		char *m = o + 4;
+		memset(m, '\0', paddedseglen);
+		memcpy(m, n->seg, n->seglen);
+		m += paddedseglen;
+		if(n->rest){
+			memcpy(m, n->rest, n->restlen);
+			m += n->restlen;
+		}else{
+			memcpy(m, ",.\0\0", 4);
+			*((uint32_t *)(m + 4)) = hton32((uint32_t)x->nodes[c].size);
+			oexplode_write(x, c, m + 8);
+			m += 8 + x->nodes[c].size;
+		}
+		*((uint32_t *)o) = hton32((uint32_t)(m - o - 4));
+		o = m;
+	}
+}
+
 //void oexplode_fullPacket(t_oexplode *x, long len, long ptr)
 void oexplode_fullPacket(t_oexplode *x, t_symbol *msg, int argc, t_atom *argv)
 {
 	OMAX_UTIL_GET_LEN_AND_PTR
-	char srcc[osc_bundle_s_getStructSize()];
-	t_osc_bndl_s *src = (t_osc_bndl_s *)srcc;
-	osc_bundle_s_setLen(src, len);
-	osc_bundle_s_setPtr(src, ptr);
-	t_osc_bndl_s *dest2 = NULL;
-	osc_bundle_s_explode(&dest2, src, x->level, x->sep->s_name);
-	omax_util_outletOSC(x->outlet, osc_bundle_s_getLen(dest2), osc_bundle_s_getPtr(dest2));
-	osc_bundle_s_deepFree(dest2);
+	if(len < OSC_HEADER_SIZE || strncmp(ptr, "#bundle", OSC_ID_SIZE)){
+		object_error((t_object *)x, "invalid OSC packet");
+		return;
+	}
+	critical_enter(x->lock);
+	x->nnodes = 0;
+	if(oexplode_addNode(x, -1, NULL, 0, NULL, 0) < 0){
+		critical_exit(x->lock);
+		object_error((t_object *)x, "out of memory");
+		return;
+	}
+	char *p = ptr + OSC_HEADER_SIZE;
+	char *e = ptr + len;
+	while(p < e){
+		long n = e - p >= 4 ? (long)ntoh32(*((uint32_t *)p)) : -1;
+		if(n < 0 || n > e - p - 4){
+			critical_exit(x->lock);
+			object_error((t_object *)x, "invalid OSC packet");
+			return;
+		}
+		int err;
+		if(n >= OSC_ID_SIZE && !strncmp(p + 4, "#bundle", OSC_ID_SIZE)){
+			err = oexplode_addNode(x, 0, NULL, -1, p + 4, n) < 0;
+		}else{
+			err = oexplode_insert(x, p + 4, n);
+		}
+		if(err){
+			critical_exit(x->lock);
+			object_error((t_object *)x, "invalid OSC packet");
+			return;
+		}
+		p += 4 + n;
+	}
+	long outlen = oexplode_measure(x, 0);
+	t_odot_scratch_mark mark = odot_scratch_mark();
+	char *out = (char *)odot_scratch_alloc(outlen);
+	if(!out){
+		critical_exit(x->lock);
+		odot_scratch_release(mark);
+		object_error((t_object *)x, "out of memory");
+		return;
+	}
+	oexplode_write(x, 0, out);
+	// keep the timetag
+	memcpy(out + OSC_ID_SIZE, ptr + OSC_ID_SIZE, OSC_HEADER_SIZE - OSC_ID_SIZE);
+	critical_exit(x->lock);
+	omax_util_outletOSC(x->outlet, outlen, out);
+	odot_scratch_release(mark);
+}
+
+void oexplode_free(t_oexplode *x)
+{
+	odot_stats_forget(x);
+	critical_free(x->lock);
+	if(x->nodes){
+		osc_mem_free(x->nodes);
+	}
+	odot_scratch_trim();
 }
 
 #ifndef OMAX_PD_VERSION
@@ -101,6 +328,9 @@ void *oexplode_new(t_symbol *msg, short argc, t_atom *argv)
 		x->outlet = outlet_new((t_object *)x, gensym("FullPacket"));
 		x->level = -1;
 		x->sep = gensym("");
+		critical_new(&(x->lock));
+		x->nodes = NULL;
+		x->nnodes = x->nodessize = 0;
         
 /********************* PD Pseudo-attributed, commented out for 1.0 release
         
@@ -146,7 +376,7 @@ void *oexplode_new(t_symbol *msg, short argc, t_atom *argv)
 
 int setup_o0x2eexplode(void)
 {
-	t_class *c = class_new(gensym("o.explode"), (t_newmethod)oexplode_new, NULL, sizeof(t_oexplode), 0L, A_GIMME, 0);
+	t_class *c = class_new(gensym("o.explode"), (t_newmethod)oexplode_new, (t_method)oexplode_free, sizeof(t_oexplode), 0L, A_GIMME, 0);
 
 	class_addmethod(c, (t_method)oexplode_fullPacket, gensym("FullPacket"), A_GIMME, 0);
 	class_addmethod(c, (t_method)oexplode_doc, gensym("doc"), 0);
@@ -165,6 +395,9 @@ void *oexplode_new(t_symbol *msg, short argc, t_atom *argv)
 		x->outlet = outlet_new((t_object *)x, "FullPacket");
 		x->level = -1;
 		x->sep = gensym("");
+		critical_new(&(x->lock));
+		x->nodes = NULL;
+		x->nnodes = x->nodessize = 0;
 		attr_args_process(x, argc, argv);
 	}
 		   	
@@ -173,7 +406,7 @@ void *oexplode_new(t_symbol *msg, short argc, t_atom *argv)
 
 int main(void)
 {
-	t_class *c = class_new("o.explode", (method)oexplode_new, NULL, sizeof(t_oexplode), 0L, A_GIMME, 0);
+	t_class *c = class_new("o.explode", (method)oexplode_new, (method)oexplode_free, sizeof(t_oexplode), 0L, A_GIMME, 0);
 	//class_addmethod(c, (method)oexplode_fullPacket, "FullPacket", A_LONG, A_LONG, 0);
 	class_addmethod(c, (method)oexplode_fullPacket, "FullPacket", A_GIMME, 0);
 	class_addmethod(c, (method)oexplode_assist, "assist", A_CANT, 0);
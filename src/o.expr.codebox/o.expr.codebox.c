@@ -449,6 +449,7 @@ void oexprcodebox_doc(t_oexprcodebox *x)
 
 void oexprcodebox_free(t_oexprcodebox *x)
 {
+    odot_stats_forget(x);
     if(x->expr){
         osc_expr_free(x->expr);
     }
@@ -430,6 +430,7 @@ void oexpr_assist(t_oexpr *x, void *b, long io, long num, char *buf){
 #endif
 
 void oexpr_free(t_oexpr *x){
+	odot_stats_forget(x);
 	if(x->expr){
 		osc_expr_free(x->expr);
 	}
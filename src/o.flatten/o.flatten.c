@@ -49,9 +49,12 @@
 #endif
 #include "osc.h"
 #include "osc_mem.h"
+#include "osc_byteorder.h"
 #include "omax_util.h"
 #include "omax_doc.h"
 #include "omax_dict.h"
+#include "odot_scratch.h"
+#include "odot_argsize.h"
 
 #include "o.h"
 
@@ -61,23 +64,301 @@ typedef struct _oflatten{
 	int level;
 	t_symbol *sep;
 	int remove_enclosing_address_if_empty;
+	t_critical lock;
+	// scratch space, kept between packets and only ever grown
+	char *prefix;	// the joined address of the message being flattened
+	long prefixsize;
+	char *seen;	// the addresses that have been output so far, one after the other
+	long seenlen, seensize;
+	long *seentab;	// open addressing hash table of offsets into seen, plus 1
+	long nseen, seentabsize;
 } t_oflatten;
 
 void *oflatten_class;
 
-int oflatten_copybundle(t_oflatten *x, long len, char *ptr);
+/*
+Messages are taken out of nested bundles in one walk over the serialized
+packet, and written straight into the output, which is measured first by
+doing the same walk without writing.  The address of a nested message is
+built up in x->prefix as the walk goes down, and cut back as it comes up,
+so joining addresses never allocates.
+
+The first message with a given address wins; later ones are discarded.
+*/
+
+static int oflatten_reserve(char **buf, long *size, long n)
+{
+	if(n <= *size){
+		return 0;
+	}
+	long newsize = *size ? *size : 256;
+	while(newsize < n){
+		newsize *= 2;
+	}
+	char *tmp = (char *)osc_mem_resize(*buf, newsize);
+	if(!tmp){
+		return 1;
+	}
+	*buf = tmp;
+	*size = newsize;
+	return 0;
+}
+
+static unsigned long oflatten_hash(const char *s, long n)
+{
+	unsigned long h = 2166136261UL;
+	long i;
+	for(i = 0; i < n; i++){
+		h = (h ^ (unsigned char)s[i]) * 16777619UL;
+	}
+	return h;
+}
+
+static void oflatten_clearSeen(t_oflatten *x)
+{
+	x->seenlen = 0;
+	x->nseen = 0;
+	if(x->seentab){
+		memset(x->seentab, '\0', x->seentabsize * sizeof(long));
+	}
+}
+
+// returns 1 if address has been seen already, otherwise remembers it and returns 0.
+// returns -1 if we're out of memory
+static int oflatten_seen(t_oflatten *x, const char *address, long n)
+{
+	if((x->nseen + 1) * 2 > x->seentabsize){
+		long size = x->seentabsize ? x->seentabsize * 2 : 64;
+		long *tab = (long *)osc_mem_alloc(size * sizeof(long));
+		if(!tab){
+			return -1;
+		}
+		memset(tab, '\0', size * sizeof(long));
+		long i;
+		for(i = 0; i < x->seentabsize; i++){
+			long o = x->seentab[i];
+			if(o){
+				char *s = x->seen + o - 1;
+				unsigned long j = oflatten_hash(s, strlen(s)) & (size - 1);
+				while(tab[j]){
+					j = (j + 1) & (size - 1);
+				}
+				tab[j] = o;
+			}
+		}
+		if(x->seentab){
+			osc_mem_free(x->seentab);
+		}
+		x->seentab = tab;
+		x->seentabsize = size;
+	}
+	unsigned long j = oflatten_hash(address, n) & (x->seentabsize - 1);
+	while(x->seentab[j]){
+		char *s = x->seen + x->seentab[j] - 1;
+		if(!strncmp(s, address, n) && s[n] == '\0'){
+			return 1;
+		}
+		j = (j + 1) & (x->seentabsize - 1);
+	}
+	if(oflatten_reserve(&(x->seen), &(x->seensize), x->seenlen + n + 1)){
+		return -1;
+	}
+	memcpy(x->seen + x->seenlen, address, n);
+	x->seen[x->seenlen + n] = '\0';
+	x->seentab[j] = x->seenlen + 1;
+	x->seenlen += n + 1;
+	x->nseen++;
+	return 0;
+}
+
+/*
+Flatten the elements of the bundle at ptr, whose messages are at the given
+depth, and whose enclosing address is the first prefixlen bytes of
+x->prefix.  Writes them into out at pos, or just measures them if out is
+NULL, and returns the new position, or -1 if the packet is malformed.
+*/
+static long oflatten_bundle(t_oflatten *x, long len, char *ptr, int depth, long prefixlen, char *out, long pos)
+{
+	long seplen = strlen(x->sep->s_name);
+	char *p = ptr + OSC_HEADER_SIZE;
+	char *e = ptr + len;
+	while(p < e){
+		if(e - p < 4){
+			return -1;
+		}
+		long n = ntoh32(*((uint32_t *)p));
+		if(n < 0 || n > e - p - 4){
+			return -1;
+		}
+		char *m = p + 4;
+		char *me = m + n;
+		p = me;
+		if(n >= OSC_ID_SIZE && !strncmp(m, "#bundle", OSC_ID_SIZE)){
+			pos = oflatten_bundle(x, n, m, depth, prefixlen, out, pos);
+			if(pos < 0){
+				return -1;
+			}
+			continue;
+		}
+		char *z = memchr(m, '\0', n);
+		if(!z){
+			return -1;
+		}
+		long addresslen = z - m;
+		long paddedaddresslen = (addresslen / 4 + 1) * 4;
+		char *tt = NULL, *data = me;
+		long ntt = 0;
+		if(paddedaddresslen < n && m[paddedaddresslen] == ','){
+			tt = m + paddedaddresslen;
+			z = memchr(tt, '\0', me - tt);
+			if(!z){
+				return -1;
+			}
+			ntt = z - tt - 1;
+			data = tt + ((z - tt) / 4 + 1) * 4;
+			if(data > me){
+				return -1;
+			}
+		}
+
+		// the joined address goes on the end of the prefix
+		long joinedlen = prefixlen + (prefixlen ? seplen : 0) + addresslen;
+		if(oflatten_reserve(&(x->prefix), &(x->prefixsize), joinedlen + 1)){
+			return -1;
+		}
+		char *joined = x->prefix + prefixlen;
+		if(prefixlen){
+			memcpy(joined, x->sep->s_name, seplen);
+			joined += seplen;
+		}
+		memcpy(joined, m, addresslen);
+		x->prefix[joinedlen] = '\0';
+
+		int flatten = x->level <= 0 || depth <= x->level;
+		long nbundles = 0, datalen = 0, i;
+		char *a = data;
+		for(i = 1; i <= ntt; i++){
+			long argsize = odot_argSize(tt[i], a, me);
+			if(argsize < 0){
+				return -1;
+			}
+			if(flatten && tt[i] == OSC_BUNDLE_TYPETAG){
+				nbundles++;
+			}else{
+				datalen += argsize;
+			}
+			a += argsize;
+		}
+		if(ntt > nbundles || !nbundles || !x->remove_enclosing_address_if_empty){
+			int seen = oflatten_seen(x, x->prefix, joinedlen);
+			if(seen < 0){
+				return -1;
+			}
+			if(!seen){
+				long newntt = ntt - nbundles;
+				long paddedjoinedlen = (joinedlen / 4 + 1) * 4;
+				long ttlen = tt ? ((newntt + 1) / 4 + 1) * 4 : 0;
+				long msglen = paddedjoinedlen + ttlen + datalen;
+				if(out){
+					char *o = out + pos;
+					*((uint32_t *)o) = hton32((uint32_t)msglen);
+					o += 4;
+					memset(o, '\0', paddedjoinedlen + ttlen);
+					memcpy(o, x->prefix, joinedlen);
+					o += paddedjoinedlen;
+					if(tt){
+						char *ttout = o;
+						char *dataout = o + ttlen;
+						*ttout++ = ',';
+						a = data;
+						for(i = 1; i <= ntt; i++){
+							long argsize = odot_argSize(tt[i], a, me);
+							if(!flatten || tt[i] != OSC_BUNDLE_TYPETAG){
+								*ttout++ = tt[i];
+								memcpy(dataout, a, argsize);
+								dataout += argsize;
+							}
+							a += argsize;
+						}
+					}
+				}
+				pos += 4 + msglen;
+			}
+		}
+		if(nbundles){
+			a = data;
+			for(i = 1; i <= ntt; i++){
+				long argsize = odot_argSize(tt[i], a, me);
+				if(tt[i] == OSC_BUNDLE_TYPETAG){
+					if(argsize - 4 < OSC_HEADER_SIZE){
+						return -1;
+					}
+					pos = oflatten_bundle(x, argsize - 4, a + 4, depth + 1, joinedlen, out, pos);
+					if(pos < 0){
+						return -1;
+					}
+				}
+				a += argsize;
+			}
+		}
+	}
+	return pos;
+}
 
 void oflatten_fullPacket(t_oflatten *x, t_symbol *msg, int argc, t_atom *argv)
 {
 	OMAX_UTIL_GET_LEN_AND_PTR
-	char srcc[osc_bundle_s_getStructSize()];
-	t_osc_bndl_s *src = (t_osc_bndl_s *)srcc;
-	osc_bundle_s_setLen(src, len);
-	osc_bundle_s_setPtr(src, ptr);
-	t_osc_bndl_s *dest = NULL;
-	osc_bundle_s_flatten(&dest, src, x->level, x->sep->s_name, x->remove_enclosing_address_if_empty);
-	omax_util_outletOSC(x->outlet, osc_bundle_s_getLen(dest), osc_bundle_s_getPtr(dest));
-	osc_bundle_s_deepFree(dest);
+	if(len < OSC_HEADER_SIZE || strncmp(ptr, "#bundle", OSC_ID_SIZE)){
+		object_error((t_object *)x, "invalid OSC packet");
+		return;
+	}
+	critical_enter(x->lock);
+	oflatten_clearSeen(x);
+	long outlen = oflatten_bundle(x, len, ptr, 1, 0, NULL, OSC_HEADER_SIZE);
+	if(outlen < 0){
+		critical_exit(x->lock);
+		object_error((t_object *)x, "invalid OSC packet");
+		return;
+	}
+	t_odot_scratch_mark mark = odot_scratch_mark();
+	char *out = (char *)odot_scratch_alloc(outlen);
+	if(!out){
+		critical_exit(x->lock);
+		odot_scratch_release(mark);
+		object_error((t_object *)x, "out of memory");
+		return;
+	}
+	memcpy(out, ptr, OSC_HEADER_SIZE);
+	oflatten_clearSeen(x);
+	oflatten_bundle(x, len, ptr, 1, 0, out, OSC_HEADER_SIZE);
+	critical_exit(x->lock);
+	omax_util_outletOSC(x->outlet, outlen, out);
+	odot_scratch_release(mark);
+}
+
+void oflatten_free(t_oflatten *x)
+{
+	odot_stats_forget(x);
+	critical_free(x->lock);
+	if(x->prefix){
+		osc_mem_free(x->prefix);
+	}
+	if(x->seen){
+		osc_mem_free(x->seen);
+	}
+	if(x->seentab){
+		osc_mem_free(x->seentab);
+	}
+	odot_scratch_trim();
+}
+
+static void oflatten_initScratch(t_oflatten *x)
+{
+	critical_new(&(x->lock));
+	x->prefix = x->seen = NULL;
+	x->prefixsize = x->seenlen = x->seensize = 0;
+	x->seentab = NULL;
+	x->nseen = x->seentabsize = 0;
 }
 
 void oflatten_doc(t_oflatten *x)
@@ -94,6 +375,7 @@ void *oflatten_new(t_symbol *msg, short argc, t_atom *argv)
 		x->level = 0;
 		x->sep = gensym("");
 		x->remove_enclosing_address_if_empty = 1;
+		oflatten_initScratch(x);
 
 /********************* PD Pseudo-attributed, commented out for 1.0 release
  
@@ -149,7 +431,7 @@ void *oflatten_new(t_symbol *msg, short argc, t_atom *argv)
 
 int setup_o0x2eflatten(void)
 {
-	t_class *c = class_new(gensym("o.flatten"), (t_newmethod)oflatten_new, NULL, sizeof(t_oflatten), 0L, A_GIMME, 0);
+	t_class *c = class_new(gensym("o.flatten"), (t_newmethod)oflatten_new, (t_method)oflatten_free, sizeof(t_oflatten), 0L, A_GIMME, 0);
 	class_addmethod(c, (t_method)oflatten_fullPacket, gensym("FullPacket"), A_GIMME, 0);
 	class_addmethod(c, (t_method)oflatten_doc, gensym("doc"), 0);
 
@@ -178,6 +460,7 @@ void *oflatten_new(t_symbol *msg, short argc, t_atom *argv)
 		x->level = 0;
 		x->sep = gensym("");
 		x->remove_enclosing_address_if_empty = 1;
+		oflatten_initScratch(x);
 		attr_args_process(x, argc, argv);
 	}
 		   	
@@ -186,7 +469,7 @@ void *oflatten_new(t_symbol *msg, short argc, t_atom *argv)
 
 int main(void)
 {
-	t_class *c = class_new("o.flatten", (method)oflatten_new, NULL, sizeof(t_oflatten), 0L, A_GIMME, 0);
+	t_class *c = class_new("o.flatten", (method)oflatten_new, (method)oflatten_free, sizeof(t_oflatten), 0L, A_GIMME, 0);
 	//class_addmethod(c, (method)oflatten_fullPacket, "FullPacket", A_LONG, A_LONG, 0);
 	class_addmethod(c, (method)oflatten_fullPacket, "FullPacket", A_GIMME, 0);
 	class_addmethod(c, (method)oflatten_assist, "assist", A_CANT, 0);
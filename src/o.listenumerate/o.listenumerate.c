@@ -56,6 +56,7 @@
 #include "omax_dict.h"
 
 #include "o.h"
+#include "odot_scratch.h"
 
 typedef struct _olistenumerate{
 	t_object ob;
@@ -99,7 +100,16 @@ void olistenumerate_doFullPacket(t_olistenumerate *x,
     
     t_osc_msg_ar_s *matches = osc_bundle_s_lookupAddress(len, ptr, address_name, 1);
     
-    char delegate[len];
+    t_odot_scratch_mark mark = odot_scratch_mark();
+    char *delegate = (char *)odot_scratch_alloc(len);
+    if (!delegate) {
+        odot_scratch_release(mark);
+        if (matches) {
+            osc_array_free(matches);
+        }
+        object_error((t_object *)x, "out of memory");
+        return;
+    }
     long dlen = len;
     memcpy(delegate, ptr, len);
     
@@ -174,6 +184,7 @@ void olistenumerate_doFullPacket(t_olistenumerate *x,
     if (matches) {
         osc_array_free(matches);
     }
+    odot_scratch_release(mark);
 }
 
 void olistenumerate_noMatchesOrData(t_olistenumerate *x)
@@ -228,10 +239,12 @@ void olistenumerate_doc(t_olistenumerate *x)
 
 void olistenumerate_free(t_olistenumerate *x)
 {
+	odot_stats_forget(x);
 	critical_free(x->lock);
     if (x->outlets) {
         free(x->outlets);
     }
+	odot_scratch_trim();
 }
 
 void *olistenumerate_new(t_symbol *msg, short argc, t_atom *argv)
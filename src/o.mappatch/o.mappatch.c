@@ -28,14 +28,16 @@ COPYRIGHT_YEARS: 2009
 SVN_REVISION: $LastChangedRevision: 587 $
 VERSION 0.0: First try
 VERSION 1.0: New name
+VERSION 1.1: Bounded, preallocated queue for packets that arrive while busy
+VERSION 1.2: Expression mode evaluated on a pool of worker threads
 @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
 */
 
 #define OMAX_DOC_NAME "o.mappatch"
 #define OMAX_DOC_SHORT_DESC "Map the contents of an OSC bundle onto a Max patch"
-#define OMAX_DOC_LONG_DESC "o.mappatch takes an OSC bundle in the right inlet and outputs each of the messages contained in it in sequence out the right outlet as OSC-style Max-messages.  After processing each message, it should be sent back into the right inlet (or not if it is to be excluded from the bundle).  After all messages have been processed, the resulting bundle with any modifications will come out the left outlet"
+#define OMAX_DOC_LONG_DESC "o.mappatch takes an OSC bundle in the right inlet and outputs each of the messages contained in it in sequence out the right outlet as OSC-style Max-messages.  After processing each message, it should be sent back into the right inlet (or not if it is to be excluded from the bundle).  After all messages have been processed, the resulting bundle with any modifications will come out the left outlet.  Alternatively, the mapping can be given as an expression with the expr message, in which case each message is evaluated as a bundle containing /address and /value on a pool of @threads worker threads, and the results are reassembled in order."
 #define OMAX_DOC_INLETS_DESC (char *[]){"OSC FullPacket", "OSC-style Max messages to be included in the bundle"}
-#define OMAX_DOC_OUTLETS_DESC (char *[]){"OSC FullPacket: results of the mapping", "OSC-style Max messages contained in the bundle"}
+#define OMAX_DOC_OUTLETS_DESC (char *[]){"OSC FullPacket: results of the mapping", "OSC-style Max messages contained in the bundle", "OSC FullPacket that arrived while the queue was full"}
 #define OMAX_DOC_SEEALSO (char *[]){"o.expr", "o.callpatch", "o.atomize"}
 
 
@@ -60,7 +62,10 @@ VERSION 1.0: New name
 #include "omax_dict.h"
 
 #include "o.h"
+#include "odot_mapexpr.h"
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
 /*
 When a new FullPacket message comes in, we make an unserialized bundle and stick it in our object
@@ -77,17 +82,37 @@ object struct to note that we are currently busy.  If we receive a FullPacket me
 busy, we simply copy it and add it to our queue and process it when we're done with the current
 FullPacket message.
 
+The queue is a ring buffer of @queuesize slots.  Each slot keeps its buffer after the packet in it
+has been processed, so once the slots have grown to the size of the packets going through, 
+queueing doesn't allocate anything.  Packets that arrive while the queue is full go out the 
+rightmost outlet.
+
+Expression mode: if an expression has been set with the expr message, the patch isn't used at all.
+Each message in the bundle is turned into a little bundle of its own,
+
+	/address : "/foo", /value : [the arguments of /foo]
+
+the expression is evaluated on that, and whatever /value holds afterwards goes into the output under
+whatever /address holds (so an expression can rename a message, or drop it by deleting /value).
+Since each message is evaluated independently, the messages of a large bundle are split between
+the calling thread and @threads worker threads, each with its own copy of the expression (see
+odot_mapexpr.h).  The expression must not depend on anything but the message it's given--there's
+no guarantee about which thread evaluates which message.
+
  */
 
+#define OMAP_DEFAULT_QUEUE_SIZE 256
+#define OMAP_MAX_THREADS ODOT_MAPEXPR_MAX_THREADS
+
 typedef struct _omap_qitem{
 	char *bndl;
 	long len;
-	struct _omap_qitem *next;
+	long size;
 } t_omap_qitem;
 
 typedef struct _omap{
 	t_object ob;
-	void *outlets[2];
+	void *outlets[3];
 #ifdef OMAX_PD_VERSION
     void **proxy;
 #else
@@ -95,10 +120,15 @@ typedef struct _omap{
 #endif
 	long inlet;
 	t_critical lock;
-	t_omap_qitem *fifo;
+	t_omap_qitem *queue;
+	long queue_max;
+	long queue_head;
+	long queue_count;
 	t_osc_bndl_u *bndl;
 	t_osc_msg_s *msg;
 	int busy;
+	t_odot_mapexpr mapexpr;
+	long nthreads;
 } t_omap;
 
 #ifdef OMAX_PD_VERSION
@@ -109,7 +139,9 @@ void *omap_class;
 #endif
 
 void omap_list(t_omap *x, t_symbol *sym, short argc, t_atom *argv);
-void omap_addQitem(t_omap *x, t_omap_qitem *qi);
+int omap_enqueue(t_omap *x, long len, char *ptr);
+void omap_map(t_omap *x, long len, char *ptr);
+void omap_mapExpr(t_omap *x, long len, char *ptr);
 
 t_symbol *ps_FullPacket;
 
@@ -131,18 +163,43 @@ void omap_fullPacket(t_omap *x, t_symbol *msg, int argc, t_atom *argv)
 		return;
 	}
     
+	critical_enter(x->lock);
 	if(x->busy){
-		t_omap_qitem *qi = (t_omap_qitem *)osc_mem_alloc(sizeof(t_omap_qitem));
-		qi->len = len;
-		qi->bndl = (char *)osc_mem_alloc(len);
-		qi->next = NULL;
-		memcpy(qi->bndl, ptr, len);
-		omap_addQitem(x, qi);
+		int overflow = omap_enqueue(x, len, ptr);
+		critical_exit(x->lock);
+		if(overflow){
+			omax_util_outletOSC(x->outlets[2], len, ptr);
+		}
 		return;
-	}else{
-		critical_enter(x->lock);
-		x->busy = 1;
+	}
+	x->busy = 1;
+	critical_exit(x->lock);
+
+	omap_map(x, len, ptr);
+
+	// process whatever came in while we were busy.  we do this here rather
+	// than use the scheduler so that we don't get interrupted by a new
+	// FullPacket message while we're waiting for the scheduler to execute.
+	// the slot at the head stays occupied until we're done with it, so
+	// anything that gets queued in the meantime can't overwrite it.
+	critical_enter(x->lock);
+	while(x->queue_count){
+		t_omap_qitem *qi = x->queue + x->queue_head;
 		critical_exit(x->lock);
+		omap_map(x, qi->len, qi->bndl);
+		critical_enter(x->lock);
+		x->queue_head = (x->queue_head + 1) % x->queue_max;
+		x->queue_count--;
+	}
+	x->busy = 0;
+	critical_exit(x->lock);
+}
+
+void omap_map(t_omap *x, long len, char *ptr)
+{
+	if(x->mapexpr.expr){
+		omap_mapExpr(x, len, ptr);
+		return;
 	}
 	x->bndl = osc_bundle_u_alloc();
 
@@ -171,22 +228,117 @@ void omap_fullPacket(t_omap *x, t_symbol *msg, int argc, t_atom *argv)
 		x->bndl = NULL;
 	}
 	x->msg = NULL;
-	x->busy = 0;
-	if(x->fifo){
-		t_omap_qitem *qi = x->fifo;
-		x->fifo = qi->next;
-		// we want to do this recursively rather than use the scheduler to avoid 
-		// recursion so that we don't get interrupted by a new FullPacket message while
-		// we're waiting for the scheduler to execute.
+	critical_exit(x->lock);
+}
+
+void omap_mapExpr(t_omap *x, long len, char *ptr)
+{
+	long outlen = 0;
+	int nothreads = 0;
+	int ret = odot_mapexpr_map(&(x->mapexpr), x->nthreads, len, ptr, &outlen, &nothreads);
+	if(nothreads){
+		object_error((t_object *)x, "couldn't start worker threads--evaluating on one thread");
+		x->nthreads = 0;
+	}
+	if(ret){
+		object_error((t_object *)x, "out of memory!");
+		return;
+	}
+	omax_util_outletOSC(x->outlets[0], outlen, x->mapexpr.outbuf);
+}
+
+#ifdef OMAX_PD_VERSION
+#define OMAP_ATOM_FLOAT t_float
+#else
+#define OMAP_ATOM_FLOAT double
+#endif
+
+// the shortest text that reads back as the same atom, with a decimal
+// point so that the parser doesn't take it for an int.  at most 25 chars
+int omap_sprintFloat(char *buf, double f)
+{
+	int prec, n = 0;
+	for(prec = 1; prec <= 17; prec++){
+		n = sprintf(buf, "%.*g", prec, f);
+		if((OMAP_ATOM_FLOAT)strtod(buf, NULL) == (OMAP_ATOM_FLOAT)f){
+			break;
+		}
+	}
+	if(!strpbrk(buf, ".en")){
+		buf[n++] = '.';
+		buf[n] = '\0';
+	}
+	return n;
+}
+
+void omap_expr(t_omap *x, t_symbol *msg, short argc, t_atom *argv)
+{
+	long buflen = 1;
+	int i;
+	for(i = 0; i < argc; i++){
+		if(atom_gettype(argv + i) == A_SYM){
+			buflen += strlen(atom_getsym(argv + i)->s_name) + 1;
+		}else{
+			buflen += 32;
+		}
+	}
+	char buf[buflen];
+	char *ptr = buf;
+	*ptr = '\0';
+	for(i = 0; i < argc; i++){
+		switch(atom_gettype(argv + i)){
+#ifndef OMAX_PD_VERSION
+		case A_LONG:
+			ptr += sprintf(ptr, "%lld ", (long long)atom_getlong(argv + i));
+			break;
+#endif
+		case A_FLOAT:
+			ptr += omap_sprintFloat(ptr, atom_getfloat(argv + i));
+			*ptr++ = ' ';
+			*ptr = '\0';
+			break;
+		case A_SYM:
+			ptr += sprintf(ptr, "%s ", atom_getsym(argv + i)->s_name);
+			break;
+		default:
+			break;
+		}
+	}
+	critical_enter(x->lock);
+	if(x->busy){
 		critical_exit(x->lock);
-		//omap_fullPacket(x, qi->len, (long)(qi->bndl));
-		t_atom a[2];
-		atom_setlong(a, qi->len);
-		atom_setlong(a + 1, (long)(qi->bndl));
-		omap_fullPacket(x, NULL, 2, a);
-		osc_mem_free(qi);
+		object_error((t_object *)x, "can't change the expression while packets are being processed");
+		return;
 	}
+	// an expr message with no arguments clears the expression
+	int ret = odot_mapexpr_setExpr(&(x->mapexpr), argc ? buf : NULL);
 	critical_exit(x->lock);
+	if(ret){
+		object_error((t_object *)x, "error parsing %s", buf);
+	}
+}
+
+t_max_err omap_setThreads(t_omap *x, void *attr, long ac, t_atom *av)
+{
+	if(!ac || !av){
+		return MAX_ERR_NONE;
+	}
+	long n = atom_getlong(av);
+	if(n < 0 || n > OMAP_MAX_THREADS){
+		object_error((t_object *)x, "threads must be between 0 and %d", OMAP_MAX_THREADS);
+		return MAX_ERR_GENERIC;
+	}
+	critical_enter(x->lock);
+	if(x->busy){
+		critical_exit(x->lock);
+		object_error((t_object *)x, "can't change the number of threads while packets are being processed");
+		return MAX_ERR_GENERIC;
+	}
+	// the pool is started again the next time it's needed
+	odot_mapexpr_stop(&(x->mapexpr));
+	x->nthreads = n;
+	critical_exit(x->lock);
+	return MAX_ERR_NONE;
 }
 
 void omap_int(t_omap *x, long l)
@@ -273,21 +425,81 @@ void omap_list(t_omap *x, t_symbol *sym, short argc, t_atom *argv)
 	//x->buffer_pos += omax_util_encode_atoms(x->buffer + x->buffer_pos, address, argc, argv);
 }
 
-void omap_addQitem(t_omap *x, t_omap_qitem *qi)
+// copy a packet into the tail of the queue.  returns 1 if the queue is full.
+// must be called with x->lock held
+int omap_enqueue(t_omap *x, long len, char *ptr)
 {
-	critical_enter(x->lock);
-	if(x->fifo){
-		t_omap_qitem *q = x->fifo;
-		while(q->next){
-			q = q->next;
+	if(x->queue_count == x->queue_max){
+		return 1;
+	}
+	t_omap_qitem *qi = x->queue + ((x->queue_head + x->queue_count) % x->queue_max);
+	if(len > qi->size){
+		char *tmp = (char *)osc_mem_resize(qi->bndl, len);
+		if(!tmp){
+			return 1;
 		}
-		q->next = qi;
-	}else{
-		x->fifo = qi;
+		qi->bndl = tmp;
+		qi->size = len;
 	}
-	critical_exit(x->lock);
+	memcpy(qi->bndl, ptr, len);
+	qi->len = len;
+	x->queue_count++;
+	return 0;
 }
 
+void omap_freeQueue(t_omap *x)
+{
+	if(x->queue){
+		long i;
+		for(i = 0; i < x->queue_max; i++){
+			if(x->queue[i].bndl){
+				osc_mem_free(x->queue[i].bndl);
+			}
+		}
+		osc_mem_free(x->queue);
+		x->queue = NULL;
+	}
+	x->queue_head = 0;
+	x->queue_count = 0;
+}
+
+int omap_allocQueue(t_omap *x, long n)
+{
+	t_omap_qitem *q = (t_omap_qitem *)osc_mem_alloc(n * sizeof(t_omap_qitem));
+	if(!q){
+		return 1;
+	}
+	memset(q, '\0', n * sizeof(t_omap_qitem));
+	omap_freeQueue(x);
+	x->queue = q;
+	x->queue_max = n;
+	return 0;
+}
+
+t_max_err omap_setQueueSize(t_omap *x, void *attr, long ac, t_atom *av)
+{
+	if(!ac || !av){
+		return MAX_ERR_NONE;
+	}
+	long n = atom_getlong(av);
+	if(n < 1){
+		object_error((t_object *)x, "queuesize must be at least 1");
+		return MAX_ERR_GENERIC;
+	}
+	critical_enter(x->lock);
+	if(x->busy || x->queue_count){
+		critical_exit(x->lock);
+		object_error((t_object *)x, "can't change the queue size while packets are being processed");
+		return MAX_ERR_GENERIC;
+	}
+	if(omap_allocQueue(x, n)){
+		critical_exit(x->lock);
+		object_error((t_object *)x, "out of memory!");
+		return MAX_ERR_GENERIC;
+	}
+	critical_exit(x->lock);
+	return MAX_ERR_NONE;
+}
 
 void omap_doc(t_omap *x)
 {
@@ -296,6 +508,9 @@ void omap_doc(t_omap *x)
 
 void omap_free(t_omap *x)
 {
+	odot_stats_forget(x);
+	odot_mapexpr_free(&(x->mapexpr));
+	omap_freeQueue(x);
 #ifdef OMAX_PD_VERSION
     if(x->proxy){
         pd_free(x->proxy[0]); 
@@ -316,15 +531,55 @@ void *omap_new(t_symbol *msg, short argc, t_atom *argv){
 	if((x = (t_omap *)object_alloc(omap_class->class))){
 		x->outlets[0] = outlet_new((t_object *)x, NULL);
 		x->outlets[1] = outlet_new((t_object *)x, gensym("FullPacket"));
-		x->proxy = (void **)malloc(2 * sizeof(t_omax_pd_proxy *));
-		x->proxy[0] = proxy_new((t_object *)x, 0, &(x->inlet), omap_proxy_class);
-		x->proxy[1] = proxy_new((t_object *)x, 1, &(x->inlet), omap_proxy_class);
-        
+		x->outlets[2] = outlet_new((t_object *)x, gensym("FullPacket"));
 		x->bndl = NULL;
 		x->msg = NULL;
-		x->fifo = NULL;
+		x->queue = NULL;
+		x->queue_max = 0;
+		x->queue_head = 0;
+		x->queue_count = 0;
 		x->busy = 0;
+		odot_mapexpr_init(&(x->mapexpr));
+		x->nthreads = odot_mapexpr_defaultThreads();
 		critical_new(&(x->lock));
+		x->proxy = (void **)malloc(2 * sizeof(t_omax_pd_proxy *));
+		if(!x->proxy){
+			object_error((t_object *)x, "out of memory!");
+			pd_free((t_pd *)x);
+			return NULL;
+		}
+		x->proxy[0] = proxy_new((t_object *)x, 0, &(x->inlet), omap_proxy_class);
+		x->proxy[1] = proxy_new((t_object *)x, 1, &(x->inlet), omap_proxy_class);
+
+		long queuesize = OMAP_DEFAULT_QUEUE_SIZE;
+		int i;
+		for(i = 0; i < argc; i++){
+			if(atom_gettype(argv + i) == A_SYM && atom_getsym(argv + i) == gensym("@queuesize")){
+				if(i + 1 < argc && atom_gettype(argv + i + 1) == A_FLOAT){
+					queuesize = atom_getfloat(argv + ++i);
+				}else{
+					post("@queuesize value must be a number");
+				}
+			}else if(atom_gettype(argv + i) == A_SYM && atom_getsym(argv + i) == gensym("@threads")){
+				if(i + 1 < argc && atom_gettype(argv + i + 1) == A_FLOAT){
+					t_atom a;
+					atom_setlong(&a, atom_getfloat(argv + ++i));
+					omap_setThreads(x, NULL, 1, &a);
+				}else{
+					post("@threads value must be a number");
+				}
+			}else{
+				post("o.mappatch optional attributes are @queuesize and @threads");
+			}
+		}
+		t_atom a;
+		atom_setlong(&a, queuesize);
+		omap_setQueueSize(x, NULL, 1, &a);
+		if(!x->queue){
+			// omap_free takes the proxies and everything else down with it
+			pd_free((t_pd *)x);
+			return NULL;
+		}
 	}
     
 	return(x);
@@ -339,6 +594,7 @@ int setup_o0x2emappatch(void){
     
     omax_pd_class_addmethod(c, (t_method)odot_version, gensym("version"));
 	omax_pd_class_addmethod(c, (t_method)omap_fullPacket, gensym("FullPacket"));
+	omax_pd_class_addmethod(c, (t_method)omap_expr, gensym("expr"));
     omax_pd_class_addmethod(c, (t_method)omap_list, gensym("list"));
 	omax_pd_class_addanything(c, (t_method)omap_anything);
 	omax_pd_class_addfloat(c, (t_method)omap_float);
@@ -362,14 +618,31 @@ OMAX_DICT_DICTIONARY(t_omap, x, omap_fullPacket);
 void *omap_new(t_symbol *msg, short argc, t_atom *argv){
 	t_omap *x;
 	if((x = (t_omap *)object_alloc(omap_class))){
+		x->outlets[2] = outlet_new((t_object *)x, "FullPacket");
 		x->outlets[1] = outlet_new((t_object *)x, NULL);
 		x->outlets[0] = outlet_new((t_object *)x, "FullPacket");
 		x->proxy = proxy_new((t_object *)x, 1, &(x->inlet));
 		x->bndl = NULL;
 		x->msg = NULL;
-		x->fifo = NULL;
+		x->queue = NULL;
+		x->queue_max = 0;
+		x->queue_head = 0;
+		x->queue_count = 0;
 		x->busy = 0;
+		odot_mapexpr_init(&(x->mapexpr));
+		x->nthreads = odot_mapexpr_defaultThreads();
 		critical_new(&(x->lock));
+
+		attr_args_process(x, argc, argv);
+		if(!x->queue){
+			t_atom a;
+			atom_setlong(&a, OMAP_DEFAULT_QUEUE_SIZE);
+			omap_setQueueSize(x, NULL, 1, &a);
+			if(!x->queue){
+				object_free(x);
+				return NULL;
+			}
+		}
 	}
 		   	
 	return(x);
@@ -379,6 +652,7 @@ int main(void){
 	t_class *c = class_new("o.mappatch", (method)omap_new, (method)omap_free, sizeof(t_omap), 0L, A_GIMME, 0);
 	//class_addmethod(c, (method)omap_fullPacket, "FullPacket", A_LONG, A_LONG, 0);
 	class_addmethod(c, (method)omap_fullPacket, "FullPacket", A_GIMME, 0);
+	class_addmethod(c, (method)omap_expr, "expr", A_GIMME, 0);
 	class_addmethod(c, (method)omap_doc, "doc", 0);
 	class_addmethod(c, (method)omap_assist, "assist", A_CANT, 0);
 	class_addmethod(c, (method)omap_int, "int", A_LONG, 0);
@@ -392,6 +666,13 @@ int main(void){
 		class_addmethod(c, (method)omax_dict_dictionary, "dictionary", A_GIMME, 0);
 	//}
 
+	CLASS_ATTR_LONG(c, "queuesize", 0, t_omap, queue_max);
+	CLASS_ATTR_ACCESSORS(c, "queuesize", NULL, omap_setQueueSize);
+	CLASS_ATTR_FILTER_MIN(c, "queuesize", 1);
+
+	CLASS_ATTR_LONG(c, "threads", 0, t_omap, nthreads);
+	CLASS_ATTR_ACCESSORS(c, "threads", NULL, omap_setThreads);
+	CLASS_ATTR_FILTER_CLIP(c, "threads", 0, OMAP_MAX_THREADS);
 
 	class_register(CLASS_BOX, c);
 	omap_class = c;
@@ -83,6 +83,8 @@
 //#include <mach/mach_time.h>
 
 #include "o.h"
+#include "odot_packet.h"
+#include "odot_redraw.h"
 
 #define OMESSAGE_MAX_NUM_MESSAGES 128
 #define OMESSAGE_MAX_MESSAGE_LENGTH 128
@@ -181,7 +183,7 @@ typedef struct _omessage {
     //new version
     int newbndl;
 	t_osc_bndl_u *bndl_u;
-	t_osc_bndl_s *bndl_s;
+	t_odot_packet *bndl_s;
 	int bndl_has_subs;
 	int bndl_has_been_checked_for_subs;
 
@@ -191,6 +193,7 @@ typedef struct _omessage {
     int have_new_data;
 	int draw_new_data_indicator;
 	t_clock *new_data_indicator_clock;
+	t_odot_redraw redraw;
     
     int     softlock;
     
@@ -209,7 +212,7 @@ typedef struct _omessage{
 	t_critical lock;
 	int newbndl;
 	t_osc_bndl_u *bndl_u;
-	t_osc_bndl_s *bndl_s;
+	t_odot_packet *bndl_s;
 	int bndl_has_subs;
 	int bndl_has_been_checked_for_subs;
 	long textlen;
@@ -219,6 +222,7 @@ typedef struct _omessage{
 	int have_new_data;
 	int draw_new_data_indicator;
 	void *new_data_indicator_clock;
+	t_odot_redraw redraw;
 } t_omessage;
 
 static t_class *omessage_class;
@@ -239,8 +243,10 @@ void omessage_enter(t_omessage *x);
 void omessage_gettext(t_omessage *x);
 void omessage_clear(t_omessage *x);
 void omessage_clearBundles(t_omessage *x);
-void omessage_newBundle(t_omessage *x, t_osc_bndl_u *bu, t_osc_bndl_s *bs);
+void omessage_newBundle(t_omessage *x, t_osc_bndl_u *bu, t_odot_packet *bs);
 void omessage_output_bundle(t_omessage *x);
+void omessage_scheduleRedraw(t_omessage *x);
+void omessage_redrawTick(t_omessage *x);
 void omessage_bang(t_omessage *x);
 void omessage_int(t_omessage *x, long n);
 void omessage_float(t_omessage *x, double xx);
@@ -293,24 +299,49 @@ void omessage_fullPacket(t_omessage *x, t_symbol *msg, int argc, t_atom *argv)
 void omessage_doFullPacket(t_omessage *x, long len, char *ptr)
 {
 	osc_bundle_s_wrap_naked_message(len, ptr);
-	long copylen = len;
-	char *copyptr = osc_mem_alloc(len);
-	memcpy(copyptr, ptr, len);
-	t_osc_bndl_s *b = osc_bundle_s_alloc(copylen, copyptr);
-	omessage_newBundle(x, NULL, b);
-#ifdef OMAX_PD_VERSION
-    x->draw_new_data_indicator = 1;
-	x->have_new_data = 1;
-    jbox_redraw((t_jbox *)x);
-#else
+	// boxes used as templates are sent the same bundle over and over.
+	// if that's what this is, keep the packet we have, along with its
+	// text and anything we've worked out about it
+	critical_enter(x->lock);
+	int same = x->bndl_s && odot_packet_equals(x->bndl_s, len, ptr);
+	critical_exit(x->lock);
+	if(!same){
+		// keep the sender's packet if it has one, rather than a copy
+		t_odot_packet *b = odot_packet_retainOrCopy(len, ptr);
+		if(!b){
+			object_error((t_object *)x, "out of memory");
+			return;
+		}
+		omessage_newBundle(x, NULL, b);
+	}
 	x->draw_new_data_indicator = 1;
 	x->have_new_data = 1;
+	omessage_scheduleRedraw(x);
+}
+
+// redraw no more often than the display can show it
+void omessage_scheduleRedraw(t_omessage *x)
+{
+	if(odot_redraw_request(&(x->redraw))){
+#ifdef OMAX_PD_VERSION
+		jbox_redraw((t_jbox *)x);
+#else
+		qelem_set(x->qelem);
+#endif
+	}
+}
+
+void omessage_redrawTick(t_omessage *x)
+{
+	odot_redraw_fired(&(x->redraw));
+#ifdef OMAX_PD_VERSION
+	jbox_redraw((t_jbox *)x);
+#else
 	qelem_set(x->qelem);
-	//jbox_redraw((t_jbox *)x);
 #endif
 }
 
-void omessage_newBundle(t_omessage *x, t_osc_bndl_u *bu, t_osc_bndl_s *bs)
+void omessage_newBundle(t_omessage *x, t_osc_bndl_u *bu, t_odot_packet *bs)
 {
 	critical_enter(x->lock);
 	omessage_clearBundles(x);
@@ -329,7 +360,7 @@ void omessage_clearBundles(t_omessage *x)
 		x->bndl_u = NULL;
 	}
 	if(x->bndl_s){
-		osc_bundle_s_deepFree(x->bndl_s);
+		odot_packet_release(x->bndl_s);
 		x->bndl_s = NULL;
 	}
 #ifndef OMAX_PD_VERSION
@@ -344,17 +375,15 @@ void omessage_clearBundles(t_omessage *x)
 
 void omessage_output_bundle(t_omessage *x)
 {
-	// the use of critical sections is a little weird here, but correct.
+	// hold a reference to the packet while it's being output, so that a
+	// new one can come in without pulling it out from under whoever
+	// is downstream
 	critical_enter(x->lock);
 	if(x->bndl_s){
-		t_osc_bndl_s *b = x->bndl_s;
-		long len = osc_bundle_s_getLen(b);
-		char *ptr = osc_bundle_s_getPtr(b);
-		char buf[len];
-		memcpy(buf, ptr, len);
+		t_odot_packet *b = odot_packet_retain(x->bndl_s);
 		critical_exit(x->lock);
-		omax_util_outletOSC(x->outlet, len, buf);
-        OSC_MEM_INVALIDATE(buf);
+		odot_packet_outlet(x->outlet, b);
+		odot_packet_release(b);
 		return;
 	}
 	critical_exit(x->lock);
@@ -366,47 +395,53 @@ void omessage_output_bundle(t_omessage *x)
     OSC_MEM_INVALIDATE(buf);
 }
 
-void omessage_bundle2text(t_omessage *x)
+// the packet as text, if it's changed since the text was last made,
+// otherwise NULL
+static char *omessage_formatBundle(t_omessage *x, long *textlen)
 {
 	critical_enter(x->lock);
-	if(x->newbndl && x->bndl_s){
-		long len = osc_bundle_s_getLen(x->bndl_s);
-		char ptr[len];
-		memcpy(ptr, osc_bundle_s_getPtr(x->bndl_s), len);
+	if(!x->newbndl || !x->bndl_s){
 		critical_exit(x->lock);
-		long bufpos = osc_bundle_s_nformat(NULL, 0, len, (char *)ptr, 0);
-		char *buf = osc_mem_alloc(bufpos + 1);
+		return NULL;
+	}
+	t_odot_packet *b = odot_packet_retain(x->bndl_s);
+	x->newbndl = 0;
+	critical_exit(x->lock);
+	long len = odot_packet_getLen(b);
+	char *ptr = odot_packet_getPtr(b);
+	long bufpos = osc_bundle_s_nformat(NULL, 0, len, (char *)ptr, 0);
+	char *buf = osc_mem_alloc(bufpos + 1);
+	if(buf){
 		osc_bundle_s_nformat(buf, bufpos + 1, len, (char *)ptr, 0);
-		if (bufpos != 0) {
-			/*
-			if(buf[bufpos - 2] == '\n'){
-				buf[bufpos - 2] = '\0';
-			}
-			*/
-		} else {
+		if(bufpos == 0){
 			*buf = '\0';
 		}
-#ifndef OMAX_PD_VERSION
-		critical_enter(x->lock);
-		if(x->text){
-			osc_mem_free(x->text);
-		}
-		x->textlen = bufpos;
-        x->text = buf;
-		critical_exit(x->lock);
-        object_method(jbox_get_textfield((t_object *)x), gensym("settext"), buf);
-#else
-        omessage_resetText(x, buf);
+	}
+	odot_packet_release(b);
+	*textlen = bufpos;
+	return buf;
+}
 
-#endif
-/*
-        if(buf){
-            osc_mem_free(buf);
-        }
-*/
-		x->newbndl = 0;
+void omessage_bundle2text(t_omessage *x)
+{
+	long bufpos = 0;
+	char *buf = omessage_formatBundle(x, &bufpos);
+	if(!buf){
+		return;
+	}
+#ifndef OMAX_PD_VERSION
+	critical_enter(x->lock);
+	if(x->text){
+		osc_mem_free(x->text);
 	}
+	x->textlen = bufpos;
+	x->text = buf;
 	critical_exit(x->lock);
+	object_method(jbox_get_textfield((t_object *)x), gensym("settext"), buf);
+#else
+	omessage_resetText(x, buf);
+	osc_mem_free(buf);
+#endif
 }
 
 #ifndef OMAX_PD_VERSION
@@ -571,7 +606,9 @@ void omessage_gettext(t_omessage *x)
 		object_error((t_object *)x, "error parsing bundle\n");
 		return;
 	}
-	t_osc_bndl_s *bndl_s = osc_bundle_u_serialize(bndl_u);
+	t_osc_bndl_s *bs = osc_bundle_u_serialize(bndl_u);
+	t_odot_packet *bndl_s = odot_packet_copy(osc_bundle_s_getLen(bs), osc_bundle_s_getPtr(bs));
+	osc_bundle_s_deepFree(bs);
 	omessage_newBundle(x, bndl_u, bndl_s);
 #ifdef OMAX_PD_VERSION
 	x->have_new_data = 1;
@@ -624,9 +661,14 @@ void omessage_list(t_omessage *x, t_symbol *list_sym, short argc, t_atom *argv)
 	if(x->bndl_has_been_checked_for_subs && !x->bndl_has_subs){
 		if(!x->bndl_s){
 			if(x->bndl_u){
+				t_osc_bndl_s *bs = osc_bundle_u_serialize(x->bndl_u);
 				critical_enter(x->lock);
-				x->bndl_s = osc_bundle_u_serialize(x->bndl_u);
+				x->bndl_s = odot_packet_copy(osc_bundle_s_getLen(bs), osc_bundle_s_getPtr(bs));
 				critical_exit(x->lock);
+				osc_bundle_s_deepFree(bs);
+				if(!x->bndl_s){
+					return;
+				}
 			}else if(x->text){
 				// pretty sure this can't happen...
 				post("%d\n", __LINE__);
@@ -635,18 +677,15 @@ void omessage_list(t_omessage *x, t_symbol *list_sym, short argc, t_atom *argv)
 			}
 		}
 		critical_enter(x->lock);
-		long len = osc_bundle_s_getLen(x->bndl_s);
-		char *ptr = osc_bundle_s_getPtr(x->bndl_s);
-		char copy[len];
-		memcpy(copy, ptr, len);
+		t_odot_packet *b = odot_packet_retain(x->bndl_s);
 		critical_exit(x->lock);
-		omax_util_outletOSC(x->outlet, len, copy);
-        OSC_MEM_INVALIDATE(copy);
+		odot_packet_outlet(x->outlet, b);
+		odot_packet_release(b);
 	} else {
 		if(!x->bndl_u){
 			if(x->bndl_s){
 				critical_enter(x->lock);
-				x->bndl_u = osc_bundle_s_deserialize(osc_bundle_s_getLen(x->bndl_s), osc_bundle_s_getPtr(x->bndl_s));
+				x->bndl_u = osc_bundle_s_deserialize(odot_packet_getLen(x->bndl_s), odot_packet_getPtr(x->bndl_s));
 				critical_exit(x->lock);
 			}else if(x->text){
 				// pretty sure this can't happen...
@@ -716,20 +755,15 @@ void omessage_anything(t_omessage *x, t_symbol *msg, short argc, t_atom *argv)
 			t_osc_bndl_u *b = osc_bundle_u_alloc();
 			osc_bundle_u_addMsg(b, m);
 			t_osc_bndl_s *bs = osc_bundle_u_serialize(b);
-			omessage_newBundle(x, b, bs);
+			omessage_newBundle(x, b, odot_packet_copy(osc_bundle_s_getLen(bs), osc_bundle_s_getPtr(bs)));
+			osc_bundle_s_deepFree(bs);
 		}
 		//omessage_processAtoms(x, ac, av);
 		break;
 	}
-#ifdef OMAX_PD_VERSION
-    x->draw_new_data_indicator = 1;
-	x->have_new_data = 1;
-	jbox_redraw((t_jbox *)x);
-#else
 	x->draw_new_data_indicator = 1;
 	x->have_new_data = 1;
-	qelem_set(x->qelem);
-#endif
+	omessage_scheduleRedraw(x);
 }
 
 void omessage_set(t_omessage *x, t_symbol *s, long ac, t_atom *av)
@@ -1420,13 +1454,12 @@ void omessage_drawElements(t_omessage *x, t_glist *glist, int width2, int height
 	have_new_data = x->have_new_data;
 	draw_new_data_indicator = x->draw_new_data_indicator;
 	critical_exit(x->lock);
-	if(have_new_data){
+	// nobody can see the text of a box that isn't showing, so don't make
+	// it until it is.  omessage_save() catches up if it has to
+	if(have_new_data && glist_isvisible(glist) && glist_getcanvas(glist)->gl_editor){
         omessage_bundle2text(x);
 	}
     
-    
-   // omessage_bundle2text(x);
-    
     int x1, y1, x2, y2;
     omessage_getrect((t_gobj *)x, glist, &x1, &y1, &x2, &y2);
     int cx1 = x1;// - 2;
@@ -1808,6 +1841,14 @@ static void omessage_save(t_gobj *z, t_binbuf *b)
     
     t_omessage *x = (t_omessage *)z;
 
+    // the text may not have been made yet if the box is hidden
+    long textlen = 0;
+    char *text = omessage_formatBundle(x, &textlen);
+    if(text){
+        omessage_setTextFromString(x, text);
+        osc_mem_free(text);
+    }
+
     omessage_setHexFromText(x, x->text);
     
 //    post("%x %s height %d", x, __func__, x->height);
@@ -1847,6 +1888,7 @@ static void omessage_save(t_gobj *z, t_binbuf *b)
 
 void omessage_free(t_omessage *x)
 {
+	odot_stats_forget(x);
 //    printf("%s\n", __func__);
     free(x->text);
     free(x->tk_text);
@@ -1861,6 +1903,7 @@ void omessage_free(t_omessage *x)
     
     clock_free(x->m_clock);
     clock_free(x->new_data_indicator_clock);
+    odot_redraw_free(&(x->redraw));
     
     
     {
@@ -1920,6 +1963,7 @@ void *omessage_new(t_symbol *msg, short argc, t_atom *argv)
         x->m_clock = clock_new(x, (t_method)omessage_tick);
         
         x->new_data_indicator_clock = clock_new(x, (t_method)omessage_refresh);
+        odot_redraw_init(&(x->redraw), clock_new(x, (t_method)omessage_redrawTick), ODOT_REDRAW_INTERVAL);
         x->have_new_data = 1;
         x->draw_new_data_indicator = 0;
         
@@ -2111,6 +2155,8 @@ void *omessage_new(t_symbol *msg, short argc, t_atom *argv)
 
 void setup_o0x2emessage(void) {
     
+    odot_packet_init();
+    
     omax_pd_class_new(omessage_class, gensym("o.message"), (t_newmethod)omessage_new, (t_method)omessage_free, sizeof(t_omessage),  CLASS_NOINLET, A_GIMME, 0);
     
     class_addmethod(omessage_class->class, (t_method)omessage_textbuf,gensym("textbuf"), A_GIMME, 0);
@@ -2168,6 +2214,8 @@ void setup_o0x2emessage(void) {
 
 void omessage_free(t_omessage *x)
 {
+    odot_stats_forget(x);
+    odot_redraw_free(&(x->redraw));
     jbox_free((t_jbox *)x);
     if(x->proxy){
 		object_free(x->proxy);
@@ -2231,6 +2279,7 @@ void *omessage_new(t_symbol *msg, short argc, t_atom *argv){
 		critical_new(&(x->lock));
 		x->qelem = qelem_new((t_object *)x, (method)omessage_refresh);
 		x->new_data_indicator_clock = clock_new((t_object *)x, (method)omessage_refresh);
+		odot_redraw_init(&(x->redraw), clock_new((t_object *)x, (method)omessage_redrawTick), ODOT_REDRAW_INTERVAL);
 		x->have_new_data = 1;
 		x->draw_new_data_indicator = 0;
 		attr_dictionary_process(x, d);
@@ -2263,6 +2312,7 @@ CLASS_ATTR_ATTR_PARSE(c,attrname,"category",USESYM(symbol),flags,parsestr)
 
 int main(void){
 	common_symbols_init();
+	odot_packet_init();
 	t_class *c = class_new("o.message", (method)omessage_new, (method)omessage_free, sizeof(t_omessage), 0L, A_GIMME, 0);
 	alias("o.m");
     
@@ -88,6 +88,7 @@ void omiterate_assist(t_omiterate *x, void *b, long io, long num, char *buf)
 
 void omiterate_free(t_omiterate *x)
 {
+	odot_stats_forget(x);
 }
 
 #ifdef OMAX_PD_VERSION
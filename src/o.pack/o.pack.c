@@ -29,6 +29,8 @@ SVN_REVISION: $LastChangedRevision: 587 $
 VERSION 0.0: First try
 VERSION 1.0: One inlet per address
 VERSION 1.1: renamed o.pack (from o.build) 
+VERSION 1.2: keep the output bundle serialized and only reserialize the message that changed
+VERSION 1.3: encode Max/Pd atoms directly into the serialized bundle
 @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
 */
 
@@ -65,14 +67,30 @@ VERSION 1.1: renamed o.pack (from o.build)
 #include "omax_dict.h"
 
 #include "o.h"
+#include "odot_encode.h"
 
 //#define MAX_NUM_ARGS 64
 
+// the serialized output bundle.  it's handed to the outlet as is, so
+// it's reference counted to know whether someone downstream is still
+// reading it when an inlet changes.
+typedef struct _opack_buf{
+	int refcount;
+	long len;
+	long size;
+	char *ptr;
+} t_opack_buf;
+
 typedef struct _opack{
 	t_object ob;
 	void *outlet;
 	t_osc_msg_u **messages;
-	t_osc_bndl_u *bndl;
+	t_osc_bndl_u **slot_bndls; // one single-message bundle per inlet, used to serialize it
+	t_opack_buf *buf;
+	long *slot_offsets; // where each inlet's message (including its size) starts in buf
+	long *slot_lens;
+	char *scratch; // where incoming data is encoded before it's patched into buf
+	long scratch_size;
 	int num_messages;
 	t_critical lock;
 	long inlet;
@@ -92,6 +110,156 @@ t_symbol *_ps_deprecated_set;
 void opack_outputBundle(t_opack *x);
 int opack_checkPosAndResize(char *buf, int len, char *pos);
 void opack_anything(t_opack *x, t_symbol *msg, short argc, t_atom *argv);
+void opack_updateSlot(t_opack *x, int slot);
+
+t_opack_buf *opack_buf_alloc(long size)
+{
+	t_opack_buf *b = (t_opack_buf *)osc_mem_alloc(sizeof(t_opack_buf));
+	if(b){
+		b->ptr = (char *)osc_mem_alloc(size);
+		if(!b->ptr){
+			osc_mem_free(b);
+			return NULL;
+		}
+		b->refcount = 1;
+		b->len = 0;
+		b->size = size;
+	}
+	return b;
+}
+
+void opack_buf_release(t_opack_buf *b)
+{
+	if(b && --(b->refcount) == 0){
+		osc_mem_free(b->ptr);
+		osc_mem_free(b);
+	}
+}
+
+// make sure x->buf is ours alone and can hold len bytes.
+// must be called with x->lock held
+int opack_buf_prepare(t_opack *x, long len)
+{
+	t_opack_buf *b = x->buf;
+	if(b->refcount > 1){
+		// still being output--leave it to whoever is reading it
+		t_opack_buf *copy = opack_buf_alloc(len > b->size ? len : b->size);
+		if(!copy){
+			return 1;
+		}
+		memcpy(copy->ptr, b->ptr, b->len);
+		copy->len = b->len;
+		opack_buf_release(b);
+		x->buf = copy;
+	}else if(len > b->size){
+		long size = len * 2;
+		char *tmp = (char *)osc_mem_resize(b->ptr, size);
+		if(!tmp){
+			return 1;
+		}
+		b->ptr = tmp;
+		b->size = size;
+	}
+	return 0;
+}
+
+// overwrite the serialized message (size included) in a slot.  if
+// the size hasn't changed, this is a straight copy, otherwise the
+// slots after it get shifted.  must be called with x->lock held
+void opack_patchSlot(t_opack *x, int slot, long n, char *bytes)
+{
+	long diff = n - x->slot_lens[slot];
+	if(opack_buf_prepare(x, x->buf->len + diff)){
+		object_error((t_object *)x, "out of memory!");
+		return;
+	}
+	t_opack_buf *b = x->buf;
+	long offset = x->slot_offsets[slot];
+	if(diff){
+		long tail = offset + x->slot_lens[slot];
+		memmove(b->ptr + tail + diff, b->ptr + tail, b->len - tail);
+		b->len += diff;
+		x->slot_lens[slot] = n;
+		int i;
+		for(i = slot + 1; i < x->num_messages; i++){
+			x->slot_offsets[i] += diff;
+		}
+	}
+	memcpy(b->ptr + offset, bytes, n);
+}
+
+// must be called with x->lock held
+int opack_growScratch(t_opack *x, long len)
+{
+	if(len <= x->scratch_size){
+		return 0;
+	}
+	char *tmp = (char *)osc_mem_resize(x->scratch, len);
+	if(!tmp){
+		return 1;
+	}
+	x->scratch = tmp;
+	x->scratch_size = len;
+	return 0;
+}
+
+// swap the address of the serialized message in a slot, keeping its
+// typetags and data.  must be called with x->lock held
+void opack_renameSlot(t_opack *x, int slot, char *address)
+{
+	long oldaddresslen = ODOT_ENCODE_PADDED(strlen(x->buf->ptr + x->slot_offsets[slot] + 4));
+	long rest = x->slot_lens[slot] - 4 - oldaddresslen;
+	long addresslen = ODOT_ENCODE_PADDED(strlen(address));
+	long n = 4 + addresslen + rest;
+	if(opack_growScratch(x, n)){
+		object_error((t_object *)x, "out of memory!");
+		return;
+	}
+	*((uint32_t *)x->scratch) = hton32((uint32_t)(n - 4));
+	odot_encode_string(x->scratch, n, 4, address);
+	memcpy(x->scratch + 4 + addresslen, x->buf->ptr + x->slot_offsets[slot] + 4 + oldaddresslen, rest);
+	opack_patchSlot(x, slot, n, x->scratch);
+}
+
+// reserialize the message of one inlet into the output buffer.
+// must be called with x->lock held
+void opack_updateSlot(t_opack *x, int slot)
+{
+	t_osc_bndl_s *bs = osc_bundle_u_serialize(x->slot_bndls[slot]);
+	if(!bs){
+		return;
+	}
+	long len = osc_bundle_s_getLen(bs);
+	char *ptr = osc_bundle_s_getPtr(bs);
+	if(len >= OSC_HEADER_SIZE){
+		opack_patchSlot(x, slot, len - OSC_HEADER_SIZE, ptr + OSC_HEADER_SIZE);
+	}
+	osc_bundle_s_deepFree(bs);
+}
+
+// set up the slots and the output buffer.  the messages are
+// serialized as they're filled in by opack_new()
+int opack_initSlots(t_opack *x, int count)
+{
+	x->slot_bndls = (t_osc_bndl_u **)osc_mem_alloc(count * sizeof(t_osc_bndl_u *));
+	x->slot_offsets = (long *)osc_mem_alloc(count * sizeof(long));
+	x->slot_lens = (long *)osc_mem_alloc(count * sizeof(long));
+	x->buf = opack_buf_alloc(OSC_HEADER_SIZE + count * 64);
+	x->scratch_size = 256;
+	x->scratch = (char *)osc_mem_alloc(x->scratch_size);
+	if(!x->slot_bndls || !x->slot_offsets || !x->slot_lens || !x->buf || !x->scratch){
+		return 1;
+	}
+	memcpy(x->buf->ptr, OSC_EMPTY_HEADER, OSC_HEADER_SIZE);
+	x->buf->len = OSC_HEADER_SIZE;
+	int i;
+	for(i = 0; i < count; i++){
+		x->slot_bndls[i] = NULL;
+		x->slot_offsets[i] = OSC_HEADER_SIZE;
+		x->slot_lens[i] = 0;
+	}
+	return 0;
+}
 
 void opack_fullPacket(t_opack *x, t_symbol *msg, int argc, t_atom *argv)
 {
@@ -101,6 +269,9 @@ void opack_fullPacket(t_opack *x, t_symbol *msg, int argc, t_atom *argv)
 	int inlet = proxy_getinlet((t_object *)x);
 	osc_message_u_clearArgs(x->messages[inlet]);
 	osc_message_u_appendBndl(x->messages[inlet], len, ptr);
+	opack_updateSlot(x, inlet);
+	// the message only holds the address between updates
+	osc_message_u_clearArgs(x->messages[inlet]);
 	critical_exit(x->lock);
 	int shouldoutput = (inlet == 0);
 #ifdef PAK
@@ -114,12 +285,13 @@ void opack_fullPacket(t_opack *x, t_symbol *msg, int argc, t_atom *argv)
 void opack_outputBundle(t_opack *x)
 {
 	critical_enter(x->lock);
-	t_osc_bndl_s *bs = osc_bundle_u_serialize(x->bndl);
+	t_opack_buf *b = x->buf;
+	b->refcount++;
+	critical_exit(x->lock);
+	omax_util_outletOSC(x->outlet, b->len, b->ptr);
+	critical_enter(x->lock);
+	opack_buf_release(b);
 	critical_exit(x->lock);
-	omax_util_outletOSC(x->outlet, osc_bundle_s_getLen(bs), osc_bundle_s_getPtr(bs));
-	if(bs){
-		osc_bundle_s_deepFree(bs);
-	}
 }
 
 void opack_list(t_opack *x, t_symbol *msg, short argc, t_atom *argv)
@@ -129,25 +301,25 @@ void opack_list(t_opack *x, t_symbol *msg, short argc, t_atom *argv)
 
 void opack_doAnything(t_opack *x, t_symbol *msg, short argc, t_atom *argv, int shouldOutput, int messagenum)
 {
+	// atoms don't go through OMAX_UTIL_GET_LEN_AND_PTR, so open the stats frame here
+	ODOT_STATS_ENTER(x, 0)
 	critical_enter(x->lock);
-	osc_message_u_clearArgs(x->messages[messagenum]);
-	if(msg){
-		osc_message_u_appendString(x->messages[messagenum], msg->s_name);
-	}
-	int i;
-#ifdef OMAX_PD_VERSION
-    t_symbol *sym;
-#endif
-	for(i = 0; i < argc; i++){
-		t_osc_atom_u *a = NULL;
-		omax_util_maxAtomToOSCAtom_u(&a, argv + i);
-		if(a){
-			osc_message_u_appendAtom(x->messages[messagenum], a);
-		}else{
-			object_error((t_object *)x, "error converting max atom of type %d to string! skipping...\n", atom_gettype(argv + i));
+	char *address = osc_message_u_getAddress(x->messages[messagenum]);
+	int nskipped = 0;
+	long n = odot_encode_message(x->scratch, x->scratch_size, address, msg, argc, argv, &nskipped);
+	if(n > x->scratch_size){
+		if(opack_growScratch(x, n)){
+			critical_exit(x->lock);
+			object_error((t_object *)x, "out of memory!");
+			return;
 		}
+		n = odot_encode_message(x->scratch, x->scratch_size, address, msg, argc, argv, NULL);
 	}
+	opack_patchSlot(x, messagenum, n, x->scratch);
 	critical_exit(x->lock);
+	if(nskipped){
+		object_error((t_object *)x, "couldn't convert %d atom(s) to OSC! skipping...", nskipped);
+	}
 	if(shouldOutput){
 		opack_outputBundle(x);
 	}
@@ -218,6 +390,8 @@ void opack_set(t_opack *x, t_symbol *msg, int argc, t_atom *argv)
 	t_osc_err ret;
 	if((ret = osc_message_u_setAddress(m, address->s_name))){
 		object_error((t_object *)x, "%s", osc_error_string(ret));
+	}else{
+		opack_renameSlot(x, inlet, address->s_name);
 	}
 	critical_exit(x->lock);
 }
@@ -256,9 +430,26 @@ void opack_doc(t_opack *x)
 
 void opack_free(t_opack *x)
 {
+	odot_stats_forget(x);
 	// this will free all the message pointers
-	if(x->bndl){
-		osc_bundle_u_free(x->bndl);
+	if(x->slot_bndls){
+		int i;
+		for(i = 0; i < x->num_messages; i++){
+			if(x->slot_bndls[i]){
+				osc_bundle_u_free(x->slot_bndls[i]);
+			}
+		}
+		osc_mem_free(x->slot_bndls);
+	}
+	if(x->slot_offsets){
+		osc_mem_free(x->slot_offsets);
+	}
+	if(x->slot_lens){
+		osc_mem_free(x->slot_lens);
+	}
+	opack_buf_release(x->buf);
+	if(x->scratch){
+		osc_mem_free(x->scratch);
 	}
 	if(x->messages){
 		osc_mem_free(x->messages);
@@ -282,13 +473,15 @@ void opack_free(t_opack *x)
 
 	}
 
-	int i;
-	for(i = 0; i < x->num_messages; i++){
-		if(x->inlet_assist_strings[i]){
-			osc_mem_free(x->inlet_assist_strings[i]);
+	if(x->inlet_assist_strings){
+		int i;
+		for(i = 0; i < x->num_messages; i++){
+			if(x->inlet_assist_strings[i]){
+				osc_mem_free(x->inlet_assist_strings[i]);
+			}
 		}
+		osc_mem_free(x->inlet_assist_strings);
 	}
-	osc_mem_free(x->inlet_assist_strings);
 
 	critical_free(x->lock);
 }
@@ -299,8 +492,11 @@ void *opack_new(t_symbol *msg, short argc, t_atom *argv)
 {
 	t_opack *x;
 	if((x = (t_opack *)object_alloc(opack_class->class))){
+		// opack_free() can clean up after a partly built object from here on
+		critical_new(&(x->lock));
 		if(argc == 0){
 			object_error((t_object *)x, "you must supply at least 1 argument");
+			pd_free((t_pd *)x);
 			return NULL;
 		}
         
@@ -313,10 +509,12 @@ void *opack_new(t_symbol *msg, short argc, t_atom *argv)
 		}
 		if(atom_gettype(argv) != A_SYM){
 			object_error((t_object *)x, "the first argument must be an OSC address");
+			pd_free((t_pd *)x);
 			return NULL;
 		}
 		if(atom_getsym(argv)->s_name[0] != '/' && atom_getsym(argv)->s_name[0] != '$'){
 			object_error((t_object *)x, "the first argument must be an OSC string that begins with a slash (/)");
+			pd_free((t_pd *)x);
 			return NULL;
 		}
 
@@ -335,6 +533,7 @@ void *opack_new(t_symbol *msg, short argc, t_atom *argv)
 					for(j = 0; j < count; j++){
 						if(atom_getsym(addresses[j]) == atom_getsym(argv + i)){
 							object_error((t_object *)x, "duplicate addresses (%s) are not allowed", atom_getsym(addresses[j])->s_name);
+							pd_free((t_pd *)x);
 							return NULL;
 						}
 					}
@@ -350,7 +549,13 @@ void *opack_new(t_symbol *msg, short argc, t_atom *argv)
 				numargs[count - 1]++;
 			}
 		}
-		x->bndl = osc_bundle_u_alloc();
+		// num_messages stays 0 until the slots exist, so opack_free()
+		// doesn't walk arrays that were never filled in
+		if(opack_initSlots(x, count)){
+			object_error((t_object *)x, "out of memory!");
+			pd_free((t_pd *)x);
+			return NULL;
+		}
 		x->num_messages = count;
 		//x->messages = osc_message_array_u_alloc(count);
 		x->messages = (t_osc_msg_u **)osc_mem_alloc(count * sizeof(t_osc_msg_u *));
@@ -361,12 +566,11 @@ void *opack_new(t_symbol *msg, short argc, t_atom *argv)
 		for(i = 0; i < count; i++){
 			x->messages[i] = osc_message_u_alloc();
 			osc_message_u_setAddress(x->messages[i], atom_getsym(addresses[i])->s_name);
+			x->slot_bndls[i] = osc_bundle_u_alloc();
+			osc_bundle_u_addMsg(x->slot_bndls[i], x->messages[i]);
 			pos++;
-			if(numargs[i]){
-				opack_doAnything(x, NULL, numargs[i], argv + pos, 0, i);
-			}
+			opack_doAnything(x, NULL, numargs[i], argv + pos, 0, i);
 			pos += numargs[i];
-			osc_bundle_u_addMsg(x->bndl, x->messages[i]);
             x->inlet_assist_strings[i] = (char *)osc_mem_alloc(128);
 			sprintf(x->inlet_assist_strings[i], "Arguments for address %s (%d)", atom_getsym(addresses[i])->s_name, i + 1);
 		}
@@ -377,7 +581,6 @@ void *opack_new(t_symbol *msg, short argc, t_atom *argv)
 		}
 
 		x->outlet = outlet_new(&x->ob, gensym("FullPacket"));
-		critical_new(&(x->lock));
 	}
     
 	return(x);
@@ -423,8 +626,11 @@ void *opack_new(t_symbol *msg, short argc, t_atom *argv)
 {
 	t_opack *x;
 	if((x = (t_opack *)object_alloc(opack_class))){
+		// opack_free() can clean up after a partly built object from here on
+		critical_new(&(x->lock));
 		if(argc == 0){
 			object_error((t_object *)x, "you must supply at least 1 argument");
+			object_free(x);
 			return NULL;
 		}
 
@@ -437,10 +643,12 @@ void *opack_new(t_symbol *msg, short argc, t_atom *argv)
 		}
 		if(atom_gettype(argv) != A_SYM){
 			object_error((t_object *)x, "the first argument must be an OSC address");
+			object_free(x);
 			return NULL;
 		}
 		if(atom_getsym(argv)->s_name[0] != '/' && atom_getsym(argv)->s_name[0] != '#'){
 			object_error((t_object *)x, "the first argument must be an OSC string that begins with a slash (/)");
+			object_free(x);
 			return NULL;
 		}
 	
@@ -456,6 +664,7 @@ void *opack_new(t_symbol *msg, short argc, t_atom *argv)
 					for(j = 0; j < count; j++){
 						if(atom_getsym(addresses[j]) == atom_getsym(argv + i)){
 							object_error((t_object *)x, "duplicate addresses (%s) are not allowed", atom_getsym(addresses[j])->s_name);
+							object_free(x);
 							return NULL;
 						}
 					}
@@ -467,7 +676,13 @@ void *opack_new(t_symbol *msg, short argc, t_atom *argv)
 				numargs[count - 1]++;
 			}
 		}
-		x->bndl = osc_bundle_u_alloc();
+		// num_messages stays 0 until the slots exist, so opack_free()
+		// doesn't walk arrays that were never filled in
+		if(opack_initSlots(x, count)){
+			object_error((t_object *)x, "out of memory!");
+			object_free(x);
+			return NULL;
+		}
 		x->num_messages = count;
 		//x->messages = osc_message_array_u_alloc(count);
 		x->messages = (t_osc_msg_u **)osc_mem_alloc(count * sizeof(t_osc_msg_u *));
@@ -477,12 +692,11 @@ void *opack_new(t_symbol *msg, short argc, t_atom *argv)
 		for(i = 0; i < count; i++){
 			x->messages[i] = osc_message_u_alloc();
 			osc_message_u_setAddress(x->messages[i], atom_getsym(addresses[i])->s_name);
+			x->slot_bndls[i] = osc_bundle_u_alloc();
+			osc_bundle_u_addMsg(x->slot_bndls[i], x->messages[i]);
 			pos++;
-			if(numargs[i]){
-				opack_doAnything(x, NULL, numargs[i], argv + pos, 0, i);
-			}
+			opack_doAnything(x, NULL, numargs[i], argv + pos, 0, i);
 			pos += numargs[i];
-			osc_bundle_u_addMsg(x->bndl, x->messages[i]);
 			x->inlet_assist_strings[i] = (char *)osc_mem_alloc(128);
 			sprintf(x->inlet_assist_strings[i], "Arguments for address %s (%d)", atom_getsym(addresses[i])->s_name, i + 1);
 		}
@@ -492,7 +706,6 @@ void *opack_new(t_symbol *msg, short argc, t_atom *argv)
 			x->proxy[i] = proxy_new((t_object *)x, count - i, &(x->inlet));
 		}
 		x->outlet = outlet_new(x, "FullPacket");
-		critical_new(&(x->lock));
 	}
 		   	
 	return(x);
@@ -28,6 +28,7 @@ COPYRIGHT_YEARS: 2009
 SVN_REVISION: $LastChangedRevision: 587 $
 VERSION 0.0: First try
 version 1.0: Rewritten to only take one argument (the symbol to be prepended) which can be overridden by a symbol at the beginning of a mesage
+version 1.1: encode Max/Pd atoms directly into the output bundle
 @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
 */
 
@@ -80,6 +81,10 @@ version 1.0: Rewritten to only take one argument (the symbol to be prepended) wh
 #include "omax_dict.h"
 
 #include "o.h"
+#include "odot_encode.h"
+
+// messages that fit in this are encoded on the stack
+#define OPPND_STACKBUF_SIZE 1024
 
 typedef struct _oppnd{
 	t_object ob;
@@ -180,6 +185,8 @@ void oppnd_set(t_oppnd *x, t_symbol *msg, int argc, t_atom *argv)
 
 void oppnd_anything(t_oppnd *x, t_symbol *msg, short argc, t_atom *argv)
 {
+	// atoms don't go through OMAX_UTIL_GET_LEN_AND_PTR, so open the stats frame here
+	ODOT_STATS_ENTER(x, 0)
 	if(!msg){
 		object_error((t_object *)x, "message must be an OSC address");
 		return;
@@ -210,52 +217,62 @@ void oppnd_anything(t_oppnd *x, t_symbol *msg, short argc, t_atom *argv)
 	if(sym_to_prepend){
 		sym_to_prepend_len = strlen(sym_to_prepend->s_name);
 	}
-	char buf[address_len + sym_to_prepend_len];
-	char address_string[address_len + 1];
-	char sym_to_prepend_string[sym_to_prepend_len + 1];
-	address_string[0] = '\0';
-	sym_to_prepend_string[0] = '\0';
-
-	// I'm not sure why I felt the need to make a copy of these here, but I'll leave it out of paranoia...
+	char newaddress[address_len + sym_to_prepend_len + 1];
+	newaddress[0] = '\0';
+#ifdef APPEND
 	if(address){
-		strncpy(address_string, address->s_name, address_len);
-		address_string[address_len] = '\0';
+		memcpy(newaddress, address->s_name, address_len);
 	}
 	if(sym_to_prepend){
-		strncpy(sym_to_prepend_string, sym_to_prepend->s_name, sym_to_prepend_len);
-		sym_to_prepend_string[sym_to_prepend_len] = '\0';
+		memcpy(newaddress + address_len, sym_to_prepend->s_name, sym_to_prepend_len);
 	}
-
-#ifdef APPEND
-	sprintf(buf, "%s%s", address_string, sym_to_prepend_string);
 #else
-	sprintf(buf, "%s%s", sym_to_prepend_string, address_string);
+	if(sym_to_prepend){
+		memcpy(newaddress, sym_to_prepend->s_name, sym_to_prepend_len);
+	}
+	if(address){
+		memcpy(newaddress + sym_to_prepend_len, address->s_name, address_len);
+	}
 #endif
-	t_symbol *newaddress = gensym(buf);
-
-	t_osc_bndl_u *bndl_u = osc_bundle_u_alloc();
-	t_osc_msg_u *msg_u = NULL;
-	e = omax_util_maxAtomsToOSCMsg_u(&msg_u, newaddress, argc, argv);
-	if(e){
-		object_error((t_object *)x, "%s", osc_error_string(e));
+	newaddress[address_len + sym_to_prepend_len] = '\0';
+	if(newaddress[0] != '/'){
+		object_error((t_object *)x, "address must begin with a slash");
 		return;
 	}
-	osc_bundle_u_addMsg(bndl_u, msg_u);
-	t_osc_bndl_s *bs = osc_bundle_u_serialize(bndl_u);
-	if(bndl_u){
-		osc_bundle_u_free(bndl_u);
+
+	// encode the atoms straight into a bundle.  if the stack buffer
+	// isn't big enough, the encoder tells us how much we need
+	char stackbuf[OPPND_STACKBUF_SIZE];
+	char *buf = stackbuf;
+	int nskipped = 0;
+	long n = odot_encode_message(buf + OSC_HEADER_SIZE, OPPND_STACKBUF_SIZE - OSC_HEADER_SIZE, newaddress, NULL, argc, argv, &nskipped);
+	if(n > OPPND_STACKBUF_SIZE - OSC_HEADER_SIZE){
+		buf = (char *)osc_mem_alloc(OSC_HEADER_SIZE + n);
+		if(!buf){
+			object_error((t_object *)x, "out of memory!");
+			return;
+		}
+		n = odot_encode_message(buf + OSC_HEADER_SIZE, n, newaddress, NULL, argc, argv, NULL);
+	}
+	if(nskipped){
+		object_error((t_object *)x, "couldn't convert %d atom(s) to OSC! skipping...", nskipped);
+	}
+	memcpy(buf, OSC_EMPTY_HEADER, OSC_HEADER_SIZE);
+	omax_util_outletOSC(x->outlet, OSC_HEADER_SIZE + n, buf);
+	if(buf != stackbuf){
+		osc_mem_free(buf);
 	}
-	omax_util_outletOSC(x->outlet, osc_bundle_s_getLen(bs), osc_bundle_s_getPtr(bs));
-	osc_bundle_s_deepFree(bs);
 }
 
-
 void oppnd_doc(t_oppnd *x)
 {
 	omax_doc_outletDoc(x->outlet);
 }
 
-void oppnd_free(t_oppnd *x){}
+void oppnd_free(t_oppnd *x)
+{
+	odot_stats_forget(x);
+}
 
 
 #ifdef OMAX_PD_VERSION
@@ -196,6 +196,7 @@ void oprint_doc(t_oprint *x)
 }
 
 void oprint_free(t_oprint *x){
+	odot_stats_forget(x);
 }
 
 #ifdef OMAX_PD_VERSION
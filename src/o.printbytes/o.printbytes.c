@@ -99,6 +99,7 @@ void opbytes_doc(t_opbytes *x)
 
 
 void opbytes_free(t_opbytes *x){
+	odot_stats_forget(x);
 }
 
 
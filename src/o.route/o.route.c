@@ -405,6 +405,7 @@ void oroute_doc(t_oroute *x)
 
 void oroute_free(t_oroute *x)
 {
+	odot_stats_forget(x);
 	critical_free(x->lock);
 	if(x->outlets){
 		free(x->outlets);
@@ -73,6 +73,7 @@
 #include "omax_dict.h"
 
 #include "o.h"
+#include "odot_packet.h"
 
 // default options
 #define DEFAULT_PACKET_SIZE 10000
@@ -108,7 +109,8 @@ typedef struct _osched
     
 	long packets_max;
 	int *packet_free;
-	char *packet_data;
+	// the packet waiting in each slot, retained rather than copied
+	t_odot_packet **packets;
 	long packet_size;
     
 	unsigned int id;
@@ -209,6 +211,12 @@ void osched_fullPacket(t_osched *x, t_symbol *s, int argc, t_atom *argv)
 	}
         
 	// message is candidate for future scheduling...
+	t_odot_packet *p = odot_packet_retainOrCopy(len, ptr);
+	if(!p){
+		object_error((t_object *)x, "out of memory");
+		omax_util_outletOSC(OSCHEDULE_OUTLET_DELEGATE, len, ptr);
+		return;
+	}
                 
 	// lock
 	critical_enter(x->lock);
@@ -237,9 +245,8 @@ void osched_fullPacket(t_osched *x, t_symbol *s, int argc, t_atom *argv)
 	//int i = heap_insert(&(x->q), n);
 	heap_insert(&(x->q), n);
         
-	// copy data...
-	// x->q.elements[i].data = x->packet_data + (x->packet_size * n.id);
-	memcpy(x->packet_data + (x->packet_size * n.id), bndl, len);
+	// hold on to the packet until it's due
+	x->packets[n.id] = p;
         
 	// check for new scheduling target delay
 	p_n = heap_max(&(x->q));
@@ -275,7 +282,10 @@ void osched_reset(t_osched *x)
     
 	// clear queue
 	while(heap_max(&(x->q)) != NULL){
-		heap_extract_max(&(x->q));
+		node n = heap_extract_max(&(x->q));
+		x->packet_free[n.id] = 1;
+		odot_packet_release(x->packets[n.id]);
+		x->packets[n.id] = NULL;
 	}
     
 	// clear soft lock
@@ -309,6 +319,8 @@ void osched_tick(t_osched *x)
 			//SETLONG(&(fp[0]), n.length);
 			//SETLONG(&(fp[1]), (unsigned long int)((x->packet_data + (x->packet_size * n.id))));
             
+			t_odot_packet *p = x->packets[n.id];
+			x->packets[n.id] = NULL;
 			x->packet_free[n.id] = 1;
 			x->id = n.id; // this isn't necessary but should keep the cache footprint smaller
             
@@ -322,21 +334,22 @@ void osched_tick(t_osched *x)
 // be added to the queue.  --JM
 //////////////////////////////////////////////////
 
-			long len = n.length;
-			char buf[n.length];
-			memcpy(buf, x->packet_data + (x->packet_size * n.id), n.length);
 			critical_exit(x->lock);
 			x->soft_lock = 0;
-			t_osc_timetag tt = osched_getTimetag(x, len, buf);
-			void *outlet = OSCHEDULE_OUTLET_MAIN;
-			/*
-			int tcomp = osc_timetag_compare(tt, now);
-			if(tcomp < 0){
-				outlet = OSCHEDULE_OUTLET_MISSED;
+			if(p){
+				long len = odot_packet_getLen(p);
+				char *buf = odot_packet_getPtr(p);
+				t_osc_timetag tt = osched_getTimetag(x, len, buf);
+				void *outlet = OSCHEDULE_OUTLET_MAIN;
+				/*
+				int tcomp = osc_timetag_compare(tt, now);
+				if(tcomp < 0){
+					outlet = OSCHEDULE_OUTLET_MISSED;
+				}
+				*/
+				omax_util_outletOSC(outlet, len, buf);
+				odot_packet_release(p);
 			}
-			*/
-			omax_util_outletOSC(outlet, len, buf);
-            OSC_MEM_INVALIDATE(buf);
 			critical_enter(x->lock);
 
 			while(x->soft_lock == 1){
@@ -412,6 +425,7 @@ t_osc_timetag osched_getTimetag(t_osched *x, long len, char *ptr)
 
 void osched_free(t_osched *x)
 {
+	odot_stats_forget(x);
 	clock_unset(x->clock);
 #ifdef OMAX_PD_VERSION
 	clock_free(x->clock);
@@ -425,7 +439,11 @@ void osched_free(t_osched *x)
 	object_free(x->proxy);
 #endif
 	critical_free(x->lock);
-	osc_mem_free(x->packet_data);
+	long i;
+	for(i = 0; i < x->packets_max; i++){
+		odot_packet_release(x->packets[i]);
+	}
+	osc_mem_free(x->packets);
 	osc_mem_free(x->packet_free);
 	heap_finalize(&(x->q));    
 }
@@ -536,8 +554,11 @@ void *osched_new(t_symbol *s, short argc, t_atom *argv)
 	OSCHEDULE_OUTLET_DELEGATE = outlet_new((t_object *)x, gensym("FullPacket"));
 	OSCHEDULE_OUTLET_IMMEDIATE = outlet_new((t_object *)x, gensym("FullPacket"));
     
-	// allocate packet data buffer
-	x->packet_data = (char*)osc_mem_alloc(x->packets_max * x->packet_size);
+	// allocate packet slots
+	x->packets = (t_odot_packet **)osc_mem_alloc(x->packets_max * sizeof(t_odot_packet *));
+	if(x->packets){
+		memset(x->packets, '\0', x->packets_max * sizeof(t_odot_packet *));
+	}
     
 	// allocate nodes
 	heap_initialize(&(x->q), x->packets_max);
@@ -569,6 +590,7 @@ int setup_o0x2eschedule(void)
 
 	osched_proxy_class = c;
 	ps_FullPacket = gensym("FullPacket");
+	odot_packet_init();
 
 	ODOT_PRINT_VERSION;
 	return 0;
@@ -621,8 +643,11 @@ void *osched_new(t_symbol *s, short argc, t_atom *argv)
 	OSCHEDULE_OUTLET_MISSED = outlet_new(x, "FullPacket");
 	OSCHEDULE_OUTLET_MAIN = outlet_new(x, "FullPacket");
 	x->proxy = proxy_new((t_object *)x, 1, &(x->inlet));
-	// allocate packet data buffer
-	x->packet_data = (char*)osc_mem_alloc(x->packets_max * x->packet_size);
+	// allocate packet slots
+	x->packets = (t_odot_packet **)osc_mem_alloc(x->packets_max * sizeof(t_odot_packet *));
+	if(x->packets){
+		memset(x->packets, '\0', x->packets_max * sizeof(t_odot_packet *));
+	}
     
 	// allocate nodes
 	heap_initialize(&(x->q), x->packets_max);
@@ -660,6 +685,7 @@ int main(void)
 
 	osched_class = c;
 	ps_FullPacket = gensym("FullPacket");
+	odot_packet_init();
 	class_register(CLASS_BOX, osched_class);
 	ODOT_PRINT_VERSION;
 	return 0;
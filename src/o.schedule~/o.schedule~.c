@@ -0,0 +1,429 @@
+/*
+  Written by John MacCallum, The Center for New Music and Audio Technologies,
+  University of California, Berkeley.  Copyright (c) 2013, The Regents of
+  the University of California (Regents). 
+  Permission to use, copy, modify, distribute, and distribute modified versions
+  of this software and its documentation without fee and without a signed
+  licensing agreement, is hereby granted, provided that the above copyright
+  notice, this paragraph and the following two paragraphs appear in all copies,
+  modifications, and distributions.
+
+  IN NO EVENT SHALL REGENTS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT,
+  SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING
+  OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF REGENTS HAS
+  BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  REGENTS SPECIFICALLY DISCLAIMS ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE. THE SOFTWARE AND ACCOMPANYING DOCUMENTATION, IF ANY, PROVIDED
+  HEREUNDER IS PROVIDED "AS IS". REGENTS HAS NO OBLIGATION TO PROVIDE
+  MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS.
+*/
+
+
+#define OMAX_DOC_NAME "o.schedule~"
+#define OMAX_DOC_SHORT_DESC "Play timetagged bundles out as signals, sample-accurately"
+#define OMAX_DOC_LONG_DESC "o.schedule~ has as many signal outlets as its argument says (1 by default).  When a bundle arrives, the first argument of each message /1, /2, ... becomes the value of the corresponding outlet, starting at the sample that corresponds to the bundle's timetag.  Timetags are converted to samples with the same realtime clock o.edge~ uses.  Bundles with an immediate timetag, or a time that has already passed, take effect at the start of the next signal vector."
+#define OMAX_DOC_INLETS_DESC (char *[]){"OSC bundle, clear"}
+#define OMAX_DOC_OUTLETS_DESC (char *[]){"Signal", "OSC bundles that couldn't be scheduled because the queue was full"}
+#define OMAX_DOC_SEEALSO (char *[]){"o.schedule", "o.edge~", "sig~"}
+
+#include "odot_version.h"
+#include "ext.h"
+#include "ext_obex.h"
+#include "ext_critical.h"
+#include "ext_obex_util.h"
+#include "ext_sysmem.h"
+#include "z_dsp.h"
+#include "osc.h"
+#include "osc_mem.h"
+#include "osc_bundle_s.h"
+#include "osc_bundle_iterator_s.h"
+#include "osc_message_s.h"
+#include "osc_atom_s.h"
+#include "osc_timetag.h"
+#include "o.h"
+#include "omax_util.h"
+#include "omax_doc.h"
+#include "omax_dict.h"
+#include "omax_realtime.h"
+
+/*
+Incoming bundles are broken up into events (a time, an outlet, and a value)
+on the main thread and handed to the audio thread through a lock-free
+single-producer/single-consumer ring.  At the top of each vector, the
+perform routine moves whatever is in the ring into a binary heap ordered by
+time, which belongs to the audio thread alone, and then takes events off
+the heap for as long as they fall before the end of the vector.  Each
+event's outlet holds its previous value up to the event's sample, and the
+new one after it.  Nothing in the perform routine allocates or locks.
+
+Events in the future stay in the heap across vectors while the ring
+fills up again, so the ring and the heap share one capacity of
+OSCHED_QUEUE_SIZE events.  The perform routine publishes the size of its
+heap in heapcount before it moves the ring's head, so the main thread
+never sees fewer events than there are, and refuses bundles that
+wouldn't fit.  The heap checks its own bounds as well, and drops and
+counts anything that doesn't fit.
+*/
+
+#define OSCHED_QUEUE_SIZE 4096
+#define OSCHED_MAX_OUTLETS 256
+
+typedef struct _osched_event{
+	t_osc_timetag time;
+	uint64_t seq;	// arrival order, to keep events with the same time in order
+	long outlet;
+	double value;
+} t_osched_event;
+
+typedef struct _osched{
+	t_pxobject ob;
+	void *outlet;
+	long noutlets;
+
+	t_osched_event *queue;
+	long queue_head; // next event for the perform routine to take
+	long queue_tail; // next slot for the main thread to fill
+	long clearto;	 // if not -1, the perform routine empties its heap and skips the ring up to here
+	long heapcount;	 // heapsize, as last published by the perform routine
+	long dropped;	 // events the heap had no room for
+
+	// audio thread
+	t_osched_event *heap;
+	long heapsize;
+	uint64_t seq;	// the next event's sequence number
+	double *values;
+	long *filled;
+	double samplerate;
+} t_osched;
+
+void *osched_class;
+
+// the heap isn't stable, so events with the same time, e.g. all the
+// immediate ones, are ordered by when they arrived
+static int osched_before(t_osched_event *a, t_osched_event *b)
+{
+	int c = osc_timetag_compare(a->time, b->time);
+	return c < 0 || (c == 0 && a->seq < b->seq);
+}
+
+static void osched_heapPush(t_osched *x, t_osched_event *e)
+{
+	if(x->heapsize >= OSCHED_QUEUE_SIZE){
+		__atomic_add_fetch(&(x->dropped), 1, __ATOMIC_RELAXED);
+		return;
+	}
+	long i = x->heapsize++;
+	while(i > 0){
+		long parent = (i - 1) / 2;
+		if(!osched_before(e, x->heap + parent)){
+			break;
+		}
+		x->heap[i] = x->heap[parent];
+		i = parent;
+	}
+	x->heap[i] = *e;
+}
+
+static void osched_heapPop(t_osched *x)
+{
+	t_osched_event last = x->heap[--(x->heapsize)];
+	long i = 0, n = x->heapsize;
+	while(1){
+		long child = 2 * i + 1;
+		if(child >= n){
+			break;
+		}
+		if(child + 1 < n && osched_before(x->heap + child + 1, x->heap + child)){
+			child++;
+		}
+		if(!osched_before(x->heap + child, &last)){
+			break;
+		}
+		x->heap[i] = x->heap[child];
+		i = child;
+	}
+	x->heap[i] = last;
+}
+
+// if the message is /<n> for one of our outlets and its first argument is a number, put
+// the outlet's index in *outlet and the number in *value
+static int osched_getEvent(t_osched *x, t_osc_msg_s *m, long *outlet, double *value)
+{
+	char *address = osc_message_s_getAddress(m);
+	char *end = NULL;
+	long n = address[0] == '/' ? strtol(address + 1, &end, 10) : 0;
+	if(n < 1 || n > x->noutlets || !end || *end != '\0'){
+		return 0;
+	}
+	if(osc_message_s_getArgCount(m) < 1){
+		return 0;
+	}
+	int ret = 0;
+	t_osc_atom_s *a = NULL;
+	osc_message_s_getArg(m, 0, &a);
+	switch(osc_atom_s_getTypetag(a)){
+	case 'i': case 'I': case 'h': case 'H': case 'f': case 'd': case 'c': case 'C': case 'T': case 'F':
+		*outlet = n - 1;
+		*value = osc_atom_s_getDouble(a);
+		ret = 1;
+		break;
+	default:
+		break;
+	}
+	osc_atom_s_free(a);
+	return ret;
+}
+
+void osched_fullPacket(t_osched *x, t_symbol *msg, int argc, t_atom *argv)
+{
+	OMAX_UTIL_GET_LEN_AND_PTR;
+	if(len < OSC_HEADER_SIZE){
+		return;
+	}
+	t_osc_timetag time = *((t_osc_timetag *)(ptr + OSC_ID_SIZE));
+	if(osc_timetag_isImmediate(time)){
+		time = OSC_TIMETAG_NULL;
+	}
+	long outlet;
+	double value;
+
+	// a bundle is scheduled all or nothing, so count first
+	long n = 0;
+	t_osc_bndl_it_s *it = osc_bndl_it_s_get(len, ptr);
+	while(osc_bndl_it_s_hasNext(it)){
+		n += osched_getEvent(x, osc_bndl_it_s_next(it), &outlet, &value);
+	}
+	osc_bndl_it_s_destroy(it);
+	long dropped = __atomic_exchange_n(&(x->dropped), 0, __ATOMIC_RELAXED);
+	if(dropped){
+		object_error((t_object *)x, "dropped %ld events", dropped);
+	}
+	if(!n){
+		return;
+	}
+	long tail = x->queue_tail;
+	long head = __atomic_load_n(&(x->queue_head), __ATOMIC_ACQUIRE);
+	long space = (head - tail - 1 + OSCHED_QUEUE_SIZE) % OSCHED_QUEUE_SIZE;
+	// events the perform routine moved after head was read are counted twice, which errs on the safe side
+	long used = OSCHED_QUEUE_SIZE - 1 - space + __atomic_load_n(&(x->heapcount), __ATOMIC_RELAXED);
+	if(n > space || used + n > OSCHED_QUEUE_SIZE){
+		object_error((t_object *)x, "queue overflow");
+		omax_util_outletOSC(x->outlet, len, ptr);
+		return;
+	}
+	it = osc_bndl_it_s_get(len, ptr);
+	while(osc_bndl_it_s_hasNext(it)){
+		if(osched_getEvent(x, osc_bndl_it_s_next(it), &outlet, &value)){
+			t_osched_event *e = x->queue + tail;
+			e->time = time;
+			e->outlet = outlet;
+			e->value = value;
+			tail = (tail + 1) % OSCHED_QUEUE_SIZE;
+		}
+	}
+	osc_bndl_it_s_destroy(it);
+	__atomic_store_n(&(x->queue_tail), tail, __ATOMIC_RELEASE);
+}
+
+#define OSCHED_PERFORM(x, outs, n, type)					\
+	{									\
+		omax_realtime_clock_tick(x);					\
+		t_osc_timetag now;						\
+		omax_realtime_clock_now(&now);					\
+		t_osc_timetag end = osc_timetag_add(now, osc_timetag_floatToTimetag(n / x->samplerate)); \
+		long head = x->queue_head;					\
+		long clearto = __atomic_exchange_n(&(x->clearto), -1, __ATOMIC_ACQ_REL); \
+		if(clearto >= 0){						\
+			x->heapsize = 0;					\
+			head = clearto;						\
+		}								\
+		long tail = __atomic_load_n(&(x->queue_tail), __ATOMIC_ACQUIRE); \
+		while(head != tail){						\
+			x->queue[head].seq = x->seq++;				\
+			osched_heapPush(x, x->queue + head);			\
+			head = (head + 1) % OSCHED_QUEUE_SIZE;			\
+		}								\
+		__atomic_store_n(&(x->heapcount), x->heapsize, __ATOMIC_RELAXED); \
+		__atomic_store_n(&(x->queue_head), head, __ATOMIC_RELEASE);	\
+		long i, j;							\
+		for(i = 0; i < x->noutlets; i++){				\
+			x->filled[i] = 0;					\
+		}								\
+		while(x->heapsize && osc_timetag_compare(x->heap[0].time, end) < 0){ \
+			t_osched_event *e = x->heap;				\
+			long offset = 0;					\
+			if(osc_timetag_compare(e->time, now) > 0){		\
+				offset = (long)(osc_timetag_timetagToFloat(osc_timetag_subtract(e->time, now)) * x->samplerate); \
+				if(offset >= n){				\
+					offset = n - 1;				\
+				}						\
+			}							\
+			long k = e->outlet;					\
+			type *out = outs[k];					\
+			type v = x->values[k];					\
+			for(j = x->filled[k]; j < offset; j++){			\
+				out[j] = v;					\
+			}							\
+			if(offset > x->filled[k]){				\
+				x->filled[k] = offset;				\
+			}							\
+			x->values[k] = e->value;				\
+			osched_heapPop(x);					\
+		}								\
+		__atomic_store_n(&(x->heapcount), x->heapsize, __ATOMIC_RELAXED); \
+		for(i = 0; i < x->noutlets; i++){				\
+			type *out = outs[i];					\
+			type v = x->values[i];					\
+			for(j = x->filled[i]; j < n; j++){			\
+				out[j] = v;					\
+			}							\
+		}								\
+	}
+
+void osched_perform64(t_osched *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vectorsize, long flags, void *userparam)
+{
+	OSCHED_PERFORM(x, outs, vectorsize, double);
+}
+
+t_int *osched_perform(t_int *w)
+{
+	t_osched *x = (t_osched *)(w[1]);
+	long n = (long)(w[2]);
+	t_float **outs = (t_float **)(w + 3);
+	OSCHED_PERFORM(x, outs, n, t_float);
+	return w + 3 + x->noutlets;
+}
+
+void osched_dsp64(t_osched *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags)
+{
+	omax_realtime_clock_register(x);
+	x->samplerate = samplerate;
+	object_method(dsp64, gensym("dsp_add64"), x, osched_perform64, 0, NULL);
+}
+
+void osched_dsp(t_osched *x, t_signal **sp, short *count)
+{
+	omax_realtime_clock_register(x);
+	x->samplerate = sp[0]->s_sr;
+	t_int *args = (t_int *)sysmem_newptr((x->noutlets + 2) * sizeof(t_int));
+	if(!args){
+		object_error((t_object *)x, "out of memory!");
+		return;
+	}
+	long i;
+	args[0] = (t_int)x;
+	args[1] = (t_int)sp[0]->s_n;
+	for(i = 0; i < x->noutlets; i++){
+		// sp[0] is our (unused) signal inlet
+		args[i + 2] = (t_int)(sp[i + 1]->s_vec);
+	}
+	dsp_addv(osched_perform, x->noutlets + 2, (void **)args);
+	sysmem_freeptr(args);
+}
+
+// forget everything that hasn't been played yet.  outlets keep their values.
+// the heap belongs to the perform routine, so it does the actual clearing
+void osched_clear(t_osched *x)
+{
+	__atomic_store_n(&(x->clearto), x->queue_tail, __ATOMIC_RELEASE);
+}
+
+void osched_doc(t_osched *x)
+{
+	omax_doc_outletDoc(x->outlet);
+}
+
+void osched_assist(t_osched *x, void *b, long io, long num, char *buf)
+{
+	omax_doc_assist(io, num, buf);
+}
+
+void osched_free(t_osched *x)
+{
+	odot_stats_forget(x);
+	dsp_free((t_pxobject *)x);
+	if(x->queue){
+		sysmem_freeptr(x->queue);
+	}
+	if(x->heap){
+		sysmem_freeptr(x->heap);
+	}
+	if(x->values){
+		sysmem_freeptr(x->values);
+	}
+	if(x->filled){
+		sysmem_freeptr(x->filled);
+	}
+}
+
+void *osched_new(t_symbol *msg, short argc, t_atom *argv)
+{
+	t_osched *x = NULL;
+	if((x = (t_osched *)object_alloc(osched_class))){
+		long noutlets = 1;
+		if(argc && atom_gettype(argv) == A_LONG){
+			noutlets = atom_getlong(argv);
+			if(noutlets < 1 || noutlets > OSCHED_MAX_OUTLETS){
+				object_error((t_object *)x, "number of outlets must be between 1 and %d", OSCHED_MAX_OUTLETS);
+				noutlets = 1;
+			}
+		}
+		dsp_setup((t_pxobject *)x, 1);
+		x->outlet = outlet_new((t_object *)x, "FullPacket");
+		long i;
+		for(i = 0; i < noutlets; i++){
+			outlet_new((t_object *)x, "signal");
+		}
+		x->noutlets = noutlets;
+		x->queue_head = 0;
+		x->queue_tail = 0;
+		x->clearto = -1;
+		x->heapsize = 0;
+		x->seq = 0;
+		x->heapcount = 0;
+		x->dropped = 0;
+		x->samplerate = 0;
+		x->queue = (t_osched_event *)sysmem_newptr(OSCHED_QUEUE_SIZE * sizeof(t_osched_event));
+		// osched_fullPacket() keeps the ring and the heap together within OSCHED_QUEUE_SIZE
+		x->heap = (t_osched_event *)sysmem_newptr(OSCHED_QUEUE_SIZE * sizeof(t_osched_event));
+		x->values = (double *)sysmem_newptrclear(noutlets * sizeof(double));
+		x->filled = (long *)sysmem_newptrclear(noutlets * sizeof(long));
+		if(!x->queue || !x->heap || !x->values || !x->filled){
+			object_error((t_object *)x, "out of memory!");
+			object_free(x);
+			return NULL;
+		}
+	}
+	return x;
+}
+
+OMAX_DICT_DICTIONARY(t_osched, x, osched_fullPacket);
+
+int main(void)
+{
+	t_class *c = class_new("o.schedule~", (method)osched_new, (method)osched_free, sizeof(t_osched), 0L, A_GIMME, 0);
+	class_addmethod(c, (method)osched_fullPacket, "FullPacket", A_GIMME, 0);
+	class_addmethod(c, (method)osched_clear, "clear", 0);
+	class_addmethod(c, (method)osched_assist, "assist", A_CANT, 0);
+	class_addmethod(c, (method)osched_doc, "doc", 0);
+	class_addmethod(c, (method)osched_dsp, "dsp", A_CANT, 0);
+	class_addmethod(c, (method)osched_dsp64, "dsp64", A_CANT, 0);
+	class_addmethod(c, (method)odot_version, "version", 0);
+	if(omax_dict_resolveDictStubs()){
+		class_addmethod(c, (method)omax_dict_dictionary, "dictionary", A_GIMME, 0);
+	}
+
+	class_dspinit(c);
+
+	class_register(CLASS_BOX, c);
+	osched_class = c;
+
+	common_symbols_init();
+
+	ODOT_PRINT_VERSION;
+
+	omax_realtime_clock_init();
+	return 0;
+}
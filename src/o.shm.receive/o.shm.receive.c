@@ -0,0 +1,391 @@
+/*
+
+  Written by Matt Wright, Adrian Freed, Andy Schmeder, John MacCallum
+
+  The Center for New Music and Audio Technologies,
+  University of California, Berkeley.  Copyright (c) 1996,97,98,99,2000,01,02,03,04,05, 2014
+  The Regents of the University of California (Regents).
+
+  Permission to use, copy, modify, distribute, and distribute modified versions
+  of this software and its documentation without fee and without a signed
+  licensing agreement, is hereby granted, provided that the above copyright
+  notice, this paragraph and the following two paragraphs appear in all copies,
+  modifications, and distributions.
+
+  IN NO EVENT SHALL REGENTS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT,
+  SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING
+  OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF REGENTS HAS
+  BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  REGENTS SPECIFICALLY DISCLAIMS ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE. THE SOFTWARE AND ACCOMPANYING DOCUMENTATION, IF ANY, PROVIDED
+  HEREUNDER IS PROVIDED "AS IS". REGENTS HAS NO OBLIGATION TO PROVIDE
+  MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS.
+
+*/
+
+
+#define OMAX_DOC_NAME "o.shm.receive"
+#define OMAX_DOC_SHORT_DESC "Receives OSC packets from other processes on the same machine through shared memory"
+#define OMAX_DOC_LONG_DESC "o.shm.receive reads the packets an o.shm.send with the same name writes into shared memory, and copies each one out before outputting it.  It only sees packets written after it was opened.  A background thread sleeps until there's something to read, so nothing is polled."
+#define OMAX_DOC_INLETS_DESC (char *[]){"open, close, info"}
+#define OMAX_DOC_OUTLETS_DESC (char *[]){"FullPacket"}
+#define OMAX_DOC_SEEALSO  (char *[]){"o.shm.send", "o.udp.receive", "o.tcp.receive"}
+
+#include "odot_version.h"
+
+#ifdef OMAX_PD_VERSION
+    #include "m_pd.h"
+    #include "s_stuff.h"
+#else
+    #include "ext.h"
+    #include "ext_obex.h"
+    #include "ext_obex_util.h"
+    #include "ext_critical.h"
+#endif
+
+#include <pthread.h>
+
+#include "osc.h"
+#include "osc_mem.h"
+#include "osc_error.h"
+#include "osc_bundle_u.h"
+#include "osc_bundle_s.h"
+#include "osc_message_u.h"
+#include "omax_util.h"
+#include "omax_doc.h"
+#include "odot_shm.h"
+#include "o.h"
+
+/*
+The main thread does all the reading: each packet is copied out of the
+shared mapping into buf and the reader's tail moved before anything is
+output.  The mapping is writable by other processes, so nothing in it
+is checked or sent downstream in place, and a slow object downstream
+doesn't hold up the writer.  The background thread only waits for the writer to
+bump the ring's sequence number (on a futex, on Linux) and then wakes
+the main thread the same way o.slip.receive does, with a qelem in Max or
+a pipe watched by Pd's poll loop.  notified keeps it from waking the main
+thread again before it has caught up.
+*/
+
+#define OSHMRECV_INFO_PFX "/oshm/info"
+#define OSHMRECV_WAIT 100 // ms
+
+typedef struct _oshmrecv{
+	t_object ob;
+	void *outlet;
+	t_symbol *name;
+	long size;
+	t_odot_shm shm;
+	int open;
+	char *buf;
+	long bufsize;
+
+	pthread_t thread;
+	int running;
+	int quit;
+	int notified;
+#ifdef OMAX_PD_VERSION
+	int wakepipe[2];
+#else
+	void *qelem;
+#endif
+
+	long packets;
+	long invalid;
+	long overruns;
+} t_oshmrecv;
+
+t_class *oshmrecv_class;
+
+void oshmrecv_close(t_oshmrecv *x);
+
+static void *oshmrecv_run(void *arg)
+{
+	t_oshmrecv *x = (t_oshmrecv *)arg;
+	while(!__atomic_load_n(&(x->quit), __ATOMIC_ACQUIRE)){
+		uint32_t seq = odot_shm_seq(&(x->shm));
+		if(odot_shm_pending(&(x->shm)) && !__atomic_exchange_n(&(x->notified), 1, __ATOMIC_ACQ_REL)){
+#ifdef OMAX_PD_VERSION
+			char c = 0;
+			if(write(x->wakepipe[1], &c, 1) < 0){
+				// the pipe is full, which means the main thread has a wakeup pending anyway
+			}
+#else
+			qelem_set(x->qelem);
+#endif
+		}
+		odot_shm_wait(&(x->shm), seq, OSHMRECV_WAIT);
+	}
+	return NULL;
+}
+
+// called on the main thread
+static void oshmrecv_drain(t_oshmrecv *x)
+{
+	__atomic_store_n(&(x->notified), 0, __ATOMIC_RELEASE);
+	// whatever is downstream of us could close the ring while we're outputting,
+	// so check that it's still open every time around
+	while(x->open){
+		char *packet = NULL;
+		long n = 0;
+		int r = odot_shm_peek(&(x->shm), &packet, &n);
+		if(r == 0){
+			break;
+		}
+		if(r < 0){
+			x->overruns++;
+			continue;
+		}
+		if(n > x->bufsize){
+			char *buf = (char *)osc_mem_resize(x->buf, n);
+			if(!buf){
+				object_error((t_object *)x, "out of memory, dropping a %ld byte packet", n);
+				odot_shm_release(&(x->shm), n);
+				continue;
+			}
+			x->buf = buf;
+			x->bufsize = n;
+		}
+		memcpy(x->buf, packet, n);
+		odot_shm_release(&(x->shm), n);
+		if(n < OSC_HEADER_SIZE || osc_error_bundleSanityCheck(n, x->buf)){
+			x->invalid++;
+		}else{
+			x->packets++;
+			omax_util_outletOSC(x->outlet, n, x->buf);
+		}
+	}
+}
+
+#ifdef OMAX_PD_VERSION
+static void oshmrecv_wake(t_oshmrecv *x, int fd)
+{
+	char buf[64];
+	while(read(fd, buf, sizeof(buf)) > 0){}
+	oshmrecv_drain(x);
+}
+#endif
+
+void oshmrecv_close(t_oshmrecv *x)
+{
+	if(x->running){
+		__atomic_store_n(&(x->quit), 1, __ATOMIC_RELEASE);
+		// the thread checks quit at least every OSHMRECV_WAIT ms; this just makes it sooner.
+		// seq belongs to the writer, so only our own thread is woken
+		odot_shm_interrupt(&(x->shm));
+		pthread_join(x->thread, NULL);
+		x->running = 0;
+	}
+	if(x->open){
+		odot_shm_close(&(x->shm));
+		x->open = 0;
+	}
+}
+
+void oshmrecv_open(t_oshmrecv *x, t_symbol *name)
+{
+	if(!name || name == gensym("")){
+		object_error((t_object *)x, "open needs a name");
+		return;
+	}
+	oshmrecv_close(x);
+	int err = odot_shm_open(&(x->shm), name->s_name, x->size);
+	if(err){
+		object_error((t_object *)x, "couldn't open shared memory %s: %s", x->shm.name, strerror(err));
+		return;
+	}
+	if(odot_shm_claimReader(&(x->shm))){
+		object_error((t_object *)x, "%s already has %d readers", name->s_name, ODOT_SHM_MAXREADERS);
+		odot_shm_close(&(x->shm));
+		return;
+	}
+	x->name = name;
+	x->open = 1;
+	x->quit = 0;
+	x->notified = 0;
+	if(pthread_create(&(x->thread), NULL, oshmrecv_run, x)){
+		object_error((t_object *)x, "couldn't start the reader thread");
+		oshmrecv_close(x);
+		return;
+	}
+	x->running = 1;
+}
+
+void oshmrecv_info(t_oshmrecv *x)
+{
+	struct { const char *address; long value; } values[] = {
+		{OSHMRECV_INFO_PFX"/open", x->open},
+		{OSHMRECV_INFO_PFX"/size", x->open ? (long)(x->shm.mask + 1) : 0},
+		{OSHMRECV_INFO_PFX"/packets", x->packets},
+		{OSHMRECV_INFO_PFX"/invalid", x->invalid},
+		{OSHMRECV_INFO_PFX"/overruns", x->overruns},
+	};
+	t_osc_bndl_u *b = osc_bundle_u_alloc();
+	int i;
+	for(i = 0; i < sizeof(values) / sizeof(values[0]); i++){
+		t_osc_msg_u *m = osc_message_u_alloc();
+		osc_message_u_setAddress(m, (char *)values[i].address);
+		osc_message_u_appendUInt64(m, values[i].value);
+		osc_bundle_u_addMsg(b, m);
+	}
+	if(x->name){
+		t_osc_msg_u *m = osc_message_u_alloc();
+		osc_message_u_setAddress(m, OSHMRECV_INFO_PFX"/name");
+		osc_message_u_appendString(m, x->name->s_name);
+		osc_bundle_u_addMsg(b, m);
+	}
+	t_osc_bndl_s *bs = osc_bundle_u_serialize(b);
+	if(bs){
+		omax_util_outletOSC(x->outlet, osc_bundle_s_getLen(bs), osc_bundle_s_getPtr(bs));
+		osc_bundle_s_deepFree(bs);
+	}
+	osc_bundle_u_free(b);
+}
+
+void oshmrecv_doc(t_oshmrecv *x)
+{
+	omax_doc_outletDoc(x->outlet);
+}
+
+void oshmrecv_free(t_oshmrecv *x)
+{
+	oshmrecv_close(x);
+	if(x->buf){
+		osc_mem_free(x->buf);
+	}
+#ifdef OMAX_PD_VERSION
+	if(x->wakepipe[0] >= 0){
+		sys_rmpollfn(x->wakepipe[0]);
+		close(x->wakepipe[0]);
+		close(x->wakepipe[1]);
+	}
+#else
+	if(x->qelem){
+		qelem_free(x->qelem);
+	}
+#endif
+}
+
+static void oshmrecv_init(t_oshmrecv *x)
+{
+	x->name = NULL;
+	x->size = ODOT_SHM_DEFAULT_SIZE;
+	x->open = 0;
+	x->buf = NULL;
+	x->bufsize = 0;
+	x->running = 0;
+	x->quit = 0;
+	x->notified = 0;
+	x->packets = 0;
+	x->invalid = 0;
+	x->overruns = 0;
+}
+
+#ifdef OMAX_PD_VERSION
+
+void *oshmrecv_new(t_symbol *msg, int argc, t_atom *argv)
+{
+	t_oshmrecv *x = (t_oshmrecv *)object_alloc(oshmrecv_class);
+	if(!x){
+		return NULL;
+	}
+	x->outlet = outlet_new(&x->ob, gensym("FullPacket"));
+	oshmrecv_init(x);
+	x->wakepipe[0] = x->wakepipe[1] = -1;
+	if(pipe(x->wakepipe) < 0){
+		object_error((t_object *)x, "couldn't create a pipe: %s", strerror(errno));
+		x->wakepipe[0] = x->wakepipe[1] = -1;
+		pd_free((t_pd *)x);
+		return NULL;
+	}
+	fcntl(x->wakepipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(x->wakepipe[1], F_SETFL, O_NONBLOCK);
+	sys_addpollfn(x->wakepipe[0], (t_fdpollfn)oshmrecv_wake, x);
+
+	t_symbol *name = NULL;
+	int i;
+	for(i = 0; i < argc; i++){
+		if(atom_gettype(argv + i) == A_SYM && atom_getsym(argv + i) == gensym("@size")){
+			if(i + 1 < argc && atom_gettype(argv + i + 1) == A_FLOAT){
+				long l = atom_getfloat(argv + ++i);
+				x->size = l > 0 ? l : ODOT_SHM_DEFAULT_SIZE;
+			}else{
+				post("@size value must be a number");
+			}
+		}else if(atom_gettype(argv + i) == A_SYM && !name){
+			name = atom_getsym(argv + i);
+		}else{
+			post("o.shm.receive takes a name and the optional attribute @size");
+		}
+	}
+	if(name){
+		oshmrecv_open(x, name);
+	}
+	return x;
+}
+
+int setup_o0x2eshm0x2ereceive(void)
+{
+	t_class *c = class_new(gensym(OMAX_DOC_NAME), (t_newmethod)oshmrecv_new, (t_method)oshmrecv_free, sizeof(t_oshmrecv), 0L, A_GIMME, 0);
+
+	class_addmethod(c, (t_method)oshmrecv_open, gensym("open"), A_SYMBOL, 0);
+	class_addmethod(c, (t_method)oshmrecv_close, gensym("close"), 0);
+	class_addmethod(c, (t_method)oshmrecv_info, gensym("info"), 0);
+	class_addmethod(c, (t_method)odot_version, gensym("version"), 0);
+	class_addmethod(c, (t_method)oshmrecv_doc, gensym("doc"), 0);
+
+	oshmrecv_class = c;
+
+	ODOT_PRINT_VERSION;
+	return 0;
+}
+
+#else
+
+void oshmrecv_assist(t_oshmrecv *x, void *b, long m, long a, char *dst)
+{
+	omax_doc_assist(m, a, dst);
+}
+
+void *oshmrecv_new(t_symbol *msg, short argc, t_atom *argv)
+{
+	t_oshmrecv *x = (t_oshmrecv *)object_alloc(oshmrecv_class);
+	if(!x){
+		return NULL;
+	}
+	x->outlet = outlet_new((t_object *)x, "FullPacket");
+	oshmrecv_init(x);
+	x->qelem = qelem_new((t_object *)x, (method)oshmrecv_drain);
+
+	long offset = attr_args_offset(argc, argv);
+	attr_args_process(x, argc, argv);
+	if(offset && atom_gettype(argv) == A_SYM){
+		oshmrecv_open(x, atom_getsym(argv));
+	}
+	return x;
+}
+
+int main(void)
+{
+	t_class *c = class_new(OMAX_DOC_NAME, (method)oshmrecv_new, (method)oshmrecv_free, sizeof(t_oshmrecv), 0L, A_GIMME, 0);
+
+	class_addmethod(c, (method)oshmrecv_open, "open", A_SYM, 0);
+	class_addmethod(c, (method)oshmrecv_close, "close", 0);
+	class_addmethod(c, (method)oshmrecv_info, "info", 0);
+	class_addmethod(c, (method)oshmrecv_assist, "assist", A_CANT, 0);
+	class_addmethod(c, (method)odot_version, "version", 0);
+	class_addmethod(c, (method)oshmrecv_doc, "doc", 0);
+
+	CLASS_ATTR_LONG(c, "size", 0, t_oshmrecv, size);
+
+	class_register(CLASS_BOX, c);
+	oshmrecv_class = c;
+
+	ODOT_PRINT_VERSION;
+	return 0;
+}
+
+#endif
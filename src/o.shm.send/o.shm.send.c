@@ -0,0 +1,290 @@
+/*
+
+  Written by Matt Wright, Adrian Freed, Andy Schmeder, John MacCallum
+
+  The Center for New Music and Audio Technologies,
+  University of California, Berkeley.  Copyright (c) 1996,97,98,99,2000,01,02,03,04,05, 2014
+  The Regents of the University of California (Regents).
+
+  Permission to use, copy, modify, distribute, and distribute modified versions
+  of this software and its documentation without fee and without a signed
+  licensing agreement, is hereby granted, provided that the above copyright
+  notice, this paragraph and the following two paragraphs appear in all copies,
+  modifications, and distributions.
+
+  IN NO EVENT SHALL REGENTS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT,
+  SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING
+  OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF REGENTS HAS
+  BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  REGENTS SPECIFICALLY DISCLAIMS ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE. THE SOFTWARE AND ACCOMPANYING DOCUMENTATION, IF ANY, PROVIDED
+  HEREUNDER IS PROVIDED "AS IS". REGENTS HAS NO OBLIGATION TO PROVIDE
+  MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS.
+
+*/
+
+
+#define OMAX_DOC_NAME "o.shm.send"
+#define OMAX_DOC_SHORT_DESC "Sends OSC packets to other processes on the same machine through shared memory"
+#define OMAX_DOC_LONG_DESC "o.shm.send writes each incoming packet into a named ring buffer in shared memory, where any number of o.shm.receive objects with the same name (up to 16), in this or any other process on the same machine, can read it.  There can only be one o.shm.send per name.  The ring is created with room for @size bytes by whichever object opens it first.  If the slowest reader is too far behind for a packet to fit, the packet is dropped."
+#define OMAX_DOC_INLETS_DESC (char *[]){"FullPacket, open, close, unlink, info"}
+#define OMAX_DOC_OUTLETS_DESC (char *[]){"Info bundle"}
+#define OMAX_DOC_SEEALSO  (char *[]){"o.shm.receive", "o.udp.send", "o.tcp.send"}
+
+#include "odot_version.h"
+#ifdef OMAX_PD_VERSION
+    #include "m_pd.h"
+#else
+    #include "ext.h"
+    #include "ext_obex.h"
+    #include "ext_obex_util.h"
+    #include "ext_critical.h"
+#endif
+
+#include "osc.h"
+#include "osc_mem.h"
+#include "osc_bundle_u.h"
+#include "osc_bundle_s.h"
+#include "osc_message_u.h"
+#include "omax_util.h"
+#include "omax_doc.h"
+#include "odot_shm.h"
+#include "o.h"
+
+#define OSHMSEND_INFO_PFX "/oshm/info"
+
+typedef struct _oshmsend{
+	t_object ob;
+	void *outlet;
+	t_symbol *name;
+	long size;
+	t_odot_shm shm;
+	int open;
+	long packets;
+	long dropped;
+} t_oshmsend;
+
+t_class *oshmsend_class;
+
+void oshmsend_close(t_oshmsend *x)
+{
+	if(x->open){
+		odot_shm_close(&(x->shm));
+		x->open = 0;
+	}
+}
+
+void oshmsend_open(t_oshmsend *x, t_symbol *name)
+{
+	if(!name || name == gensym("")){
+		object_error((t_object *)x, "open needs a name");
+		return;
+	}
+	oshmsend_close(x);
+	int err = odot_shm_open(&(x->shm), name->s_name, x->size);
+	if(err){
+		object_error((t_object *)x, "couldn't open shared memory %s: %s", x->shm.name, strerror(err));
+		return;
+	}
+	err = odot_shm_claimWriter(&(x->shm));
+	if(err){
+		object_error((t_object *)x, "%s already has a writer", name->s_name);
+		odot_shm_close(&(x->shm));
+		return;
+	}
+	x->name = name;
+	x->open = 1;
+}
+
+// remove the name, so that the next object to open it makes a new ring.  anything
+// that has it open already keeps working
+void oshmsend_unlink(t_oshmsend *x)
+{
+	if(!x->name){
+		return;
+	}
+	char name[ODOT_SHM_NAMELEN];
+	snprintf(name, ODOT_SHM_NAMELEN, "/odot.%s", x->name->s_name);
+	shm_unlink(name);
+}
+
+void oshmsend_FullPacket(t_oshmsend *x, t_symbol *msg, short argc, t_atom *argv)
+{
+	OMAX_UTIL_GET_LEN_AND_PTR
+	if(!x->open){
+		return;
+	}
+	switch(odot_shm_write(&(x->shm), ptr, len)){
+	case 0:
+		x->packets++;
+		break;
+	case EMSGSIZE:
+		object_error((t_object *)x, "a %ld byte packet is too big for %s (use a larger @size)", len, x->name->s_name);
+		x->dropped++;
+		break;
+	default:
+		x->dropped++;
+		break;
+	}
+}
+
+void oshmsend_info(t_oshmsend *x)
+{
+	long nreaders = 0, size = 0;
+	if(x->open){
+		int i;
+		for(i = 0; i < ODOT_SHM_MAXREADERS; i++){
+			if(__atomic_load_n(&(x->shm.header->readers[i].active), __ATOMIC_RELAXED) == 1){
+				nreaders++;
+			}
+		}
+		size = x->shm.mask + 1;
+	}
+	struct { const char *address; long value; } values[] = {
+		{OSHMSEND_INFO_PFX"/open", x->open},
+		{OSHMSEND_INFO_PFX"/size", size},
+		{OSHMSEND_INFO_PFX"/readers", nreaders},
+		{OSHMSEND_INFO_PFX"/packets", x->packets},
+		{OSHMSEND_INFO_PFX"/dropped", x->dropped},
+	};
+	t_osc_bndl_u *b = osc_bundle_u_alloc();
+	int i;
+	for(i = 0; i < sizeof(values) / sizeof(values[0]); i++){
+		t_osc_msg_u *m = osc_message_u_alloc();
+		osc_message_u_setAddress(m, (char *)values[i].address);
+		osc_message_u_appendUInt64(m, values[i].value);
+		osc_bundle_u_addMsg(b, m);
+	}
+	if(x->name){
+		t_osc_msg_u *m = osc_message_u_alloc();
+		osc_message_u_setAddress(m, OSHMSEND_INFO_PFX"/name");
+		osc_message_u_appendString(m, x->name->s_name);
+		osc_bundle_u_addMsg(b, m);
+	}
+	t_osc_bndl_s *bs = osc_bundle_u_serialize(b);
+	if(bs){
+		omax_util_outletOSC(x->outlet, osc_bundle_s_getLen(bs), osc_bundle_s_getPtr(bs));
+		osc_bundle_s_deepFree(bs);
+	}
+	osc_bundle_u_free(b);
+}
+
+void oshmsend_doc(t_oshmsend *x)
+{
+	omax_doc_outletDoc(x->outlet);
+}
+
+void oshmsend_free(t_oshmsend *x)
+{
+	odot_stats_forget(x);
+	oshmsend_close(x);
+}
+
+#ifdef OMAX_PD_VERSION
+
+void *oshmsend_new(t_symbol *msg, int argc, t_atom *argv)
+{
+	t_oshmsend *x = (t_oshmsend *)object_alloc(oshmsend_class);
+	if(!x){
+		return NULL;
+	}
+	x->outlet = outlet_new(&x->ob, gensym("FullPacket"));
+	x->name = NULL;
+	x->size = ODOT_SHM_DEFAULT_SIZE;
+	x->open = 0;
+	x->packets = 0;
+	x->dropped = 0;
+
+	t_symbol *name = NULL;
+	int i;
+	for(i = 0; i < argc; i++){
+		if(atom_gettype(argv + i) == A_SYM && atom_getsym(argv + i) == gensym("@size")){
+			if(i + 1 < argc && atom_gettype(argv + i + 1) == A_FLOAT){
+				long l = atom_getfloat(argv + ++i);
+				x->size = l > 0 ? l : ODOT_SHM_DEFAULT_SIZE;
+			}else{
+				post("@size value must be a number");
+			}
+		}else if(atom_gettype(argv + i) == A_SYM && !name){
+			name = atom_getsym(argv + i);
+		}else{
+			post("o.shm.send takes a name and the optional attribute @size");
+		}
+	}
+	if(name){
+		oshmsend_open(x, name);
+	}
+	return x;
+}
+
+int setup_o0x2eshm0x2esend(void)
+{
+	t_class *c = class_new(gensym(OMAX_DOC_NAME), (t_newmethod)oshmsend_new, (t_method)oshmsend_free, sizeof(t_oshmsend), 0L, A_GIMME, 0);
+
+	class_addmethod(c, (t_method)oshmsend_FullPacket, gensym("FullPacket"), A_GIMME, 0);
+	class_addmethod(c, (t_method)oshmsend_open, gensym("open"), A_SYMBOL, 0);
+	class_addmethod(c, (t_method)oshmsend_close, gensym("close"), 0);
+	class_addmethod(c, (t_method)oshmsend_unlink, gensym("unlink"), 0);
+	class_addmethod(c, (t_method)oshmsend_info, gensym("info"), 0);
+	class_addmethod(c, (t_method)odot_version, gensym("version"), 0);
+	class_addmethod(c, (t_method)oshmsend_doc, gensym("doc"), 0);
+
+	oshmsend_class = c;
+
+	ODOT_PRINT_VERSION;
+	return 0;
+}
+
+#else
+
+void oshmsend_assist(t_oshmsend *x, void *b, long m, long a, char *dst)
+{
+	omax_doc_assist(m, a, dst);
+}
+
+void *oshmsend_new(t_symbol *msg, short argc, t_atom *argv)
+{
+	t_oshmsend *x = (t_oshmsend *)object_alloc(oshmsend_class);
+	if(!x){
+		return NULL;
+	}
+	x->outlet = outlet_new((t_object *)x, "FullPacket");
+	x->name = NULL;
+	x->size = ODOT_SHM_DEFAULT_SIZE;
+	x->open = 0;
+	x->packets = 0;
+	x->dropped = 0;
+
+	long offset = attr_args_offset(argc, argv);
+	attr_args_process(x, argc, argv);
+	if(offset && atom_gettype(argv) == A_SYM){
+		oshmsend_open(x, atom_getsym(argv));
+	}
+	return x;
+}
+
+int main(void)
+{
+	t_class *c = class_new(OMAX_DOC_NAME, (method)oshmsend_new, (method)oshmsend_free, sizeof(t_oshmsend), 0L, A_GIMME, 0);
+
+	class_addmethod(c, (method)oshmsend_FullPacket, "FullPacket", A_GIMME, 0);
+	class_addmethod(c, (method)oshmsend_open, "open", A_SYM, 0);
+	class_addmethod(c, (method)oshmsend_close, "close", 0);
+	class_addmethod(c, (method)oshmsend_unlink, "unlink", 0);
+	class_addmethod(c, (method)oshmsend_info, "info", 0);
+	class_addmethod(c, (method)oshmsend_assist, "assist", A_CANT, 0);
+	class_addmethod(c, (method)odot_version, "version", 0);
+	class_addmethod(c, (method)oshmsend_doc, "doc", 0);
+
+	CLASS_ATTR_LONG(c, "size", 0, t_oshmsend, size);
+
+	class_register(CLASS_BOX, c);
+	oshmsend_class = c;
+
+	ODOT_PRINT_VERSION;
+	return 0;
+}
+
+#endif
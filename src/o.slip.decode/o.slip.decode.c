@@ -48,21 +48,19 @@
 #include "osc_serial.h"
 #include "omax_util.h"
 #include "omax_doc.h"
+#include "odot_slip.h"
 #include "o.h"
+#include "odot_scratch.h"
 
 t_class *oslip_class;
 
 t_symbol *ps_gimme, *ps_OSCTimeTag, *ps_FullPacket, *ps_OSCBlob;
 
-#define MAXSLIPBUF 2048
-
 typedef struct oslip {
 	t_object ob;
 	void *outlet;  
   
-	char slipibuf[MAXSLIPBUF]; // buffer used to write the new packet
-	int icount;
-	short istate; // initialize to 0
+	t_odot_slip_decoder decoder;
 	t_critical lock;
 } t_oslip;
 
@@ -81,114 +79,33 @@ int oslip_stringSubstitution(char *target, char *format, short *argcp, t_atom **
 void oslip_sendBuffer(t_oslip *x);
 void oslip_sendData(t_oslip *x, short size, char *data);
 
-// SLIP codes
-#define END             0300    // indicates end of packet 
-#define ESC             0333    // indicates byte stuffing 
-#define ESC_END         0334    // ESC ESC_END means END data byte 
-#define ESC_ESC         0335    // ESC ESC_ESC means ESC data byte
-
-  
-int oslip_decode(t_oslip *x, unsigned char c)
+// decode a block of bytes and output every packet that gets completed along the way.
+// packets are copied out of the decoder before they're output, since whatever is
+// downstream could send more bytes back in
+void oslip_decode(t_oslip *x, const unsigned char *bytes, long n)
 {
 	critical_enter(x->lock);
-	int t; 
-	switch(x->istate)
-		{
-		case 0: // waiting for packet to start
-			x->istate = 1;
-			if(c==END){
-				break;
+	while(n > 0){
+		long len = 0;
+		long c = odot_slip_decode(&(x->decoder), bytes, n, &len);
+		bytes += c;
+		n -= c;
+		if(len){
+			t_odot_scratch_mark mark = odot_scratch_mark();
+			char *buf = (char *)odot_scratch_alloc(len);
+			if(!buf){
+				object_error((t_object *)x, "out of memory!");
+				continue;
 			}
-		case 1: // packet has started
-			switch(c){
-			case END:
-				if((x->icount > 0)){ // it was the END byte
-#ifdef untestedDEBUGOUTPUT
-					// full packet process		
-					char stringbuf[4096];
-					int j=0;
-					int i;
-					for(p=0;i<x->icount && i<4095;++i)
-						{
-							char c = x->slipibuf[i];
-							if(c=='/' || c=='#' || (c>='a' && c<='z')  || (c>='A' && c<='Z') || (c<='9' && c>='0') )
-								stringbuf[j++] = c;
-							else
-								stringbuf[j++] = '*';
-						}
-					stringbuf[j++] = '\0';
-					object_post((t_object *)x, "slipOSC: packet %d %s", x->icount, stringbuf);
-#endif
-					// ParseOSCPacket(x, x->slipibuf, x->icount, true);
-					t = x->icount;
-					x->icount = 0;
-					x->istate = 0;
-	      
-					if((t % 4) == 0){
-						char buf[t];
-						memcpy(buf, x->slipibuf, t);
-	critical_exit(x->lock);
-						omax_util_outletOSC(x->outlet, t, buf);
-                        OSC_MEM_INVALIDATE(buf);
-						//oslip_sendData(x, t, x->slipibuf);
-						return 0;
-					}else{
-    critical_exit(x->lock);
-						//object_error((t_object *)x, "bad packet: not a multiple of 4 length");
-						return 0;
-					}
-				}
-				x->istate = 0;
-				break;
-			case ESC:
-				x->istate = 2;
-				break;
-	  
-				// otherwise, just stick it in the packet	 buffer	
-			default:
-				if(x->icount < MAXSLIPBUF){
-					x->slipibuf[(x->icount)++] = c; 
-				}else{
-					x->istate = 3;
-				}
-				break;
-			}
-			break;
-		case 2: // process escapes
-			switch(c){
-			case ESC_END:
-				if(x->icount<MAXSLIPBUF){
-					x->slipibuf[(x->icount)++] = END;
-					x->istate = 1;
-				}
-				else
-					x->istate = 3;
-	  
-				break;
-			case ESC_ESC:
-				if(x->icount<MAXSLIPBUF){
-					x->slipibuf[(x->icount)++] = ESC;
-					x->istate = 1;
-				}
-				else
-					x->istate = 3;
-				break;
-			default:
-				object_post((t_object *)x, "slipOSC: ESC not followed by ESC_END or ESC_ESC.");
-				x->istate = 3;
-			}
-			break;
-		case 3:   // error state: hunt for END character (this should probably be a hunt for a non escaped END character..
-			if(c == END){
-				x->icount = 0;
-				x->istate = 0;
-			}
-			break;
-      
+			memcpy(buf, x->decoder.buf, len);
+			critical_exit(x->lock);
+			omax_util_outletOSC(x->outlet, len, buf);
+			OSC_MEM_INVALIDATE(buf);
+			odot_scratch_release(mark);
+			critical_enter(x->lock);
 		}
-
+	}
 	critical_exit(x->lock);
-	return 1;
 }
 
 #ifdef OMAX_PD_VERSION
@@ -199,7 +116,8 @@ void slipbyte(t_oslip *x, t_float f)
 void slipbyte(t_oslip *x, long n)
 {
 #endif
-	oslip_decode(x, n);
+	unsigned char c = n;
+	oslip_decode(x, &c, 1);
 }
 
 void sliplist(t_oslip *x, t_symbol *s, int argc, t_atom *argv)
@@ -218,12 +136,30 @@ void sliplist(t_oslip *x, t_symbol *s, int argc, t_atom *argv)
 			return;
 		}
 	}
+	t_odot_scratch_mark mark = odot_scratch_mark();
+	unsigned char *bytes = (unsigned char *)odot_scratch_alloc(argc);
+	if(!bytes){
+		object_error((t_object *)x, "out of memory!");
+		return;
+	}
+	long n = 0;
 	for(i=0;i<argc;++i) {
 		int e = atom_getlong(argv + i);
 		if(e < 256){
-			oslip_decode(x, e);
+			bytes[n++] = e;
 		}
 	}
+	oslip_decode(x, bytes, n);
+	odot_scratch_release(mark);
+}
+
+void oslip_errors(t_oslip *x)
+{
+	critical_enter(x->lock);
+	long errors = x->decoder.errors;
+	long dropped = x->decoder.dropped;
+	critical_exit(x->lock);
+	object_post((t_object *)x, "%ld bad packets, %ld bytes dropped", errors, dropped);
 }
 
 void oslip_doc(t_oslip *x)
@@ -234,7 +170,9 @@ void oslip_doc(t_oslip *x)
 void myobject_free(t_oslip *x);
 void myobject_free(t_oslip *x)
 {
+	odot_slip_decoder_free(&(x->decoder));
 	critical_free(x->lock);
+	odot_scratch_trim();
 }
 
 #ifdef OMAX_PD_VERSION
@@ -249,8 +187,7 @@ void *oslip_new(long arg) {
     
 	x->outlet = outlet_new(&x->ob, NULL);
     
-	x->icount = 0;
-	x->istate = 0;
+	odot_slip_decoder_init(&(x->decoder), ODOT_SLIP_DEFAULT_MAXSIZE);
     
 	critical_new(&(x->lock));
     
@@ -268,6 +205,7 @@ int setup_o0x2eslip0x2edecode(void)
 	class_addmethod(c, (t_method)sliplist, gensym("list"), A_GIMME, 0);
     
 	class_addmethod(c, (t_method)oslip_printcontents, gensym("printcontents"), 0);
+	class_addmethod(c, (t_method)oslip_errors, gensym("errors"), 0);
     
 	// remove this if statement when we stop supporting Max 5
 
@@ -299,6 +237,7 @@ int main (void)
 	class_addmethod(c, (method)sliplist, "list", A_GIMME, 0);
   
 	class_addmethod(c, (method)oslip_printcontents, "printcontents", 0);
+	class_addmethod(c, (method)oslip_errors, "errors", 0);
 
 	finder_addclass("Devices","slipOSC");
 
@@ -319,8 +258,7 @@ void *oslip_new(long arg) {
   
 	x->outlet = outlet_new(x, NULL);
 
-	x->icount = 0;
-	x->istate = 0;
+	odot_slip_decoder_init(&(x->decoder), ODOT_SLIP_DEFAULT_MAXSIZE);
   
 	critical_new(&(x->lock));
   
@@ -337,8 +275,8 @@ void oslip_printcontents (t_oslip *x) {
 	char *m, buf[100], *p;
 	int n, i;
   
-	m = x->slipibuf;
-	n = x->icount;
+	m = (char *)x->decoder.buf;
+	n = x->decoder.len;
   
 	object_post((t_object *)x, "oslip_printcontents: buffer %p, size %ld", m, (long) n);
   
@@ -48,7 +48,9 @@
 #include "osc_serial.h"
 #include "omax_util.h"
 #include "omax_doc.h"
+#include "odot_slip.h"
 #include "o.h"
+#include "odot_scratch.h"
 
 t_class *oslip_class;
 
@@ -81,49 +83,29 @@ int oslip_stringSubstitution(char *target, char *format, short *argcp, t_atom **
 void oslip_sendBuffer(t_oslip *x);
 void oslip_sendData(t_oslip *x, short size, char *data);
 
-// SLIP codes
-#define END             0300    // indicates end of packet 
-#define ESC             0333    // indicates byte stuffing 
-#define ESC_END         0334    // ESC ESC_END means END data byte 
-#define ESC_ESC         0335    // ESC ESC_ESC means ESC data byte
-
-
 #ifdef OMAX_PD_VERSION
 void oslip_FullPacket(t_oslip *x, t_symbol *msg, short argc, t_atom *argv) {
     OMAX_UTIL_GET_LEN_AND_PTR
     long size = len;
-    char *source = ptr;
+    unsigned char *source = (unsigned char *)ptr;
 #else
 void oslip_FullPacket(t_oslip *x, long size, unsigned char *source) {
 #endif
-	t_atom encoded[size * 2 + 1];
-	memset(encoded, '\0', size * 2 + 1);
-	int i=0;
-	unsigned char c;
-    
-	atom_setlong(encoded + i++, END);
-
-	for(int j = 0; j < size; j++) {
-		switch(c=*source++)
-			{
-			case END:
-				atom_setlong(encoded + i++, ESC);
-				atom_setlong(encoded + i++, ESC_END);
-				break;
-	  
-			case ESC:
-				atom_setlong(encoded + i++, ESC);
-				atom_setlong(encoded + i++, ESC_ESC);
-				break;
-	  
-			default:
-				atom_setlong(encoded + i++, c);
-
-	  
-			}
+	// encode into a block of exactly the right size first, and then turn that into atoms,
+	// rather than reserving two atoms for every byte of the packet
+	long n = odot_slip_encodedLen(source, size);
+	t_odot_scratch_mark mark = odot_scratch_mark();
+	unsigned char *bytes = (unsigned char *)odot_scratch_alloc(n);
+	t_atom *encoded = (t_atom *)odot_scratch_alloc(n * sizeof(t_atom));
+	if(!bytes || !encoded){
+		object_error((t_object *)x, "out of memory!");
+		goto out;
+	}
+	odot_slip_encode(bytes, source, size);
+	long i;
+	for(i = 0; i < n; i++){
+		atom_setlong(encoded + i, bytes[i]);
 	}
-	atom_setlong(encoded + i++, END);
-	//x->out[i++].a_w.w_long  = END;
     
 #ifdef DEBUGOUTPUT
 	{
@@ -131,20 +113,22 @@ void oslip_FullPacket(t_oslip *x, long size, unsigned char *source) {
 		char stringbuf[4096];
 		int j=0;
 		int p;
-		for(p=0;p<i && p<4095;++p)
+		for(p=0;p<n && p<4095;++p)
 			{
-				unsigned char c = x->out[p].a_w.w_long;
+				unsigned char c = bytes[p];
 				if(c=='/' || c=='#' || c==' ' ||  (c>='a' && c<='z')  || (c>='A' && c<='Z') || (c<='9' && c>='0') )
 					stringbuf[j++] = c;
 				else
 					stringbuf[j++] = '*';
 			}
 		stringbuf[j++] = '\0';
-		object_post((t_object *)x, "packet %d %s", i, stringbuf);
+		object_post((t_object *)x, "packet %ld %s", n, stringbuf);
 	}
 #endif
     
-	outlet_list(x->outlet, NULL, i, encoded);  
+	outlet_list(x->outlet, NULL, n, encoded);  
+ out:
+	odot_scratch_release(mark);
 }
 
 void oslip_doc(t_oslip *x)
@@ -155,7 +139,9 @@ void oslip_doc(t_oslip *x)
 void myobject_free(t_oslip *x);
 void myobject_free(t_oslip *x)
 {
+	odot_stats_forget(x);
 	critical_free(x->lock);
+	odot_scratch_trim();
 }
 
 #ifdef OMAX_PD_VERSION
@@ -0,0 +1,641 @@
+/*
+
+  Written by Matt Wright, Adrian Freed, Andy Schmeder, John MacCallum
+
+  The Center for New Music and Audio Technologies,
+  University of California, Berkeley.  Copyright (c) 1996,97,98,99,2000,01,02,03,04,05, 2014
+  The Regents of the University of California (Regents).
+
+  Permission to use, copy, modify, distribute, and distribute modified versions
+  of this software and its documentation without fee and without a signed
+  licensing agreement, is hereby granted, provided that the above copyright
+  notice, this paragraph and the following two paragraphs appear in all copies,
+  modifications, and distributions.
+
+  IN NO EVENT SHALL REGENTS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT,
+  SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING
+  OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF REGENTS HAS
+  BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  REGENTS SPECIFICALLY DISCLAIMS ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE. THE SOFTWARE AND ACCOMPANYING DOCUMENTATION, IF ANY, PROVIDED
+  HEREUNDER IS PROVIDED "AS IS". REGENTS HAS NO OBLIGATION TO PROVIDE
+  MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS.
+
+*/
+
+#define OMAX_DOC_NAME "o.slip.receive"
+#define OMAX_DOC_SHORT_DESC "Reads a SLIP stream from a serial port or file descriptor and outputs OSC packets"
+#define OMAX_DOC_LONG_DESC "o.slip.receive reads a SLIP-encoded stream from a device (a serial port, FIFO, pty, ...) or an already open file descriptor on a background thread, and outputs each complete, valid OSC packet.  Use open <path> or fd <n> to start reading, close to stop, and info to get the number of packets received and the number of bytes and packets thrown away."
+#define OMAX_DOC_INLETS_DESC (char *[]){"open, fd, close, info"}
+#define OMAX_DOC_OUTLETS_DESC (char *[]){"FullPacket"}
+#define OMAX_DOC_SEEALSO  (char *[]){"o.slip.decode", "o.slip.encode", "o.udp.receive"}
+
+#include "odot_version.h"
+
+#ifdef OMAX_PD_VERSION
+    #include "m_pd.h"
+    #include "s_stuff.h"
+#else
+    #include "ext.h"
+    #include "ext_obex.h"
+    #include "ext_obex_util.h"
+    #include "ext_critical.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "osc.h"
+#include "osc_mem.h"
+#include "osc_error.h"
+#include "osc_bundle_u.h"
+#include "osc_bundle_s.h"
+#include "osc_message_u.h"
+#include "omax_util.h"
+#include "omax_doc.h"
+#include "odot_slip.h"
+#include "o.h"
+
+/*
+A background thread blocks in poll() on the descriptor, reads whatever is
+available in one go, and runs it through the block SLIP decoder.  Complete
+packets are sanity checked and copied into a ring of preallocated slots
+that's shared with the main thread without a lock: the reader thread only
+ever moves the tail and the main thread only ever moves the head.  Each slot
+keeps its buffer, so once the slots have grown to the size of the packets
+coming in, nothing gets allocated.  After publishing a packet, the reader
+wakes the main thread (a qelem in Max, a pipe watched by Pd's poll loop),
+which outputs everything in the ring straight out of the slots.
+
+If the main thread falls so far behind that the ring fills up, packets are
+dropped and counted rather than blocking the reader, which would only push
+the backlog into the kernel's buffers.
+*/
+
+#define OSLRECV_QUEUE_SIZE 256
+#define OSLRECV_READSIZE 65536
+#define OSLRECV_INFO_PFX "/oslip/info"
+
+typedef struct _oslrecv_qitem{
+	char *bndl;
+	long len;
+	long size;
+} t_oslrecv_qitem;
+
+typedef struct _oslrecv{
+	t_object ob;
+	void *outlet;
+
+	int fd;
+	int ownfd; // did we open it, and so should we close it?
+	long baud;
+	t_symbol *path;
+
+	pthread_t thread;
+	int running;
+	int stoppipe[2];
+#ifdef OMAX_PD_VERSION
+	int wakepipe[2];
+#else
+	void *qelem;
+#endif
+
+	t_oslrecv_qitem *queue;
+	long queue_max;
+	long queue_head; // next slot for the main thread to output
+	long queue_tail; // next slot for the reader thread to fill
+
+	t_odot_slip_decoder decoder; // only touched by the reader thread
+	long packets;
+	long framingerrors;
+	long invalid;
+	long droppedbytes;
+	long droppedpackets;
+	int eof;
+} t_oslrecv;
+
+t_class *oslrecv_class;
+
+void oslrecv_close(t_oslrecv *x);
+
+static void oslrecv_notify(t_oslrecv *x)
+{
+#ifdef OMAX_PD_VERSION
+	char c = 0;
+	if(write(x->wakepipe[1], &c, 1) < 0){
+		// the pipe is full, which means the main thread has a wakeup pending anyway
+	}
+#else
+	qelem_set(x->qelem);
+#endif
+}
+
+static void oslrecv_count(long *counter, long n)
+{
+	__atomic_add_fetch(counter, n, __ATOMIC_RELAXED);
+}
+
+// called on the reader thread
+static void oslrecv_push(t_oslrecv *x, long len, char *ptr)
+{
+	if(strncmp(ptr, OSC_ID, OSC_ID_SIZE) == 0){
+		if(osc_error_bundleSanityCheck(len, ptr)){
+			oslrecv_count(&(x->invalid), 1);
+			return;
+		}
+	}else if(*ptr != '/'){
+		oslrecv_count(&(x->invalid), 1);
+		return;
+	}
+	long tail = x->queue_tail;
+	long next = (tail + 1) % x->queue_max;
+	if(next == __atomic_load_n(&(x->queue_head), __ATOMIC_ACQUIRE)){
+		oslrecv_count(&(x->droppedpackets), 1);
+		return;
+	}
+	t_oslrecv_qitem *qi = x->queue + tail;
+	if(len > qi->size){
+		char *tmp = (char *)osc_mem_resize(qi->bndl, len);
+		if(!tmp){
+			oslrecv_count(&(x->droppedpackets), 1);
+			return;
+		}
+		qi->bndl = tmp;
+		qi->size = len;
+	}
+	memcpy(qi->bndl, ptr, len);
+	qi->len = len;
+	__atomic_store_n(&(x->queue_tail), next, __ATOMIC_RELEASE);
+	oslrecv_count(&(x->packets), 1);
+}
+
+static void *oslrecv_run(void *arg)
+{
+	t_oslrecv *x = (t_oslrecv *)arg;
+	unsigned char *buf = (unsigned char *)osc_mem_alloc(OSLRECV_READSIZE);
+	if(!buf){
+		__atomic_store_n(&(x->eof), 1, __ATOMIC_RELEASE);
+		oslrecv_notify(x);
+		return NULL;
+	}
+	struct pollfd pfd[2];
+	pfd[0].fd = x->fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = x->stoppipe[0];
+	pfd[1].events = POLLIN;
+	while(1){
+		if(poll(pfd, 2, -1) < 0){
+			if(errno == EINTR){
+				continue;
+			}
+			break;
+		}
+		if(pfd[1].revents){
+			break;
+		}
+		if(!pfd[0].revents){
+			continue;
+		}
+		ssize_t n = read(x->fd, buf, OSLRECV_READSIZE);
+		if(n < 0){
+			if(errno == EINTR || errno == EAGAIN){
+				continue;
+			}
+			__atomic_store_n(&(x->eof), 1, __ATOMIC_RELEASE);
+			oslrecv_notify(x);
+			break;
+		}
+		if(n == 0){
+			// the other end hung up
+			__atomic_store_n(&(x->eof), 1, __ATOMIC_RELEASE);
+			oslrecv_notify(x);
+			break;
+		}
+		unsigned char *p = buf;
+		long published = 0;
+		long errors = x->decoder.errors, dropped = x->decoder.dropped;
+		while(n > 0){
+			long len = 0;
+			long c = odot_slip_decode(&(x->decoder), p, n, &len);
+			p += c;
+			n -= c;
+			if(len){
+				oslrecv_push(x, len, (char *)x->decoder.buf);
+				published++;
+			}
+		}
+		oslrecv_count(&(x->framingerrors), x->decoder.errors - errors);
+		oslrecv_count(&(x->droppedbytes), x->decoder.dropped - dropped);
+		if(published){
+			oslrecv_notify(x);
+		}
+	}
+	osc_mem_free(buf);
+	return NULL;
+}
+
+// called on the main thread
+static void oslrecv_drain(t_oslrecv *x)
+{
+	// re-read the head every time around: whatever is downstream of us could
+	// close or reopen the port while we're outputting
+	while(x->queue_head != __atomic_load_n(&(x->queue_tail), __ATOMIC_ACQUIRE)){
+		t_oslrecv_qitem *qi = x->queue + x->queue_head;
+		omax_util_outletOSC(x->outlet, qi->len, qi->bndl);
+		__atomic_store_n(&(x->queue_head), (x->queue_head + 1) % x->queue_max, __ATOMIC_RELEASE);
+	}
+	if(__atomic_load_n(&(x->eof), __ATOMIC_ACQUIRE)){
+		object_error((t_object *)x, "%s: end of stream", x->path ? x->path->s_name : "fd");
+		oslrecv_close(x);
+	}
+}
+
+#ifdef OMAX_PD_VERSION
+static void oslrecv_wake(t_oslrecv *x, int fd)
+{
+	char buf[64];
+	while(read(fd, buf, sizeof(buf)) > 0){}
+	oslrecv_drain(x);
+}
+#endif
+
+static speed_t oslrecv_speed(long baud)
+{
+	switch(baud){
+	case 9600: return B9600;
+	case 19200: return B19200;
+	case 38400: return B38400;
+	case 57600: return B57600;
+	case 115200: return B115200;
+	case 230400: return B230400;
+#ifdef B460800
+	case 460800: return B460800;
+#endif
+#ifdef B921600
+	case 921600: return B921600;
+#endif
+#ifdef B1000000
+	case 1000000: return B1000000;
+#endif
+#ifdef B2000000
+	case 2000000: return B2000000;
+#endif
+#ifdef B3000000
+	case 3000000: return B3000000;
+#endif
+	default: return 0;
+	}
+}
+
+// put a tty into raw mode at the requested speed.  anything else is left alone
+static int oslrecv_configure(t_oslrecv *x)
+{
+	if(!isatty(x->fd)){
+		return 0;
+	}
+	struct termios t;
+	if(tcgetattr(x->fd, &t) < 0){
+		object_error((t_object *)x, "couldn't get the terminal attributes: %s", strerror(errno));
+		return 1;
+	}
+	cfmakeraw(&t);
+	t.c_cflag |= CLOCAL | CREAD;
+	t.c_cc[VMIN] = 1;
+	t.c_cc[VTIME] = 0;
+	if(x->baud){
+		speed_t s = oslrecv_speed(x->baud);
+		if(!s){
+			object_error((t_object *)x, "unsupported baud rate %ld", x->baud);
+			return 1;
+		}
+		cfsetispeed(&t, s);
+		cfsetospeed(&t, s);
+	}
+	if(tcsetattr(x->fd, TCSANOW, &t) < 0){
+		object_error((t_object *)x, "couldn't set the terminal attributes: %s", strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+static void oslrecv_start(t_oslrecv *x, int fd, int ownfd)
+{
+	oslrecv_close(x);
+	x->fd = fd;
+	x->ownfd = ownfd;
+	if(oslrecv_configure(x)){
+		oslrecv_close(x);
+		return;
+	}
+	if(pipe(x->stoppipe) < 0){
+		object_error((t_object *)x, "couldn't create a pipe: %s", strerror(errno));
+		oslrecv_close(x);
+		return;
+	}
+	odot_slip_decoder_init(&(x->decoder), ODOT_SLIP_DEFAULT_MAXSIZE);
+	__atomic_store_n(&(x->eof), 0, __ATOMIC_RELEASE);
+	if(pthread_create(&(x->thread), NULL, oslrecv_run, x)){
+		object_error((t_object *)x, "couldn't start the reader thread");
+		oslrecv_close(x);
+		return;
+	}
+	x->running = 1;
+}
+
+void oslrecv_close(t_oslrecv *x)
+{
+	if(x->running){
+		char c = 0;
+		if(write(x->stoppipe[1], &c, 1) < 0){
+			object_error((t_object *)x, "couldn't stop the reader thread: %s", strerror(errno));
+		}
+		pthread_join(x->thread, NULL);
+		x->running = 0;
+		odot_slip_decoder_free(&(x->decoder));
+	}
+	if(x->stoppipe[0] >= 0){
+		close(x->stoppipe[0]);
+		close(x->stoppipe[1]);
+		x->stoppipe[0] = x->stoppipe[1] = -1;
+	}
+	if(x->fd >= 0 && x->ownfd){
+		close(x->fd);
+	}
+	x->fd = -1;
+	x->ownfd = 0;
+}
+
+void oslrecv_open(t_oslrecv *x, t_symbol *path)
+{
+	if(!path || path == gensym("")){
+		object_error((t_object *)x, "open needs a path");
+		return;
+	}
+	// a FIFO opened read-only hits end of file whenever there's no writer, so open
+	// it for writing too, which keeps it open across writers coming and going
+	struct stat st;
+	int flags = O_RDONLY;
+	if(stat(path->s_name, &st) == 0 && S_ISFIFO(st.st_mode)){
+		flags = O_RDWR;
+	}
+	int fd = open(path->s_name, flags | O_NOCTTY | O_NONBLOCK);
+	if(fd < 0){
+		object_error((t_object *)x, "couldn't open %s: %s", path->s_name, strerror(errno));
+		return;
+	}
+	x->path = path;
+	oslrecv_start(x, fd, 1);
+}
+
+#ifdef OMAX_PD_VERSION
+void oslrecv_fd(t_oslrecv *x, t_float f)
+{
+	long n = (long)f;
+#else
+void oslrecv_fd(t_oslrecv *x, long n)
+{
+#endif
+	if(n < 0 || fcntl(n, F_GETFL) < 0){
+		object_error((t_object *)x, "%ld is not an open file descriptor", n);
+		return;
+	}
+	x->path = NULL;
+	oslrecv_start(x, n, 0);
+}
+
+t_max_err oslrecv_setBaud(t_oslrecv *x, void *attr, long ac, t_atom *av)
+{
+	if(!ac || !av){
+		return MAX_ERR_NONE;
+	}
+	long baud = atom_getlong(av);
+	if(baud && !oslrecv_speed(baud)){
+		object_error((t_object *)x, "unsupported baud rate %ld", baud);
+		return MAX_ERR_GENERIC;
+	}
+	x->baud = baud;
+	if(x->running){
+		// tcsetattr is fine to call while the reader is blocked in poll
+		oslrecv_configure(x);
+	}
+	return MAX_ERR_NONE;
+}
+
+void oslrecv_info(t_oslrecv *x)
+{
+	t_osc_bndl_u *b = osc_bundle_u_alloc();
+	struct { const char *address; long *counter; } counters[] = {
+		{OSLRECV_INFO_PFX"/packets", &(x->packets)},
+		{OSLRECV_INFO_PFX"/framingerrors", &(x->framingerrors)},
+		{OSLRECV_INFO_PFX"/invalid", &(x->invalid)},
+		{OSLRECV_INFO_PFX"/droppedbytes", &(x->droppedbytes)},
+		{OSLRECV_INFO_PFX"/droppedpackets", &(x->droppedpackets)},
+	};
+	int i;
+	for(i = 0; i < sizeof(counters) / sizeof(counters[0]); i++){
+		t_osc_msg_u *m = osc_message_u_alloc();
+		osc_message_u_setAddress(m, (char *)counters[i].address);
+		osc_message_u_appendUInt64(m, __atomic_load_n(counters[i].counter, __ATOMIC_RELAXED));
+		osc_bundle_u_addMsg(b, m);
+	}
+	t_osc_msg_u *mopen = osc_message_u_alloc();
+	osc_message_u_setAddress(mopen, OSLRECV_INFO_PFX"/open");
+	osc_message_u_appendInt32(mopen, x->running);
+	osc_bundle_u_addMsg(b, mopen);
+	if(x->path){
+		t_osc_msg_u *mpath = osc_message_u_alloc();
+		osc_message_u_setAddress(mpath, OSLRECV_INFO_PFX"/path");
+		osc_message_u_appendString(mpath, x->path->s_name);
+		osc_bundle_u_addMsg(b, mpath);
+	}
+
+	t_osc_bndl_s *bs = osc_bundle_u_serialize(b);
+	if(bs){
+		omax_util_outletOSC(x->outlet, osc_bundle_s_getLen(bs), osc_bundle_s_getPtr(bs));
+		osc_bundle_s_deepFree(bs);
+	}
+	osc_bundle_u_free(b);
+}
+
+void oslrecv_doc(t_oslrecv *x)
+{
+	omax_doc_outletDoc(x->outlet);
+}
+
+void oslrecv_free(t_oslrecv *x)
+{
+	oslrecv_close(x);
+#ifdef OMAX_PD_VERSION
+	if(x->wakepipe[0] >= 0){
+		sys_rmpollfn(x->wakepipe[0]);
+		close(x->wakepipe[0]);
+		close(x->wakepipe[1]);
+	}
+#else
+	if(x->qelem){
+		qelem_free(x->qelem);
+	}
+#endif
+	if(x->queue){
+		long i;
+		for(i = 0; i < x->queue_max; i++){
+			if(x->queue[i].bndl){
+				osc_mem_free(x->queue[i].bndl);
+			}
+		}
+		osc_mem_free(x->queue);
+	}
+}
+
+static int oslrecv_init(t_oslrecv *x)
+{
+	x->fd = -1;
+	x->ownfd = 0;
+	x->baud = 0;
+	x->path = NULL;
+	x->running = 0;
+	x->stoppipe[0] = x->stoppipe[1] = -1;
+	x->queue_head = 0;
+	x->queue_tail = 0;
+	x->packets = 0;
+	x->framingerrors = 0;
+	x->invalid = 0;
+	x->droppedbytes = 0;
+	x->droppedpackets = 0;
+	x->eof = 0;
+	odot_slip_decoder_init(&(x->decoder), ODOT_SLIP_DEFAULT_MAXSIZE);
+	x->queue_max = OSLRECV_QUEUE_SIZE;
+	x->queue = (t_oslrecv_qitem *)osc_mem_alloc(x->queue_max * sizeof(t_oslrecv_qitem));
+	if(!x->queue){
+		return 1;
+	}
+	memset(x->queue, '\0', x->queue_max * sizeof(t_oslrecv_qitem));
+	return 0;
+}
+
+#ifdef OMAX_PD_VERSION
+
+void *oslrecv_new(t_symbol *msg, int argc, t_atom *argv)
+{
+	t_oslrecv *x = (t_oslrecv *)object_alloc(oslrecv_class);
+	if(!x){
+		return NULL;
+	}
+	x->outlet = outlet_new(&x->ob, gensym("FullPacket"));
+	x->wakepipe[0] = x->wakepipe[1] = -1;
+	// oslrecv_free copes with whatever has been set up so far
+	if(oslrecv_init(x)){
+		object_error((t_object *)x, "out of memory!");
+		pd_free((t_pd *)x);
+		return NULL;
+	}
+	if(pipe(x->wakepipe) < 0){
+		object_error((t_object *)x, "couldn't create a pipe: %s", strerror(errno));
+		x->wakepipe[0] = x->wakepipe[1] = -1;
+		pd_free((t_pd *)x);
+		return NULL;
+	}
+	fcntl(x->wakepipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(x->wakepipe[1], F_SETFL, O_NONBLOCK);
+	sys_addpollfn(x->wakepipe[0], (t_fdpollfn)oslrecv_wake, x);
+
+	t_symbol *path = NULL;
+	int i;
+	for(i = 0; i < argc; i++){
+		if(atom_gettype(argv + i) == A_SYM && atom_getsym(argv + i) == gensym("@baud")){
+			if(i + 1 < argc && atom_gettype(argv + i + 1) == A_FLOAT){
+				t_atom a;
+				atom_setlong(&a, atom_getfloat(argv + ++i));
+				oslrecv_setBaud(x, NULL, 1, &a);
+			}else{
+				post("@baud value must be a number");
+			}
+		}else if(atom_gettype(argv + i) == A_SYM && !path){
+			path = atom_getsym(argv + i);
+		}else{
+			post("o.slip.receive takes a path and the optional attribute @baud");
+		}
+	}
+	if(path){
+		oslrecv_open(x, path);
+	}
+	return x;
+}
+
+int setup_o0x2eslip0x2ereceive(void)
+{
+	t_class *c = class_new(gensym(OMAX_DOC_NAME), (t_newmethod)oslrecv_new, (t_method)oslrecv_free, sizeof(t_oslrecv), 0L, A_GIMME, 0);
+
+	class_addmethod(c, (t_method)oslrecv_open, gensym("open"), A_SYMBOL, 0);
+	class_addmethod(c, (t_method)oslrecv_fd, gensym("fd"), A_FLOAT, 0);
+	class_addmethod(c, (t_method)oslrecv_close, gensym("close"), 0);
+	class_addmethod(c, (t_method)oslrecv_info, gensym("info"), 0);
+	class_addmethod(c, (t_method)odot_version, gensym("version"), 0);
+	class_addmethod(c, (t_method)oslrecv_doc, gensym("doc"), 0);
+
+	oslrecv_class = c;
+
+	ODOT_PRINT_VERSION;
+	return 0;
+}
+
+#else
+
+void oslrecv_assist(t_oslrecv *x, void *b, long m, long a, char *dst)
+{
+	omax_doc_assist(m, a, dst);
+}
+
+void *oslrecv_new(t_symbol *msg, short argc, t_atom *argv)
+{
+	t_oslrecv *x = (t_oslrecv *)object_alloc(oslrecv_class);
+	if(!x){
+		return NULL;
+	}
+	x->outlet = outlet_new((t_object *)x, "FullPacket");
+	x->qelem = NULL;
+	if(oslrecv_init(x)){
+		object_error((t_object *)x, "out of memory!");
+		object_free(x);
+		return NULL;
+	}
+	x->qelem = qelem_new((t_object *)x, (method)oslrecv_drain);
+
+	long offset = attr_args_offset(argc, argv);
+	attr_args_process(x, argc, argv);
+	if(offset && atom_gettype(argv) == A_SYM){
+		oslrecv_open(x, atom_getsym(argv));
+	}
+	return x;
+}
+
+int main(void)
+{
+	t_class *c = class_new(OMAX_DOC_NAME, (method)oslrecv_new, (method)oslrecv_free, sizeof(t_oslrecv), 0L, A_GIMME, 0);
+
+	class_addmethod(c, (method)oslrecv_open, "open", A_SYM, 0);
+	class_addmethod(c, (method)oslrecv_fd, "fd", A_LONG, 0);
+	class_addmethod(c, (method)oslrecv_close, "close", 0);
+	class_addmethod(c, (method)oslrecv_info, "info", 0);
+	class_addmethod(c, (method)oslrecv_assist, "assist", A_CANT, 0);
+	class_addmethod(c, (method)odot_version, "version", 0);
+	class_addmethod(c, (method)oslrecv_doc, "doc", 0);
+
+	CLASS_ATTR_LONG(c, "baud", 0, t_oslrecv, baud);
+	CLASS_ATTR_ACCESSORS(c, "baud", NULL, oslrecv_setBaud);
+
+	class_register(CLASS_BOX, c);
+	oslrecv_class = c;
+
+	ODOT_PRINT_VERSION;
+	return 0;
+}
+
+#endif
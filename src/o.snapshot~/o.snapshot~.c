@@ -0,0 +1,521 @@
+/*
+  Written by John MacCallum, The Center for New Music and Audio Technologies,
+  University of California, Berkeley.  Copyright (c) 2013, The Regents of
+  the University of California (Regents). 
+  Permission to use, copy, modify, distribute, and distribute modified versions
+  of this software and its documentation without fee and without a signed
+  licensing agreement, is hereby granted, provided that the above copyright
+  notice, this paragraph and the following two paragraphs appear in all copies,
+  modifications, and distributions.
+
+  IN NO EVENT SHALL REGENTS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT,
+  SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING
+  OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF REGENTS HAS
+  BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  REGENTS SPECIFICALLY DISCLAIMS ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE. THE SOFTWARE AND ACCOMPANYING DOCUMENTATION, IF ANY, PROVIDED
+  HEREUNDER IS PROVIDED "AS IS". REGENTS HAS NO OBLIGATION TO PROVIDE
+  MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS.
+*/
+
+
+#define OMAX_DOC_NAME "o.snapshot~"
+#define OMAX_DOC_SHORT_DESC "Sample or summarize signals into timetagged bundles"
+#define OMAX_DOC_LONG_DESC "o.snapshot~ takes any number of signals (set by its argument) and every @interval milliseconds outputs a bundle timetagged with the time of the last sample of the interval.  For each signal n, the bundle contains /n/value (the last sample), /n/min, /n/max, /n/mean, and /n/rms, or whichever of those are listed in @stats."
+#define OMAX_DOC_INLETS_DESC (char *[]){"Signal"}
+#define OMAX_DOC_OUTLETS_DESC (char *[]){"OSC bundle"}
+#define OMAX_DOC_SEEALSO (char *[]){"o.edge~", "snapshot~"}
+
+#include "odot_version.h"
+#include "ext.h"
+#include "ext_obex.h"
+#include "ext_critical.h"
+#include "ext_obex_util.h"
+#include "ext_sysmem.h"
+#include "z_dsp.h"
+#include <math.h>
+#include <float.h>
+#include "osc.h"
+#include "osc_mem.h"
+#include "osc_bundle_s.h"
+#include "osc_timetag.h"
+#include "o.h"
+#include "omax_util.h"
+#include "omax_doc.h"
+#include "omax_realtime.h"
+
+/*
+The perform routine keeps running reductions (last value, min, max, sum,
+and sum of squares) for each input over the current interval, in one pass
+over each vector that the compiler can vectorize.  An interval can end in
+the middle of a vector, in which case the vector is reduced in two pieces.
+When an interval ends, its results and timetag are written to a frame in a
+ring that's shared with the scheduler thread without a lock, and a
+callback is scheduled if one isn't pending already.
+
+The callback turns frames into bundles by writing the timetag and values
+into a bundle that was serialized ahead of time, whenever the number of
+inputs or @stats changed, so nothing is allocated or serialized per frame.
+*/
+
+#define OSNAP_QUEUE_SIZE 64
+#define OSNAP_MAX_INPUTS 256
+#define OSNAP_DEFAULT_INTERVAL 100. // ms
+
+enum{
+	OSNAP_VALUE,
+	OSNAP_MIN,
+	OSNAP_MAX,
+	OSNAP_MEAN,
+	OSNAP_RMS,
+	OSNAP_NSTATS
+};
+
+static const char *osnap_statnames[OSNAP_NSTATS] = {"value", "min", "max", "mean", "rms"};
+
+typedef struct _osnap_acc{
+	double last, min, max, sum, sumsq;
+} t_osnap_acc;
+
+typedef struct _osnap_frame{
+	long sample;	// within the block
+	double samplerate;
+	t_osc_timetag now;
+	double *values; // ninputs * OSNAP_NSTATS
+} t_osnap_frame;
+
+typedef struct _osnap{
+	t_pxobject ob;
+	void *outlet;
+	t_critical lock;
+	long ninputs;
+	double interval;
+	t_symbol *stats[OSNAP_NSTATS];
+	long nstats;
+
+	// audio thread
+	double samplerate;
+	t_osnap_acc *acc;
+	long count;	// samples so far in this interval
+	long window;	// samples per interval
+
+	t_osnap_frame *queue;
+	double *queue_values;
+	long queue_head; // next frame for the callback to output
+	long queue_tail; // next frame for the perform routine to fill
+	long dropped;
+	int scheduled;
+
+	// serialized output, and where in it each selected value goes
+	char *bndl;
+	long bndllen;
+	long *offsets;	// ninputs * OSNAP_NSTATS, -1 for stats that aren't selected
+	char *outbuf;	// bndl gets copied here to be output, so the lock isn't held across the outlet call
+	long outbufsize;	// bytes allocated for outbuf
+} t_osnap;
+
+void *osnap_class;
+
+// build the bundle the callback fills in.  called with the lock held
+static void osnap_makeBundle(t_osnap *x)
+{
+	int selected[OSNAP_NSTATS];
+	long i, j, k;
+	for(j = 0; j < OSNAP_NSTATS; j++){
+		selected[j] = x->nstats == 0;
+		for(k = 0; k < x->nstats; k++){
+			if(x->stats[k] == gensym(osnap_statnames[j])){
+				selected[j] = 1;
+			}
+		}
+	}
+	long len = OSC_HEADER_SIZE;
+	for(i = 0; i < x->ninputs; i++){
+		for(j = 0; j < OSNAP_NSTATS; j++){
+			if(selected[j]){
+				char address[64];
+				long n = snprintf(address, sizeof(address), "/%ld/%s", i + 1, osnap_statnames[j]);
+				len += 4 + ((n / 4) + 1) * 4 + 4 + 8;
+			}
+		}
+	}
+	char *bndl = (char *)osc_mem_resize(x->bndl, len);
+	if(!bndl){
+		object_error((t_object *)x, "out of memory!");
+		x->bndllen = 0;
+		return;
+	}
+	x->bndl = bndl;
+	x->bndllen = len;
+	memset(bndl, '\0', len);
+	memcpy(bndl, OSC_EMPTY_HEADER, OSC_HEADER_SIZE);
+	long pos = OSC_HEADER_SIZE;
+	for(i = 0; i < x->ninputs; i++){
+		for(j = 0; j < OSNAP_NSTATS; j++){
+			x->offsets[i * OSNAP_NSTATS + j] = -1;
+			if(!selected[j]){
+				continue;
+			}
+			char address[64];
+			long n = snprintf(address, sizeof(address), "/%ld/%s", i + 1, osnap_statnames[j]);
+			long addresslen = ((n / 4) + 1) * 4;
+			*((uint32_t *)(bndl + pos)) = hton32(addresslen + 4 + 8);
+			memcpy(bndl + pos + 4, address, n);
+			memcpy(bndl + pos + 4 + addresslen, ",d", 2);
+			x->offsets[i * OSNAP_NSTATS + j] = pos + 4 + addresslen + 4;
+			pos += 4 + addresslen + 4 + 8;
+		}
+	}
+}
+
+// the time of sample samplenum of the block that started at now
+t_osc_timetag osnap_computeTime(t_osc_timetag now, double samplerate, double samplenum)
+{
+	return osc_timetag_add(now, osc_timetag_floatToTimetag(samplenum / samplerate));
+}
+
+// called on the scheduler thread
+void osnap_callback(t_osnap *x, t_symbol *msg, int argc, t_atom *argv)
+{
+	__atomic_store_n(&(x->scheduled), 0, __ATOMIC_RELEASE);
+	long head = x->queue_head;
+	while(head != __atomic_load_n(&(x->queue_tail), __ATOMIC_ACQUIRE)){
+		t_osnap_frame *f = x->queue + head;
+		critical_enter(x->lock);
+		long len = x->bndllen;
+		if(len > x->outbufsize){
+			char *tmp = (char *)osc_mem_resize(x->outbuf, len);
+			if(tmp){
+				x->outbuf = tmp;
+				x->outbufsize = len;
+			}else{
+				len = 0;
+			}
+		}
+		if(len){
+			long i;
+			for(i = 0; i < x->ninputs * OSNAP_NSTATS; i++){
+				if(x->offsets[i] >= 0){
+					uint64_t u;
+					memcpy(&u, f->values + i, 8);
+					*((uint64_t *)(x->bndl + x->offsets[i])) = hton64(u);
+				}
+			}
+			osc_bundle_s_setTimetag(len, x->bndl, osnap_computeTime(f->now, f->samplerate, f->sample));
+			memcpy(x->outbuf, x->bndl, len);
+		}
+		critical_exit(x->lock);
+		head = (head + 1) % OSNAP_QUEUE_SIZE;
+		__atomic_store_n(&(x->queue_head), head, __ATOMIC_RELEASE);
+		if(len){
+			omax_util_outletOSC(x->outlet, len, x->outbuf);
+		}
+	}
+	long dropped = __atomic_exchange_n(&(x->dropped), 0, __ATOMIC_RELAXED);
+	if(dropped){
+		object_error((t_object *)x, "dropped %ld frames", dropped);
+	}
+}
+
+static void osnap_reset(t_osnap *x)
+{
+	long i;
+	for(i = 0; i < x->ninputs; i++){
+		x->acc[i].last = 0;
+		x->acc[i].min = DBL_MAX;
+		x->acc[i].max = -DBL_MAX;
+		x->acc[i].sum = 0;
+		x->acc[i].sumsq = 0;
+	}
+	x->count = 0;
+}
+
+// called on the audio thread when an interval ends, offset samples into the block
+static void osnap_push(t_osnap *x, t_osc_timetag now, long offset)
+{
+	long tail = x->queue_tail;
+	long next = (tail + 1) % OSNAP_QUEUE_SIZE;
+	if(next == __atomic_load_n(&(x->queue_head), __ATOMIC_ACQUIRE)){
+		__atomic_add_fetch(&(x->dropped), 1, __ATOMIC_RELAXED);
+	}else{
+		t_osnap_frame *f = x->queue + tail;
+		f->sample = offset;
+		f->samplerate = x->samplerate;
+		f->now = now;
+		long i;
+		for(i = 0; i < x->ninputs; i++){
+			double *v = f->values + i * OSNAP_NSTATS;
+			t_osnap_acc *a = x->acc + i;
+			v[OSNAP_VALUE] = a->last;
+			v[OSNAP_MIN] = a->min;
+			v[OSNAP_MAX] = a->max;
+			v[OSNAP_MEAN] = a->sum / x->count;
+			v[OSNAP_RMS] = sqrt(a->sumsq / x->count);
+		}
+		__atomic_store_n(&(x->queue_tail), next, __ATOMIC_RELEASE);
+		if(!__atomic_exchange_n(&(x->scheduled), 1, __ATOMIC_ACQ_REL)){
+			schedule_delay(x, (method)osnap_callback, 0, NULL, 0, NULL);
+		}
+	}
+	osnap_reset(x);
+}
+
+// reduce in[0..n) into a.  no branches in the loop, so it vectorizes
+#define OSNAP_REDUCE(name, type)						\
+	static void name(t_osnap_acc *a, const type *in, long n)		\
+	{									\
+		double mn = a->min, mx = a->max, sum = 0, sumsq = 0;		\
+		long i;								\
+		for(i = 0; i < n; i++){						\
+			double v = in[i];					\
+			mn = v < mn ? v : mn;					\
+			mx = v > mx ? v : mx;					\
+			sum += v;						\
+			sumsq += v * v;						\
+		}								\
+		a->min = mn;							\
+		a->max = mx;							\
+		a->sum += sum;							\
+		a->sumsq += sumsq;						\
+		a->last = in[n - 1];						\
+	}
+
+OSNAP_REDUCE(osnap_reduce64, double)
+OSNAP_REDUCE(osnap_reduce32, t_float)
+
+#define OSNAP_PERFORM(x, ins, n, reduce)					\
+	{									\
+		omax_realtime_clock_tick(x);					\
+		long start = 0;							\
+		int gotnow = 0;							\
+		t_osc_timetag now;						\
+		while(start < n){						\
+			long c = x->window - x->count;				\
+			if(c < 1){ /* @interval just got shorter */		\
+				c = 1;						\
+			}							\
+			if(c > n - start){					\
+				c = n - start;					\
+			}							\
+			long i;							\
+			for(i = 0; i < x->ninputs; i++){			\
+				reduce(x->acc + i, ins[i] + start, c);		\
+			}							\
+			x->count += c;						\
+			start += c;						\
+			if(x->count >= x->window){				\
+				if(!gotnow){					\
+					omax_realtime_clock_now(&now);		\
+					gotnow = 1;				\
+				}						\
+				osnap_push(x, now, start - 1);			\
+			}							\
+		}								\
+	}
+
+void osnap_perform64(t_osnap *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vectorsize, long flags, void *userparam)
+{
+	OSNAP_PERFORM(x, ins, vectorsize, osnap_reduce64);
+}
+
+t_int *osnap_perform(t_int *w)
+{
+	t_osnap *x = (t_osnap *)(w[1]);
+	long n = (long)(w[2]);
+	t_float **ins = (t_float **)(w + 3);
+	OSNAP_PERFORM(x, ins, n, osnap_reduce32);
+	return w + 3 + x->ninputs;
+}
+
+static void osnap_setWindow(t_osnap *x)
+{
+	long window = (long)(x->interval * x->samplerate / 1000. + .5);
+	x->window = window > 0 ? window : 1;
+}
+
+void osnap_dsp64(t_osnap *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags)
+{
+	omax_realtime_clock_register(x);
+	x->samplerate = samplerate;
+	osnap_setWindow(x);
+	osnap_reset(x);
+	object_method(dsp64, gensym("dsp_add64"), x, osnap_perform64, 0, NULL);
+}
+
+void osnap_dsp(t_osnap *x, t_signal **sp, short *count)
+{
+	omax_realtime_clock_register(x);
+	x->samplerate = sp[0]->s_sr;
+	osnap_setWindow(x);
+	osnap_reset(x);
+	t_int *args = (t_int *)sysmem_newptr((x->ninputs + 2) * sizeof(t_int));
+	if(!args){
+		object_error((t_object *)x, "out of memory!");
+		return;
+	}
+	long i;
+	args[0] = (t_int)x;
+	args[1] = (t_int)sp[0]->s_n;
+	for(i = 0; i < x->ninputs; i++){
+		args[i + 2] = (t_int)(sp[i]->s_vec);
+	}
+	dsp_addv(osnap_perform, x->ninputs + 2, (void **)args);
+	sysmem_freeptr(args);
+}
+
+t_max_err osnap_setInterval(t_osnap *x, void *attr, long ac, t_atom *av)
+{
+	if(ac && av){
+		double interval = atom_getfloat(av);
+		if(interval <= 0){
+			object_error((t_object *)x, "interval must be greater than 0");
+			return MAX_ERR_GENERIC;
+		}
+		x->interval = interval;
+		if(x->samplerate > 0){
+			// the perform routine picks this up at its next interval
+			osnap_setWindow(x);
+		}
+	}
+	return MAX_ERR_NONE;
+}
+
+t_max_err osnap_setStats(t_osnap *x, void *attr, long ac, t_atom *av)
+{
+	if(ac > OSNAP_NSTATS){
+		ac = OSNAP_NSTATS;
+	}
+	long i, j, n = 0;
+	t_symbol *stats[OSNAP_NSTATS];
+	for(i = 0; i < ac; i++){
+		t_symbol *s = atom_getsym(av + i);
+		for(j = 0; j < OSNAP_NSTATS; j++){
+			if(s == gensym(osnap_statnames[j])){
+				break;
+			}
+		}
+		if(j == OSNAP_NSTATS){
+			object_error((t_object *)x, "unknown stat %s (must be value, min, max, mean, or rms)", s->s_name);
+			return MAX_ERR_GENERIC;
+		}
+		stats[n++] = s;
+	}
+	critical_enter(x->lock);
+	memcpy(x->stats, stats, n * sizeof(t_symbol *));
+	x->nstats = n;
+	osnap_makeBundle(x);
+	critical_exit(x->lock);
+	return MAX_ERR_NONE;
+}
+
+void osnap_doc(t_osnap *x)
+{
+	omax_doc_outletDoc(x->outlet);
+}
+
+void osnap_assist(t_osnap *x, void *b, long io, long num, char *buf)
+{
+	omax_doc_assist(io, num, buf);
+}
+
+void osnap_free(t_osnap *x)
+{
+	dsp_free((t_pxobject *)x);
+	critical_free(x->lock);
+	if(x->acc){
+		sysmem_freeptr(x->acc);
+	}
+	if(x->queue){
+		sysmem_freeptr(x->queue);
+	}
+	if(x->queue_values){
+		sysmem_freeptr(x->queue_values);
+	}
+	if(x->offsets){
+		sysmem_freeptr(x->offsets);
+	}
+	if(x->bndl){
+		osc_mem_free(x->bndl);
+	}
+	if(x->outbuf){
+		osc_mem_free(x->outbuf);
+	}
+}
+
+void *osnap_new(t_symbol *msg, short argc, t_atom *argv)
+{
+	t_osnap *x = NULL;
+	if((x = (t_osnap *)object_alloc(osnap_class))){
+		long ninputs = 1;
+		if(argc && atom_gettype(argv) == A_LONG){
+			ninputs = atom_getlong(argv);
+			if(ninputs < 1 || ninputs > OSNAP_MAX_INPUTS){
+				object_error((t_object *)x, "number of inputs must be between 1 and %d", OSNAP_MAX_INPUTS);
+				ninputs = 1;
+			}
+		}
+		dsp_setup((t_pxobject *)x, ninputs);
+		x->outlet = outlet_new((t_object *)x, "FullPacket");
+		critical_new(&(x->lock));
+		x->ninputs = ninputs;
+		x->interval = OSNAP_DEFAULT_INTERVAL;
+		x->nstats = 0;
+		x->samplerate = 0;
+		x->count = 0;
+		x->window = 1;
+		x->queue_head = 0;
+		x->queue_tail = 0;
+		x->dropped = 0;
+		x->scheduled = 0;
+		x->bndl = NULL;
+		x->bndllen = 0;
+		x->outbuf = NULL;
+		x->outbufsize = 0;
+		x->acc = (t_osnap_acc *)sysmem_newptr(ninputs * sizeof(t_osnap_acc));
+		x->queue = (t_osnap_frame *)sysmem_newptr(OSNAP_QUEUE_SIZE * sizeof(t_osnap_frame));
+		x->queue_values = (double *)sysmem_newptr(OSNAP_QUEUE_SIZE * ninputs * OSNAP_NSTATS * sizeof(double));
+		x->offsets = (long *)sysmem_newptr(ninputs * OSNAP_NSTATS * sizeof(long));
+		if(!x->acc || !x->queue || !x->queue_values || !x->offsets){
+			object_error((t_object *)x, "out of memory!");
+			object_free(x);
+			return NULL;
+		}
+		long i;
+		for(i = 0; i < OSNAP_QUEUE_SIZE; i++){
+			x->queue[i].values = x->queue_values + i * ninputs * OSNAP_NSTATS;
+		}
+		osnap_reset(x);
+		osnap_makeBundle(x);
+		attr_args_process(x, argc, argv);
+	}
+	return x;
+}
+
+int main(void)
+{
+	t_class *c = class_new("o.snapshot~", (method)osnap_new, (method)osnap_free, sizeof(t_osnap), 0L, A_GIMME, 0);
+	class_addmethod(c, (method)osnap_assist, "assist", A_CANT, 0);
+	class_addmethod(c, (method)osnap_doc, "doc", 0);
+	class_addmethod(c, (method)osnap_dsp, "dsp", A_CANT, 0);
+	class_addmethod(c, (method)osnap_dsp64, "dsp64", A_CANT, 0);
+	class_addmethod(c, (method)odot_version, "version", 0);
+
+	CLASS_ATTR_DOUBLE(c, "interval", 0, t_osnap, interval);
+	CLASS_ATTR_ACCESSORS(c, "interval", NULL, osnap_setInterval);
+	CLASS_ATTR_SYM_VARSIZE(c, "stats", 0, t_osnap, stats, nstats, OSNAP_NSTATS);
+	CLASS_ATTR_ACCESSORS(c, "stats", NULL, osnap_setStats);
+
+	class_dspinit(c);
+
+	class_register(CLASS_BOX, c);
+	osnap_class = c;
+
+	common_symbols_init();
+
+	ODOT_PRINT_VERSION;
+
+	omax_realtime_clock_init();
+	return 0;
+}
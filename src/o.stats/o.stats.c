@@ -0,0 +1,407 @@
+/*
+
+  Written by John MacCallum, The Center for New Music and Audio Technologies,
+  University of California, Berkeley.  Copyright (c) 2014, The Regents of
+  the University of California (Regents).
+
+  Permission to use, copy, modify, distribute, and distribute modified versions
+  of this software and its documentation without fee and without a signed
+  licensing agreement, is hereby granted, provided that the above copyright
+  notice, this paragraph and the following two paragraphs appear in all copies,
+  modifications, and distributions.
+
+  IN NO EVENT SHALL REGENTS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT,
+  SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING
+  OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF REGENTS HAS
+  BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  REGENTS SPECIFICALLY DISCLAIMS ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE. THE SOFTWARE AND ACCOMPANYING DOCUMENTATION, IF ANY, PROVIDED
+  HEREUNDER IS PROVIDED "AS IS". REGENTS HAS NO OBLIGATION TO PROVIDE
+  MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS.
+
+*/
+
+#define OMAX_DOC_NAME "o.stats"
+#define OMAX_DOC_SHORT_DESC "Per-object performance counters for odot"
+#define OMAX_DOC_LONG_DESC "o.stats turns the instrumentation shared by all odot objects on and off, and reports what it has recorded: for every object that has been sent a packet, the number of calls, bytes in, packets and bytes out, allocations, and inclusive and exclusive (less the time spent in odot objects further down the chain) time in ns, with histograms whose bucket n counts calls that took from 2^n to 2^(n+1) ns.  For every object class that allocates from the odot memory pool it also reports live and peak bytes, allocations and frees, which are always counted, and allocations per second since the last report, under /pool/<name>.  The stats message (or bang) outputs a bundle, optionally only for the objects with a given name, total outputs the counters summed over all the objects with a given name (or all objects) under /<name> (or /total), and dump posts the same to the console.  Instrumentation is off until it's enabled, and stays on for all objects in the process until it's disabled."
+#define OMAX_DOC_INLETS_DESC (char *[]){"enable, stats, total, dump, clear"}
+#define OMAX_DOC_OUTLETS_DESC (char *[]){"OSC bundle of statistics"}
+#define OMAX_DOC_SEEALSO (char *[]){"o.display"}
+
+#include "odot_version.h"
+#ifdef OMAX_PD_VERSION
+#include "m_pd.h"
+#else
+#include "ext.h"
+#include "ext_obex.h"
+#include "ext_obex_util.h"
+#include "ext_critical.h"
+#endif
+
+#include <stdio.h>
+#include "osc.h"
+#include "osc_mem.h"
+#include "osc_bundle_u.h"
+#include "osc_bundle_s.h"
+#include "osc_message_u.h"
+#include "omax_util.h"
+#include "omax_doc.h"
+#include "o.h"
+#include "odot_pool.h"
+
+#define OSTATS_NAMELEN 128
+
+typedef struct _ostats{
+	t_object ob;
+	void *outlet;
+} t_ostats;
+
+void *ostats_class;
+
+// copy the entries out, so that we don't build bundles with the table locked
+static t_odot_stats_entry *ostats_snapshot(long *n)
+{
+	*n = 0;
+	t_odot_stats *s = odot_stats_get();
+	if(!s){
+		return NULL;
+	}
+	odot_stats_lock(s);
+	t_odot_stats_entry *entries = NULL;
+	if(s->live){
+		entries = (t_odot_stats_entry *)osc_mem_alloc(s->live * sizeof(t_odot_stats_entry));
+	}
+	if(entries){
+		long i;
+		for(i = 0; i < s->tab->size; i++){
+			t_odot_stats_entry *e = s->tab->slots[i];
+			if(e && e != ODOT_STATS_TOMBSTONE){
+				entries[(*n)++] = *e;
+			}
+		}
+	}
+	odot_stats_unlock(s);
+	return entries;
+}
+
+typedef struct _ostats_pool{
+	t_odot_pool_counters c;
+	double rate; // allocs/sec since the last time we looked
+} t_ostats_pool;
+
+// same for the pool counters, which are kept per object class
+static t_ostats_pool *ostats_snapshotPool(long *n)
+{
+	*n = 0;
+	t_odot_pool_depot *d = odot_pool_getDepot();
+	if(!d){
+		return NULL;
+	}
+	uint64_t now = odot_stats_now();
+	odot_pool_lock(d);
+	long count = 0;
+	t_odot_pool_counters *c;
+	for(c = d->counters; c; c = c->next){
+		count++;
+	}
+	t_ostats_pool *pools = NULL;
+	if(count){
+		pools = (t_ostats_pool *)osc_mem_alloc(count * sizeof(t_ostats_pool));
+	}
+	if(pools){
+		for(c = d->counters; c; c = c->next){
+			t_ostats_pool *p = pools + (*n)++;
+			p->c = *c;
+			uint64_t allocs = __atomic_load_n(&(c->allocs), __ATOMIC_RELAXED);
+			p->rate = 0.;
+			if(c->lasttime && now > c->lasttime){
+				p->rate = (allocs - c->lastallocs) * 1000000000. / (now - c->lasttime);
+			}
+			c->lastallocs = allocs;
+			c->lasttime = now;
+		}
+	}
+	odot_pool_unlock(d);
+	return pools;
+}
+
+static void ostats_appendMsg(t_osc_bndl_u *b, char *prefix, char *name, uint64_t *v, long n)
+{
+	char address[OSTATS_NAMELEN * 2];
+	snprintf(address, sizeof(address), "%s/%s", prefix, name);
+	t_osc_msg_u *m = osc_message_u_allocWithAddress(address);
+	long i;
+	for(i = 0; i < n; i++){
+		osc_message_u_appendUInt64(m, v[i]);
+	}
+	osc_bundle_u_addMsg(b, m);
+}
+
+void ostats_stats(t_ostats *x, t_symbol *msg, int argc, t_atom *argv)
+{
+	t_symbol *only = NULL;
+	if(argc && atom_gettype(argv) == A_SYM){
+		only = atom_getsym(argv);
+	}
+	long n = 0;
+	t_odot_stats_entry *entries = ostats_snapshot(&n);
+	t_osc_bndl_u *b = osc_bundle_u_alloc();
+	long i;
+	for(i = 0; i < n; i++){
+		t_odot_stats_entry *e = entries + i;
+		char name[OSTATS_NAMELEN];
+		odot_stats_getName(e, name, OSTATS_NAMELEN);
+		if(only && strcmp(only->s_name, name)){
+			continue;
+		}
+		char prefix[OSTATS_NAMELEN + 32];
+		snprintf(prefix, sizeof(prefix), "/%s/%ld", name, e->id);
+		ostats_appendMsg(b, prefix, "calls", &(e->calls), 1);
+		ostats_appendMsg(b, prefix, "bytes/in", &(e->bytes_in), 1);
+		ostats_appendMsg(b, prefix, "packets/out", &(e->packets_out), 1);
+		ostats_appendMsg(b, prefix, "bytes/out", &(e->bytes_out), 1);
+		ostats_appendMsg(b, prefix, "allocs", &(e->allocs), 1);
+		ostats_appendMsg(b, prefix, "time/inclusive", &(e->inclusive), 1);
+		ostats_appendMsg(b, prefix, "time/exclusive", &(e->exclusive), 1);
+		ostats_appendMsg(b, prefix, "time/inclusive/histogram", e->inclusive_hist, ODOT_STATS_NBUCKETS);
+		ostats_appendMsg(b, prefix, "time/exclusive/histogram", e->exclusive_hist, ODOT_STATS_NBUCKETS);
+	}
+	if(entries){
+		osc_mem_free(entries);
+	}
+	t_ostats_pool *pools = ostats_snapshotPool(&n);
+	for(i = 0; i < n; i++){
+		t_ostats_pool *p = pools + i;
+		char name[OSTATS_NAMELEN];
+		odot_stats_nameFromFile(p->c.file, name, OSTATS_NAMELEN);
+		if(only && strcmp(only->s_name, name)){
+			continue;
+		}
+		char prefix[OSTATS_NAMELEN + 32];
+		snprintf(prefix, sizeof(prefix), "/pool/%s", name);
+		uint64_t live = p->c.live > 0 ? p->c.live : 0, peak = p->c.peak;
+		ostats_appendMsg(b, prefix, "live", &live, 1);
+		ostats_appendMsg(b, prefix, "peak", &peak, 1);
+		ostats_appendMsg(b, prefix, "allocs", &(p->c.allocs), 1);
+		ostats_appendMsg(b, prefix, "frees", &(p->c.frees), 1);
+		char address[OSTATS_NAMELEN * 2];
+		snprintf(address, sizeof(address), "%s/allocs/sec", prefix);
+		t_osc_msg_u *m = osc_message_u_allocWithAddress(address);
+		osc_message_u_appendDouble(m, p->rate);
+		osc_bundle_u_addMsg(b, m);
+	}
+	if(pools){
+		osc_mem_free(pools);
+	}
+	t_osc_bndl_s *bs = osc_bundle_u_serialize(b);
+	osc_bundle_u_free(b);
+	if(bs){
+		omax_util_outletOSC(x->outlet, osc_bundle_s_getLen(bs), osc_bundle_s_getPtr(bs));
+		osc_bundle_s_deepFree(bs);
+	}
+}
+
+// the counters summed over every instance of an object, or over everything
+void ostats_total(t_ostats *x, t_symbol *msg, int argc, t_atom *argv)
+{
+	t_symbol *only = NULL;
+	if(argc && atom_gettype(argv) == A_SYM){
+		only = atom_getsym(argv);
+	}
+	long n = 0;
+	t_odot_stats_entry *entries = ostats_snapshot(&n);
+	t_odot_stats_entry sum;
+	memset(&sum, '\0', sizeof(sum));
+	long i;
+	for(i = 0; i < n; i++){
+		t_odot_stats_entry *e = entries + i;
+		if(only){
+			char name[OSTATS_NAMELEN];
+			odot_stats_getName(e, name, OSTATS_NAMELEN);
+			if(strcmp(only->s_name, name)){
+				continue;
+			}
+		}
+		sum.calls += e->calls;
+		sum.bytes_in += e->bytes_in;
+		sum.packets_out += e->packets_out;
+		sum.bytes_out += e->bytes_out;
+		sum.allocs += e->allocs;
+		sum.inclusive += e->inclusive;
+		sum.exclusive += e->exclusive;
+	}
+	if(entries){
+		osc_mem_free(entries);
+	}
+	char prefix[OSTATS_NAMELEN + 2];
+	snprintf(prefix, sizeof(prefix), "/%s", only ? only->s_name : "total");
+	t_osc_bndl_u *b = osc_bundle_u_alloc();
+	ostats_appendMsg(b, prefix, "calls", &(sum.calls), 1);
+	ostats_appendMsg(b, prefix, "bytes/in", &(sum.bytes_in), 1);
+	ostats_appendMsg(b, prefix, "packets/out", &(sum.packets_out), 1);
+	ostats_appendMsg(b, prefix, "bytes/out", &(sum.bytes_out), 1);
+	ostats_appendMsg(b, prefix, "allocs", &(sum.allocs), 1);
+	ostats_appendMsg(b, prefix, "time/inclusive", &(sum.inclusive), 1);
+	ostats_appendMsg(b, prefix, "time/exclusive", &(sum.exclusive), 1);
+	t_osc_bndl_s *bs = osc_bundle_u_serialize(b);
+	osc_bundle_u_free(b);
+	if(bs){
+		omax_util_outletOSC(x->outlet, osc_bundle_s_getLen(bs), osc_bundle_s_getPtr(bs));
+		osc_bundle_s_deepFree(bs);
+	}
+}
+
+void ostats_bang(t_ostats *x)
+{
+	ostats_stats(x, NULL, 0, NULL);
+}
+
+void ostats_dump(t_ostats *x)
+{
+	long n = 0;
+	t_odot_stats_entry *entries = ostats_snapshot(&n);
+	long i;
+	for(i = 0; i < n; i++){
+		t_odot_stats_entry *e = entries + i;
+		char name[OSTATS_NAMELEN];
+		odot_stats_getName(e, name, OSTATS_NAMELEN);
+		double calls = e->calls ? (double)e->calls : 1.;
+		object_post((t_object *)x, "%s %ld: %llu calls, %llu bytes in, %llu packets (%llu bytes) out, %llu allocs, %.0f ns inclusive, %.0f ns exclusive per call",
+			    name, e->id,
+			    (unsigned long long)e->calls,
+			    (unsigned long long)e->bytes_in,
+			    (unsigned long long)e->packets_out,
+			    (unsigned long long)e->bytes_out,
+			    (unsigned long long)e->allocs,
+			    e->inclusive / calls,
+			    e->exclusive / calls);
+	}
+	if(!n){
+		object_post((t_object *)x, "nothing recorded%s", (odot_stats_get() && odot_stats_get()->enabled) ? "" : " (stats are off)");
+	}
+	if(entries){
+		osc_mem_free(entries);
+	}
+	t_ostats_pool *pools = ostats_snapshotPool(&n);
+	for(i = 0; i < n; i++){
+		t_ostats_pool *p = pools + i;
+		char name[OSTATS_NAMELEN];
+		odot_stats_nameFromFile(p->c.file, name, OSTATS_NAMELEN);
+		object_post((t_object *)x, "pool %s: %lld bytes live, %lld bytes peak, %llu allocs, %llu frees, %.1f allocs/sec",
+			    name,
+			    (long long)p->c.live,
+			    (long long)p->c.peak,
+			    (unsigned long long)p->c.allocs,
+			    (unsigned long long)p->c.frees,
+			    p->rate);
+	}
+	if(pools){
+		osc_mem_free(pools);
+	}
+}
+
+void ostats_clear(t_ostats *x)
+{
+	odot_stats_clear();
+}
+
+void ostats_doc(t_ostats *x)
+{
+	omax_doc_outletDoc(x->outlet);
+}
+
+void ostats_free(t_ostats *x)
+{
+}
+
+#ifdef OMAX_PD_VERSION
+
+void ostats_enable(t_ostats *x, t_floatarg f)
+{
+	odot_stats_enable(f != 0);
+}
+
+void *ostats_new(t_symbol *msg, int argc, t_atom *argv)
+{
+	t_ostats *x = (t_ostats *)object_alloc(ostats_class);
+	if(!x){
+		return NULL;
+	}
+	x->outlet = outlet_new(&x->ob, gensym("FullPacket"));
+	if(argc && atom_gettype(argv) == A_FLOAT){
+		ostats_enable(x, atom_getfloat(argv));
+	}
+	return x;
+}
+
+int setup_o0x2estats(void)
+{
+	t_class *c = class_new(gensym(OMAX_DOC_NAME), (t_newmethod)ostats_new, (t_method)ostats_free, sizeof(t_ostats), 0L, A_GIMME, 0);
+
+	class_addmethod(c, (t_method)ostats_enable, gensym("enable"), A_FLOAT, 0);
+	class_addmethod(c, (t_method)ostats_stats, gensym("stats"), A_GIMME, 0);
+	class_addmethod(c, (t_method)ostats_total, gensym("total"), A_GIMME, 0);
+	class_addmethod(c, (t_method)ostats_dump, gensym("dump"), 0);
+	class_addmethod(c, (t_method)ostats_clear, gensym("clear"), 0);
+	class_addbang(c, (t_method)ostats_bang);
+	class_addmethod(c, (t_method)odot_version, gensym("version"), 0);
+	class_addmethod(c, (t_method)ostats_doc, gensym("doc"), 0);
+
+	ostats_class = c;
+
+	odot_stats_get();
+	ODOT_PRINT_VERSION;
+	return 0;
+}
+
+#else
+
+void ostats_enable(t_ostats *x, long l)
+{
+	odot_stats_enable(l != 0);
+}
+
+void ostats_assist(t_ostats *x, void *b, long io, long num, char *buf)
+{
+	omax_doc_assist(io, num, buf);
+}
+
+void *ostats_new(t_symbol *msg, short argc, t_atom *argv)
+{
+	t_ostats *x = (t_ostats *)object_alloc(ostats_class);
+	if(!x){
+		return NULL;
+	}
+	x->outlet = outlet_new((t_object *)x, "FullPacket");
+	if(argc && atom_gettype(argv) == A_LONG){
+		ostats_enable(x, atom_getlong(argv));
+	}
+	return x;
+}
+
+int main(void)
+{
+	t_class *c = class_new(OMAX_DOC_NAME, (method)ostats_new, (method)ostats_free, sizeof(t_ostats), 0L, A_GIMME, 0);
+
+	class_addmethod(c, (method)ostats_enable, "enable", A_LONG, 0);
+	class_addmethod(c, (method)ostats_stats, "stats", A_GIMME, 0);
+	class_addmethod(c, (method)ostats_total, "total", A_GIMME, 0);
+	class_addmethod(c, (method)ostats_dump, "dump", 0);
+	class_addmethod(c, (method)ostats_clear, "clear", 0);
+	class_addmethod(c, (method)ostats_bang, "bang", 0);
+	class_addmethod(c, (method)ostats_assist, "assist", A_CANT, 0);
+	class_addmethod(c, (method)odot_version, "version", 0);
+	class_addmethod(c, (method)ostats_doc, "doc", 0);
+
+	class_register(CLASS_BOX, c);
+	ostats_class = c;
+
+	common_symbols_init();
+	odot_stats_get();
+	ODOT_PRINT_VERSION;
+	return 0;
+}
+
+#endif
@@ -28,6 +28,7 @@ COPYRIGHT_YEARS: 2011
 SVN_REVISION: $LastChangedRevision: 587 $
 VERSION 0.0: First try
 VERSION 0.1: porting to pd, note: the name and key attributes are only setable on load in pd -- rama
+VERSION 0.2: @maxbytes, @maxentries, and @evict for running as a bounded cache
 @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
 
 */
@@ -55,21 +56,50 @@ VERSION 0.1: porting to pd, note: the name and key attributes are only setable o
 #include "osc_bundle_s.h"
 #include "osc_message_s.h"
 #include "osc_atom_s.h"
-#include "osc_linkedlist.h"
 #include "omax_util.h"
 #include "omax_dict.h"
 #include "omax_doc.h"
 
+
 #include "o.h"
+#include "odot_scratch.h"
 
 #define OTABLE_MANGLE_PFX "__CNMAT_otable_name_"
 
+// eviction policies used when @maxbytes or @maxentries is exceeded
+enum{
+	OTABLE_EVICT_FIFO, // drop the oldest entry
+	OTABLE_EVICT_LRU, // drop the entry least recently stored or recalled
+	OTABLE_EVICT_NEWEST // refuse the incoming bundle
+};
+
+// each entry holds its bundle inline, right after the struct.
+// entries live on two lists: the table order (what dump, pop, and
+// peek see) and the age order that eviction takes from the head of.
+typedef struct _otable_entry{
+	long len;
+	char *ptr;
+	int keylen;
+	char *key;
+	struct _otable_entry *prev, *next;
+	struct _otable_entry *older, *newer;
+} t_otable_entry;
+
 typedef struct _otable_db{
 	t_osc_hashtab *ht;
-	t_osc_linkedlist *ll;
+	t_otable_entry *head, *tail;
+	t_otable_entry *oldest, *newest;
+	unsigned long count;
 	char *keyaddress;
 	int refcount;
 	uint64_t bytecount;
+	uint64_t evictions;
+	// the limits belong to the db, so every o.table that refers to it
+	// enforces the same ones.  0 means unbounded
+	long maxbytes;
+	long maxentries;
+	t_symbol *evict;
+	int evict_policy;
 } t_otable_db;
 
 typedef struct _otable{
@@ -78,13 +108,21 @@ typedef struct _otable{
 	t_otable_db *db;
 	t_symbol *name;
 	t_critical lock;
+	// limits given to this instance, passed on to its db when it gets one
+	long maxbytes;
+	long maxentries;
+	t_symbol *evict;
+	int limitsset; // which of the above have been given
 } t_otable;
 
+#define OTABLE_SET_MAXBYTES 1
+#define OTABLE_SET_MAXENTRIES 2
+#define OTABLE_SET_EVICT 4
+
 void *otable_class;
 
 t_otable_db *otable_makedb(void);
 void otable_destroydb(t_otable *x, t_otable_db *db);
-void otable_linkedlist_dtor(void *bndl);
 void otable_hashtab_dtor(char *key, void *data);
 void otable_free(t_otable *x);
 void otable_assist(t_otable *x, void *b, long m, long a, char *s);
@@ -92,11 +130,15 @@ void *otable_new(t_symbol *msg, short argc, t_atom *argv);
 t_max_err otable_setName(t_otable *x, void *attr, long ac, t_atom *av);
 t_max_err otable_getKey(t_otable *x, void *attr, long *ac, t_atom **av);
 t_max_err otable_setKey(t_otable *x, void *attr, long ac, t_atom *av);
+t_max_err otable_setMaxbytes(t_otable *x, void *attr, long ac, t_atom *av);
+t_max_err otable_setMaxentries(t_otable *x, void *attr, long ac, t_atom *av);
+t_max_err otable_setEvict(t_otable *x, void *attr, long ac, t_atom *av);
+void otable_applyLimits(t_otable *x);
 
 
-t_symbol *ps_FullPacket;
+t_symbol *ps_FullPacket, *ps_fifo, *ps_lru, *ps_newest;
 
-void otable_getKeyOutOfBundle(t_otable *x, t_osc_bndl_s *bndl, int *keylen, char **key)
+void otable_getKeyOutOfBundle(t_otable *x, long len, char *ptr, int *keylen, char **key)
 {
 	char *keyaddress = NULL;
 	int _keylen = 0;
@@ -106,7 +148,7 @@ void otable_getKeyOutOfBundle(t_otable *x, t_osc_bndl_s *bndl, int *keylen, char
 	critical_exit(x->lock);
 
 	if(keyaddress){
-		t_osc_msg_ar_s *ar = osc_bundle_s_lookupAddress_b(bndl, keyaddress, 1);
+		t_osc_msg_ar_s *ar = osc_bundle_s_lookupAddress(len, ptr, keyaddress, 1);
 		if(ar){
 			t_osc_msg_s *m = osc_message_array_s_get(ar, 0);
 			if(osc_message_s_getArgCount(m) > 0){
@@ -127,32 +169,245 @@ void otable_getKeyOutOfBundle(t_otable *x, t_osc_bndl_s *bndl, int *keylen, char
 	*key = _key;
 }
 
-void otable_insert(t_otable *x, long len, char *ptr, void (*ll_fptr)(t_osc_linkedlist*, void*))
+t_otable_entry *otable_entry_alloc(long len, char *ptr, int keylen, char *key)
+{
+	t_otable_entry *e = (t_otable_entry *)osc_mem_alloc(sizeof(t_otable_entry) + len);
+	if(e){
+		e->len = len;
+		e->ptr = (char *)(e + 1);
+		memcpy(e->ptr, ptr, len);
+		e->keylen = keylen;
+		e->key = key;
+		e->prev = e->next = NULL;
+		e->older = e->newer = NULL;
+	}
+	return e;
+}
+
+void otable_entry_free(t_otable_entry *e)
+{
+	if(e){
+		if(e->key){
+			osc_mem_free(e->key);
+		}
+		osc_mem_free(e);
+	}
+}
+
+// all of the otable_db_* functions below expect the caller to hold x->lock
+
+void otable_db_link(t_otable_db *db, t_otable_entry *e, int prepend)
+{
+	if(prepend){
+		e->next = db->head;
+		if(db->head){
+			db->head->prev = e;
+		}else{
+			db->tail = e;
+		}
+		db->head = e;
+	}else{
+		e->prev = db->tail;
+		if(db->tail){
+			db->tail->next = e;
+		}else{
+			db->head = e;
+		}
+		db->tail = e;
+	}
+	e->older = db->newest;
+	if(db->newest){
+		db->newest->newer = e;
+	}else{
+		db->oldest = e;
+	}
+	db->newest = e;
+	if(e->key){
+		// a later bundle with the same key shadows the earlier one
+		osc_hashtab_store(db->ht, e->keylen, e->key, (void *)e);
+	}
+	db->count++;
+	db->bytecount += e->len;
+}
+
+void otable_db_unlink(t_otable_db *db, t_otable_entry *e)
+{
+	if(e->prev){
+		e->prev->next = e->next;
+	}else{
+		db->head = e->next;
+	}
+	if(e->next){
+		e->next->prev = e->prev;
+	}else{
+		db->tail = e->prev;
+	}
+	if(e->older){
+		e->older->newer = e->newer;
+	}else{
+		db->oldest = e->newer;
+	}
+	if(e->newer){
+		e->newer->older = e->older;
+	}else{
+		db->newest = e->older;
+	}
+	e->prev = e->next = NULL;
+	e->older = e->newer = NULL;
+	if(e->key && osc_hashtab_lookup(db->ht, e->keylen, e->key) == e){
+		osc_hashtab_remove(db->ht, e->keylen, e->key, otable_hashtab_dtor);
+	}
+	db->count--;
+	db->bytecount -= e->len;
+}
+
+// move an entry to the young end of the age list
+void otable_db_touch(t_otable_db *db, t_otable_entry *e)
+{
+	if(e == db->newest){
+		return;
+	}
+	if(e->older){
+		e->older->newer = e->newer;
+	}else{
+		db->oldest = e->newer;
+	}
+	e->newer->older = e->older;
+	e->older = db->newest;
+	e->newer = NULL;
+	db->newest->newer = e;
+	db->newest = e;
+}
+
+// negative indexes count back from the end of the table
+t_otable_entry *otable_db_nth(t_otable_db *db, int n)
+{
+	t_otable_entry *e = NULL;
+	if(n >= 0){
+		e = db->head;
+		while(e && n--){
+			e = e->next;
+		}
+	}else{
+		e = db->tail;
+		while(e && ++n){
+			e = e->prev;
+		}
+	}
+	return e;
+}
+
+void otable_db_clear(t_otable_db *db)
+{
+	osc_hashtab_clear(db->ht);
+	t_otable_entry *e = db->head;
+	while(e){
+		t_otable_entry *next = e->next;
+		otable_entry_free(e);
+		e = next;
+	}
+	db->head = db->tail = NULL;
+	db->oldest = db->newest = NULL;
+	db->count = 0;
+	db->bytecount = 0;
+}
+
+// would storing n more entries totalling len bytes exceed the limits?
+int otable_overLimit(t_otable_db *db, long n, long len)
+{
+	if(db->maxentries > 0 && db->count + (unsigned long)n > (unsigned long)db->maxentries){
+		return 1;
+	}
+	if(db->maxbytes > 0 && db->bytecount + (uint64_t)len > (uint64_t)db->maxbytes){
+		return 1;
+	}
+	return 0;
+}
+
+// make room for n entries totalling len bytes by dropping the oldest
+// entries.  with @evict lru, recalled entries have been moved to the
+// young end of the list, so the oldest one is the least recently used.
+void otable_evict(t_otable_db *db, long n, long len)
+{
+	while(db->oldest && otable_overLimit(db, n, len)){
+		t_otable_entry *e = db->oldest;
+		otable_db_unlink(db, e);
+		otable_entry_free(e);
+		db->evictions++;
+	}
+}
+
+void otable_recalled(t_otable *x, t_otable_entry *e)
 {
-	char *copy = (char *)osc_mem_alloc(len);
-	memcpy(copy, ptr, len);
-	t_osc_bndl_s *bndl = osc_bundle_s_alloc(len, copy);
+	if(x->db->evict_policy == OTABLE_EVICT_LRU){
+		otable_db_touch(x->db, e);
+	}
+}
+
+// output a copy of an entry, or an empty bundle if e is NULL.  call with
+// the lock held; it is released before anything goes out, since a
+// downstream insert can evict e
+void otable_outputEntry(t_otable *x, t_otable_entry *e)
+{
+	if(!e){
+		critical_exit(x->lock);
+		omax_util_outletOSC(x->outlet, OSC_HEADER_SIZE, OSC_EMPTY_HEADER);
+		return;
+	}
+	t_odot_scratch_mark mark = odot_scratch_mark();
+	long len = e->len;
+	char *copy = (char *)odot_scratch_alloc(len);
+	if(copy){
+		memcpy(copy, e->ptr, len);
+	}
+	critical_exit(x->lock);
+	if(copy){
+		omax_util_outletOSC(x->outlet, len, copy);
+	}else{
+		object_error((t_object *)x, "out of memory!");
+	}
+	odot_scratch_release(mark);
+}
 
+void otable_insert(t_otable *x, long len, char *ptr, int prepend)
+{
 	int keylen = 0;
 	char *key = NULL;
-	otable_getKeyOutOfBundle(x, bndl, &keylen, &key);
+	otable_getKeyOutOfBundle(x, len, ptr, &keylen, &key);
 
 	critical_enter(x->lock);
-	if(key){
-		osc_hashtab_store(x->db->ht, keylen, key, bndl);
+	t_otable_db *db = x->db;
+	if(otable_overLimit(db, 1, len)){
+		if(db->evict_policy == OTABLE_EVICT_NEWEST || (db->maxbytes > 0 && len > db->maxbytes)){
+			db->evictions++;
+			critical_exit(x->lock);
+			if(key){
+				osc_mem_free(key);
+			}
+			return;
+		}
+		otable_evict(db, 1, len);
+	}
+	t_otable_entry *e = otable_entry_alloc(len, ptr, keylen, key);
+	if(e){
+		otable_db_link(db, e, prepend);
 	}
-	ll_fptr(x->db->ll, bndl);
-	x->db->bytecount += len;
 	critical_exit(x->lock);
+	if(!e){
+		object_error((t_object *)x, "out of memory!");
+		if(key){
+			osc_mem_free(key);
+		}
+	}
 }
 
 void otable_dopend(t_otable *x,
 		   t_symbol *msg,
 		   int argc,
 		   t_atom *argv,
-		   void (*ll_fptr)(t_osc_linkedlist*, void*))
+		   int prepend)
 {
-	if(argc != 3){
+	if(argc < 1){
 		object_error((t_object *)x, "bad arguments--expected FullPacket <len> <ptr>");
 		return;
 	}
@@ -167,18 +422,18 @@ void otable_dopend(t_otable *x,
 	argc--;
 	argv++;
 	OMAX_UTIL_GET_LEN_AND_PTR;
-	otable_insert(x, len, ptr, ll_fptr);
+	otable_insert(x, len, ptr, prepend);
 }
 
 
 void otable_prepend(t_otable *x, t_symbol *msg, int argc, t_atom *argv)
 {
-	otable_dopend(x, msg, argc, argv, osc_linkedlist_prepend);
+	otable_dopend(x, msg, argc, argv, 1);
 }
 
 void otable_append(t_otable *x, t_symbol *msg, int argc, t_atom *argv)
 {
-	otable_dopend(x, msg, argc, argv, osc_linkedlist_append);
+	otable_dopend(x, msg, argc, argv, 0);
 }
 
 void otable_processFullPacket(t_otable *x, long len, char *ptr)
@@ -191,7 +446,7 @@ void otable_processFullPacket(t_otable *x, long len, char *ptr)
 		len = copylen;
 		ptr = copy;
 	}
-	otable_insert(x, len, ptr, osc_linkedlist_append);
+	otable_insert(x, len, ptr, 0);
 	if(alloc && copy){
 		osc_mem_free(copy);
 	}
@@ -203,31 +458,6 @@ void otable_fullPacket(t_otable *x, t_symbol *msg, int argc, t_atom *argv)
 	otable_processFullPacket(x, len, ptr);
 }
 
-void otable_pop(t_otable *x, void *(*ll_pop)(t_osc_linkedlist*))
-{
-	critical_enter(x->lock);
-	t_osc_bndl_s *bndl = (t_osc_bndl_s *)ll_pop(x->db->ll);
-	if(bndl){
-		int len = 0;
-		char *key = NULL;
-		otable_getKeyOutOfBundle(x, bndl, &len, &key);
-		if(key){
-			osc_hashtab_remove(x->db->ht, len, key, otable_hashtab_dtor);
-		}
-	}
-	critical_exit(x->lock);
-	if(bndl){
-		long len = osc_bundle_s_getLen(bndl);
-		char *ptr = osc_bundle_s_getPtr(bndl);
-		omax_util_outletOSC(x->outlet, len, ptr);
-		osc_bundle_s_deepFree(bndl);
-		x->db->bytecount -= len;
-	}else{
-		omax_util_outletOSC(x->outlet, OSC_HEADER_SIZE, OSC_EMPTY_HEADER);
-	}
-}
-
-
 #ifdef OMAX_PD_VERSION
 void otable_popnth(t_otable *x, float f)
 {
@@ -237,14 +467,14 @@ void otable_popnth(t_otable *x, int n)
 {
 #endif
 	critical_enter(x->lock);
-	t_osc_bndl_s *bndl = (t_osc_bndl_s *)osc_linkedlist_popNth(x->db->ll, n);
+	t_otable_entry *e = otable_db_nth(x->db, n);
+	if(e){
+		otable_db_unlink(x->db, e);
+	}
 	critical_exit(x->lock);
-	if(bndl){
-		long len = osc_bundle_s_getLen(bndl);
-		char *ptr = osc_bundle_s_getPtr(bndl);
-		omax_util_outletOSC(x->outlet, len, ptr);
-		osc_bundle_s_deepFree(bndl);
-		x->db->bytecount -= len;
+	if(e){
+		omax_util_outletOSC(x->outlet, e->len, e->ptr);
+		otable_entry_free(e);
 	}else{
 		omax_util_outletOSC(x->outlet, OSC_HEADER_SIZE, OSC_EMPTY_HEADER);
 	}
@@ -252,12 +482,12 @@ void otable_popnth(t_otable *x, int n)
 
 void otable_popfirst(t_otable *x)
 {
-	otable_pop(x, osc_linkedlist_popHead);
+	otable_popnth(x, 0);
 }
 
 void otable_poplast(t_otable *x)
 {
-	otable_pop(x, osc_linkedlist_popTail);
+	otable_popnth(x, -1);
 }
 
 #ifdef OMAX_PD_VERSION
@@ -269,15 +499,11 @@ void otable_peeknth(t_otable *x, int n)
 {
 #endif
 	critical_enter(x->lock);
-	t_osc_bndl_s *bndl = (t_osc_bndl_s *)osc_linkedlist_peekNth(x->db->ll, n);
-	critical_exit(x->lock);
-	if(bndl){
-		long len = osc_bundle_s_getLen(bndl);
-		char *ptr = osc_bundle_s_getPtr(bndl);
-		omax_util_outletOSC(x->outlet, len, ptr);
-	}else{
-		omax_util_outletOSC(x->outlet, OSC_HEADER_SIZE, OSC_EMPTY_HEADER);
+	t_otable_entry *e = otable_db_nth(x->db, n);
+	if(e){
+		otable_recalled(x, e);
 	}
+	otable_outputEntry(x, e);
 }
 
 void otable_peekfirst(t_otable *x)
@@ -299,17 +525,12 @@ void otable_delnth(t_otable *x, int n)
 {
 #endif
 	critical_enter(x->lock);
-	t_osc_bndl_s *bndl = (t_osc_bndl_s *)osc_linkedlist_popNth(x->db->ll, n);
-	critical_exit(x->lock);
-	if(bndl){
-		long len = osc_bundle_s_getLen(bndl);
-		//char *ptr = osc_bundle_s_getPtr(bndl);
-		//omax_util_outletOSC(x->outlet, len, ptr);
-		osc_bundle_s_deepFree(bndl);
-		x->db->bytecount -= len;
-	}else{
-		//omax_util_outletOSC(x->outlet, OSC_HEADER_SIZE, OSC_EMPTY_HEADER);
+	t_otable_entry *e = otable_db_nth(x->db, n);
+	if(e){
+		otable_db_unlink(x->db, e);
 	}
+	critical_exit(x->lock);
+	otable_entry_free(e);
 }
 
 void otable_delfirst(t_otable *x)
@@ -322,45 +543,32 @@ void otable_dellast(t_otable *x)
 	otable_delnth(x, -1);
 }
 
-void otable_dumpCallback(void *obj, int index, void *data)
-{
-	t_otable *x = (t_otable *)obj;
-	if(index == -1 && data == NULL){
-		omax_util_outletOSC(x->outlet, OSC_HEADER_SIZE, OSC_EMPTY_HEADER);
-	}else{
-		t_osc_bndl_s *bndl = (t_osc_bndl_s *)data;
-		long len = osc_bundle_s_getLen(bndl);
-		char *ptr = osc_bundle_s_getPtr(bndl);
-		omax_util_outletOSC(x->outlet, len, ptr);
-	}
-}
-
-void otable_cloneCallback(void **dest, void *src)
-{
-	if(src){
-		t_osc_bndl_s *bndl = (t_osc_bndl_s *)src;
-		long len = osc_bundle_s_getLen(bndl);
-		char *ptr = osc_bundle_s_getPtr(bndl);
-		char *ptrcpy = osc_mem_alloc(len);
-		memcpy(ptrcpy, ptr, len);
-		t_osc_bndl_s *copy = osc_bundle_s_alloc(len, ptrcpy);
-		*dest = (void *)copy;
-	}
-}
-
-#define OTABLE_COPY_BEFORE_DUMP
 void otable_dump(t_otable *x)
 {
-	t_osc_linkedlist *ll = x->db->ll;
-#ifdef OTABLE_COPY_BEFORE_DUMP
+	// copy everything out before we start outputting, since
+	// downstream objects may modify the table
 	critical_enter(x->lock);
-	ll = osc_linkedlist_clone(x->db->ll, otable_cloneCallback);
+	unsigned long n = x->db->count;
+	t_otable_entry **copies = NULL;
+	if(n){
+		copies = (t_otable_entry **)osc_mem_alloc(n * sizeof(t_otable_entry *));
+		t_otable_entry *e = x->db->head;
+		for(unsigned long i = 0; i < n; i++, e = e->next){
+			copies[i] = otable_entry_alloc(e->len, e->ptr, 0, NULL);
+		}
+	}
 	critical_exit(x->lock);
-#endif
-	osc_linkedlist_iterate(ll, otable_dumpCallback, (void *)x);
-#ifdef OTABLE_COPY_BEFORE_DUMP
-	osc_linkedlist_destroy(ll);
-#endif
+	if(!n){
+		omax_util_outletOSC(x->outlet, OSC_HEADER_SIZE, OSC_EMPTY_HEADER);
+		return;
+	}
+	for(unsigned long i = 0; i < n; i++){
+		if(copies[i]){
+			omax_util_outletOSC(x->outlet, copies[i]->len, copies[i]->ptr);
+			otable_entry_free(copies[i]);
+		}
+	}
+	osc_mem_free(copies);
 }
 
 void otable_getkeys(t_otable *x, t_symbol *msg, int argc, t_atom *argv)
@@ -373,13 +581,11 @@ void otable_getindexes(t_otable *x, t_symbol *msg, int argc, t_atom *argv)
 
 void otable_clear(t_otable *x)
 {
-	// could be cheaper to just replace the ll and ht with new ones and 
+	// could be cheaper to just replace the entries with new ones and
 	// free everything in another thread.
 	critical_enter(x->lock);
-	osc_hashtab_clear(x->db->ht);
-	osc_linkedlist_clear(x->db->ll);
+	otable_db_clear(x->db);
 	critical_exit(x->lock);
-	x->db->bytecount = 0;
 }
 
 t_symbol *otable_mangle(t_symbol *name)
@@ -412,21 +618,18 @@ void otable_refer(t_otable *x, t_symbol *msg, int argc, t_atom *argv)
 	}
 	x->name = name;
 	critical_exit(x->lock);
+	otable_applyLimits(x);
 }
 
 void otable_anything(t_otable *x, t_symbol *msg, int argc, t_atom *argv)
 {
 	// assume for now that this is a key to look up in the hashtab
 	critical_enter(x->lock);
-	t_osc_bndl_s *bndl = osc_hashtab_lookup(x->db->ht, strlen(msg->s_name), msg->s_name);
-	critical_exit(x->lock);
-	if(bndl){
-		long len = osc_bundle_s_getLen(bndl);
-		char *ptr = osc_bundle_s_getPtr(bndl);
-		omax_util_outletOSC(x->outlet, len, ptr);
-	}else{
-		omax_util_outletOSC(x->outlet, OSC_HEADER_SIZE, OSC_EMPTY_HEADER);
+	t_otable_entry *e = (t_otable_entry *)osc_hashtab_lookup(x->db->ht, strlen(msg->s_name), msg->s_name);
+	if(e){
+		otable_recalled(x, e);
 	}
+	otable_outputEntry(x, e);
 }
 
 void otable_doread(t_otable *x, t_symbol *msg, int argc, t_atom *argv)
@@ -500,15 +703,13 @@ void otable_dowrite(t_otable *x, t_symbol *msg, int argc, t_atom *argv)
 	if(f){
 		object_post((t_object *)x, "opened %s for writing", path);
 		critical_enter(x->lock);
-		unsigned long n = osc_linkedlist_getCount(x->db->ll);
+		unsigned long n = x->db->count;
 		size_t count = 0;
-		for(int i = 0; i < n; i++){
-			t_osc_bndl_s *bndl = (t_osc_bndl_s *)osc_linkedlist_peekNth(x->db->ll, i);
-			int32_t len = osc_bundle_s_getLen(bndl);
+		for(t_otable_entry *e = x->db->head; e; e = e->next){
+			int32_t len = e->len;
 			int32_t len_n = hton32(len);
-			char *ptr = osc_bundle_s_getPtr(bndl);
 			count += fwrite(&len_n, 4, 1, f);
-			count += fwrite(ptr, 1, len, f);
+			count += fwrite(e->ptr, 1, len, f);
 		}
 		critical_exit(x->lock);
 		fclose(f);
@@ -530,8 +731,10 @@ void otable_write(t_otable *x, t_symbol *msg, int argc, t_atom *argv)
 
 void otable_free(t_otable *x)
 {
+	odot_stats_forget(x);
 	otable_destroydb(x, x->db);
 	critical_free(x->lock);
+	odot_scratch_trim();
 }
 
 void otable_doc(t_otable *x)
@@ -546,19 +749,9 @@ void otable_assist(t_otable *x, void *b, long io, long num, char *buf)
 }
 #endif
 
-void otable_linkedlist_dtor(void *bndl)
-{
-	if(bndl){
-		osc_bundle_s_deepFree((t_osc_bndl_s *)bndl);
-	}
-}
-
 void otable_hashtab_dtor(char *key, void *data)
 {
-	// don't free the data--otable_linkedlist_dtor will do that
-	if(key){
-		osc_mem_free(key);
-	}
+	// don't free anything--the entry owns both the key and the data
 }
 
 t_otable_db *otable_makedb(void)
@@ -566,10 +759,17 @@ t_otable_db *otable_makedb(void)
 	t_otable_db *db = (t_otable_db *)osc_mem_alloc(sizeof(t_otable_db));
 	if(db){
 		db->ht = osc_hashtab_new(-1, otable_hashtab_dtor);
-		db->ll = osc_linkedlist_new(otable_linkedlist_dtor);
+		db->head = db->tail = NULL;
+		db->oldest = db->newest = NULL;
+		db->count = 0;
 		db->refcount = 1;
 		db->keyaddress = NULL;
 		db->bytecount = 0;
+		db->evictions = 0;
+		db->maxbytes = 0;
+		db->maxentries = 0;
+		db->evict = ps_fifo;
+		db->evict_policy = OTABLE_EVICT_FIFO;
 	}
 	return db;
 }
@@ -580,8 +780,8 @@ void otable_destroydb(t_otable *x, t_otable_db *db)
 	if(db){
 		db->refcount--;
 		if(db->refcount == 0){
+			otable_db_clear(db);
 			osc_hashtab_destroy(db->ht);
-			osc_linkedlist_destroy(db->ll);
 			if(x->name){
 				t_symbol *mangled_name = otable_mangle(x->name);
 				mangled_name->s_thing = NULL;
@@ -633,8 +833,12 @@ void otable_outputinfo(t_otable *x)
 {
 	critical_enter(x->lock);
 	t_symbol *name = x->name;
-	unsigned long n = osc_linkedlist_getCount(x->db->ll);
+	unsigned long n = x->db->count;
 	uint64_t bytecount = x->db->bytecount;
+	uint64_t evictions = x->db->evictions;
+	long maxbytes = x->db->maxbytes;
+	long maxentries = x->db->maxentries;
+	t_symbol *evict = x->db->evict;
 	critical_exit(x->lock);
 	t_osc_bndl_u *b = osc_bundle_u_alloc();
 	t_osc_msg_u *msgname = osc_message_u_alloc();
@@ -654,6 +858,26 @@ void otable_outputinfo(t_otable *x)
 	osc_message_u_appendUInt64(msgmem, bytecount);
 	osc_bundle_u_addMsg(b, msgmem);
 
+	t_osc_msg_u *msgev = osc_message_u_alloc();
+	osc_message_u_setAddress(msgev, OTABLE_INFO_PFX"/evictions");
+	osc_message_u_appendUInt64(msgev, evictions);
+	osc_bundle_u_addMsg(b, msgev);
+
+	t_osc_msg_u *msgmaxbytes = osc_message_u_alloc();
+	osc_message_u_setAddress(msgmaxbytes, OTABLE_INFO_PFX"/maxbytes");
+	osc_message_u_appendInt64(msgmaxbytes, maxbytes);
+	osc_bundle_u_addMsg(b, msgmaxbytes);
+
+	t_osc_msg_u *msgmaxentries = osc_message_u_alloc();
+	osc_message_u_setAddress(msgmaxentries, OTABLE_INFO_PFX"/maxentries");
+	osc_message_u_appendInt64(msgmaxentries, maxentries);
+	osc_bundle_u_addMsg(b, msgmaxentries);
+
+	t_osc_msg_u *msgevict = osc_message_u_alloc();
+	osc_message_u_setAddress(msgevict, OTABLE_INFO_PFX"/evict");
+	osc_message_u_appendString(msgevict, evict->s_name);
+	osc_bundle_u_addMsg(b, msgevict);
+
 	t_osc_bndl_s *bs = osc_bundle_u_serialize(b);
 	if(bs){
 		omax_util_outletOSC(x->outlet, osc_bundle_s_getLen(bs), osc_bundle_s_getPtr(bs));
@@ -674,6 +898,126 @@ t_max_err otable_setKey(t_otable *x, void *attr, long ac, t_atom *av)
 	return MAX_ERR_NONE;
 }
 
+int otable_evictPolicy(t_symbol *s)
+{
+	if(s == ps_lru){
+		return OTABLE_EVICT_LRU;
+	}else if(s == ps_newest){
+		return OTABLE_EVICT_NEWEST;
+	}
+	return OTABLE_EVICT_FIFO;
+}
+
+// pass the limits this instance has been given on to its db.  lowering a
+// limit evicts right away, even with @evict newest, since there's nothing
+// incoming to refuse.
+void otable_applyLimits(t_otable *x)
+{
+	critical_enter(x->lock);
+	t_otable_db *db = x->db;
+	if(db){
+		if(x->limitsset & OTABLE_SET_MAXBYTES){
+			db->maxbytes = x->maxbytes;
+		}
+		if(x->limitsset & OTABLE_SET_MAXENTRIES){
+			db->maxentries = x->maxentries;
+		}
+		if(x->limitsset & OTABLE_SET_EVICT){
+			db->evict = x->evict;
+			db->evict_policy = otable_evictPolicy(x->evict);
+		}
+		otable_evict(db, 0, 0);
+	}
+	critical_exit(x->lock);
+}
+
+// a limit of 0 means unbounded.  the limits are shared by every
+// o.table that refers to the same db
+t_max_err otable_setMaxbytes(t_otable *x, void *attr, long ac, t_atom *av)
+{
+	if(ac && av){
+		long l = atom_getlong(av);
+		x->maxbytes = l > 0 ? l : 0;
+		x->limitsset |= OTABLE_SET_MAXBYTES;
+		otable_applyLimits(x);
+	}
+	return MAX_ERR_NONE;
+}
+
+t_max_err otable_setMaxentries(t_otable *x, void *attr, long ac, t_atom *av)
+{
+	if(ac && av){
+		long l = atom_getlong(av);
+		x->maxentries = l > 0 ? l : 0;
+		x->limitsset |= OTABLE_SET_MAXENTRIES;
+		otable_applyLimits(x);
+	}
+	return MAX_ERR_NONE;
+}
+
+t_max_err otable_setEvict(t_otable *x, void *attr, long ac, t_atom *av)
+{
+	if(!ac || !av || atom_gettype(av) != A_SYM){
+		return MAX_ERR_NONE;
+	}
+	t_symbol *s = atom_getsym(av);
+	if(s != ps_fifo && s != ps_lru && s != ps_newest){
+		object_error((t_object *)x, "unknown eviction policy %s--expected fifo, lru, or newest", s->s_name);
+		return MAX_ERR_GENERIC;
+	}
+	x->evict = s;
+	x->limitsset |= OTABLE_SET_EVICT;
+	otable_applyLimits(x);
+	return MAX_ERR_NONE;
+}
+
+#ifndef OMAX_PD_VERSION
+// the attributes report the limits of the db, which another o.table
+// may have changed
+t_max_err otable_getMaxbytes(t_otable *x, void *attr, long *ac, t_atom **av)
+{
+	char alloc;
+	if(atom_alloc(ac, av, &alloc)){
+		return MAX_ERR_GENERIC;
+	}
+	critical_enter(x->lock);
+	atom_setlong(*av, x->db ? x->db->maxbytes : x->maxbytes);
+	critical_exit(x->lock);
+	return MAX_ERR_NONE;
+}
+
+t_max_err otable_getMaxentries(t_otable *x, void *attr, long *ac, t_atom **av)
+{
+	char alloc;
+	if(atom_alloc(ac, av, &alloc)){
+		return MAX_ERR_GENERIC;
+	}
+	critical_enter(x->lock);
+	atom_setlong(*av, x->db ? x->db->maxentries : x->maxentries);
+	critical_exit(x->lock);
+	return MAX_ERR_NONE;
+}
+
+t_max_err otable_getEvict(t_otable *x, void *attr, long *ac, t_atom **av)
+{
+	char alloc;
+	if(atom_alloc(ac, av, &alloc)){
+		return MAX_ERR_GENERIC;
+	}
+	critical_enter(x->lock);
+	atom_setsym(*av, x->db ? x->db->evict : x->evict);
+	critical_exit(x->lock);
+	return MAX_ERR_NONE;
+}
+#endif
+
+void otable_initLimits(t_otable *x)
+{
+	x->maxbytes = 0;
+	x->maxentries = 0;
+	x->evict = ps_fifo;
+	x->limitsset = 0;
+}
 
 #ifdef OMAX_PD_VERSION
 void *otable_new(t_symbol *msg, short argc, t_atom *argv)
@@ -684,6 +1028,7 @@ void *otable_new(t_symbol *msg, short argc, t_atom *argv)
 		critical_new(&x->lock);
 		x->name = NULL;
 		x->db = NULL;
+		otable_initLimits(x);
         
         if(!x->name){
 			x->db = otable_makedb();
@@ -715,6 +1060,26 @@ void *otable_new(t_symbol *msg, short argc, t_atom *argv)
                         post("@key value must be a osc address");
                         return 0;
                     }
+                } else if( attribute == gensym("@maxbytes") || attribute == gensym("@maxentries") ){
+                    if(atom_gettype(argv+(++i)) == A_FLOAT)
+                    {
+                        if(attribute == gensym("@maxbytes")){
+                            otable_setMaxbytes(x, NULL, 1, argv+i);
+                        } else {
+                            otable_setMaxentries(x, NULL, 1, argv+i);
+                        }
+                    } else {
+                        post("%s value must be a number", attribute->s_name);
+                        return 0;
+                    }
+                } else if( attribute == gensym("@evict") ){
+                    if(atom_gettype(argv+(++i)) == A_SYMBOL)
+                    {
+                        otable_setEvict(x, NULL, 1, argv+i);
+                    } else {
+                        post("@evict value must be fifo, lru, or newest");
+                        return 0;
+                    }
                 } else if(attribute->s_name[0] == '@') {
                     post("unknown attribute");
                 }
@@ -756,6 +1121,11 @@ int setup_o0x2etable(void)
 	class_addmethod(c, (t_method)otable_peekfirst, gensym("peekfirst"), 0);
 	class_addmethod(c, (t_method)otable_peeklast, gensym("peeklast"), 0);
 	class_addmethod(c, (t_method)otable_peeknth, gensym("peeknth"), A_DEFFLOAT, 0);//<<long
+	class_addmethod(c, (t_method)otable_delfirst, gensym("delfirst"), 0);
+	class_addmethod(c, (t_method)otable_dellast, gensym("dellast"), 0);
+	class_addmethod(c, (t_method)otable_delnth, gensym("delnth"), A_DEFFLOAT, 0);//<<long
+
+	class_addmethod(c, (t_method)otable_outputinfo, gensym("info"), 0);
     
     class_addmethod(c, (t_method)otable_doc, gensym("doc"), 0);
 
@@ -769,6 +1139,9 @@ int setup_o0x2etable(void)
 	otable_class = c;
         
 	ps_FullPacket = gensym("FullPacket");
+	ps_fifo = gensym("fifo");
+	ps_lru = gensym("lru");
+	ps_newest = gensym("newest");
 	ODOT_PRINT_VERSION
 	return 0;
 }
@@ -782,6 +1155,7 @@ void *otable_new(t_symbol *msg, short argc, t_atom *argv)
 		critical_new(&x->lock);
 		x->name = NULL;
 		x->db = NULL;
+		otable_initLimits(x);
 
 		attr_args_process(x, argc, argv);
 		if(!x->name){
@@ -789,6 +1163,7 @@ void *otable_new(t_symbol *msg, short argc, t_atom *argv)
 			if(!x->db){
 				return NULL;
 			}
+			otable_applyLimits(x);
 		}
 	}
 		   	
@@ -838,12 +1213,27 @@ int main(void)
 	CLASS_ATTR_SYM(c, "key", 0, t_otable, name); // name is a dummy
 	CLASS_ATTR_ACCESSORS(c, "key", otable_getKey, otable_setKey);
 
+	CLASS_ATTR_LONG(c, "maxbytes", 0, t_otable, maxbytes);
+	CLASS_ATTR_ACCESSORS(c, "maxbytes", otable_getMaxbytes, otable_setMaxbytes);
+	CLASS_ATTR_FILTER_MIN(c, "maxbytes", 0);
+
+	CLASS_ATTR_LONG(c, "maxentries", 0, t_otable, maxentries);
+	CLASS_ATTR_ACCESSORS(c, "maxentries", otable_getMaxentries, otable_setMaxentries);
+	CLASS_ATTR_FILTER_MIN(c, "maxentries", 0);
+
+	CLASS_ATTR_SYM(c, "evict", 0, t_otable, evict);
+	CLASS_ATTR_ACCESSORS(c, "evict", otable_getEvict, otable_setEvict);
+	CLASS_ATTR_ENUM(c, "evict", 0, "fifo lru newest");
+
 	class_register(CLASS_BOX, c);
 	otable_class = c;
 
 	common_symbols_init();
 
 	ps_FullPacket = gensym("FullPacket");
+	ps_fifo = gensym("fifo");
+	ps_lru = gensym("lru");
+	ps_newest = gensym("newest");
 	ODOT_PRINT_VERSION
 	return 0;
 }
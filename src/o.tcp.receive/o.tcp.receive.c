@@ -0,0 +1,397 @@
+/*
+
+  Written by Matt Wright, Adrian Freed, Andy Schmeder, John MacCallum
+
+  The Center for New Music and Audio Technologies,
+  University of California, Berkeley.  Copyright (c) 1996,97,98,99,2000,01,02,03,04,05, 2014
+  The Regents of the University of California (Regents).
+
+  Permission to use, copy, modify, distribute, and distribute modified versions
+  of this software and its documentation without fee and without a signed
+  licensing agreement, is hereby granted, provided that the above copyright
+  notice, this paragraph and the following two paragraphs appear in all copies,
+  modifications, and distributions.
+
+  IN NO EVENT SHALL REGENTS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT,
+  SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING
+  OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF REGENTS HAS
+  BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  REGENTS SPECIFICALLY DISCLAIMS ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE. THE SOFTWARE AND ACCOMPANYING DOCUMENTATION, IF ANY, PROVIDED
+  HEREUNDER IS PROVIDED "AS IS". REGENTS HAS NO OBLIGATION TO PROVIDE
+  MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS.
+
+*/
+
+
+#define OMAX_DOC_NAME "o.tcp.receive"
+#define OMAX_DOC_SHORT_DESC "Receives OSC packets over TCP or Unix domain socket connections"
+#define OMAX_DOC_LONG_DESC "o.tcp.receive listens on a TCP port, or on the path of a Unix domain socket, accepts any number of connections, and outputs each OSC packet it receives.  Packets are framed with SLIP (@framing slip, OSC 1.1) or a size prefix (@framing length, OSC 1.0).  A connection that sends something that can't be decoded is closed.  The right outlet reports the number of open connections."
+#define OMAX_DOC_INLETS_DESC (char *[]){"listen, close, info"}
+#define OMAX_DOC_OUTLETS_DESC (char *[]){"FullPacket", "Number of connections"}
+#define OMAX_DOC_SEEALSO  (char *[]){"o.tcp.send", "o.udp.receive"}
+
+#include "odot_version.h"
+#ifdef OMAX_PD_VERSION
+    #include "m_pd.h"
+    #include "s_stuff.h"
+    #include <stdio.h>
+    #include <string.h>
+#else
+    #include "ext.h"
+    #include "ext_obex.h"
+    #include "ext_obex_util.h"
+    #include "ext_critical.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "osc.h"
+#include "osc_mem.h"
+#include "osc_error.h"
+#include "omax_util.h"
+#include "omax_doc.h"
+#include "odot_stream.h"
+#include "o.h"
+
+/*
+The listening socket and every connection are non-blocking and watched by
+the scheduler's poll loop, so nothing here ever waits.  Each connection
+has its own stream decoder, since packets can be split across reads at
+any point; a single read can also complete several packets, and they are
+output in order.  The decoder's buffer is only good until the next call,
+which is fine because nothing downstream holds on to a FullPacket after
+the outlet call returns.
+*/
+
+#define OTCPRECV_READSIZE 65536
+#define OTCPRECV_BACKLOG 16
+
+typedef struct _otcprecv_client{
+	struct _otcprecv *x;
+	int fd;
+	t_odot_stream_decoder decoder;
+} t_otcprecv_client;
+
+typedef struct _otcprecv{
+	t_object ob;
+	void *outlet;
+	void *countoutlet;
+	int listenfd;
+	t_symbol *path; // non-NULL if we're listening on a Unix domain socket
+	t_otcprecv_client **clients;
+	long nclients;
+	long clientssize;
+	int framing;
+	long maxsize;
+	char *readbuf;
+	long packets;
+	long invalid;
+} t_otcprecv;
+
+t_class *otcprecv_class;
+
+t_symbol *ps_slip, *ps_length;
+
+static void otcprecv_drop(t_otcprecv *x, t_otcprecv_client *c)
+{
+	long i;
+	for(i = 0; i < x->nclients; i++){
+		if(x->clients[i] == c){
+			x->clients[i] = x->clients[--(x->nclients)];
+			break;
+		}
+	}
+	sys_rmpollfn(c->fd);
+	close(c->fd);
+	x->invalid += odot_stream_decoder_errors(&(c->decoder));
+	odot_stream_decoder_free(&(c->decoder));
+	osc_mem_free(c);
+	outlet_float(x->countoutlet, x->nclients);
+}
+
+static void otcprecv_read(t_otcprecv_client *c, int fd)
+{
+	t_otcprecv *x = c->x;
+	ssize_t n = recv(fd, x->readbuf, OTCPRECV_READSIZE, 0);
+	if(n < 0){
+		if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR){
+			return;
+		}
+		object_error((t_object *)x, "recv: %s", strerror(errno));
+		otcprecv_drop(x, c);
+		return;
+	}
+	if(n == 0){
+		otcprecv_drop(x, c);
+		return;
+	}
+	const unsigned char *p = (const unsigned char *)x->readbuf;
+	while(n > 0){
+		long packetlen = 0;
+		char *packet = NULL;
+		long used = odot_stream_decode(&(c->decoder), p, n, &packetlen, &packet);
+		p += used;
+		n -= used;
+		if(packetlen){
+			// a bare message is fine too, as it is for o.slip.receive
+			if(packetlen >= OSC_ID_SIZE && strncmp(packet, OSC_ID, OSC_ID_SIZE) == 0 ? osc_error_bundleSanityCheck(packetlen, packet) : *packet != '/'){
+				x->invalid++;
+			}else{
+				x->packets++;
+				// the outlet call can drop this connection (e.g. by closing the object),
+				// so stop if it's gone
+				long nclients = x->nclients;
+				omax_util_outletOSC(x->outlet, packetlen, packet);
+				if(nclients != x->nclients || x->listenfd < 0){
+					return;
+				}
+			}
+		}
+		if(odot_stream_decoder_broken(&(c->decoder))){
+			object_error((t_object *)x, "bad packet size, closing connection");
+			otcprecv_drop(x, c);
+			return;
+		}
+	}
+}
+
+static void otcprecv_accept(t_otcprecv *x, int fd)
+{
+	int cfd = accept(fd, NULL, NULL);
+	if(cfd < 0){
+		if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+			object_error((t_object *)x, "accept: %s", strerror(errno));
+		}
+		return;
+	}
+	if(x->nclients == x->clientssize){
+		long size = x->clientssize ? x->clientssize * 2 : 8;
+		t_otcprecv_client **tmp = (t_otcprecv_client **)osc_mem_resize(x->clients, size * sizeof(t_otcprecv_client *));
+		if(!tmp){
+			object_error((t_object *)x, "out of memory!");
+			close(cfd);
+			return;
+		}
+		x->clients = tmp;
+		x->clientssize = size;
+	}
+	t_otcprecv_client *c = (t_otcprecv_client *)osc_mem_alloc(sizeof(t_otcprecv_client));
+	if(!c){
+		object_error((t_object *)x, "out of memory!");
+		close(cfd);
+		return;
+	}
+	fcntl(cfd, F_SETFL, fcntl(cfd, F_GETFL) | O_NONBLOCK);
+	int one = 1;
+	setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // harmless failure on Unix domain sockets
+	c->x = x;
+	c->fd = cfd;
+	odot_stream_decoder_init(&(c->decoder), x->framing, x->maxsize);
+	x->clients[x->nclients++] = c;
+	sys_addpollfn(cfd, (t_fdpollfn)otcprecv_read, c);
+	outlet_float(x->countoutlet, x->nclients);
+}
+
+// remove a Unix domain socket, but nothing else that might be at path
+void otcprecv_unlinkSocket(const char *path)
+{
+	struct stat st;
+	if(lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)){
+		unlink(path);
+	}
+}
+
+void otcprecv_close(t_otcprecv *x)
+{
+	while(x->nclients){
+		otcprecv_drop(x, x->clients[x->nclients - 1]);
+	}
+	if(x->listenfd >= 0){
+		sys_rmpollfn(x->listenfd);
+		close(x->listenfd);
+		x->listenfd = -1;
+	}
+	if(x->path){
+		otcprecv_unlinkSocket(x->path->s_name);
+		x->path = NULL;
+	}
+}
+
+// listen <port> or listen <path>
+void otcprecv_listen(t_otcprecv *x, t_symbol *msg, int argc, t_atom *argv)
+{
+	if(argc < 1){
+		object_error((t_object *)x, "listen takes a port or the path of a Unix domain socket");
+		return;
+	}
+	otcprecv_close(x);
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	memset(&addr, '\0', sizeof(addr));
+	int fd;
+	if(atom_gettype(argv) == A_SYMBOL){
+		struct sockaddr_un *un = (struct sockaddr_un *)&addr;
+		const char *path = atom_getsym(argv)->s_name;
+		if(strlen(path) >= sizeof(un->sun_path)){
+			object_error((t_object *)x, "socket path %s is too long", path);
+			return;
+		}
+		un->sun_family = AF_UNIX;
+		strcpy(un->sun_path, path);
+		addrlen = sizeof(struct sockaddr_un);
+		// a socket left behind by a previous run would make bind() fail
+		otcprecv_unlinkSocket(path);
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	}else{
+		long port = atom_getlong(argv);
+		if(port <= 0 || port > 65535){
+			object_error((t_object *)x, "bad port %ld", port);
+			return;
+		}
+		struct sockaddr_in *in = (struct sockaddr_in *)&addr;
+		in->sin_family = AF_INET;
+		in->sin_addr.s_addr = INADDR_ANY;
+		in->sin_port = htons((unsigned short)port);
+		addrlen = sizeof(struct sockaddr_in);
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if(fd >= 0){
+			int one = 1;
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		}
+	}
+	if(fd < 0){
+		object_error((t_object *)x, "couldn't create a socket: %s", strerror(errno));
+		return;
+	}
+	if(bind(fd, (struct sockaddr *)&addr, addrlen) < 0 || listen(fd, OTCPRECV_BACKLOG) < 0){
+		object_error((t_object *)x, "couldn't listen: %s", strerror(errno));
+		close(fd);
+		return;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	x->listenfd = fd;
+	if(addr.ss_family == AF_UNIX){
+		x->path = atom_getsym(argv);
+	}
+	sys_addpollfn(fd, (t_fdpollfn)otcprecv_accept, x);
+}
+
+void otcprecv_setFraming(t_otcprecv *x, t_symbol *framing)
+{
+	if(framing == ps_slip){
+		x->framing = ODOT_STREAM_FRAMING_SLIP;
+	}else if(framing == ps_length){
+		x->framing = ODOT_STREAM_FRAMING_LENGTH;
+	}else{
+		object_error((t_object *)x, "framing must be slip or length");
+	}
+	// connections that are already open keep the framing they started with
+}
+
+void otcprecv_info(t_otcprecv *x)
+{
+	long invalid = x->invalid, i;
+	for(i = 0; i < x->nclients; i++){
+		invalid += odot_stream_decoder_errors(&(x->clients[i]->decoder));
+	}
+	object_post((t_object *)x, "%ld connections, %ld packets received, %ld invalid", x->nclients, x->packets, invalid);
+}
+
+void otcprecv_doc(t_otcprecv *x)
+{
+	omax_doc_outletDoc(x->outlet);
+}
+
+void otcprecv_free(t_otcprecv *x)
+{
+	otcprecv_close(x);
+	if(x->clients){
+		osc_mem_free(x->clients);
+	}
+	if(x->readbuf){
+		osc_mem_free(x->readbuf);
+	}
+}
+
+#ifdef OMAX_PD_VERSION
+
+void *otcprecv_new(t_symbol *s, int argc, t_atom *argv)
+{
+	t_otcprecv *x = (t_otcprecv *)object_alloc(otcprecv_class);
+	if(!x){
+		return NULL;
+	}
+	x->outlet = outlet_new(&x->ob, gensym("FullPacket"));
+	x->countoutlet = outlet_new(&x->ob, &s_float);
+	x->listenfd = -1;
+	x->path = NULL;
+	x->clients = NULL;
+	x->nclients = 0;
+	x->clientssize = 0;
+	x->framing = ODOT_STREAM_FRAMING_SLIP;
+	x->maxsize = ODOT_STREAM_DEFAULT_MAXSIZE;
+	x->packets = 0;
+	x->invalid = 0;
+	x->readbuf = (char *)osc_mem_alloc(OTCPRECV_READSIZE);
+	if(!x->readbuf){
+		object_error((t_object *)x, "out of memory!");
+		pd_free((t_pd *)x);
+		return NULL;
+	}
+
+	int i, nargs = 0;
+	for(i = 0; i < argc; i++){
+		if(atom_gettype(argv + i) == A_SYMBOL && *(atom_getsym(argv + i)->s_name) == '@'){
+			break;
+		}
+		nargs++;
+	}
+	for(i = nargs; i < argc; i++){
+		t_symbol *attr = atom_getsym(argv + i);
+		if(attr == gensym("@framing") && i + 1 < argc && atom_gettype(argv + i + 1) == A_SYMBOL){
+			otcprecv_setFraming(x, atom_getsym(argv + ++i));
+		}else if(attr == gensym("@maxsize") && i + 1 < argc && atom_gettype(argv + i + 1) == A_FLOAT){
+			long l = atom_getfloat(argv + ++i);
+			x->maxsize = l > 0 ? l : ODOT_STREAM_DEFAULT_MAXSIZE;
+		}else{
+			post("o.tcp.receive optional attributes are @framing and @maxsize");
+		}
+	}
+	if(nargs){
+		otcprecv_listen(x, NULL, 1, argv);
+	}
+	return x;
+}
+
+int setup_o0x2etcp0x2ereceive(void)
+{
+	t_class *c = class_new(gensym(OMAX_DOC_NAME), (t_newmethod)otcprecv_new, (t_method)otcprecv_free, sizeof(t_otcprecv), 0L, A_GIMME, 0);
+
+	class_addmethod(c, (t_method)otcprecv_listen, gensym("listen"), A_GIMME, 0);
+	class_addmethod(c, (t_method)otcprecv_close, gensym("close"), 0);
+	class_addmethod(c, (t_method)otcprecv_setFraming, gensym("framing"), A_SYMBOL, 0);
+	class_addmethod(c, (t_method)otcprecv_info, gensym("info"), 0);
+	class_addmethod(c, (t_method)odot_version, gensym("version"), 0);
+	class_addmethod(c, (t_method)otcprecv_doc, gensym("doc"), 0);
+
+	ps_slip = gensym("slip");
+	ps_length = gensym("length");
+
+	otcprecv_class = c;
+
+	ODOT_PRINT_VERSION;
+	return 0;
+}
+
+#endif
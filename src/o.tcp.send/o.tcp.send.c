@@ -0,0 +1,619 @@
+/*
+
+  Written by Matt Wright, Adrian Freed, Andy Schmeder, John MacCallum
+
+  The Center for New Music and Audio Technologies,
+  University of California, Berkeley.  Copyright (c) 1996,97,98,99,2000,01,02,03,04,05, 2014
+  The Regents of the University of California (Regents).
+
+  Permission to use, copy, modify, distribute, and distribute modified versions
+  of this software and its documentation without fee and without a signed
+  licensing agreement, is hereby granted, provided that the above copyright
+  notice, this paragraph and the following two paragraphs appear in all copies,
+  modifications, and distributions.
+
+  IN NO EVENT SHALL REGENTS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT,
+  SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING
+  OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF REGENTS HAS
+  BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  REGENTS SPECIFICALLY DISCLAIMS ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE. THE SOFTWARE AND ACCOMPANYING DOCUMENTATION, IF ANY, PROVIDED
+  HEREUNDER IS PROVIDED "AS IS". REGENTS HAS NO OBLIGATION TO PROVIDE
+  MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS.
+
+*/
+
+#define OMAX_DOC_NAME "o.tcp.send"
+#define OMAX_DOC_SHORT_DESC "Sends OSC packets over a TCP or Unix domain socket connection"
+#define OMAX_DOC_LONG_DESC "o.tcp.send connects to an o.tcp.receive (or anything else that speaks OSC over a stream) at a host and port, or at the path of a Unix domain socket, and sends each incoming packet framed with SLIP (@framing slip, OSC 1.1) or a size prefix (@framing length, OSC 1.0).  Packets sent during the same scheduler tick are written together.  If the connection can't be made or is lost, it is retried with an increasing delay."
+#define OMAX_DOC_INLETS_DESC (char *[]){"FullPacket, connect, disconnect"}
+#define OMAX_DOC_OUTLETS_DESC (char *[]){"Connection state (1 connected, 0 not)"}
+#define OMAX_DOC_SEEALSO  (char *[]){"o.tcp.receive", "o.udp.send"}
+
+#include "odot_version.h"
+#ifdef OMAX_PD_VERSION
+    #include "m_pd.h"
+    #include "s_stuff.h"
+    #include <stdio.h>
+    #include <string.h>
+#else
+    #include "ext.h"
+    #include "ext_obex.h"
+    #include "ext_obex_util.h"
+    #include "ext_critical.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "osc.h"
+#include "osc_mem.h"
+#include "omax_util.h"
+#include "omax_doc.h"
+#include "odot_stream.h"
+#include "o.h"
+
+/*
+Sending never blocks.  Each packet is framed into an output buffer, and the
+buffer is flushed with one send() from a clock set for the current logical
+time, so everything sent during a scheduler tick goes out in as few
+segments as possible (Nagle is turned off, so nothing else delays it).  If
+the socket can't take everything, the rest stays in the buffer and we try
+again a millisecond later.  The buffer is capped at @maxbuffer bytes;
+packets that don't fit are dropped.
+
+Connecting doesn't block either.  Host names are looked up by a thread of
+their own, since getaddrinfo() can take seconds, and the thread wakes the
+main thread through a pipe watched by Pd's poll loop.  A lookup that is
+no longer wanted (because of a disconnect, another connect, or the object
+going away) is abandoned rather than waited for: whichever of the thread
+and the object lets go of it last frees it.  The socket is non-blocking,
+and the same clock that does the flushing polls for the connection to
+complete.  When a connection fails or is lost, we try again after a delay
+that starts at OTCPSEND_BACKOFF_MIN and doubles each time up to
+OTCPSEND_BACKOFF_MAX.  Packets sent in the meantime are buffered, up to
+@maxbuffer.  If the connection goes down in the middle of a packet, the
+buffer is thrown away, since the other end would have no way to make
+sense of the rest of it.
+*/
+
+#define OTCPSEND_DEFAULT_MAXBUFFER (1 << 24)
+#define OTCPSEND_BACKOFF_MIN 100. // ms
+#define OTCPSEND_BACKOFF_MAX 10000.
+#define OTCPSEND_CONNECT_POLL 10.
+#define OTCPSEND_CONNECT_TIMEOUT 5000.
+#define OTCPSEND_RETRY 1.
+
+enum{
+	OTCPSEND_DISCONNECTED,
+	OTCPSEND_RESOLVING,
+	OTCPSEND_CONNECTING,
+	OTCPSEND_CONNECTED
+};
+
+// a host name being looked up on a thread of its own
+typedef struct _otcpsend_lookup{
+	pthread_mutex_t lock;
+	int refs;
+	int abandoned;
+	int done;
+	int wakefd;
+	const char *host; // symbols are never freed
+	long port;
+	int err;
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+} t_otcpsend_lookup;
+
+typedef struct _otcpsend{
+	t_object ob;
+	void *outlet;
+
+	t_symbol *host; // or the path of a Unix domain socket, if port is 0
+	long port;
+	int wantconnection;
+	int fd;
+	int state;
+	double connectstart;
+	double backoff;
+	t_otcpsend_lookup *lookup;
+	int wakepipe[2];
+
+	int framing;
+	char *outbuf;
+	long outlen;
+	long outsize;
+	long maxbuffer;
+	int midpacket; // has part of the packet at the front of outbuf already been sent?
+	long dropped;
+
+	t_clock *clock;
+} t_otcpsend;
+
+t_class *otcpsend_class;
+
+t_symbol *ps_slip, *ps_length;
+
+static void otcpsend_tick(t_otcpsend *x);
+
+// let go of a lookup; the thread won't wake us once this has been called
+static void otcpsend_lookupRelease(t_otcpsend_lookup *l)
+{
+	pthread_mutex_lock(&(l->lock));
+	l->abandoned = 1;
+	int last = --(l->refs) == 0;
+	pthread_mutex_unlock(&(l->lock));
+	if(last){
+		pthread_mutex_destroy(&(l->lock));
+		osc_mem_free(l);
+	}
+}
+
+static void otcpsend_close(t_otcpsend *x)
+{
+	if(x->lookup){
+		otcpsend_lookupRelease(x->lookup);
+		x->lookup = NULL;
+	}
+	if(x->fd >= 0){
+		if(x->state == OTCPSEND_CONNECTED){
+			sys_rmpollfn(x->fd);
+		}
+		close(x->fd);
+		x->fd = -1;
+	}
+	if(x->state == OTCPSEND_CONNECTED){
+		outlet_float(x->outlet, 0);
+	}
+	x->state = OTCPSEND_DISCONNECTED;
+	if(x->midpacket){
+		x->dropped += x->outlen;
+		x->outlen = 0;
+		x->midpacket = 0;
+	}
+}
+
+// close the connection and, if we still want one, try again later
+static void otcpsend_fail(t_otcpsend *x)
+{
+	otcpsend_close(x);
+	if(x->wantconnection){
+		clock_delay(x->clock, x->backoff);
+		x->backoff *= 2;
+		if(x->backoff > OTCPSEND_BACKOFF_MAX){
+			x->backoff = OTCPSEND_BACKOFF_MAX;
+		}
+	}
+}
+
+// the other end shouldn't send us anything, but this is how we find out it hung up
+static void otcpsend_read(t_otcpsend *x, int fd)
+{
+	char buf[1024];
+	ssize_t n = recv(fd, buf, sizeof(buf), 0);
+	if(n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)){
+		object_error((t_object *)x, "connection closed");
+		otcpsend_fail(x);
+	}
+}
+
+static void otcpsend_connected(t_otcpsend *x)
+{
+	x->state = OTCPSEND_CONNECTED;
+	x->backoff = OTCPSEND_BACKOFF_MIN;
+	sys_addpollfn(x->fd, (t_fdpollfn)otcpsend_read, x);
+	outlet_float(x->outlet, 1);
+	if(x->outlen){
+		clock_delay(x->clock, 0);
+	}
+}
+
+static void otcpsend_connectTo(t_otcpsend *x, struct sockaddr_storage *addr, socklen_t addrlen)
+{
+	int fd = socket(addr->ss_family, SOCK_STREAM, 0);
+	if(fd < 0){
+		object_error((t_object *)x, "couldn't create a socket: %s", strerror(errno));
+		otcpsend_fail(x);
+		return;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	int one = 1;
+	if(addr->ss_family != AF_UNIX){
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	}
+#ifdef SO_NOSIGPIPE
+	setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+	x->fd = fd;
+	if(connect(fd, (struct sockaddr *)addr, addrlen) == 0){
+		otcpsend_connected(x);
+		return;
+	}
+	if(errno == EINPROGRESS || errno == EAGAIN){
+		x->state = OTCPSEND_CONNECTING;
+		x->connectstart = clock_getlogicaltime();
+		clock_delay(x->clock, OTCPSEND_CONNECT_POLL);
+		return;
+	}
+	otcpsend_fail(x);
+}
+
+// called on the lookup thread
+static void *otcpsend_lookupRun(void *arg)
+{
+	t_otcpsend_lookup *l = (t_otcpsend_lookup *)arg;
+	struct addrinfo hints, *res = NULL;
+	char port[16];
+	memset(&hints, '\0', sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf(port, sizeof(port), "%ld", l->port);
+	int err = getaddrinfo(l->host, port, &hints, &res);
+	if(!err && !res){
+		err = EAI_FAIL;
+	}
+	if(!err){
+		memcpy(&(l->addr), res->ai_addr, res->ai_addrlen);
+		l->addrlen = res->ai_addrlen;
+	}
+	if(res){
+		freeaddrinfo(res);
+	}
+	pthread_mutex_lock(&(l->lock));
+	l->err = err;
+	l->done = 1;
+	if(!l->abandoned){
+		char c = 0;
+		if(write(l->wakefd, &c, 1) < 0){
+			// the pipe is full, so the main thread will look anyway
+		}
+	}
+	int last = --(l->refs) == 0;
+	pthread_mutex_unlock(&(l->lock));
+	if(last){
+		pthread_mutex_destroy(&(l->lock));
+		osc_mem_free(l);
+	}
+	return NULL;
+}
+
+// called from the poll loop once the lookup thread is done
+static void otcpsend_lookupDone(t_otcpsend *x, int fd)
+{
+	char buf[64];
+	while(read(fd, buf, sizeof(buf)) > 0){}
+	t_otcpsend_lookup *l = x->lookup;
+	if(!l){
+		return;
+	}
+	pthread_mutex_lock(&(l->lock));
+	int done = l->done;
+	pthread_mutex_unlock(&(l->lock));
+	if(!done){
+		return;
+	}
+	x->lookup = NULL;
+	x->state = OTCPSEND_DISCONNECTED;
+	if(l->err){
+		object_error((t_object *)x, "couldn't resolve %s: %s", l->host, gai_strerror(l->err));
+		otcpsend_lookupRelease(l);
+		otcpsend_fail(x);
+		return;
+	}
+	struct sockaddr_storage addr;
+	socklen_t addrlen = l->addrlen;
+	memcpy(&addr, &(l->addr), sizeof(addr));
+	otcpsend_lookupRelease(l);
+	otcpsend_connectTo(x, &addr, addrlen);
+}
+
+static void otcpsend_connect(t_otcpsend *x)
+{
+	if(x->port){
+		t_otcpsend_lookup *l = (t_otcpsend_lookup *)osc_mem_alloc(sizeof(t_otcpsend_lookup));
+		if(!l){
+			object_error((t_object *)x, "out of memory!");
+			otcpsend_fail(x);
+			return;
+		}
+		memset(l, '\0', sizeof(t_otcpsend_lookup));
+		pthread_mutex_init(&(l->lock), NULL);
+		l->refs = 2;
+		l->wakefd = x->wakepipe[1];
+		l->host = x->host->s_name;
+		l->port = x->port;
+		pthread_t thread;
+		if(pthread_create(&thread, NULL, otcpsend_lookupRun, l)){
+			object_error((t_object *)x, "couldn't start a thread to look up %s", x->host->s_name);
+			pthread_mutex_destroy(&(l->lock));
+			osc_mem_free(l);
+			otcpsend_fail(x);
+			return;
+		}
+		pthread_detach(thread);
+		x->lookup = l;
+		x->state = OTCPSEND_RESOLVING;
+		return;
+	}
+	struct sockaddr_storage addr;
+	memset(&addr, '\0', sizeof(addr));
+	struct sockaddr_un *un = (struct sockaddr_un *)&addr;
+	if(strlen(x->host->s_name) >= sizeof(un->sun_path)){
+		object_error((t_object *)x, "socket path %s is too long", x->host->s_name);
+		x->wantconnection = 0;
+		return;
+	}
+	un->sun_family = AF_UNIX;
+	strcpy(un->sun_path, x->host->s_name);
+	otcpsend_connectTo(x, &addr, sizeof(struct sockaddr_un));
+}
+
+static void otcpsend_flush(t_otcpsend *x)
+{
+	if(x->state != OTCPSEND_CONNECTED || !x->outlen){
+		return;
+	}
+#ifdef MSG_NOSIGNAL
+	ssize_t n = send(x->fd, x->outbuf, x->outlen, MSG_NOSIGNAL);
+#else
+	ssize_t n = send(x->fd, x->outbuf, x->outlen, 0);
+#endif
+	if(n < 0){
+		if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR){
+			clock_delay(x->clock, OTCPSEND_RETRY);
+			return;
+		}
+		object_error((t_object *)x, "send: %s", strerror(errno));
+		otcpsend_fail(x);
+		return;
+	}
+	if(n < x->outlen){
+		memmove(x->outbuf, x->outbuf + n, x->outlen - n);
+		x->outlen -= n;
+		x->midpacket = 1;
+		clock_delay(x->clock, OTCPSEND_RETRY);
+		return;
+	}
+	x->outlen = 0;
+	x->midpacket = 0;
+}
+
+static void otcpsend_tick(t_otcpsend *x)
+{
+	switch(x->state){
+	case OTCPSEND_DISCONNECTED:
+		if(x->wantconnection){
+			otcpsend_connect(x);
+		}
+		break;
+	case OTCPSEND_RESOLVING:
+		// otcpsend_lookupDone() takes it from here
+		break;
+	case OTCPSEND_CONNECTING:
+		{
+			struct pollfd pfd;
+			pfd.fd = x->fd;
+			pfd.events = POLLOUT;
+			if(poll(&pfd, 1, 0) > 0){
+				int err = 0;
+				socklen_t errlen = sizeof(err);
+				getsockopt(x->fd, SOL_SOCKET, SO_ERROR, &err, &errlen);
+				if(err){
+					otcpsend_fail(x);
+				}else{
+					otcpsend_connected(x);
+				}
+			}else if(clock_gettimesince(x->connectstart) > OTCPSEND_CONNECT_TIMEOUT){
+				otcpsend_fail(x);
+			}else{
+				clock_delay(x->clock, OTCPSEND_CONNECT_POLL);
+			}
+		}
+		break;
+	case OTCPSEND_CONNECTED:
+		otcpsend_flush(x);
+		break;
+	}
+}
+
+void otcpsend_FullPacket(t_otcpsend *x, t_symbol *msg, int argc, t_atom *argv)
+{
+	OMAX_UTIL_GET_LEN_AND_PTR
+	long n = odot_stream_encodedLen(x->framing, ptr, len);
+	if(x->outlen + n > x->maxbuffer){
+		x->dropped++;
+		return;
+	}
+	if(x->outlen + n > x->outsize){
+		long size = x->outsize ? x->outsize : 4096;
+		while(size < x->outlen + n){
+			size *= 2;
+		}
+		char *tmp = (char *)osc_mem_resize(x->outbuf, size);
+		if(!tmp){
+			object_error((t_object *)x, "out of memory!");
+			x->dropped++;
+			return;
+		}
+		x->outbuf = tmp;
+		x->outsize = size;
+	}
+	int wasempty = x->outlen == 0;
+	x->outlen += odot_stream_encode(x->framing, x->outbuf + x->outlen, ptr, len);
+	if(wasempty && x->state == OTCPSEND_CONNECTED){
+		// flush at the end of this tick, along with anything else that gets sent before then
+		clock_delay(x->clock, 0);
+	}
+}
+
+// connect <host> <port> or connect <path>
+void otcpsend_connectMsg(t_otcpsend *x, t_symbol *msg, int argc, t_atom *argv)
+{
+	if(argc < 1 || atom_gettype(argv) != A_SYMBOL){
+		object_error((t_object *)x, "connect takes a host and port, or the path of a Unix domain socket");
+		return;
+	}
+	long port = 0;
+	if(argc > 1){
+		port = atom_getlong(argv + 1);
+		if(port <= 0 || port > 65535){
+			object_error((t_object *)x, "bad port %ld", port);
+			return;
+		}
+	}
+	clock_unset(x->clock);
+	otcpsend_close(x);
+	x->host = atom_getsym(argv);
+	x->port = port;
+	x->wantconnection = 1;
+	x->backoff = OTCPSEND_BACKOFF_MIN;
+	otcpsend_connect(x);
+}
+
+void otcpsend_disconnect(t_otcpsend *x)
+{
+	x->wantconnection = 0;
+	clock_unset(x->clock);
+	otcpsend_close(x);
+}
+
+void otcpsend_setFraming(t_otcpsend *x, t_symbol *framing)
+{
+	if(framing == ps_slip){
+		x->framing = ODOT_STREAM_FRAMING_SLIP;
+	}else if(framing == ps_length){
+		x->framing = ODOT_STREAM_FRAMING_LENGTH;
+	}else{
+		object_error((t_object *)x, "framing must be slip or length");
+		return;
+	}
+	if(x->outlen){
+		// whatever is in the buffer was framed the old way
+		object_error((t_object *)x, "dropping %ld buffered bytes", x->outlen);
+		x->dropped++;
+		if(x->midpacket && x->state == OTCPSEND_CONNECTED){
+			otcpsend_fail(x);
+		}
+		x->outlen = 0;
+		x->midpacket = 0;
+	}
+}
+
+void otcpsend_info(t_otcpsend *x)
+{
+	object_post((t_object *)x, "%s, %ld bytes buffered, %ld packets dropped", x->state == OTCPSEND_CONNECTED ? "connected" : (x->state == OTCPSEND_DISCONNECTED ? "not connected" : "connecting"), x->outlen, x->dropped);
+}
+
+void otcpsend_doc(t_otcpsend *x)
+{
+	omax_doc_outletDoc(x->outlet);
+}
+
+void otcpsend_free(t_otcpsend *x)
+{
+	odot_stats_forget(x);
+	x->wantconnection = 0;
+	otcpsend_close(x);
+	clock_free(x->clock);
+	if(x->outbuf){
+		osc_mem_free(x->outbuf);
+	}
+	if(x->wakepipe[0] >= 0){
+		sys_rmpollfn(x->wakepipe[0]);
+		close(x->wakepipe[0]);
+		close(x->wakepipe[1]);
+	}
+}
+
+#ifdef OMAX_PD_VERSION
+
+void *otcpsend_new(t_symbol *s, int argc, t_atom *argv)
+{
+	t_otcpsend *x = (t_otcpsend *)object_alloc(otcpsend_class);
+	if(!x){
+		return NULL;
+	}
+	x->outlet = outlet_new(&x->ob, &s_float);
+	x->clock = clock_new(x, (t_method)otcpsend_tick);
+	x->host = NULL;
+	x->port = 0;
+	x->wantconnection = 0;
+	x->fd = -1;
+	x->state = OTCPSEND_DISCONNECTED;
+	x->backoff = OTCPSEND_BACKOFF_MIN;
+	x->framing = ODOT_STREAM_FRAMING_SLIP;
+	x->outbuf = NULL;
+	x->outlen = 0;
+	x->outsize = 0;
+	x->maxbuffer = OTCPSEND_DEFAULT_MAXBUFFER;
+	x->midpacket = 0;
+	x->dropped = 0;
+	x->lookup = NULL;
+	x->wakepipe[0] = x->wakepipe[1] = -1;
+	if(pipe(x->wakepipe) < 0){
+		object_error((t_object *)x, "couldn't create a pipe: %s", strerror(errno));
+		x->wakepipe[0] = x->wakepipe[1] = -1;
+		pd_free((t_pd *)x);
+		return NULL;
+	}
+	fcntl(x->wakepipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(x->wakepipe[1], F_SETFL, O_NONBLOCK);
+	sys_addpollfn(x->wakepipe[0], (t_fdpollfn)otcpsend_lookupDone, x);
+
+	int i, nargs = 0;
+	for(i = 0; i < argc; i++){
+		if(atom_gettype(argv + i) == A_SYMBOL && *(atom_getsym(argv + i)->s_name) == '@'){
+			break;
+		}
+		nargs++;
+	}
+	for(i = nargs; i < argc; i++){
+		t_symbol *attr = atom_getsym(argv + i);
+		if(attr == gensym("@framing") && i + 1 < argc && atom_gettype(argv + i + 1) == A_SYMBOL){
+			otcpsend_setFraming(x, atom_getsym(argv + ++i));
+		}else if(attr == gensym("@maxbuffer") && i + 1 < argc && atom_gettype(argv + i + 1) == A_FLOAT){
+			long l = atom_getfloat(argv + ++i);
+			x->maxbuffer = l > 0 ? l : OTCPSEND_DEFAULT_MAXBUFFER;
+		}else{
+			post("o.tcp.send optional attributes are @framing and @maxbuffer");
+		}
+	}
+	if(nargs){
+		otcpsend_connectMsg(x, NULL, nargs, argv);
+	}
+	return x;
+}
+
+int setup_o0x2etcp0x2esend(void)
+{
+	t_class *c = class_new(gensym(OMAX_DOC_NAME), (t_newmethod)otcpsend_new, (t_method)otcpsend_free, sizeof(t_otcpsend), 0L, A_GIMME, 0);
+
+	class_addmethod(c, (t_method)otcpsend_FullPacket, gensym("FullPacket"), A_GIMME, 0);
+	class_addmethod(c, (t_method)otcpsend_connectMsg, gensym("connect"), A_GIMME, 0);
+	class_addmethod(c, (t_method)otcpsend_disconnect, gensym("disconnect"), 0);
+	class_addmethod(c, (t_method)otcpsend_setFraming, gensym("framing"), A_SYMBOL, 0);
+	class_addmethod(c, (t_method)otcpsend_info, gensym("info"), 0);
+	class_addmethod(c, (t_method)odot_version, gensym("version"), 0);
+	class_addmethod(c, (t_method)otcpsend_doc, gensym("doc"), 0);
+
+	ps_slip = gensym("slip");
+	ps_length = gensym("length");
+
+	otcpsend_class = c;
+
+	ODOT_PRINT_VERSION;
+	return 0;
+}
+
+#endif
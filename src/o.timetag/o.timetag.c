@@ -33,7 +33,7 @@ VERSION 1.0: Completely revised to work with new odot objects and libs
 
 #define OMAX_DOC_NAME "o.timetag"
 #define OMAX_DOC_SHORT_DESC "Bind a timetag to an address"
-#define OMAX_DOC_LONG_DESC "o.timetag binds the current time to a user-specified address."
+#define OMAX_DOC_LONG_DESC "o.timetag binds the current time to a user-specified address, or sets the timetag of the bundle if no address is given.  With @clock dsp, the time comes from the audio clock shared by the odot signal objects, and every packet that arrives during the same scheduler tick gets the same time."
 #define OMAX_DOC_INLETS_DESC (char *[]){"OSC packet"}
 #define OMAX_DOC_OUTLETS_DESC (char *[]){"The OSC packet with a timestamp bound to an address"}
 #define OMAX_DOC_SEEALSO (char *[]){"o.expr.codebox"}
@@ -50,18 +50,32 @@ VERSION 1.0: Completely revised to work with new odot objects and libs
 #include "osc.h"
 #include "osc_timetag.h"
 #include "osc_mem.h"
+#include "osc_byteorder.h"
 #include "osc_message_iterator_u.h"
 #include "omax_util.h"
 #include "omax_doc.h"
 #include "omax_dict.h"
 
 #include "o.h"
+#include "odot_scratch.h"
+#include "odot_clock.h"
+
+#define OTIMETAG_TIMETAG_SIZE 8
 
 typedef struct _otimetag{
 	t_object ob;
 	void *outlet;
 	t_symbol *address;
 	t_critical lock;
+	// the message we add to bundles that don't have one at address yet,
+	// serialized and preceded by its size.  the timetag is the last 8 bytes
+	char *msg;
+	long msglen;
+	long addresslen; // padded
+	t_symbol *clock; // system or dsp
+	double lasttick;
+	t_osc_timetag laststamp;
+	int havestamp;
 } t_otimetag;
 
 
@@ -76,7 +90,7 @@ void otimetag_assist(t_otimetag *x, void *b, long io, long num, char *buf);
 void *otimetag_new(t_symbol *msg, short argc, t_atom *argv);
 //t_max_err otimetag_notify(t_otimetag *x, t_symbol *s, t_symbol *msg, void *sender, void *data);
 
-t_symbol *ps_FullPacket;
+t_symbol *ps_FullPacket, *ps_system, *ps_dsp;
 
 void otimetag_fullPacket(t_otimetag *x, t_symbol *msg, int argc, t_atom *argv)
 {
@@ -85,12 +99,94 @@ void otimetag_fullPacket(t_otimetag *x, t_symbol *msg, int argc, t_atom *argv)
 	otimetag_doFullPacket(x, len, ptr);
 }
 
+static int otimetag_makemsg(t_otimetag *x, const char *address)
+{
+	long addresslen = ((strlen(address) / 4) + 1) * 4;
+	long msglen = 4 + addresslen + 4 + OTIMETAG_TIMETAG_SIZE;
+	char *msg = (char *)osc_mem_alloc(msglen);
+	if(!msg){
+		return 1;
+	}
+	memset(msg, '\0', msglen);
+	*((uint32_t *)msg) = hton32((uint32_t)(msglen - 4));
+	strcpy(msg + 4, address);
+	msg[4 + addresslen] = ',';
+	msg[4 + addresslen + 1] = OSC_TIMETAG_TYPETAG;
+	x->msg = msg;
+	x->msglen = msglen;
+	x->addresslen = addresslen;
+	return 0;
+}
+
+static t_osc_timetag otimetag_now(t_otimetag *x)
+{
+	if(x->clock != ps_dsp){
+		return osc_timetag_now();
+	}
+	// read the clock once per tick
+	double tick = odot_clock_tick();
+	if(!x->havestamp || tick != x->lasttick){
+		x->laststamp = odot_clock_now();
+		x->lasttick = tick;
+		x->havestamp = 1;
+	}
+	return x->laststamp;
+}
+
+// the offset of the message at x->address in a serialized bundle, or -1
+static long otimetag_find(t_otimetag *x, long len, char *ptr)
+{
+	long pos = OSC_HEADER_SIZE;
+	while(pos + 4 <= len){
+		long size = (long)ntoh32(*((uint32_t *)(ptr + pos)));
+		if(size < 0 || pos + 4 + size > len){
+			return -1;
+		}
+		// the padding is part of the comparison, so this only matches
+		// addresses that are exactly the same
+		if(size >= x->addresslen && !memcmp(ptr + pos + 4, x->msg + 4, x->addresslen)){
+			return pos;
+		}
+		pos += 4 + size;
+	}
+	return -1;
+}
+
 void otimetag_doFullPacket(t_otimetag *x,
 			   long len,
 			   char *ptr)
 {
-	t_osc_timetag t = osc_timetag_now();
+	t_osc_timetag t = otimetag_now(x);
 	if(x->address){
+		// if the bundle doesn't have a message at the address, append
+		// ours, and if it has a timetag there, overwrite it.  either
+		// way the bundle doesn't need to be deserialized
+		long pos = otimetag_find(x, len, ptr);
+		long ttpos = -1, copylen = len;
+		if(pos < 0){
+			copylen = len + x->msglen;
+			ttpos = copylen - OTIMETAG_TIMETAG_SIZE;
+		}else if(ntoh32(*((uint32_t *)(ptr + pos))) == x->msglen - 4 && !memcmp(ptr + pos + 4 + x->addresslen, x->msg + 4 + x->addresslen, 4)){
+			ttpos = pos + x->msglen - OTIMETAG_TIMETAG_SIZE;
+		}
+		if(ttpos >= 0){
+			t_odot_scratch_mark mark = odot_scratch_mark();
+			char *copy = (char *)odot_scratch_alloc(copylen);
+			if(!copy){
+				odot_scratch_release(mark);
+				object_error((t_object *)x, "out of memory");
+				return;
+			}
+			memcpy(copy, ptr, len);
+			if(copylen > len){
+				memcpy(copy + len, x->msg, x->msglen);
+			}
+			osc_timetag_encodeForHeader(t, copy + ttpos);
+			omax_util_outletOSC(x->outlet, copylen, copy);
+			odot_scratch_release(mark);
+			return;
+		}
+		// something other than a timetag is bound to the address
 		t_osc_bndl_u *copy = osc_bundle_s_deserialize(len, ptr);
 
 		t_osc_msg_u *m = osc_message_u_allocWithTimetag(x->address->s_name, t);
@@ -103,11 +199,18 @@ void otimetag_doFullPacket(t_otimetag *x,
 		}
 		osc_bundle_u_free(copy);
 	}else{
-		char copy[len];
+		t_odot_scratch_mark mark = odot_scratch_mark();
+		char *copy = (char *)odot_scratch_alloc(len);
+		if(!copy){
+			odot_scratch_release(mark);
+			object_error((t_object *)x, "out of memory");
+			return;
+		}
 		memcpy(copy, ptr, len);
 		osc_bundle_s_setTimetag(len, copy, t);
 		omax_util_outletOSC(x->outlet, len, copy);
         OSC_MEM_INVALIDATE(copy);
+		odot_scratch_release(mark);
 	}
 }
 
@@ -208,22 +311,49 @@ void otimetag_doc(t_otimetag *x)
 
 void otimetag_free(t_otimetag *x)
 {
+	odot_stats_forget(x);
 	critical_free(x->lock);
+	if(x->msg){
+		osc_mem_free(x->msg);
+	}
+	odot_scratch_trim();
 }
 
 
+#ifdef OMAX_PD_VERSION
+void otimetag_setClock(t_otimetag *x, t_symbol *clock)
+{
+	if(clock != ps_system && clock != ps_dsp){
+		object_error((t_object *)x, "clock must be system or dsp");
+		return;
+	}
+	x->clock = clock;
+	x->havestamp = 0;
+}
+#endif
+
 void *otimetag_new(t_symbol *msg, short argc, t_atom *argv)
 {
 	t_otimetag *x;
 	if((x = (t_otimetag *)object_alloc(otimetag_class))){
 		x->address = NULL;
-		if(argc){
+		x->msg = NULL;
+		x->msglen = 0;
+		x->addresslen = 0;
+		x->clock = ps_system;
+		x->lasttick = 0;
+		x->havestamp = 0;
+		if(argc && !(atom_gettype(argv) == A_SYM && atom_getsym(argv)->s_name[0] == '@')){
 			if(atom_gettype(argv) == A_SYM){
 				t_symbol *s = atom_getsym(argv);
 				if(s->s_name[0] != '/'){
 					object_error((t_object *)x, "address must begin with a slash");
 					return NULL;
 				}
+				if(otimetag_makemsg(x, s->s_name)){
+					object_error((t_object *)x, "out of memory");
+					return NULL;
+				}
 				x->address = s;
 			}else{
 				object_error((t_object *)x, "argument must be an OSC address (symbol)");
@@ -232,6 +362,21 @@ void *otimetag_new(t_symbol *msg, short argc, t_atom *argv)
 		}
 		x->outlet = outlet_new((t_object *)x, NULL);
 		critical_new(&(x->lock));
+#ifdef OMAX_PD_VERSION
+		int i;
+		for(i = 0; i < argc; i++){
+			if(atom_gettype(argv + i) != A_SYM || atom_getsym(argv + i)->s_name[0] != '@'){
+				continue;
+			}
+			if(atom_getsym(argv + i) == gensym("@clock") && i + 1 < argc && atom_gettype(argv + i + 1) == A_SYM){
+				otimetag_setClock(x, atom_getsym(argv + ++i));
+			}else{
+				post("o.timetag optional attributes are @clock");
+			}
+		}
+#else
+		attr_args_process(x, argc, argv);
+#endif
 	}    
 	return x;
 }
@@ -245,12 +390,15 @@ int setup_o0x2etimetag(void)
 	class_addmethod(c, (t_method)otimetag_anything, gensym("anything"), A_GIMME, 0);
 	class_addmethod(c, (t_method)otimetag_bang, gensym("bang"), 0);
 	//class_addmethod(c, (t_method)otimetag_set, gensym("set"), A_GIMME, 0);
+	class_addmethod(c, (t_method)otimetag_setClock, gensym("clock"), A_SYMBOL, 0);
 	class_addmethod(c, (t_method)odot_version, gensym("version"), 0);
     class_addmethod(c, (t_method)otimetag_doc, gensym("doc"), 0);
 
 	otimetag_class = c;
     
 	ps_FullPacket = gensym("FullPacket");
+	ps_system = gensym("system");
+	ps_dsp = gensym("dsp");
 	ODOT_PRINT_VERSION;
 	return 0;
 }
@@ -283,11 +431,17 @@ int main(void)
 		class_addmethod(c, (method)omax_dict_dictionary, "dictionary", A_GIMME, 0);
 	//}
 
+	CLASS_ATTR_SYM(c, "clock", 0, t_otimetag, clock);
+	CLASS_ATTR_ENUM(c, "clock", 0, "system dsp");
+
 	class_register(CLASS_BOX, c);
 	otimetag_class = c;
 
 	common_symbols_init();
 	ps_FullPacket = gensym("FullPacket");
+	ps_system = gensym("system");
+	ps_dsp = gensym("dsp");
+	omax_realtime_clock_init();
 	ODOT_PRINT_VERSION;
 	return 0;
 }
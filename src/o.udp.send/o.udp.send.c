@@ -673,6 +673,7 @@ void oudpsend_doc(t_oudpsend *x)
 
 void oudpsend_free(t_oudpsend *x)
 {
+    odot_stats_forget(x);
     udpsend_disconnect(x);
     critical_free(x->lock);
 }
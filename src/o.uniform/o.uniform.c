@@ -27,18 +27,21 @@
  COPYRIGHT_YEARS: 2014-ll
  SVN_REVISION: $LastChangedRevision: 587 $
  VERSION 0.0: First try
+ VERSION 0.1: Per-instance counter-based generator, @count
  @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
  */
 
 #define OMAX_DOC_NAME "o.uniform"
 #define OMAX_DOC_SHORT_DESC "Bind a uniformly-distrubuted random number to an address"
-#define OMAX_DOC_LONG_DESC "o.uniform binds a uniformly-distributed random number to a user-specified address."
+#define OMAX_DOC_LONG_DESC "o.uniform binds a uniformly-distributed random number (or, with @count, a list of them) to a user-specified address.  Each instance has its own generator: /uniform/set/seed reseeds it and /uniform/set/state jumps straight to any point in its sequence."
 #define OMAX_DOC_INLETS_DESC (char *[]){"OSC packet"}
 #define OMAX_DOC_OUTLETS_DESC (char *[]){"The OSC packet with a random number bound to an address"}
 #define OMAX_DOC_SEEALSO (char *[]){"o.timetag"}
 
 #include <time.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "odot_version.h"
 #ifdef OMAX_PD_VERSION
@@ -52,20 +55,37 @@
 #include "osc.h"
 #include "osc_timetag.h"
 #include "osc_mem.h"
+#include "osc_byteorder.h"
 #include "osc_message_iterator_u.h"
 #include "omax_util.h"
 #include "omax_doc.h"
 #include "omax_dict.h"
 
 #include "o.h"
+#include "odot_scratch.h"
+
+#define OUNIFORM_DEFAULT_ADDRESS "/uniform/random"
+#define OUNIFORM_SEED_ADDRESS "/uniform/seed"
+#define OUNIFORM_STATE_ADDRESS "/uniform/state"
+#define OUNIFORM_NMSGS 3 // the numbers, the seed and the state
 
 typedef struct _ouniform{
 	t_object ob;
 	void *outlet;
 	t_symbol *address;
-    long seed;
-    long state;
+	long seed;
+	uint64_t state; // how many numbers have been drawn since the seed was set
+	uint64_t key; // the seed, scrambled
+	long count;
 	t_critical lock;
+	// the messages we append to bundles, serialized and preceded by their
+	// sizes, with room for count numbers, the seed and the state
+	char *msg;
+	long msglen;
+	long msgcount; // the count msg was made for
+	long msgpos[OUNIFORM_NMSGS]; // where each message starts
+	long addresslen[OUNIFORM_NMSGS]; // padded
+	long datapos[OUNIFORM_NMSGS]; // where each message's data starts
 } t_ouniform;
 
 
@@ -79,6 +99,7 @@ void ouniform_free(t_ouniform *x);
 void ouniform_assist(t_ouniform *x, void *b, long io, long num, char *buf);
 void *ouniform_new(t_symbol *msg, short argc, t_atom *argv);
 long ouniform_getNumber(long len, char *ptr, char *address);
+t_max_err ouniform_setCount(t_ouniform *x, void *attr, long ac, t_atom *av);
 
 t_symbol *ps_FullPacket;
 
@@ -89,62 +110,231 @@ void ouniform_fullPacket(t_ouniform *x, t_symbol *msg, int argc, t_atom *argv)
 	ouniform_doFullPacket(x, len, ptr);
 }
 
+/*
+  The generator is counter-based: the nth number after a seed is a hash of
+  the seed and n (the splitmix64 finalizer), so there's no state to carry
+  from one number to the next other than n.  Jumping to any point in the
+  sequence is just setting n, and a batch of numbers is a loop with no
+  dependence between iterations, which the compiler turns into SIMD code.
+*/
+#define OUNIFORM_GAMMA 0x9e3779b97f4a7c15ULL
+
+static inline uint64_t ouniform_mix(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static void ouniform_setSeed(t_ouniform *x, long seed)
+{
+	x->seed = seed;
+	x->key = ouniform_mix((uint64_t)seed);
+	x->state = 0;
+}
+
+// n numbers in [0. 1.) as big-endian OSC floats, starting at state
+static void ouniform_generate(uint64_t key, uint64_t state, long n, uint32_t *out)
+{
+	long i;
+	for(i = 0; i < n; i++){
+		uint64_t z = ouniform_mix(key + (state + (uint64_t)i) * OUNIFORM_GAMMA);
+		// the top 24 bits, so every float in [0. 1.) that can come out
+		// is equally likely.  they fit in an int32, and converting from
+		// that rather than from 64 bits keeps the loop vectorizable on
+		// machines without AVX-512
+		float f = (float)(int32_t)(z >> 40) * (1.f / 16777216.f);
+		uint32_t u;
+		memcpy(&u, &f, 4);
+		out[i] = hton32(u);
+	}
+}
+
+static long ouniform_encodeMsg(char *buf, long pos, const char *address, char typetag, long n)
+{
+	long start = pos;
+	long addresslen = ((strlen(address) / 4) + 1) * 4;
+	long typetaglen = (((n + 1) / 4) + 1) * 4;
+	long size = addresslen + typetaglen + n * 4;
+	if(buf){
+		memset(buf + pos, '\0', 4 + addresslen + typetaglen);
+		*((uint32_t *)(buf + pos)) = hton32((uint32_t)size);
+		strcpy(buf + pos + 4, address);
+		pos += 4 + addresslen;
+		buf[pos] = ',';
+		memset(buf + pos + 1, typetag, n);
+	}
+	return start + 4 + size;
+}
+
+static int ouniform_makemsg(t_ouniform *x)
+{
+	const char *addresses[OUNIFORM_NMSGS] = {x->address ? x->address->s_name : OUNIFORM_DEFAULT_ADDRESS, OUNIFORM_SEED_ADDRESS, OUNIFORM_STATE_ADDRESS};
+	const char typetags[OUNIFORM_NMSGS] = {'f', 'i', 'i'};
+	long counts[OUNIFORM_NMSGS] = {x->count, 1, 1};
+	long msglen = 0;
+	int i;
+	for(i = 0; i < OUNIFORM_NMSGS; i++){
+		msglen = ouniform_encodeMsg(NULL, msglen, addresses[i], typetags[i], counts[i]);
+	}
+	char *msg = (char *)osc_mem_alloc(msglen);
+	if(!msg){
+		return 1;
+	}
+	long pos = 0;
+	for(i = 0; i < OUNIFORM_NMSGS; i++){
+		long next = ouniform_encodeMsg(msg, pos, addresses[i], typetags[i], counts[i]);
+		x->msgpos[i] = pos;
+		x->addresslen[i] = ((strlen(addresses[i]) / 4) + 1) * 4;
+		x->datapos[i] = next - counts[i] * 4;
+		pos = next;
+	}
+	if(x->msg){
+		osc_mem_free(x->msg);
+	}
+	x->msg = msg;
+	x->msglen = msglen;
+	x->msgcount = x->count;
+	return 0;
+}
+
+// whether the bundle has a message at any of the addresses we bind
+static int ouniform_bound(t_ouniform *x, long len, char *ptr)
+{
+	long pos = OSC_HEADER_SIZE;
+	while(pos + 4 <= len){
+		long size = (long)ntoh32(*((uint32_t *)(ptr + pos)));
+		if(size < 0 || pos + 4 + size > len){
+			return 1;
+		}
+		int i;
+		for(i = 0; i < OUNIFORM_NMSGS; i++){
+			// the padding is part of the comparison, so this only
+			// matches addresses that are exactly the same
+			if(size >= x->addresslen[i] && !memcmp(ptr + pos + 4, x->msg + x->msgpos[i] + 4, x->addresslen[i])){
+				return 1;
+			}
+		}
+		pos += 4 + size;
+	}
+	return 0;
+}
+
 void ouniform_doFullPacket(t_ouniform *x,
                            long len,
                            char *ptr)
 {
-    int seed_is_bound = 0;
+	t_odot_scratch_mark mark = odot_scratch_mark();
+    int seed_is_bound = 0, state_is_bound = 0;
     osc_bundle_s_addressIsBound(len, ptr, "/uniform/set/seed", 1, &seed_is_bound);
+    osc_bundle_s_addressIsBound(len, ptr, "/uniform/set/state", 1, &state_is_bound);
+	if(seed_is_bound || state_is_bound){
+		// the packet may be shared with other receivers, so the set
+		// messages are removed from a copy of it
+		char *set = (char *)odot_scratch_alloc(len);
+		if(!set){
+			odot_scratch_release(mark);
+			object_error((t_object *)x, "out of memory");
+			return;
+		}
+		memcpy(set, ptr, len);
+		ptr = set;
+	}
     if (seed_is_bound) {
         long change_to = ouniform_getNumber(len, ptr, "/uniform/set/seed");
         
         if (change_to > 0) {
+            critical_enter(x->lock);
             if (x->seed != change_to) {
-                x->seed = change_to;
-                srand(x->seed);
-                x->state = 0;
+                ouniform_setSeed(x, change_to);
             }
+            critical_exit(x->lock);
         }
         osc_bundle_s_removeMessage("/uniform/set/seed", &len, ptr, 1);
     }
-    int state_is_bound = 0;
-    osc_bundle_s_addressIsBound(len, ptr, "/uniform/set/state", 1, &state_is_bound);
     if (state_is_bound) {
         long change_to = ouniform_getNumber(len, ptr, "/uniform/set/state");
         if (change_to >= 0) {
-            x->state = 0;
-            srand(x->seed);
-            for (int i = 0; i < change_to; ++i) {
-                rand();
-                ++x->state;
-            }
+            critical_enter(x->lock);
+            x->state = (uint64_t)change_to;
+            critical_exit(x->lock);
         }
         osc_bundle_s_removeMessage("/uniform/set/state", &len, ptr, 1);
     }
+
+	char *copy = NULL;
+	long copylen = 0, datapos[OUNIFORM_NMSGS];
+	critical_enter(x->lock);
+	if(x->msgcount != x->count && ouniform_makemsg(x)){
+		critical_exit(x->lock);
+		odot_scratch_release(mark);
+		object_error((t_object *)x, "out of memory");
+		return;
+	}
+	long count = x->count;
+	long seed = x->seed;
+	uint64_t key = x->key;
+	uint64_t state = x->state;
+	x->state += (uint64_t)count;
+	if(!ouniform_bound(x, len, ptr)){
+		// append our messages to a copy of the bundle, and write the
+		// numbers straight into it
+		copylen = len + x->msglen;
+		copy = (char *)odot_scratch_alloc(copylen);
+		if(copy){
+			memcpy(copy, ptr, len);
+			memcpy(copy + len, x->msg, x->msglen);
+			memcpy(datapos, x->datapos, sizeof(datapos));
+		}
+	}
+	critical_exit(x->lock);
+	if(copylen){
+		if(!copy){
+			odot_scratch_release(mark);
+			object_error((t_object *)x, "out of memory");
+			return;
+		}
+		ouniform_generate(key, state, count, (uint32_t *)(copy + len + datapos[0]));
+		*((uint32_t *)(copy + len + datapos[1])) = hton32((uint32_t)((int32_t)seed));
+		*((uint32_t *)(copy + len + datapos[2])) = hton32((uint32_t)((int32_t)state));
+		omax_util_outletOSC(x->outlet, copylen, copy);
+		odot_scratch_release(mark);
+		return;
+	}
+
+	// something is already bound to one of our addresses, so it has to be
+	// replaced rather than appended to
+	uint32_t *numbers = (uint32_t *)odot_scratch_alloc(count * sizeof(uint32_t));
+	if(!numbers){
+		odot_scratch_release(mark);
+		object_error((t_object *)x, "out of memory");
+		return;
+	}
+	ouniform_generate(key, state, count, numbers);
+	t_osc_bndl_u *bndl = osc_bundle_s_deserialize(len, ptr);
+	t_osc_message_u *result = osc_message_u_allocWithAddress(x->address ? x->address->s_name : OUNIFORM_DEFAULT_ADDRESS);
+	long i;
+	for(i = 0; i < count; i++){
+		uint32_t u = ntoh32(numbers[i]);
+		float f;
+		memcpy(&f, &u, 4);
+		osc_message_u_appendFloat(result, f);
+	}
+	odot_scratch_release(mark);
+    t_osc_message_u *seedmsg = osc_message_u_allocWithAddress(OUNIFORM_SEED_ADDRESS);
+    osc_message_u_appendInt32(seedmsg, seed);
+    t_osc_message_u *statemsg = osc_message_u_allocWithAddress(OUNIFORM_STATE_ADDRESS);
+    osc_message_u_appendInt32(statemsg, (int32_t)state);
+    osc_bundle_u_addMsgWithoutDups(bndl, result);
+    osc_bundle_u_addMsgWithoutDups(bndl, seedmsg);
+    osc_bundle_u_addMsgWithoutDups(bndl, statemsg);
     
-    t_osc_bndl_u *copy = osc_bundle_s_deserialize(len, ptr);
-    t_osc_message_u *result = NULL;
-    if(x->address) {
-        result = osc_message_u_allocWithFloat(x->address->s_name, (1.0f * rand() / RAND_MAX));
-    }else{
-        result = osc_message_u_allocWithFloat("/uniform/random", (1.0f * rand() / RAND_MAX));
-    }
-    t_osc_message_u *seed = osc_message_u_allocWithAddress("/uniform/seed");
-    osc_message_u_appendInt32(seed, x->seed);
-    t_osc_message_u *state = osc_message_u_allocWithAddress("/uniform/state");
-    osc_message_u_appendInt32(state, x->state);
-    osc_bundle_u_addMsgWithoutDups(copy, result);
-    osc_bundle_u_addMsgWithoutDups(copy, seed);
-    osc_bundle_u_addMsgWithoutDups(copy, state);
-    
-    ++x->state;
-    
-    t_osc_bndl_s *bs = osc_bundle_u_serialize(copy);
+    t_osc_bndl_s *bs = osc_bundle_u_serialize(bndl);
     if(bs){
 	    omax_util_outletOSC(x->outlet, osc_bundle_s_getLen(bs), osc_bundle_s_getPtr(bs));
 	    osc_bundle_s_deepFree(bs);
     }
-    osc_bundle_u_free(copy);
+    osc_bundle_u_free(bndl);
 }
 
 long ouniform_getNumber(long len, char *ptr, char *address)
@@ -200,15 +390,46 @@ void ouniform_doc(t_ouniform *x)
 
 void ouniform_free(t_ouniform *x)
 {
+	odot_stats_forget(x);
 	critical_free(x->lock);
+	if(x->msg){
+		osc_mem_free(x->msg);
+	}
+	odot_scratch_trim();
 }
 
+// the messages are remade with room for the new count the next time
+// a packet comes in
+t_max_err ouniform_setCount(t_ouniform *x, void *attr, long ac, t_atom *av)
+{
+	if(ac && av){
+		long l = atom_getlong(av);
+		critical_enter(x->lock);
+		x->count = l > 0 ? l : 1;
+		critical_exit(x->lock);
+	}
+	return MAX_ERR_NONE;
+}
+
+#ifdef OMAX_PD_VERSION
+void ouniform_count(t_ouniform *x, t_floatarg f)
+{
+	t_atom a;
+	atom_setlong(&a, (long)f);
+	ouniform_setCount(x, NULL, 1, &a);
+}
+#endif
+
 void *ouniform_new(t_symbol *msg, short argc, t_atom *argv)
 {
 	t_ouniform *x;
 	if((x = (t_ouniform *)object_alloc(ouniform_class))){
 		x->address = NULL;
-		if(argc){
+		x->msg = NULL;
+		x->msglen = 0;
+		x->msgcount = 0;
+		x->count = 1;
+		if(argc && !(atom_gettype(argv) == A_SYM && atom_getsym(argv)->s_name[0] == '@')){
 			if(atom_gettype(argv) == A_SYM){
 				t_symbol *s = atom_getsym(argv);
 				if(s->s_name[0] != '/'){
@@ -222,22 +443,40 @@ void *ouniform_new(t_symbol *msg, short argc, t_atom *argv)
 			}
 		}
 		x->outlet = outlet_new((t_object *)x, NULL);
-        x->seed = time(NULL);
-        x->state = 0;
-        srand(x->seed);
+		ouniform_setSeed(x, (long)time(NULL));
 		critical_new(&(x->lock));
+#ifdef OMAX_PD_VERSION
+		int i;
+		for(i = 0; i < argc; i++){
+			if(atom_gettype(argv + i) != A_SYM || atom_getsym(argv + i)->s_name[0] != '@'){
+				continue;
+			}
+			if(atom_getsym(argv + i) == gensym("@count") && i + 1 < argc && atom_gettype(argv + i + 1) == A_FLOAT){
+				ouniform_setCount(x, NULL, 1, argv + ++i);
+			}else{
+				post("o.uniform optional attributes are @count");
+			}
+		}
+#else
+		attr_args_process(x, argc, argv);
+#endif
+		if(ouniform_makemsg(x)){
+			object_error((t_object *)x, "out of memory");
+			return NULL;
+		}
 	}
 	return x;
 }
 #ifdef OMAX_PD_VERSION
 
-int setup_o0x2etimetag(void)
+int setup_o0x2euniform(void)
 {
 	t_class *c = class_new(gensym("o.uniform"), (t_newmethod)ouniform_new, (t_method)ouniform_free, sizeof(t_ouniform), 0L, A_GIMME, 0);
     
 	class_addmethod(c, (t_method)ouniform_fullPacket, gensym("FullPacket"), A_GIMME, 0);
 	class_addmethod(c, (t_method)ouniform_anything, gensym("anything"), A_GIMME, 0);
 	class_addmethod(c, (t_method)ouniform_bang, gensym("bang"), 0);
+	class_addmethod(c, (t_method)ouniform_count, gensym("count"), A_FLOAT, 0);
 	class_addmethod(c, (t_method)odot_version, gensym("version"), 0);
     
 	ouniform_class = c;
@@ -272,6 +511,10 @@ int main(void)
 		//class_addmethod(c, (method)omax_util_dictionary, "dictionary", A_SYM, 0);
 		class_addmethod(c, (method)omax_dict_dictionary, "dictionary", A_GIMME, 0);
 	}
+
+	CLASS_ATTR_LONG(c, "count", 0, t_ouniform, count);
+	CLASS_ATTR_ACCESSORS(c, "count", NULL, ouniform_setCount);
+	CLASS_ATTR_FILTER_MIN(c, "count", 1);
     
 	class_register(CLASS_BOX, c);
 	ouniform_class = c;
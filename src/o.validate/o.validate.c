@@ -214,6 +214,7 @@ void ovalidate_assist(t_ovalidate *x, void *b, long io, long num, char *buf)
 
 void ovalidate_free(t_ovalidate *x)
 {
+	odot_stats_forget(x);
 }
 
 #ifdef OMAX_PD_VERSION
@@ -59,6 +59,7 @@
 #include "osc_bundle_s.r"
 
 #include "o.h"
+#include "odot_packet.h"
 
 typedef struct _ovar{
 	t_object ob;
@@ -69,9 +70,7 @@ typedef struct _ovar{
 	void *proxy;
 #endif
 	long inlet;
-	long len;
-	char *bndl;
-	long buflen;
+	t_odot_packet *bndl;
 	t_critical lock;
 	char emptybndl[OSC_HEADER_SIZE];
 } t_ovar;
@@ -87,33 +86,49 @@ void *ovar_class;
 void ovar_clear(t_ovar *x);
 void ovar_anything(t_ovar *x, t_symbol *msg, int argc, t_atom *argv);
 
+// keep the packet.  if it belongs to a packet handle, that is retained
+// rather than copied
+int ovar_store(t_ovar *x, long len, char *ptr)
+{
+	t_odot_packet *p = odot_packet_retainOrCopy(len, ptr);
+	if(!p){
+		object_error((t_object *)x, "ran out of memory!\n");
+		return 1;
+	}
+	critical_enter(x->lock);
+	t_odot_packet *old = x->bndl;
+	x->bndl = p;
+	critical_exit(x->lock);
+	odot_packet_release(old);
+	return 0;
+}
+
+// the packet we're holding, retained, or NULL
+t_odot_packet *ovar_get(t_ovar *x)
+{
+	critical_enter(x->lock);
+	t_odot_packet *p = x->bndl;
+	if(p){
+		odot_packet_retain(p);
+	}
+	critical_exit(x->lock);
+	return p;
+}
+
 void ovar_doFullPacket(t_ovar *x, long len, char *ptr, long inlet)
 {
 	osc_bundle_s_wrap_naked_message(len, ptr);
 	if(inlet == 1){
 		if(len > 0){
-			critical_enter(x->lock);
-			if(len > x->buflen){
-				x->bndl = osc_mem_resize(x->bndl, len);
-				if(!(x->bndl)){
-					object_error((t_object *)x, "ran out of memory!\n");
-					critical_exit(x->lock);
-					return;
-				}
-				x->buflen = len;
-			}
-			memcpy(x->bndl, ptr, len);
-			x->len = len;
-			critical_exit(x->lock);
+			ovar_store(x, len, ptr);
 		}
 	}else{
 #if (defined ODOT_UNION || defined ODOT_INTERSECTION || defined ODOT_DIFFERENCE)
-		critical_enter(x->lock);
-		long copylen = x->len;
-		//char copy[copylen];
-		char *copy = osc_mem_alloc(copylen);
-		memcpy(copy, x->bndl, copylen);
-		critical_exit(x->lock);
+		// packets are never changed once they've been kept, so the right
+		// hand side can be read without copying it
+		t_odot_packet *p = ovar_get(x);
+		long copylen = p ? odot_packet_getLen(p) : OSC_HEADER_SIZE;
+		char *copy = p ? odot_packet_getPtr(p) : x->emptybndl;
 		long bndllen = 0;
 		char *bndl = NULL;
 #ifdef ODOT_UNION
@@ -122,7 +137,8 @@ void ovar_doFullPacket(t_ovar *x, long len, char *ptr, long inlet)
 		t_osc_bndl_s *res = osc_bundle_s_union(lhs, rhs);
 		omax_util_outletOSC(x->outlet, osc_bundle_s_getLen(res), osc_bundle_s_getPtr(res));
 		osc_bundle_s_free(lhs);
-		osc_bundle_s_deepFree(rhs);
+		osc_bundle_s_free(rhs);
+		odot_packet_release(p);
 		osc_bundle_s_deepFree(res);
 		//osc_bundle_s_union(len, ptr, copylen, copy, &bndllen, &bndl);
 #else
@@ -135,25 +151,11 @@ void ovar_doFullPacket(t_ovar *x, long len, char *ptr, long inlet)
 		if(bndl){
 			osc_mem_free(bndl);
 		}
-		if(copy){
-			osc_mem_free(copy);
-		}
+		odot_packet_release(p);
 #endif
 #else // o.var
 		if(len > 0){
-			critical_enter(x->lock);
-			if(len > x->buflen){
-				x->bndl = osc_mem_resize(x->bndl, len);
-				if(!(x->bndl)){
-					object_error((t_object *)x, "ran out of memory!\n");
-					critical_exit(x->lock);
-					return;
-				}
-				x->buflen = len;
-			}
-			memcpy(x->bndl, ptr, len);
-			x->len = len;
-			critical_exit(x->lock);
+			ovar_store(x, len, ptr);
 		}
 		omax_util_outletOSC(x->outlet, len, ptr);
 #endif
@@ -171,8 +173,10 @@ void ovar_fullPacket(t_ovar *x, t_symbol *msg, int argc, t_atom *argv)
 void ovar_clear(t_ovar *x)
 {
 	critical_enter(x->lock);
-	x->len = 0;
+	t_odot_packet *old = x->bndl;
+	x->bndl = NULL;
 	critical_exit(x->lock);
+	odot_packet_release(old);
 }
 
 void ovar_doAnything(t_ovar *x, t_symbol *msg, int argc, t_atom *argv, long inlet)
@@ -234,14 +238,12 @@ void ovar_bang(t_ovar *x)
 #if (defined ODOT_UNION || defined ODOT_INTERSECTION || defined ODOT_DIFFERENCE)
 	ovar_doFullPacket(x, OSC_HEADER_SIZE, (long)x->emptybndl, inlet);
 #else
-	if(x->len){
-		critical_enter(x->lock);
-		long len = x->len;
-		char bndl[len];
-		memcpy(bndl, x->bndl, len);
-		critical_exit(x->lock);
-		omax_util_outletOSC(x->outlet, len, bndl);
-        OSC_MEM_INVALIDATE(bndl);
+	t_odot_packet *p = ovar_get(x);
+	if(p){
+		// hand the packet on as it is; downstream objects that keep it
+		// retain it too, and nobody writes to it
+		odot_packet_outlet(x->outlet, p);
+		odot_packet_release(p);
 	}else{
 		omax_util_outletOSC(x->outlet, OSC_HEADER_SIZE, x->emptybndl);
 	}
@@ -264,6 +266,7 @@ void ovar_doc(t_ovar *x)
 
 void ovar_free(t_ovar *x)
 {
+	odot_stats_forget(x);
 #ifdef OMAX_PD_VERSION
     pd_free(x->proxy[0]);
     pd_free(x->proxy[1]);
@@ -271,9 +274,7 @@ void ovar_free(t_ovar *x)
 #else
 	object_free(x->proxy);
 #endif
-	if(x->bndl){
-		osc_mem_free(x->bndl);
-	}
+	odot_packet_release(x->bndl);
 	critical_free(x->lock);
 }
 
@@ -296,8 +297,6 @@ void *ovar_new(t_symbol *msg, short argc, t_atom *argv)
         x->proxy[1] = proxy_new((t_object *)x, 1, &(x->inlet), ovar_proxy_class);
         
 		critical_new(&(x->lock));
-		x->len = 0;
-		x->buflen = 0;
 		x->bndl = NULL;
 		memset(x->emptybndl, '\0', OSC_HEADER_SIZE);
 		osc_bundle_s_setBundleID(x->emptybndl);
@@ -370,6 +369,7 @@ int setup_o0x2evar(void)
     omax_pd_class_addmethod(c, (t_method)ovar_doc, gensym("doc"));
     
 	ovar_proxy_class = c;
+	odot_packet_init();
     
 	ODOT_PRINT_VERSION;
 	return 0;
@@ -383,8 +383,6 @@ void *ovar_new(t_symbol *msg, short argc, t_atom *argv)
 		x->outlet = outlet_new((t_object *)x, "FullPacket");
 		x->proxy = proxy_new((t_object *)x, 1, &(x->inlet));
 		critical_new(&(x->lock));
-		x->len = 0;
-		x->buflen = 0;
 		x->bndl = NULL;
 		memset(x->emptybndl, '\0', OSC_HEADER_SIZE);
 		osc_bundle_s_setBundleID(x->emptybndl);
@@ -408,15 +406,11 @@ void *ovar_new(t_symbol *msg, short argc, t_atom *argv)
 					return NULL;
 				}
 				osc_bundle_u_addMsg(bndl_u, msg_u);
-				x->buflen = 0;
-				x->bndl = NULL;
 				t_osc_bndl_s *bs = osc_bundle_u_serialize(bndl_u);
 				if(bs){
-					x->buflen = osc_bundle_s_getLen(bs);
-					x->bndl = osc_bundle_s_getPtr(bs);
-					osc_bundle_s_free(bs);
+					x->bndl = odot_packet_copy(osc_bundle_s_getLen(bs), osc_bundle_s_getPtr(bs));
+					osc_bundle_s_deepFree(bs);
 				}
-				x->len = x->buflen;
 				if(bndl_u){
 					osc_bundle_u_free(bndl_u);
 				}
@@ -460,6 +454,7 @@ int main(void){
 	ovar_class = c;
 
 	common_symbols_init();
+	odot_packet_init();
 
 	ODOT_PRINT_VERSION;
 	return 0;
@@ -544,6 +544,7 @@ void omenu_setdisplymode(t_omenu *x, float t)
 
 void omenu_free(t_omenu *x)
 {
+    odot_stats_forget(x);
     free(x->tcl_namespace);
     free(x->io_tag);
     free(x->button_tag);
@@ -1,6 +1,6 @@
 # move all odot files into one place?
 
-COBJECT_LIST=(o.compose o.display o.append o.atomize o.bundle o.change o.collect o.cond o.context o.dict o.difference o.downcast o.explode o.expr o.expr.codebox o.flatten o.if o.intersection o.messageiterate o.listenumerate o.mappatch o.message o.pack o.pak o.prepend o.print o.printbytes o.route o.schedule o.select o.slip.decode o.slip.encode o.table o.timetag o.union o.unless o.validate o.var o.when)
+COBJECT_LIST=(o.compose o.display o.append o.atomize o.bundle o.change o.collect o.cond o.context o.dict o.difference o.downcast o.edge~ o.explode o.expr o.expr.codebox o.flatten o.if o.intersection o.messageiterate o.listenumerate o.mappatch o.message o.pack o.pak o.prepend o.print o.printbytes o.route o.schedule o.select o.shm.receive o.shm.send o.slip.decode o.slip.encode o.slip.receive o.stats o.table o.tcp.receive o.tcp.send o.timetag o.udp.receive o.udp.send o.union o.unless o.validate o.var o.when)
 
 for f in ${COBJECT_LIST[*]}
 do
@@ -0,0 +1,201 @@
+/*
+  Time of the single-pass downcast in src/include/odot_downcast.h against
+  the deserialize, rewrite, and serialize path o.downcast used before it.
+
+	downcast-bench [messages per bundle ...]
+
+  Each message is /msg/<n> with a timetag, a double, a 64-bit int, and a
+  string, so every one of them has something to downcast.  Bundles of 10,
+  100, and 1000 messages are timed if no sizes are given, and the output
+  of the two paths is compared byte for byte.  Build it with make
+  downcast-bench in src/pd-build.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "osc.h"
+#include "osc_mem.h"
+#include "osc_byteorder.h"
+#include "osc_timetag.h"
+#include "osc_bundle_s.h"
+#include "osc_bundle_u.h"
+#include "osc_message_u.h"
+#include "osc_atom_u.h"
+#include "osc_bundle_iterator_u.h"
+#include "osc_message_iterator_u.h"
+#include "odot_downcast.h"
+
+#define TOTAL_MESSAGES 1000000
+
+// the old path, as it was in odowncast_fullPacket, without nested bundles.  it
+// always put the seconds at index 1, which is why the timetags come first here
+static long old_downcast(long len, char *ptr, char **out)
+{
+	t_osc_bndl_u *b = osc_bundle_s_deserialize(len, ptr);
+	if(!b){
+		return -1;
+	}
+	t_osc_bndl_it_u *bit = osc_bndl_it_u_get(b);
+	while(osc_bndl_it_u_hasNext(bit)){
+		t_osc_msg_u *m = osc_bndl_it_u_next(bit);
+		t_osc_msg_it_u *mit = osc_msg_it_u_get(m);
+		while(osc_msg_it_u_hasNext(mit)){
+			t_osc_atom_u *a = osc_msg_it_u_next(mit);
+			int i = 0;
+			switch(osc_atom_u_getTypetag(a)){
+			case 'c': case 'C': case 'I': case 'h': case 'H': case 'u': case 'U': case 'N': case 'T': case 'F':
+				osc_atom_u_setInt32(a, osc_atom_u_getInt32(a));
+				break;
+			case 'd':
+				osc_atom_u_setFloat(a, osc_atom_u_getFloat(a));
+				break;
+			case OSC_TIMETAG_TYPETAG:
+				{
+					t_osc_timetag tt = osc_atom_u_getTimetag(a);
+					t_osc_atom_u *aa = osc_atom_u_alloc();
+					osc_atom_u_setInt32(aa, ntoh32(osc_timetag_ntp_getSeconds(tt)));
+					osc_atom_u_setInt32(a, ntoh32(osc_timetag_ntp_getFraction(tt)));
+					osc_message_u_insertAtom(m, aa, ++i);
+				}
+				break;
+			}
+		}
+		osc_msg_it_u_destroy(mit);
+	}
+	osc_bndl_it_u_destroy(bit);
+	t_osc_bndl_s *bs = osc_bundle_u_serialize(b);
+	osc_bundle_u_free(b);
+	if(!bs){
+		return -1;
+	}
+	long l = osc_bundle_s_getLen(bs);
+	*out = (char *)malloc(l);
+	memcpy(*out, osc_bundle_s_getPtr(bs), l);
+	t_osc_timetag timetag = OSC_TIMETAG_NULL;
+	memcpy(*out + OSC_ID_SIZE, &timetag, sizeof(t_osc_timetag));
+	osc_bundle_s_deepFree(bs);
+	return l;
+}
+
+static long put32(char *p, uint32_t v)
+{
+	*((uint32_t *)p) = hton32(v);
+	return 4;
+}
+
+static long put64(char *p, uint64_t v)
+{
+	*((uint64_t *)p) = hton64(v);
+	return 8;
+}
+
+// a bundle of n messages, in a buffer from malloc
+static long make_bundle(long n, char **bundle)
+{
+	long size = OSC_HEADER_SIZE + n * 64;
+	char *b = (char *)calloc(1, size);
+	memcpy(b, "#bundle\0", OSC_ID_SIZE);
+	long pos = OSC_HEADER_SIZE;
+	long i;
+	for(i = 0; i < n; i++){
+		char *m = b + pos + 4;
+		long l = 0;
+		int an = snprintf(m, 24, "/msg/%ld", i);
+		l += (an / 4 + 1) * 4;
+		memcpy(m + l, ",tdhs", 6);
+		l += 8;
+		l += put32(m + l, 3600 + i);
+		l += put32(m + l, 0x80000000);
+		double d = i * .5;
+		uint64_t u;
+		memcpy(&u, &d, 8);
+		l += put64(m + l, u);
+		l += put64(m + l, (uint64_t)i * 1000);
+		memcpy(m + l, "hello", 5);
+		l += 8;
+		put32(b + pos, l);
+		pos += 4 + l;
+	}
+	*bundle = b;
+	return pos;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *what, double t, long nbundles, long nmessages)
+{
+	printf("%-24s %12.1f ns/bundle %8.1f ns/message\n", what, t * 1e9 / nbundles, t * 1e9 / (nbundles * nmessages));
+}
+
+static int bench(long nmessages)
+{
+	char *bundle = NULL;
+	long len = make_bundle(nmessages, &bundle);
+	long nbundles = TOTAL_MESSAGES / nmessages;
+	if(nbundles < 1){
+		nbundles = 1;
+	}
+	printf("%ld bundles of %ld messages (%ld bytes)\n", nbundles, nmessages, len);
+
+	t_odot_downcast d = {1, 1, 1, 1, NULL, 0};
+	long outlen = odot_downcast_bundle(&d, len, bundle, NULL);
+	char *out = (char *)malloc(outlen);
+	double t = now();
+	long i;
+	for(i = 0; i < nbundles; i++){
+		// measure and write, as odowncast_fullPacket() does
+		odot_downcast_bundle(&d, len, bundle, NULL);
+		odot_downcast_bundle(&d, len, bundle, out);
+	}
+	report("single pass", now() - t, nbundles, nmessages);
+
+	char *oldout = NULL;
+	long oldlen = 0;
+	t = now();
+	for(i = 0; i < nbundles; i++){
+		if(oldout){
+			free(oldout);
+		}
+		oldlen = old_downcast(len, bundle, &oldout);
+	}
+	report("deserialize/serialize", now() - t, nbundles, nmessages);
+
+	int ret = 0;
+	if(oldlen != outlen || memcmp(oldout, out, outlen)){
+		fprintf(stderr, "the two paths disagree (%ld and %ld bytes)\n", oldlen, outlen);
+		ret = 1;
+	}
+	free(oldout);
+	free(out);
+	free(bundle);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	long sizes[] = {10, 100, 1000};
+	int ret = 0;
+	int i;
+	if(argc > 1){
+		for(i = 1; i < argc; i++){
+			long n = atol(argv[i]);
+			if(n <= 0){
+				fprintf(stderr, "usage: downcast-bench [messages per bundle ...]\n");
+				return 1;
+			}
+			ret |= bench(n);
+		}
+	}else{
+		for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++){
+			ret |= bench(sizes[i]);
+		}
+	}
+	return ret;
+}
@@ -0,0 +1,154 @@
+/*
+  Time o.mappatch's expression mode, src/include/odot_mapexpr.h, on the
+  calling thread alone and with a pool of worker threads.
+
+	mappatch-bench [threads [messages per bundle ...]]
+
+  Each message is /msg/<n> with a float, and the expression scales and
+  offsets it.  Bundles of 64, 256, and 1024 messages are timed if no
+  sizes are given, with one worker per core but one if threads isn't
+  given, and the output of the two runs is compared byte for byte.
+  Build it with make mappatch-bench in src/pd-build.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "osc.h"
+#include "osc_mem.h"
+#include "osc_byteorder.h"
+#include "odot_mapexpr.h"
+
+#define TOTAL_MESSAGES 1000000
+#define EXPR "/value = /value * 2. + 1."
+
+// a bundle of n messages, in a buffer from malloc
+static long make_bundle(long n, char **bundle)
+{
+	long size = OSC_HEADER_SIZE + n * 32;
+	char *b = (char *)calloc(1, size);
+	memcpy(b, "#bundle\0", OSC_ID_SIZE);
+	long pos = OSC_HEADER_SIZE;
+	long i;
+	for(i = 0; i < n; i++){
+		char *m = b + pos + 4;
+		long l = 0;
+		int an = snprintf(m, 24, "/msg/%ld", i);
+		l += (an / 4 + 1) * 4;
+		memcpy(m + l, ",f", 3);
+		l += 4;
+		float f = i * .5f;
+		uint32_t u;
+		memcpy(&u, &f, 4);
+		*((uint32_t *)(m + l)) = hton32(u);
+		l += 4;
+		*((uint32_t *)(b + pos)) = hton32(l);
+		pos += 4 + l;
+	}
+	*bundle = b;
+	return pos;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *what, long nthreads, double t, long nbundles, long nmessages)
+{
+	printf("%-10s %2ld workers %12.1f ns/bundle %8.1f ns/message\n", what, nthreads, t * 1e9 / nbundles, t * 1e9 / (nbundles * nmessages));
+}
+
+// map the bundle nbundles times with nthreads workers, and leave a copy of the last result in *out
+static long run(long nthreads, long len, char *bundle, long nbundles, long nmessages, char **out)
+{
+	t_odot_mapexpr m;
+	odot_mapexpr_init(&m);
+	if(odot_mapexpr_setExpr(&m, EXPR)){
+		fprintf(stderr, "couldn't parse %s\n", EXPR);
+		return -1;
+	}
+	long outlen = 0;
+	int nothreads = 0;
+	// the first bundle starts the workers, so it isn't timed
+	odot_mapexpr_map(&m, nthreads, len, bundle, &outlen, &nothreads);
+	if(nothreads){
+		fprintf(stderr, "couldn't start %ld workers\n", nthreads);
+	}
+	double t = now();
+	long i;
+	for(i = 0; i < nbundles; i++){
+		if(odot_mapexpr_map(&m, nthreads, len, bundle, &outlen, &nothreads)){
+			fprintf(stderr, "out of memory\n");
+			odot_mapexpr_free(&m);
+			return -1;
+		}
+	}
+	report(nthreads ? "pool" : "one thread", m.nworkers, now() - t, nbundles, nmessages);
+	*out = (char *)malloc(outlen);
+	memcpy(*out, m.outbuf, outlen);
+	odot_mapexpr_free(&m);
+	return outlen;
+}
+
+static int bench(long nthreads, long nmessages)
+{
+	char *bundle = NULL;
+	long len = make_bundle(nmessages, &bundle);
+	long nbundles = TOTAL_MESSAGES / nmessages;
+	if(nbundles < 1){
+		nbundles = 1;
+	}
+	printf("%ld bundles of %ld messages (%ld bytes)\n", nbundles, nmessages, len);
+	if(nmessages < ODOT_MAPEXPR_PARALLEL_MIN){
+		printf("bundles of fewer than %d messages are always mapped on one thread\n", ODOT_MAPEXPR_PARALLEL_MIN);
+	}
+
+	char *out1 = NULL, *outn = NULL;
+	long len1 = run(0, len, bundle, nbundles, nmessages, &out1);
+	long lenn = run(nthreads, len, bundle, nbundles, nmessages, &outn);
+	int ret = 0;
+	if(len1 < 0 || lenn < 0){
+		ret = 1;
+	}else if(len1 != lenn || memcmp(out1, outn, len1)){
+		fprintf(stderr, "one thread and the pool disagree (%ld and %ld bytes)\n", len1, lenn);
+		ret = 1;
+	}
+	free(out1);
+	free(outn);
+	free(bundle);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	long sizes[] = {64, 256, 1024};
+	long nthreads = argc > 1 ? atol(argv[1]) : odot_mapexpr_defaultThreads();
+	if(argc < 2 && nthreads < 1){
+		nthreads = 1;
+	}
+	if(nthreads < 1 || nthreads > ODOT_MAPEXPR_MAX_THREADS){
+		fprintf(stderr, "usage: mappatch-bench [threads [messages per bundle ...]]\n");
+		return 1;
+	}
+	int ret = 0;
+	int i;
+	if(argc > 2){
+		for(i = 2; i < argc; i++){
+			long n = atol(argv[i]);
+			if(n <= 0){
+				fprintf(stderr, "usage: mappatch-bench [threads [messages per bundle ...]]\n");
+				return 1;
+			}
+			ret |= bench(nthreads, n);
+		}
+	}else{
+		for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++){
+			ret |= bench(nthreads, sizes[i]);
+		}
+	}
+	return ret;
+}
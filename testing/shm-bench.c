@@ -0,0 +1,482 @@
+/*
+  Latency and throughput of the shared memory ring in
+  src/include/odot_shm.h, used by o.shm.send and o.shm.receive, against
+  UDP over the loopback interface, which is what o.udp.send and
+  o.udp.receive would use to do the same job.
+
+	shm-bench [packets [packet size ...]]
+
+  Two processes are forked for each test.  For throughput, one sends
+  the given number of packets as fast as it can and the other receives
+  and copies each one out, the way o.shm.receive does; the time is
+  taken by the receiver, from the first packet to the last.  For
+  latency, the two play ping pong, and the time reported is half the
+  average round trip.  Both sides block while waiting: the ring reader
+  on its futex, the socket on recv().  UDP packets the kernel drops are
+  reported rather than retried.  Packets of 64, 1024 and 8192 bytes are
+  timed if no sizes are given.  Build and run it with make shm-bench in
+  src/pd-build.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "odot_shm.h"
+
+#define DEFAULT_PACKETS 200000
+#define PINGS 20000
+#define RING_SIZE (1 << 22)
+#define UDP_PORT 17777
+#define WAIT 100 // ms
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// the result of a test, passed from the child that times it
+typedef struct _result{
+	double seconds;
+	long received;
+} t_result;
+
+static void report(const char *what, long size, t_result *r, long sent)
+{
+	if(r->received <= 0 || r->seconds <= 0){
+		printf("%-4s %6ld bytes  nothing received\n", what, size);
+		return;
+	}
+	printf("%-4s %6ld bytes  %10.0f packets/s %9.1f MB/s", what, size, r->received / r->seconds, r->received * size / r->seconds / 1e6);
+	if(r->received < sent){
+		printf("  (%ld of %ld dropped)", sent - r->received, sent);
+	}
+	printf("\n");
+}
+
+static void report_latency(const char *what, long size, double seconds, long pings)
+{
+	printf("%-4s %6ld bytes  %10.2f us one way\n", what, size, seconds * 1e6 / pings / 2);
+}
+
+/*
+  Processes
+*/
+
+// run f(arg) in a child, and return its pid; the child exits with f's return value
+static pid_t spawn(int (*f)(void *), void *arg)
+{
+	pid_t pid = fork();
+	if(pid == 0){
+		_exit(f(arg));
+	}
+	return pid;
+}
+
+static int join(pid_t pid)
+{
+	int status = 0;
+	if(waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)){
+		return 1;
+	}
+	return WEXITSTATUS(status);
+}
+
+typedef struct _test{
+	long packets;
+	long size;
+	int ready[2];	// the receiver writes a byte here once it's listening
+	int result[2];	// and its t_result here once it's done
+} t_test;
+
+static void signal_ready(t_test *t)
+{
+	char c = 0;
+	if(write(t->ready[1], &c, 1) < 0){}
+}
+
+static void await_ready(t_test *t)
+{
+	char c;
+	if(read(t->ready[0], &c, 1) < 0){}
+}
+
+static int send_result(t_test *t, double seconds, long received)
+{
+	t_result r = {seconds, received};
+	if(write(t->result[1], &r, sizeof(r)) != sizeof(r)){
+		return 1;
+	}
+	return 0;
+}
+
+/*
+  Shared memory
+*/
+
+// the next packet from the ring, copied into buf; sleeps until there is one
+static long shm_receive(t_odot_shm *s, char *buf)
+{
+	while(1){
+		uint32_t seq = odot_shm_seq(s);
+		char *packet = NULL;
+		long n = 0;
+		int r = odot_shm_peek(s, &packet, &n);
+		if(r > 0){
+			memcpy(buf, packet, n);
+			odot_shm_release(s, n);
+			return n;
+		}
+		if(r < 0){
+			return -1;
+		}
+		odot_shm_wait(s, seq, WAIT);
+	}
+}
+
+static void shm_send(t_odot_shm *s, char *buf, long n)
+{
+	while(odot_shm_write(s, buf, n) == ENOSPC){
+		sched_yield();
+	}
+}
+
+static int shm_open_as(t_odot_shm *s, const char *name, int writer)
+{
+	if(odot_shm_open(s, name, RING_SIZE)){
+		return 1;
+	}
+	if(writer ? odot_shm_claimWriter(s) : odot_shm_claimReader(s)){
+		odot_shm_close(s);
+		return 1;
+	}
+	return 0;
+}
+
+static int shm_throughput_receiver(void *arg)
+{
+	t_test *t = (t_test *)arg;
+	t_odot_shm s;
+	if(shm_open_as(&s, "shm-bench.a", 0)){
+		return 1;
+	}
+	char *buf = (char *)malloc(t->size);
+	signal_ready(t);
+	double start = 0;
+	long i;
+	for(i = 0; i < t->packets; i++){
+		if(shm_receive(&s, buf) < 0){
+			break;
+		}
+		if(i == 0){
+			start = now();
+		}
+	}
+	double seconds = now() - start;
+	free(buf);
+	odot_shm_close(&s);
+	// the first packet only started the clock
+	return send_result(t, seconds, i - 1);
+}
+
+static int shm_throughput_sender(void *arg)
+{
+	t_test *t = (t_test *)arg;
+	t_odot_shm s;
+	if(shm_open_as(&s, "shm-bench.a", 1)){
+		return 1;
+	}
+	char *buf = (char *)calloc(1, t->size);
+	await_ready(t);
+	long i;
+	for(i = 0; i < t->packets; i++){
+		shm_send(&s, buf, t->size);
+	}
+	free(buf);
+	odot_shm_close(&s);
+	return 0;
+}
+
+// sends on a and receives on b, or the other way around
+static int shm_ping(t_test *t, int echo)
+{
+	t_odot_shm in, out;
+	if(shm_open_as(&in, echo ? "shm-bench.a" : "shm-bench.b", 0)){
+		return 1;
+	}
+	if(shm_open_as(&out, echo ? "shm-bench.b" : "shm-bench.a", 1)){
+		odot_shm_close(&in);
+		return 1;
+	}
+	char *buf = (char *)calloc(1, t->size);
+	int ret = 0;
+	long i;
+	if(echo){
+		signal_ready(t);
+		for(i = 0; i < PINGS; i++){
+			if(shm_receive(&in, buf) < 0){
+				ret = 1;
+				break;
+			}
+			shm_send(&out, buf, t->size);
+		}
+	}else{
+		await_ready(t);
+		double start = now();
+		for(i = 0; i < PINGS; i++){
+			shm_send(&out, buf, t->size);
+			if(shm_receive(&in, buf) < 0){
+				break;
+			}
+		}
+		ret = send_result(t, now() - start, i);
+	}
+	free(buf);
+	odot_shm_close(&out);
+	odot_shm_close(&in);
+	return ret;
+}
+
+static int shm_ping_echo(void *arg)
+{
+	return shm_ping((t_test *)arg, 1);
+}
+
+static int shm_ping_start(void *arg)
+{
+	return shm_ping((t_test *)arg, 0);
+}
+
+static void shm_unlink_all(void)
+{
+	shm_unlink("/odot.shm-bench.a");
+	shm_unlink("/odot.shm-bench.b");
+}
+
+/*
+  UDP
+*/
+
+static int udp_socket(int port)
+{
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if(fd < 0){
+		return -1;
+	}
+	int bufsize = RING_SIZE;
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+	setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+	struct sockaddr_in addr;
+	memset(&addr, '\0', sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0){
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int udp_connect(int fd, int port)
+{
+	struct sockaddr_in addr;
+	memset(&addr, '\0', sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	return connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+}
+
+static int udp_throughput_receiver(void *arg)
+{
+	t_test *t = (t_test *)arg;
+	int fd = udp_socket(UDP_PORT);
+	if(fd < 0){
+		return 1;
+	}
+	// give up once the sender has stopped and nothing more arrives
+	struct timeval tv = {0, 200000};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	char *buf = (char *)malloc(t->size);
+	signal_ready(t);
+	double start = 0, last = 0;
+	long i = 0;
+	while(i < t->packets){
+		ssize_t n = recv(fd, buf, t->size, 0);
+		if(n < 0){
+			if(errno == EINTR || (i == 0 && (errno == EAGAIN || errno == EWOULDBLOCK))){
+				continue;
+			}
+			break;
+		}
+		last = now();
+		if(i == 0){
+			start = last;
+		}
+		i++;
+	}
+	free(buf);
+	close(fd);
+	return send_result(t, last - start, i - 1);
+}
+
+static int udp_throughput_sender(void *arg)
+{
+	t_test *t = (t_test *)arg;
+	int fd = udp_socket(0);
+	if(fd < 0 || udp_connect(fd, UDP_PORT) < 0){
+		return 1;
+	}
+	char *buf = (char *)calloc(1, t->size);
+	await_ready(t);
+	long i;
+	for(i = 0; i < t->packets; i++){
+		while(send(fd, buf, t->size, 0) < 0 && (errno == ENOBUFS || errno == EAGAIN || errno == EINTR)){
+			sched_yield();
+		}
+	}
+	free(buf);
+	close(fd);
+	return 0;
+}
+
+static int udp_ping(t_test *t, int echo)
+{
+	int fd = udp_socket(echo ? UDP_PORT : UDP_PORT + 1);
+	if(fd < 0 || udp_connect(fd, echo ? UDP_PORT + 1 : UDP_PORT) < 0){
+		return 1;
+	}
+	// a dropped packet would stop the game, so don't wait for one forever
+	struct timeval tv = {1, 0};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	char *buf = (char *)calloc(1, t->size);
+	int ret = 0;
+	long i;
+	if(echo){
+		signal_ready(t);
+		for(i = 0; i < PINGS; i++){
+			if(recv(fd, buf, t->size, 0) < 0 || send(fd, buf, t->size, 0) < 0){
+				break;
+			}
+		}
+	}else{
+		await_ready(t);
+		double start = now();
+		for(i = 0; i < PINGS; i++){
+			if(send(fd, buf, t->size, 0) < 0 || recv(fd, buf, t->size, 0) < 0){
+				break;
+			}
+		}
+		ret = send_result(t, now() - start, i);
+	}
+	free(buf);
+	close(fd);
+	return ret;
+}
+
+static int udp_ping_echo(void *arg)
+{
+	return udp_ping((t_test *)arg, 1);
+}
+
+static int udp_ping_start(void *arg)
+{
+	return udp_ping((t_test *)arg, 0);
+}
+
+/*
+  Tests
+*/
+
+// run the two sides of a test in their own processes; the result comes from timer
+static int run(int (*timer)(void *), int (*other)(void *), t_test *t, t_result *r)
+{
+	if(pipe(t->ready) < 0 || pipe(t->result) < 0){
+		return 1;
+	}
+	pid_t a = spawn(timer, t);
+	pid_t b = spawn(other, t);
+	int ret = join(a) | join(b);
+	if(!ret && read(t->result[0], r, sizeof(*r)) != sizeof(*r)){
+		ret = 1;
+	}
+	close(t->ready[0]);
+	close(t->ready[1]);
+	close(t->result[0]);
+	close(t->result[1]);
+	shm_unlink_all();
+	return ret;
+}
+
+static int bench(long packets, long size)
+{
+	t_test t;
+	t_result r;
+	int ret = 0;
+	t.packets = packets;
+	t.size = size;
+
+	if(run(shm_throughput_receiver, shm_throughput_sender, &t, &r)){
+		fprintf(stderr, "shared memory throughput test failed\n");
+		ret = 1;
+	}else{
+		report("shm", size, &r, packets - 1);
+	}
+	if(run(udp_throughput_receiver, udp_throughput_sender, &t, &r)){
+		fprintf(stderr, "UDP throughput test failed\n");
+		ret = 1;
+	}else{
+		report("udp", size, &r, packets - 1);
+	}
+	if(run(shm_ping_start, shm_ping_echo, &t, &r)){
+		fprintf(stderr, "shared memory latency test failed\n");
+		ret = 1;
+	}else{
+		report_latency("shm", size, r.seconds, r.received);
+	}
+	if(run(udp_ping_start, udp_ping_echo, &t, &r)){
+		fprintf(stderr, "UDP latency test failed\n");
+		ret = 1;
+	}else{
+		report_latency("udp", size, r.seconds, r.received);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	long sizes[] = {64, 1024, 8192};
+	long packets = argc > 1 ? atol(argv[1]) : DEFAULT_PACKETS;
+	if(packets < 2){
+		fprintf(stderr, "usage: shm-bench [packets [packet size ...]]\n");
+		return 1;
+	}
+	shm_unlink_all();
+	int ret = 0;
+	int i;
+	if(argc > 2){
+		for(i = 2; i < argc; i++){
+			long n = atol(argv[i]);
+			if(n <= 0 || n > 65507){
+				fprintf(stderr, "packet sizes must be between 1 and 65507 bytes, the most UDP can carry\n");
+				return 1;
+			}
+			ret |= bench(packets, n);
+		}
+	}else{
+		for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++){
+			ret |= bench(packets, sizes[i]);
+		}
+	}
+	return ret;
+}
@@ -0,0 +1,221 @@
+/*
+  Throughput of the block SLIP codec in src/include/odot_slip.h against
+  the byte-at-a-time state machine o.slip.encode and o.slip.decode used
+  before it.
+
+	slip-bench [packet size [packets [block size]]]
+
+  Packets are random bytes, so about one in 128 needs escaping.  The
+  encoded stream is handed to the decoders in blocks of the given size,
+  the way bytes arrive from a serial port, and every decoded packet is
+  checked against the original.  Build it with make slip-bench in
+  src/pd-build.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "odot_slip.h"
+
+// the per-byte path, as it was in o.slip.encode and o.slip.decode
+#define END 0300
+#define ESC 0333
+#define ESC_END 0334
+#define ESC_ESC 0335
+#define MAXSLIPBUF 2048
+
+typedef struct _bytedecoder{
+	unsigned char buf[MAXSLIPBUF];
+	int count;
+	int state;
+} t_bytedecoder;
+
+static long byte_encode(unsigned char *dst, const unsigned char *src, long n)
+{
+	long i = 0, j;
+	dst[i++] = END;
+	for(j = 0; j < n; j++){
+		switch(src[j]){
+		case END:
+			dst[i++] = ESC;
+			dst[i++] = ESC_END;
+			break;
+		case ESC:
+			dst[i++] = ESC;
+			dst[i++] = ESC_ESC;
+			break;
+		default:
+			dst[i++] = src[j];
+		}
+	}
+	dst[i++] = END;
+	return i;
+}
+
+// one call per byte, like slipbyte().  returns the length of a completed packet, or 0
+__attribute__((noinline)) static int byte_decode(t_bytedecoder *x, unsigned char c)
+{
+	switch(x->state){
+	case 0:
+		x->state = 1;
+		if(c == END){
+			break;
+		}
+		// fall through
+	case 1:
+		switch(c){
+		case END:
+			if(x->count > 0){
+				int t = x->count;
+				x->count = 0;
+				x->state = 0;
+				return (t % 4) == 0 ? t : 0;
+			}
+			x->state = 0;
+			break;
+		case ESC:
+			x->state = 2;
+			break;
+		default:
+			if(x->count < MAXSLIPBUF){
+				x->buf[x->count++] = c;
+			}else{
+				x->state = 3;
+			}
+		}
+		break;
+	case 2:
+		switch(c){
+		case ESC_END:
+		case ESC_ESC:
+			if(x->count < MAXSLIPBUF){
+				x->buf[x->count++] = c == ESC_END ? END : ESC;
+				x->state = 1;
+			}else{
+				x->state = 3;
+			}
+			break;
+		default:
+			x->state = 3;
+		}
+		break;
+	case 3:
+		if(c == END){
+			x->count = 0;
+			x->state = 0;
+		}
+		break;
+	}
+	return 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *what, double t, long npackets, long nbytes)
+{
+	printf("%-24s %10.1f MB/s %10.1f ns/packet\n", what, nbytes / t * 1e-6, t * 1e9 / npackets);
+}
+
+int main(int argc, char **argv)
+{
+	long size = argc > 1 ? atol(argv[1]) : 256;
+	long npackets = argc > 2 ? atol(argv[2]) : 100000;
+	long blocksize = argc > 3 ? atol(argv[3]) : 64;
+	size = (size + 3) & ~3L;
+	if(size <= 0 || npackets <= 0 || blocksize <= 0){
+		fprintf(stderr, "usage: slip-bench [packet size [packets [block size]]]\n");
+		return 1;
+	}
+	int bytepath = size <= MAXSLIPBUF;
+	if(!bytepath){
+		printf("packets over %d bytes are too big for the per-byte decoder; only timing the block codec\n", MAXSLIPBUF);
+	}
+
+	unsigned char *packets = (unsigned char *)malloc(size * npackets);
+	unsigned char *encoded = (unsigned char *)malloc((2 * size + 2) * npackets);
+	unsigned char *encoded2 = (unsigned char *)malloc((2 * size + 2) * npackets);
+	if(!packets || !encoded || !encoded2){
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	srand(1);
+	long i;
+	for(i = 0; i < size * npackets; i++){
+		packets[i] = rand() & 0xff;
+	}
+	printf("%ld packets of %ld bytes, decoded in blocks of %ld bytes\n", npackets, size, blocksize);
+
+	double t = now();
+	long enclen = 0;
+	for(i = 0; i < npackets; i++){
+		enclen += byte_encode(encoded2 + enclen, packets + i * size, size);
+	}
+	report("encode, per byte", now() - t, npackets, size * npackets);
+
+	t = now();
+	long enclen2 = 0;
+	for(i = 0; i < npackets; i++){
+		enclen2 += odot_slip_encode(encoded + enclen2, packets + i * size, size);
+	}
+	report("encode, block", now() - t, npackets, size * npackets);
+	if(enclen != enclen2 || memcmp(encoded, encoded2, enclen)){
+		fprintf(stderr, "the two encoders disagree\n");
+		return 1;
+	}
+
+	long ndecoded = 0, bad = 0;
+	if(bytepath){
+		t_bytedecoder *bd = (t_bytedecoder *)calloc(1, sizeof(t_bytedecoder));
+		t = now();
+		for(i = 0; i < enclen; i++){
+			int len = byte_decode(bd, encoded[i]);
+			if(len){
+				bad += len != size || memcmp(bd->buf, packets + ndecoded * size, size);
+				ndecoded++;
+			}
+		}
+		report("decode, per byte", now() - t, npackets, size * npackets);
+		free(bd);
+		if(ndecoded != npackets || bad){
+			fprintf(stderr, "per-byte decoder: %ld of %ld packets, %ld bad\n", ndecoded, npackets, bad);
+			return 1;
+		}
+	}
+
+	t_odot_slip_decoder d;
+	odot_slip_decoder_init(&d, 0);
+	ndecoded = bad = 0;
+	t = now();
+	long off;
+	for(off = 0; off < enclen; off += blocksize){
+		const unsigned char *p = encoded + off;
+		long n = enclen - off < blocksize ? enclen - off : blocksize;
+		while(n > 0){
+			long len = 0;
+			long used = odot_slip_decode(&d, p, n, &len);
+			p += used;
+			n -= used;
+			if(len){
+				bad += len != size || memcmp(d.buf, packets + ndecoded * size, size);
+				ndecoded++;
+			}
+		}
+	}
+	report("decode, block", now() - t, npackets, size * npackets);
+	odot_slip_decoder_free(&d);
+	if(ndecoded != npackets || bad || d.errors){
+		fprintf(stderr, "block decoder: %ld of %ld packets, %ld bad, %ld errors\n", ndecoded, npackets, bad, d.errors);
+		return 1;
+	}
+
+	free(packets);
+	free(encoded);
+	free(encoded2);
+	return 0;
+}